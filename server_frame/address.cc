@@ -15,7 +15,12 @@
 #include <sstream>
 
 #include "address.h"
+#include "base/block_detector.h"
+#include "base/blocking_executor.h"
+#include "config.h"
+#include "dns.h"
 #include "endian.h"
+#include "hook.h"
 #include "log.h"
 
 namespace ygw {
@@ -27,6 +32,10 @@ namespace ygw {
 
         static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
 
+        static ygw::config::ConfigVar<bool>::ptr g_dns_async =
+                ygw::config::Config::Lookup("dns.async", true
+                        , "resolve names with fiber dns resolver in hooked threads");
+
         // 创建bits位的掩码
         template<class T>
         static T CreateMask(uint32_t bits)
@@ -130,7 +139,49 @@ namespace ygw {
                 node = host;
             }
 
-            int error = getaddrinfo(node.c_str(), service, &hints, &results);
+            //hook线程里getaddrinfo会卡住整个线程, 先交给协程DNS解析器(只支持数字端口).
+            //它没有search/ndots展开, 也不会改用TCP重试, 不带'.'的名字和没有服务器应答的名字
+            //仍然交给getaddrinfo, 在阻塞任务线程池中执行. 否定应答和负缓存直接返回失败
+            bool hooked = hook::IsHookEnable();
+            if (hooked && g_dns_async->GetValue()
+                    && (family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)
+                    && (!service || (*service && strspn(service, "0123456789") == strlen(service)))
+                    && node.find_first_of(".:") != std::string::npos) 
+            {
+                std::vector<IPAddress::ptr> addrs;
+                DnsResolver::Status status = DnsResolverMgr::GetInstance()->Resolve(addrs, node, family);
+                if (status == DnsResolver::kAnswer) 
+                {
+                    uint16_t port = service ? (uint16_t)atoi(service) : 0;
+                    for (auto& i : addrs) 
+                    {
+                        i->SetPort(port);
+                        result.push_back(i);
+                    }
+                    return !result.empty();
+                }
+                if (status == DnsResolver::kNegative) 
+                {
+                    YGW_LOG_DEBUG(g_logger) << "Address::Lookup resolve(" << host << ", "
+                        << family << ", " << type << ") not found";
+                    return false;
+                }
+                YGW_LOG_DEBUG(g_logger) << "Address::Lookup resolve(" << host << ", "
+                    << family << ", " << type << ") no answer, fallback to getaddrinfo";
+            }
+
+            int error = 0;
+            if (hooked) 
+            {
+                scheduler::RunBlocking([&]() {
+                    error = getaddrinfo(node.c_str(), service, &hints, &results);
+                });
+            } 
+            else 
+            {
+                scheduler::BlockGuard guard("getaddrinfo");
+                error = getaddrinfo(node.c_str(), service, &hints, &results);
+            }
             if (error) 
             {
                 YGW_LOG_DEBUG(g_logger) << "Address::Lookup getaddress(" << host << ", "
@@ -0,0 +1,193 @@
+/*
+ * ====================================================
+ * Copyright (c) 2020-2100
+ *     FileName: server_frame/base/block_detector.cc
+ *       Author: Ye Gui Wu
+ *        Email: yeguiwu@qq.com
+ *      Version: 1.0
+ *     Compiler: gcc
+ *  Create Date: 2020-10-01
+ *  Description: 
+ * ====================================================
+ */
+
+#include <atomic>
+
+#include "block_detector.h"
+#include "mutex.h"
+#include "server_frame/config.h"  // 里面有log.h util.h
+#include "server_frame/hook.h"
+
+namespace ygw {
+
+    //---------------------------------------------------
+
+    namespace scheduler {
+
+        static log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        static config::ConfigVar<bool>::ptr g_block_detector_enable = 
+            config::Config::Lookup<bool>("block_detector.enable", 
+                    false, "detect blocking calls on io threads");
+
+        static config::ConfigVar<uint64_t>::ptr g_block_detector_threshold = 
+            config::Config::Lookup<uint64_t>("block_detector.threshold_us", 
+                    10000, "blocking time threshold us");
+
+        static config::ConfigVar<uint64_t>::ptr g_block_detector_interval = 
+            config::Config::Lookup<uint64_t>("block_detector.report_interval_ms", 
+                    1000, "min interval between two blocking reports ms");
+
+        //常量初始化, 静态构造之前的加锁也能安全读取
+        static bool s_enabled = false;
+        static uint64_t s_threshold_us = 10000;
+        static uint64_t s_interval_ms = 1000;
+
+        static std::atomic<uint64_t> s_last_report_ms {0};
+        static std::atomic<uint64_t> s_suppressed {0};
+
+        /// 上报过程中自己的锁/写日志不再检测
+        static thread_local bool t_reporting = false;
+
+        struct BlockDetectorIniter 
+        {
+            BlockDetectorIniter() 
+            {
+                s_enabled = g_block_detector_enable->GetValue();
+                if (s_enabled) 
+                {
+                    util::TscClock::Calibrate();
+                }
+                s_threshold_us = g_block_detector_threshold->GetValue();
+                s_interval_ms = g_block_detector_interval->GetValue();
+
+                g_block_detector_enable->AddListener([](const bool& old_value, const bool& new_value) {
+                    YGW_LOG_INFO(g_logger) << "block detector changed from "
+                        << old_value << " to " << new_value;
+                    //开启时先校准计时用的TSC, 不让第一次统计在IO线程上校准
+                    if (new_value) 
+                    {
+                        util::TscClock::Calibrate();
+                    }
+                    s_enabled = new_value;
+                });
+                g_block_detector_threshold->AddListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                    s_threshold_us = new_value;
+                });
+                g_block_detector_interval->AddListener([](const uint64_t& old_value, const uint64_t& new_value) {
+                    s_interval_ms = new_value;
+                });
+            }
+        };
+        static BlockDetectorIniter s_block_detector_initer;
+
+        static thread::Spinlock& GetStatsMutex() 
+        {
+            static thread::Spinlock s_mutex;
+            return s_mutex;
+        }
+
+        static std::map<std::string, BlockDetector::Stat>& GetStatsMap() 
+        {
+            static std::map<std::string, BlockDetector::Stat> s_stats;
+            return s_stats;
+        }
+
+        bool BlockDetector::IsArmed() 
+        {
+            return s_enabled && !t_reporting && hook::IsHookEnable();
+        }
+
+        uint64_t BlockDetector::GetThresholdUs() 
+        {
+            return s_threshold_us;
+        }
+
+        void BlockDetector::Report(const char* what, uint64_t us, bool backtrace) 
+        {
+            if (us < s_threshold_us || t_reporting) 
+            {
+                return;
+            }
+            t_reporting = true;
+            {
+                thread::Spinlock::Lock lock(GetStatsMutex());
+                Stat& stat = GetStatsMap()[what];
+                ++stat.count;
+                stat.total_us += us;
+                if (us > stat.max_us) 
+                {
+                    stat.max_us = us;
+                }
+            }
+
+            //限频: 一个间隔内只有抢到时间戳的线程输出告警, 其余只计数
+            uint64_t now = util::TimeUtil::GetMonotonicMS();
+            uint64_t last = s_last_report_ms;
+            if ((last && now - last < s_interval_ms) 
+                    || !s_last_report_ms.compare_exchange_strong(last, now)) 
+            {
+                ++s_suppressed;
+                t_reporting = false;
+                return;
+            }
+
+            uint64_t suppressed = s_suppressed.exchange(0);
+            if (backtrace) 
+            {
+                YGW_LOG_WARN(g_logger) << "io thread blocked in " << what << " for " << us
+                    << "us, suppressed=" << suppressed << "\nbacktrace:\n"
+                    << util::BacktraceToString(64, 3, "    ");
+            } 
+            else 
+            {
+                YGW_LOG_WARN(g_logger) << "io thread blocked in " << what << " for " << us
+                    << "us, suppressed=" << suppressed;
+            }
+            t_reporting = false;
+        }
+
+        void BlockDetector::GetStats(std::map<std::string, Stat>& stats) 
+        {
+            thread::Spinlock::Lock lock(GetStatsMutex());
+            stats = GetStatsMap();
+        }
+
+        void BlockDetector::ResetStats() 
+        {
+            thread::Spinlock::Lock lock(GetStatsMutex());
+            GetStatsMap().clear();
+        }
+
+        std::ostream& BlockDetector::Dump(std::ostream& os) 
+        {
+            std::map<std::string, Stat> stats;
+            GetStats(stats);
+            os << "[BlockDetector enable=" << s_enabled
+                << " threshold_us=" << s_threshold_us << "]" << std::endl;
+            for (auto& i : stats) 
+            {
+                os << "    " << i.first << ": count=" << i.second.count
+                    << " total_us=" << i.second.total_us
+                    << " max_us=" << i.second.max_us << std::endl;
+            }
+            return os;
+        }
+
+        uint64_t BlockGuard::Now() 
+        {
+            return util::TscClock::Ticks();
+        }
+
+        uint64_t BlockGuard::ElapsedUs(uint64_t start) 
+        {
+            return util::TscClock::TicksToNS(util::TscClock::Ticks() - start) / 1000;
+        }
+
+        //---------------------------------------------------
+
+    } // namespace scheduler
+
+    //---------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,138 @@
+/**
+ * @file block_detector.h
+ * @brief IO线程阻塞检测
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-01
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#ifndef __YGW_BLOCK_DETECTOR_H__
+#define __YGW_BLOCK_DETECTOR_H__
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace ygw {
+
+    //-------------------------------------------------------
+
+    namespace scheduler {
+
+        /**
+         * @brief 阻塞检测器
+         * @details IO线程上一次阻塞调用会卡住这个线程上的所有连接.
+         *          检测器统计开启hook的线程在未hook/直通的系统调用、锁等待以及单次协程运行中
+         *          花费的时间, 超过阈值(block_detector.threshold_us)的记录到聚合计数中,
+         *          并按block_detector.report_interval_ms限频输出带调用栈的告警.
+         *          由配置block_detector.enable开启, 关闭时每个检测点只多一次判断
+         */
+        class BlockDetector 
+        {
+        public:
+            /**
+             * @brief 某一类阻塞的聚合计数
+             */
+            struct Stat 
+            {
+                /// 超过阈值的次数
+                uint64_t count = 0;
+                /// 累计耗时微秒
+                uint64_t total_us = 0;
+                /// 最长耗时微秒
+                uint64_t max_us = 0;
+            };
+
+            /**
+             * @brief 当前线程是否需要检测(检测开启且线程开启了hook)
+             */
+            static bool IsArmed();
+
+            /**
+             * @brief 阈值微秒
+             */
+            static uint64_t GetThresholdUs();
+
+            /**
+             * @brief 记录一次阻塞, 未超过阈值直接返回
+             * @param[in] what 阻塞点名称
+             * @param[in] us 耗时微秒
+             * @param[in] backtrace 告警时是否附带当前调用栈
+             */
+            static void Report(const char* what, uint64_t us, bool backtrace = true);
+
+            /**
+             * @brief 获取聚合计数
+             */
+            static void GetStats(std::map<std::string, Stat>& stats);
+
+            /**
+             * @brief 清空聚合计数
+             */
+            static void ResetStats();
+
+            /**
+             * @brief 输出聚合计数
+             */
+            static std::ostream& Dump(std::ostream& os);
+        }; // class BlockDetector
+
+        /**
+         * @brief 阻塞检测点, 作用域内的耗时超过阈值时上报
+         */
+        class BlockGuard 
+        {
+        public:
+            /**
+             * @brief 构造函数
+             * @param[in] what 阻塞点名称, 需要是静态字符串
+             */
+            BlockGuard(const char* what)
+                :what_(what)
+                ,start_(BlockDetector::IsArmed() ? Now() : 0) 
+            {
+            }
+
+            /**
+             * @brief 析构函数, 计算耗时并上报
+             * @details 包住的系统调用刚返回, 上报时保留它设置的errno
+             */
+            ~BlockGuard() 
+            {
+                if (start_) 
+                {
+                    int saved_errno = errno;
+                    BlockDetector::Report(what_, ElapsedUs(start_));
+                    errno = saved_errno;
+                }
+            }
+        private:
+            /**
+             * @brief 返回TscClock计数
+             */
+            static uint64_t Now();
+
+            /**
+             * @brief 返回从start到现在的微秒
+             */
+            static uint64_t ElapsedUs(uint64_t start);
+        private:
+            /// 阻塞点名称
+            const char* what_;
+            /// 开始时的TscClock计数, 0表示不检测
+            uint64_t start_;
+        }; // class BlockGuard
+
+        //---------------------------------------------------
+
+    } // namespace scheduler
+
+    //-------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_BLOCK_DETECTOR_H__
@@ -0,0 +1,198 @@
+/*
+ * ====================================================
+ * Copyright (c) 2020-2100
+ *     FileName: server_frame/base/blocking_executor.cc
+ *       Author: Ye Gui Wu
+ *        Email: yeguiwu@qq.com
+ *      Version: 1.0
+ *     Compiler: gcc
+ *  Create Date: 2020-10-01
+ *  Description: 
+ * ====================================================
+ */
+
+#include "blocking_executor.h"
+#include "scheduler.h"
+#include "server_frame/config.h"  // 里面有log.h util.h
+#include "server_frame/macro.h"
+
+namespace ygw {
+
+    //---------------------------------------------------
+
+    namespace scheduler {
+
+        static log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        static config::ConfigVar<uint32_t>::ptr g_blocking_threads = 
+            config::Config::Lookup<uint32_t>("blocking.threads", 
+                    4, "blocking executor thread count");
+
+        BlockingExecutor::BlockingExecutor() 
+            :name_("blocking") 
+        {
+            Start(g_blocking_threads->GetValue());
+        }
+
+        BlockingExecutor::BlockingExecutor(size_t threads, const std::string& name) 
+            :name_(name) 
+        {
+            Start(threads);
+        }
+
+        BlockingExecutor::~BlockingExecutor() 
+        {
+            Stop();
+        }
+
+        void BlockingExecutor::Start(size_t threads) 
+        {
+            if (threads == 0) 
+            {
+                threads = 1;
+            }
+            threads_.reserve(threads);
+            for (size_t i = 0; i < threads; ++i) 
+            {
+                threads_.push_back(std::make_shared<thread::Thread>(
+                            std::bind(&BlockingExecutor::Run, this)
+                            , name_ + "_" + std::to_string(i)));
+            }
+        }
+
+        void BlockingExecutor::RunBlocking(std::function<void()> fn) 
+        {
+            if (!Scheduler::IsInTaskFiber()) 
+            {
+                fn();
+                return;
+            }
+
+            //任务和异常都在本协程栈上, 协程挂起期间栈一直有效
+            std::exception_ptr error;
+            Job job;
+            job.fn.swap(fn);
+            job.scheduler = Scheduler::GetThis();
+            job.thread = Scheduler::GetTaskThread();
+            job.fiber = Fiber::GetThis();
+            job.error = &error;
+            //协程挂起期间调度器不能停止, 否则线程池唤醒时调度器已经析构
+            job.scheduler->AddPendingWakeup();
+            //必须等协程切出后再入队, 否则线程池可能在切出前就把协程调度到其他线程
+            Scheduler::YieldToHoldThen([this, &job]() {
+                Post(std::move(job));
+            });
+
+            if (error) 
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        void BlockingExecutor::Submit(std::function<void()> fn) 
+        {
+            Job job;
+            job.fn.swap(fn);
+            Post(std::move(job));
+        }
+
+        void BlockingExecutor::Post(Job&& job) 
+        {
+            {
+                MutexType::Lock lock(mutex_);
+                if (!stopping_) 
+                {
+                    jobs_.push_back(std::move(job));
+                    lock.unlock();
+                    sem_.Notify();
+                    return;
+                }
+            }
+            Execute(job);
+        }
+
+        void BlockingExecutor::Execute(Job& job) 
+        {
+            try 
+            {
+                job.fn();
+            } 
+            catch (...) 
+            {
+                if (job.error) 
+                {
+                    *job.error = std::current_exception();
+                } 
+                else 
+                {
+                    YGW_LOG_ERROR(g_logger) << "BlockingExecutor job exception";
+                }
+            }
+            job.fn = nullptr;
+            if (job.fiber) 
+            {
+                //回到提交时的线程, 和IO事件唤醒一样保持协程的线程绑定.
+                //执行器停止后job在协程栈上, 调度之后协程可能已经恢复, 不能再访问job
+                Scheduler* scheduler = job.scheduler;
+                scheduler->Schedule(job.fiber, job.thread);
+                scheduler->DelPendingWakeup();
+            }
+        }
+
+        void BlockingExecutor::Run() 
+        {
+            while (true) 
+            {
+                sem_.Wait();
+                Job job;
+                {
+                    MutexType::Lock lock(mutex_);
+                    if (jobs_.empty()) 
+                    {
+                        if (stopping_) 
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+                    job = std::move(jobs_.front());
+                    jobs_.pop_front();
+                }
+                Execute(job);
+            }
+        }
+
+        void BlockingExecutor::Stop() 
+        {
+            {
+                MutexType::Lock lock(mutex_);
+                if (stopping_) 
+                {
+                    return;
+                }
+                stopping_ = true;
+            }
+            //每个线程一个信号, 队列清空后逐个退出
+            for (size_t i = 0; i < threads_.size(); ++i) 
+            {
+                sem_.Notify();
+            }
+            for (auto& i : threads_) 
+            {
+                i->Join();
+            }
+            threads_.clear();
+        }
+
+        void RunBlocking(std::function<void()> fn) 
+        {
+            BlockingExecutorMgr::GetInstance()->RunBlocking(std::move(fn));
+        }
+
+        //---------------------------------------------------
+
+    } // namespace scheduler
+
+    //---------------------------------------------------
+
+} // namespace ygw
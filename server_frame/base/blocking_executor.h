@@ -0,0 +1,152 @@
+/**
+ * @file blocking_executor.h
+ * @brief 阻塞任务执行器, 把会阻塞线程的操作(磁盘IO等)交给独立线程池执行
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-01
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#ifndef __YGW_BLOCKING_EXECUTOR_H__
+#define __YGW_BLOCKING_EXECUTOR_H__
+
+#include <exception>
+#include <functional>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "fiber.h"
+#include "thread.h"
+#include "server_frame/noncopyable.h"
+#include "server_frame/singleton.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------
+
+    namespace scheduler {
+
+        class Scheduler;
+
+        /**
+         * @brief 阻塞任务执行器
+         * @details 文件读写, fsync, stat等操作不能被epoll驱动, 在IO线程中执行会卡住整个线程上的协程.
+         *          RunBlocking在线程池中执行任务, 调用协程挂起等待, 任务完成后由原调度器唤醒
+         */
+        class BlockingExecutor : able::Noncopyable 
+        {
+        public:
+            using MutexType = thread::Mutex;
+
+            /**
+             * @brief 构造函数, 线程数取配置blocking.threads
+             */
+            BlockingExecutor();
+
+            /**
+             * @brief 构造函数
+             * @param[in] threads 线程数量
+             * @param[in] name 线程名称前缀
+             */
+            BlockingExecutor(size_t threads, const std::string& name = "blocking");
+
+            /**
+             * @brief 析构函数, 等待已提交的任务执行完
+             */
+            ~BlockingExecutor();
+
+            /**
+             * @brief 执行阻塞任务并等待完成
+             * @details 在调度器的任务协程中调用时, 协程挂起直到任务在线程池中执行完;
+             *          其他情况(线程主协程, 执行器已停止)直接在当前线程执行.
+             *          任务抛出的异常会在调用方重新抛出
+             * @param[in] fn 任务
+             */
+            void RunBlocking(std::function<void()> fn);
+
+            /**
+             * @brief 提交任务, 不等待结果
+             * @param[in] fn 任务
+             */
+            void Submit(std::function<void()> fn);
+
+            /**
+             * @brief 停止执行器, 执行完队列中的任务后回收线程
+             */
+            void Stop();
+
+            /**
+             * @brief 线程数量
+             */
+            size_t GetThreadCount() const { return threads_.size(); }
+        private:
+            /**
+             * @brief 线程池中的任务
+             */
+            struct Job 
+            {
+                /// 任务
+                std::function<void()> fn;
+                /// 等待任务的协程所在调度器
+                Scheduler* scheduler = nullptr;
+                /// 等待任务的协程被指定执行的线程id, -1表示任意线程
+                int thread = -1;
+                /// 等待任务的协程, 为空表示不需要唤醒
+                Fiber::ptr fiber;
+                /// 任务异常回传给等待协程
+                std::exception_ptr* error = nullptr;
+            };
+
+            /**
+             * @brief 启动线程
+             */
+            void Start(size_t threads);
+
+            /**
+             * @brief 任务入队, 执行器已停止时在当前线程直接执行
+             */
+            void Post(Job&& job);
+
+            /**
+             * @brief 执行任务并唤醒等待的协程
+             */
+            static void Execute(Job& job);
+
+            /**
+             * @brief 线程执行函数
+             */
+            void Run();
+        private:
+            /// 线程名称前缀
+            std::string name_;
+            /// Mutex
+            MutexType mutex_;
+            /// 任务队列
+            std::list<Job> jobs_;
+            /// 任务计数
+            thread::Semaphore sem_;
+            /// 线程池
+            std::vector<thread::Thread::ptr> threads_;
+            /// 是否停止
+            bool stopping_ = false;
+        }; // class BlockingExecutor
+
+        /// 全局阻塞任务执行器
+        using BlockingExecutorMgr = mode::Singleton<BlockingExecutor>;
+
+        /**
+         * @brief 在全局阻塞任务执行器中执行任务并等待完成
+         * @param[in] fn 任务
+         */
+        void RunBlocking(std::function<void()> fn);
+
+        //---------------------------------------------------
+
+    } // namespace scheduler
+
+    //-------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_BLOCKING_EXECUTOR_H__
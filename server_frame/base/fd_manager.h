@@ -58,6 +58,11 @@ namespace ygw {
              */
             bool IsClose() const { return is_closed_; }
 
+            /**
+             * @brief 标记已关闭, 等在该句柄上的协程被唤醒后不再重试
+             */
+            void SetClose() { is_closed_ = true; }
+
             /**
              * @brief 设置用户主动设置非阻塞
              * @param[in] v 是否阻塞
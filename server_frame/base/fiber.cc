@@ -182,10 +182,12 @@ namespace ygw {
             SetThis(this);
             YGW_ASSERT(state_ != State::kExec);
             state_ = State::kExec;
+            running_ = true;
             //YGW_MSG_ASSERT(!swapcontext(&t_thread_fiber->context_, &context_),
             //        "swapcontext");
             YGW_MSG_ASSERT(!swapcontext(&Scheduler::GetMainFiber()->context_, &context_), 
                     "swapcontext");
+            running_ = false;
 
         }
 
@@ -204,8 +206,10 @@ namespace ygw {
         {
             SetThis(this);
             state_ = State::kExec;
+            running_ = true;
             YGW_MSG_ASSERT(!swapcontext(&t_thread_fiber->context_, &context_),
                     "swapcontext"); 
+            running_ = false;
         }
 
         void Fiber::Back()
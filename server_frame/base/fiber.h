@@ -13,6 +13,7 @@
 #include <ucontext.h>
 #endif // __GNUC__
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
@@ -105,6 +106,13 @@ namespace ygw {
              * @brief 返回协程状态
              */
             State GetState() const { return state_; }
+
+            /**
+             * @brief 上下文是否还在某个线程上运行
+             * @details YieldToHold先置kHold再切出, 切出完成前上下文还没保存,
+             *          此时被其他线程唤醒的协程不能切入
+             */
+            bool IsRunning() const { return running_; }
         public:
 
             /**
@@ -158,6 +166,8 @@ namespace ygw {
             uint32_t stack_size_ = 0;
             /// 协程状态
             State state_ = State::kInit;
+            /// 是否正在运行, 切回调用方(上下文已保存)后清除
+            std::atomic<bool> running_ {false};
             /// 协程上下文
             ucontext_t context_;
             /// 协程运行栈指针
@@ -12,6 +12,7 @@
  */
 #include <stdexcept>
 
+#include "block_detector.h"
 #include "mutex.h" 
 
 
@@ -66,6 +67,12 @@ namespace ygw {
 
         void Mutex::lock() 
         {
+            //抢不到锁才计时, 无竞争时不增加开销
+            if (pthread_mutex_trylock(&mutex_) == 0) 
+            {
+                return;
+            }
+            scheduler::BlockGuard guard("mutex");
             pthread_mutex_lock(&mutex_);
         }
 
@@ -88,21 +95,36 @@ namespace ygw {
 
         void RWMutex::rdlock() 
         {
+            if (pthread_rwlock_tryrdlock(&lock_) == 0) 
+            {
+                return;
+            }
+            scheduler::BlockGuard guard("rwmutex");
             pthread_rwlock_rdlock(&lock_);
         }
 
         void RWMutex::lock_shared() 
         {
+            if (pthread_rwlock_tryrdlock(&lock_) == 0) 
+            {
+                return;
+            }
+            scheduler::BlockGuard guard("rwmutex");
             pthread_rwlock_rdlock(&lock_);
         }
 
         void RWMutex::lock()
         {
-            pthread_rwlock_wrlock(&lock_);
+            wrlock();
         }
 
         void RWMutex::wrlock() 
         {
+            if (pthread_rwlock_trywrlock(&lock_) == 0) 
+            {
+                return;
+            }
+            scheduler::BlockGuard guard("rwmutex");
             pthread_rwlock_wrlock(&lock_);
         }
 
@@ -0,0 +1,136 @@
+/**
+ * @file server_frame/base/rcu.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-17
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <sched.h>
+
+#include <set>
+
+#include "mutex.h"
+#include "rcu.h"
+
+namespace ygw {
+
+    //----------------------------------------------------
+
+    namespace thread {
+
+        namespace {
+
+            /**
+             * @brief 线程的读临界区序号, 前后填充避免和其他数据共享缓存行
+             */
+            struct RcuSlot
+            {
+                char pad0[64];
+                /// 奇数表示在读临界区内
+                std::atomic<uint64_t> seq {0};
+                /// 嵌套深度, 只有本线程访问
+                uint32_t depth = 0;
+                char pad1[64];
+            };
+
+            /**
+             * @brief 所有线程的序号
+             */
+            struct RcuRegistry
+            {
+                Mutex mutex;
+                std::set<RcuSlot*> slots;
+            };
+
+            RcuRegistry& GetRegistry()
+            {
+                //不析构, 进程退出时其他线程可能还在注销
+                static RcuRegistry* s_registry = new RcuRegistry;
+                return *s_registry;
+            }
+
+            /**
+             * @brief 线程第一次进入读临界区时注册, 线程退出时注销
+             */
+            struct RcuSlotHolder
+            {
+                RcuSlot* slot = nullptr;
+
+                RcuSlot* Get()
+                {
+                    if (!slot)
+                    {
+                        RcuSlot* s = new RcuSlot;
+                        RcuRegistry& r = GetRegistry();
+                        Mutex::Lock lock(r.mutex);
+                        r.slots.insert(s);
+                        slot = s;
+                    }
+                    return slot;
+                }
+
+                ~RcuSlotHolder()
+                {
+                    if (slot)
+                    {
+                        RcuRegistry& r = GetRegistry();
+                        Mutex::Lock lock(r.mutex);
+                        r.slots.erase(slot);
+                        delete slot;
+                    }
+                }
+            };
+
+            thread_local RcuSlotHolder t_slot;
+
+        } // namespace
+
+        void Rcu::ReadLock()
+        {
+            RcuSlot* s = t_slot.Get();
+            if (s->depth++ == 0)
+            {
+                s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                //序号变成奇数要先于读取数据指针被写端看到
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        void Rcu::ReadUnlock()
+        {
+            RcuSlot* s = t_slot.slot;
+            if (--s->depth == 0)
+            {
+                s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+        }
+
+        void Rcu::Synchronize()
+        {
+            //新指针的发布要先于读取各线程的序号
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            RcuRegistry& r = GetRegistry();
+            Mutex::Lock lock(r.mutex);
+            for (auto s : r.slots)
+            {
+                uint64_t seq = s->seq.load(std::memory_order_acquire);
+                if (!(seq & 1))
+                {
+                    continue;
+                }
+                //序号变了说明那次读临界区已经结束, 之后再进入的只会读到新指针
+                while (s->seq.load(std::memory_order_acquire) == seq)
+                {
+                    sched_yield();
+                }
+            }
+        }
+
+    } // namespace thread
+
+    //----------------------------------------------------
+
+} // namespace ygw
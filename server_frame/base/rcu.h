@@ -0,0 +1,110 @@
+/**
+ * @file rcu.h
+ * @brief 读多写少数据的RCU(read-copy-update)封装
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-17
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#ifndef __YGW_RCU_H__
+#define __YGW_RCU_H__
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "server_frame/noncopyable.h"
+
+namespace ygw {
+
+    //----------------------------------------------------
+
+    namespace thread {
+
+        /**
+         * @brief RCU读临界区和宽限期
+         * @details 每个线程有一个独占缓存行的序号, 进入/退出读临界区各加1(奇数表示在临界区内).
+         *          读端只写自己的序号, 不和其他核争抢同一个缓存行.
+         *          写端发布新数据后调用Synchronize, 等待发布之前已经进入临界区的线程全部退出,
+         *          之后旧数据不会再被读到, 可以释放.
+         *          读临界区内不能切换协程(协程可能被换到其他线程, 也会拖长宽限期),
+         *          也不能调用Synchronize
+         */
+        class Rcu
+        {
+        public:
+            /**
+             * @brief 进入读临界区, 可以嵌套
+             */
+            static void ReadLock();
+
+            /**
+             * @brief 退出读临界区
+             */
+            static void ReadUnlock();
+
+            /**
+             * @brief 等待所有线程当前的读临界区结束
+             */
+            static void Synchronize();
+        };
+
+        /**
+         * @brief 局部RCU读临界区
+         */
+        class RcuReadLock : able::Noncopyable
+        {
+        public:
+            RcuReadLock() { Rcu::ReadLock(); }
+            ~RcuReadLock() { Rcu::ReadUnlock(); }
+        };
+
+        /**
+         * @brief 用RCU发布的只读数据指针
+         * @details 读端在RcuReadLock内Get, 拿到的对象在临界区内一直有效;
+         *          写端拷贝出新对象修改后Update替换, 等宽限期结束后释放旧对象.
+         *          多个写端之间需要自己加锁
+         */
+        template<class T>
+        class RcuPtr : able::Noncopyable
+        {
+        public:
+            explicit RcuPtr(T* p = nullptr)
+                : ptr_(p)
+            {
+            }
+
+            ~RcuPtr()
+            {
+                delete ptr_.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief 返回当前数据, 只能在读临界区或写锁内使用
+             */
+            const T* Get() const { return ptr_.load(std::memory_order_acquire); }
+
+            /**
+             * @brief 发布新数据, 等待读端不再使用旧数据后释放旧数据
+             */
+            void Update(T* p)
+            {
+                T* old = ptr_.exchange(p, std::memory_order_acq_rel);
+                if (old)
+                {
+                    Rcu::Synchronize();
+                    delete old;
+                }
+            }
+        private:
+            std::atomic<T*> ptr_;
+        };
+
+    } // namespace thread
+
+    //----------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_RCU_H__
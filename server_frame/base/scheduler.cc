@@ -10,6 +10,7 @@
 
 #include <algorithm>
 
+#include "block_detector.h"
 #include "scheduler.h"
 #include "server_frame/hook.h"
 #include "server_frame/log.h"
@@ -24,6 +25,9 @@ namespace ygw {
 
         static thread_local Scheduler* t_scheduler = nullptr;  //当前协程调度器指针
         static thread_local Fiber* t_scheduler_fiber = nullptr;//主协程
+        static thread_local Fiber* t_task_fiber = nullptr;     //正在执行的任务协程
+        static thread_local std::function<void()> t_after_yield;//任务协程切出后执行
+        static thread_local int t_task_thread = -1;            //任务协程被指定的线程
 
         Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
             :name_(name) 
@@ -71,6 +75,57 @@ namespace ygw {
                 return t_scheduler_fiber;
         }
 
+        bool Scheduler::IsInTaskFiber() 
+        {
+            return t_task_fiber && Fiber::GetThis().get() == t_task_fiber;
+        }
+
+        int Scheduler::GetTaskThread() 
+        {
+            return IsInTaskFiber() ? t_task_thread : -1;
+        }
+
+        std::vector<int> Scheduler::GetWorkerThreadIds() const 
+        {
+            std::vector<int> ids;
+            for (auto id : thread_ids_) 
+            {
+                if (id != root_thread_) 
+                {
+                    ids.push_back(id);
+                }
+            }
+            return ids;
+        }
+
+        void Scheduler::YieldToHoldThen(std::function<void()> cb) 
+        {
+            YGW_ASSERT(IsInTaskFiber());
+            t_after_yield.swap(cb);
+            Fiber::YieldToHold();
+        }
+
+        //任务协程一次运行不让出的时长, 覆盖没有经过hook的阻塞调用(此时调用栈已经不在了)
+        static void ReportSlice(uint64_t slice_start) 
+        {
+            if (slice_start) 
+            {
+                BlockDetector::Report("fiber_slice"
+                        ,util::TscClock::TicksToNS(util::TscClock::Ticks() - slice_start) / 1000, false);
+            }
+        }
+
+        //任务协程切回调度协程并处理完状态后, 执行它留下的回调
+        static void RunAfterYield() 
+        {
+            if (t_after_yield) 
+            {
+                std::function<void()> cb;
+                cb.swap(t_after_yield);
+                cb();
+            }
+        }
+
         void Scheduler::Start() 
         {
             MutexType::Lock lock(mutex_);
@@ -218,9 +273,11 @@ namespace ygw {
                         }
 
                         YGW_ASSERT(it->fiber_ || it->cb_);
-                        if (it->fiber_ && it->fiber_->GetState() == Fiber::State::kExec) 
-                        {//是执行中就不干
+                        if (it->fiber_ && (it->fiber_->GetState() == Fiber::State::kExec
+                                    || it->fiber_->IsRunning())) 
+                        {//是执行中或者还没切出完成就不干, 稍后再取
                             ++it;
+                            tickle_me = true;
                             continue;
                         }
 
@@ -244,7 +301,13 @@ namespace ygw {
                 if (ft.fiber_ && (ft.fiber_->GetState() != Fiber::State::kTerm
                             && ft.fiber_->GetState() != Fiber::State::kExcept)) 
                 {
+                    t_task_fiber = ft.fiber_.get();
+                    t_task_thread = ft.thread_id_;
+                    uint64_t slice_start = BlockDetector::IsArmed() ? util::TscClock::Ticks() : 0;
                     ft.fiber_->SwapIn();
+                    t_task_fiber = nullptr;
+                    t_task_thread = -1;
+                    ReportSlice(slice_start);
                     --active_thread_count_;
 
                     if (ft.fiber_->GetState() == Fiber::State::kReady) 
@@ -257,6 +320,7 @@ namespace ygw {
                         ft.fiber_->state_ = Fiber::State::kHold;
                     }
                     ft.Reset();
+                    RunAfterYield();
                 } 
                 //如果是回调
                 else if (ft.cb_) 
@@ -269,9 +333,15 @@ namespace ygw {
                     {
                         cb_fiber.reset(new Fiber(ft.cb_));
                     }
+                    t_task_thread = ft.thread_id_;
                     ft.Reset();
 
+                    t_task_fiber = cb_fiber.get();
+                    uint64_t slice_start = BlockDetector::IsArmed() ? util::TscClock::Ticks() : 0;
                     cb_fiber->SwapIn();
+                    t_task_fiber = nullptr;
+                    t_task_thread = -1;
+                    ReportSlice(slice_start);
                     --active_thread_count_;
                     if (cb_fiber->GetState() == Fiber::State::kReady) 
                     {
@@ -288,6 +358,7 @@ namespace ygw {
                         cb_fiber->state_ = Fiber::State::kHold;
                         cb_fiber.reset();
                     }
+                    RunAfterYield();
                     } 
                 //没有任务做
                 else 
@@ -325,7 +396,8 @@ namespace ygw {
         {
             MutexType::Lock lock(mutex_);
             return auto_stop_ && stopping_
-                && fibers_.empty() && active_thread_count_ == 0;
+                && fibers_.empty() && active_thread_count_ == 0
+                && pending_wakeup_count_ == 0;
         }
 
         void Scheduler::Idle()
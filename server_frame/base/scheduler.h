@@ -55,6 +55,12 @@ namespace ygw {
              */
             const std::string& GetName() const { return name_;}
 
+            /**
+             * @brief 返回工作线程id
+             * @details 不含use_caller的调用线程, 它只在Stop时才参与调度
+             */
+            std::vector<int> GetWorkerThreadIds() const;
+
             /**
              * @brief 返回当前协程调度器
              */
@@ -65,6 +71,35 @@ namespace ygw {
              */
             static Fiber* GetMainFiber();
 
+            /**
+             * @brief 当前是否运行在调度器调度的任务协程中(非调度协程/idle协程/线程主协程)
+             */
+            static bool IsInTaskFiber();
+
+            /**
+             * @brief 当前任务协程被指定执行的线程id, 未指定返回-1
+             */
+            static int GetTaskThread();
+
+            /**
+             * @brief 挂起当前任务协程, 切回调度协程后再执行cb
+             * @details cb执行时协程上下文已保存完毕, 可以安全地把协程交给其他线程唤醒
+             * @pre IsInTaskFiber()
+             */
+            static void YieldToHoldThen(std::function<void()> cb);
+
+            /**
+             * @brief 登记一个挂起后由其他线程唤醒的协程
+             * @details 协程挂起期间不在任务队列中也不关联IO事件, 登记后调度器在唤醒前不会停止
+             */
+            void AddPendingWakeup() { ++pending_wakeup_count_; }
+
+            /**
+             * @brief 唤醒方调度完登记的协程后注销
+             * @pre 已调用Schedule把协程放回任务队列
+             */
+            void DelPendingWakeup() { --pending_wakeup_count_; }
+
             /**
              * @brief 启动协程调度器
              */
@@ -264,6 +299,8 @@ namespace ygw {
             std::atomic<size_t> active_thread_count_ = {0};
             /// 空闲线程数量
             std::atomic<size_t> idle_thread_count_ = {0};
+            /// 等待其他线程唤醒的协程数量
+            std::atomic<size_t> pending_wakeup_count_ = {0};
             /// 是否正在停止
             bool stopping_ = true;
             /// 是否自动停止
@@ -7,7 +7,11 @@
  * @date 2020-09-27
  * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
  */
+#include <algorithm>
+
 #include "timer.h"
+#include "server_frame/log.h"
+#include "server_frame/macro.h"
 #include "server_frame/util.h"
 
 
@@ -49,13 +53,15 @@ namespace ygw {
         //-----------------------------------------------------------
         //class Timer
         Timer::Timer(uint64_t ms, std::function<void()> cb,
-                             bool recurring, TimerManager* manager)
+                             bool recurring, TimerManager* manager, uint64_t slack_ms)
             :recurring_(recurring)
             ,ms_(ms)
+            ,slack_(slack_ms)
             ,cb_(cb)
             ,manager_(manager) 
         {
-            next_ = ygw::util::TimeUtil::GetCurrentMS() + ms_;
+            deadline_ = ygw::util::TimeUtil::GetMonotonicMS() + ms_;
+            next_ = TimerManager::CoalesceDeadline(deadline_, slack_);
         }
         
         Timer::Timer(uint64_t next)
@@ -64,36 +70,101 @@ namespace ygw {
 
         }
 
+        uint64_t Timer::Now() const 
+        {
+            return precise_ ? ygw::util::TimeUtil::GetMonotonicUS()
+                : ygw::util::TimeUtil::GetMonotonicMS();
+        }
+
+        bool Timer::Transit(uint32_t state) 
+        {
+            uint32_t cur = state_.load();
+            do 
+            {
+                if ((cur & kStateMask) != kArmed) 
+                {
+                    return false;
+                }
+            } while (!state_.compare_exchange_weak(cur, (cur & ~(uint32_t)kStateMask) | state));
+            return true;
+        }
+
         bool Timer::Cancel() 
         {
-            TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-            if (cb_) 
+            if (precise_) 
+            {
+                thread::Mutex::Lock lock(manager_->precise_mutex_);
+                if (!cb_) 
+                {
+                    return false;
+                }
+                cb_ = nullptr;
+                Disarm();
+                auto it = manager_->precise_timers_.find(shared_from_this());
+                if (it != manager_->precise_timers_.end()) 
+                {
+                    //timerfd不需要重新设置, 多一次空唤醒时会按新的首部重设
+                    manager_->precise_timers_.erase(it);
+                    --manager_->timer_count_;
+                }
+                return true;
+            }
+            TimerShard* owner = shard_;
+            if (!owner) 
+            {
+                return false;
+            }
+            if (owner == &manager_->shared_) 
+            {
+                TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
+                if (!cb_) 
+                {
+                    return false;
+                }
+                cb_ = nullptr;
+                Disarm();
+                auto it = owner->timers.find(shared_from_this());
+                if (it != owner->timers.end()) 
+                {
+                    owner->timers.erase(it);
+                    --manager_->shared_count_;
+                    --manager_->timer_count_;
+                }
+                return true;
+            }
+            if (owner == manager_->GetLocalShard()) 
             {
+                //归属线程, 直接从分片删除. 已被其他线程取消的留给DrainOps回收
+                auto it = owner->timers.find(shared_from_this());
+                if (it == owner->timers.end() || !Transit(kIdle)) 
+                {
+                    return false;
+                }
+                owner->timers.erase(it);
                 cb_ = nullptr;
-                auto it = manager_->timers_.find(shared_from_this());
-                manager_->timers_.erase(it);
+                --manager_->timer_count_;
                 return true;
             }
-            return false;
+            //其他线程, 和归属线程的到期执行竞争kArmed, 成功后投递给归属线程回收
+            if (!Transit(kCancelled)) 
+            {
+                return false;
+            }
+            TimerOp* op = new TimerOp;
+            op->type = TimerOp::kCancel;
+            op->timer = shared_from_this();
+            manager_->PostOp(owner, op);
+            return true;
         }
 
         bool Timer::Refresh() 
         {
-            TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-            if (!cb_) 
+            if ((!shard_ && !precise_) || !IsArmed()) 
             {
                 return false;
             }
-            auto it = manager_->timers_.find(shared_from_this());
-            if (it == manager_->timers_.end()) 
-            {
-                return false;
-            }
-            //必须先从树上删除，再添加回去
-            //直接改next_会改变树的key
-            manager_->timers_.erase(it);
-            next_ = ygw::util::TimeUtil::GetCurrentMS() + ms_;
-            manager_->timers_.insert(shared_from_this());
+            //只推后期限, 集合中的位置不变; 原执行时间到达时发现期限已推后, 再重新插入
+            deadline_.store(Now() + ms_, std::memory_order_relaxed);
             return true;
         }
 
@@ -103,54 +174,216 @@ namespace ygw {
             {
                 return true;
             }
-            TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-            if (!cb_) 
+            if (precise_) 
             {
-                return false;
+                thread::Mutex::Lock lock(manager_->precise_mutex_);
+                auto& timers = manager_->precise_timers_;
+                auto it = cb_ ? timers.find(shared_from_this()) : timers.end();
+                if (it == timers.end()) 
+                {
+                    return false;
+                }
+                timers.erase(it);
+                uint64_t start = from_now ? Now() : deadline_ - ms_;
+                ms_ = ms;
+                deadline_ = start + ms_;
+                next_ = deadline_;
+                timers.insert(shared_from_this());
+                manager_->SetPreciseNext((*timers.begin())->next_);
+                return true;
             }
-            auto it = manager_->timers_.find(shared_from_this());
-            if (it == manager_->timers_.end()) 
+            TimerShard* owner = shard_;
+            if (!owner) 
             {
                 return false;
             }
-            //找到的第一时间就移除他
-            manager_->timers_.erase(it);
-            uint64_t start = 0;
-            if (from_now) 
+            if (owner == &manager_->shared_) 
             {
-                start = ygw::util::TimeUtil::GetCurrentMS();
-            } 
-            else
+                TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
+                if (!cb_) 
+                {
+                    return false;
+                }
+                auto it = owner->timers.find(shared_from_this());
+                if (it == owner->timers.end()) 
+                {
+                    return false;
+                }
+                //找到的第一时间就移除他
+                owner->timers.erase(it);
+                --manager_->shared_count_;
+                --manager_->timer_count_;
+                uint64_t start = 0;
+                if (from_now) 
+                {
+                    start = ygw::util::TimeUtil::GetMonotonicMS();
+                } 
+                else
+                {
+                    start = deadline_ - ms_;
+                }
+                ms_ = ms;
+                deadline_ = start + ms_;
+                next_ = TimerManager::CoalesceDeadline(deadline_, slack_);
+                manager_->AddTimer(shared_from_this(), lock);
+                return true;
+            }
+            if (owner == manager_->GetLocalShard()) 
             {
-                start = next_ - ms_;
+                if (!IsArmed()) 
+                {
+                    return false;
+                }
+                auto it = owner->timers.find(shared_from_this());
+                if (it == owner->timers.end()) 
+                {
+                    return false;
+                }
+                owner->timers.erase(it);
+                uint64_t start = from_now ? ygw::util::TimeUtil::GetMonotonicMS() : deadline_ - ms_;
+                ms_ = ms;
+                deadline_ = start + ms_;
+                next_ = TimerManager::CoalesceDeadline(deadline_, slack_);
+                owner->timers.insert(shared_from_this());
+                return true;
             }
-            ms_ = ms;
-            next_ = start + ms_;
-            manager_->AddTimer(shared_from_this(), lock);
+            //计入待执行的Reset, 归属线程看到计数后不按旧时间执行, 等消息到达后重新插入
+            uint32_t cur = state_.load();
+            do 
+            {
+                if ((cur & kStateMask) != kArmed) 
+                {
+                    return false;
+                }
+            } while (!state_.compare_exchange_weak(cur, cur + kResetUnit));
+            //执行时间可能提前, 投递后唤醒一次
+            TimerOp* op = new TimerOp;
+            op->type = TimerOp::kReset;
+            op->timer = shared_from_this();
+            op->ms = ms;
+            op->from_now = from_now;
+            manager_->PostOp(owner, op);
+            manager_->OnTimerInsertedAtFront();
             return true;
         }
 
 
         //---------------------------------------------------------------------
         // class TimerManager method
+
+        /// 当前线程私有分片所属的管理器
+        static thread_local TimerManager* t_timer_manager = nullptr;
+        /// 当前线程的私有分片
+        static thread_local TimerShard* t_timer_shard = nullptr;
+
         TimerManager::TimerManager() 
         {
-            previouse_time_ = ygw::util::TimeUtil::GetCurrentMS();
         }
 
         TimerManager::~TimerManager() 
         {
+            for (auto shard : shards_) 
+            {
+                TimerOp* op = shard->inbox.exchange(nullptr);
+                while (op) 
+                {
+                    TimerOp* next = op->next;
+                    delete op;
+                    op = next;
+                }
+                delete shard;
+            }
+            shards_.clear();
         }
 
         Timer::ptr TimerManager::AddTimer(uint64_t ms, std::function<void()> cb
-                ,bool recurring) 
+                ,bool recurring, uint64_t slack_ms) 
         {
-            Timer::ptr timer(new Timer(ms, cb, recurring, this));
+            Timer::ptr timer(new Timer(ms, cb, recurring, this, slack_ms));
+            TimerShard* local = GetLocalShard();
+            if (local) 
+            {
+                //本线程的idle循环会重新计算超时, 不需要tickle
+                InsertLocal(local, timer);
+                return timer;
+            }
             RWMutexType::WriteLock lock(mutex_);
             AddTimer(timer, lock);
             return timer;
         }
 
+        Timer::ptr TimerManager::AddTimerUs(uint64_t us, std::function<void()> cb
+                ,bool recurring) 
+        {
+            Timer::ptr timer(new Timer(us, cb, recurring, this, 0));
+            timer->precise_ = true;
+            timer->deadline_ = ygw::util::TimeUtil::GetMonotonicUS() + us;
+            timer->next_ = timer->deadline_;
+
+            thread::Mutex::Lock lock(precise_mutex_);
+            timer->state_ = Timer::kArmed;
+            ++timer_count_;
+            precise_timers_.insert(timer);
+            SetPreciseNext((*precise_timers_.begin())->next_);
+            return timer;
+        }
+
+        void TimerManager::ListExpiredPreciseCb(std::vector<std::function<void()> >& cbs) 
+        {
+            //每轮idle都会调用, 首部未到期时不加锁也不重设timerfd
+            uint64_t next_us = precise_next_us_.load(std::memory_order_relaxed);
+            if (next_us == 0) 
+            {
+                return;
+            }
+            uint64_t now_us = ygw::util::TimeUtil::GetMonotonicUS();
+            if (next_us > now_us) 
+            {
+                return;
+            }
+
+            thread::Mutex::Lock lock(precise_mutex_);
+            while (!precise_timers_.empty() 
+                    && (*precise_timers_.begin())->next_ <= now_us) 
+            {
+                Timer::ptr timer = *precise_timers_.begin();
+                precise_timers_.erase(precise_timers_.begin());
+                uint64_t deadline = timer->deadline_.load(std::memory_order_relaxed);
+                if (deadline > now_us) 
+                {
+                    //期限被Refresh推后
+                    timer->next_ = deadline;
+                    precise_timers_.insert(timer);
+                    continue;
+                }
+                cbs.push_back(timer->cb_);
+                if (timer->recurring_) 
+                {
+                    timer->deadline_ = now_us + timer->ms_;
+                    timer->next_ = timer->deadline_;
+                    precise_timers_.insert(timer);
+                } 
+                else 
+                {
+                    timer->cb_ = nullptr;
+                    timer->Disarm();
+                    --timer_count_;
+                }
+            }
+            SetPreciseNext(precise_timers_.empty() ? 0 
+                    : (*precise_timers_.begin())->next_);
+        }
+
+        void TimerManager::SetPreciseNext(uint64_t next_us) 
+        {
+            if (precise_next_us_.load(std::memory_order_relaxed) == next_us) 
+            {
+                return;
+            }
+            precise_next_us_.store(next_us, std::memory_order_relaxed);
+            OnPreciseTimerChanged(next_us);
+        }
+
         static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) 
         {
             if (weak_cond.lock()) 
@@ -161,85 +394,176 @@ namespace ygw {
 
         Timer::ptr TimerManager::AddConditionTimer(uint64_t ms, std::function<void()> cb
                 ,std::weak_ptr<void> weak_cond
-                ,bool recurring) 
+                ,bool recurring, uint64_t slack_ms) 
         {
-            return AddTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+            return AddTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring, slack_ms);
+        }
+
+        uint64_t TimerManager::CoalesceDeadline(uint64_t deadline, uint64_t slack_ms) 
+        {
+            if (slack_ms == 0) 
+            {
+                return deadline;
+            }
+            //取不超过slack的最大2的幂作为桶宽, 不同slack的桶边界互相对齐
+            uint64_t granularity = 1;
+            while (granularity <= slack_ms / 2) 
+            {
+                granularity <<= 1;
+            }
+            return (deadline + granularity - 1) & ~(granularity - 1);
         }
 
         uint64_t TimerManager::GetNextTimer() 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            tickled_ = false;
-            if (timers_.empty()) 
+            uint64_t next = ~0ull;
+            TimerShard* local = GetLocalShard();
+            if (local) 
             {
-                return ~0ull;
+                DrainOps(local);
+                if (!local->timers.empty()) 
+                {
+                    next = (*local->timers.begin())->next_;
+                }
+                next = std::min(next, NextTimeout(local));
+            }
+            next = std::min(next, NextTimeout(&shared_));
+            if (shared_count_ > 0) 
+            {
+                RWMutexType::ReadLock lock(mutex_);
+                tickled_ = false;
+                if (!shared_.timers.empty()) 
+                {
+                    next = std::min(next, (*shared_.timers.begin())->next_);
+                }
+            }
+            else 
+            {
+                tickled_ = false;
             }
 
-            const Timer::ptr& next = *timers_.begin();
-            uint64_t now_ms = ygw::util::TimeUtil::GetCurrentMS();
-            if (now_ms >= next->next_) 
+            if (next == ~0ull) 
+            {
+                return ~0ull;
+            }
+            // 计算等待时间前刷新一次缓存时钟
+            uint64_t now_ms = ygw::util::TimeUtil::UpdateCachedMS();
+            if (now_ms >= next) 
             {
                 return 0;
             } 
             else 
             {
-                return next->next_ - now_ms;
+                return next - now_ms;
             }
         }
 
         void TimerManager::ListExpiredCb(std::vector<std::function<void()> >& cbs) 
         {
-            uint64_t now_ms = ygw::util::TimeUtil::GetCurrentMS();
-            std::vector<Timer::ptr> expired;
+            uint64_t now_ms = ygw::util::TimeUtil::GetCachedMS();
+            TimerShard* local = GetLocalShard();
+            if (local) 
             {
-                RWMutexType::ReadLock lock(mutex_);
-                if (timers_.empty()) 
-                {
-                    return;
-                }
+                DrainOps(local);
+                timer_count_ -= ListExpired(local, now_ms, cbs);
             }
-            RWMutexType::WriteLock lock(mutex_);
-            if (timers_.empty()) 
+
+            if (shared_count_ == 0) 
             {
                 return;
             }
-            // 判断服务器时间是否被调过
-            bool rollover = DetectClockRollover(now_ms);
-            if (!rollover && ((*timers_.begin())->next_ > now_ms)) 
+            RWMutexType::WriteLock lock(mutex_);
+            size_t removed = ListExpired(&shared_, now_ms, cbs);
+            shared_count_ -= removed;
+            timer_count_ -= removed;
+        }
+
+        size_t TimerManager::ListExpired(TimerShard* shard, uint64_t now_ms
+                ,std::vector<std::function<void()> >& cbs) 
+        {
+            if (shard->timers.empty()) 
+            {
+                return 0;
+            }
+            // 使用单调时钟, 不会出现时间回调
+            if ((*shard->timers.begin())->next_ > now_ms) 
             {
-                return;
+                return 0;
             }
 
+            std::set<Timer::ptr, Timer::Comparator>& timers = shard->timers;
             Timer::ptr now_timer(new Timer(now_ms));
-            auto it = rollover ? timers_.end() : timers_.lower_bound(now_timer);
-            while(it != timers_.end() && (*it)->next_ == now_ms) 
+            auto it = timers.lower_bound(now_timer);
+            while(it != timers.end() && (*it)->next_ == now_ms) 
             {
                 ++it;
             }
             //取出 timers[begin, 最后一个lower_bound]
-            expired.insert(expired.begin(), timers_.begin(), it);
-            timers_.erase(timers_.begin(), it);
-            cbs.reserve(expired.size());
+            std::vector<Timer::ptr> expired(timers.begin(), it);
+            timers.erase(timers.begin(), it);
+            cbs.reserve(cbs.size() + expired.size());
 
+            size_t removed = 0;
             for(auto& timer : expired) 
             {
+                uint32_t state = timer->state_.load();
+                if ((state & Timer::kStateMask) == Timer::kCancelled) 
+                {
+                    timer->cb_ = nullptr;
+                    timer->Disarm();
+                    ++removed;
+                    continue;
+                }
+                uint64_t deadline = timer->deadline_.load(std::memory_order_relaxed);
+                if (deadline > now_ms) 
+                {
+                    //期限被Refresh推后, 按新期限重新插入
+                    timer->next_ = CoalesceDeadline(deadline, timer->slack_);
+                    timers.insert(timer);
+                    continue;
+                }
+                //和其他线程的Cancel/Reset竞争: 只有没有待执行的Reset时才能从kArmed转出
+                state = Timer::kArmed;
+                if (!timer->state_.compare_exchange_strong(state
+                            ,timer->recurring_ ? Timer::kArmed : Timer::kIdle)) 
+                {
+                    if ((state & Timer::kStateMask) == Timer::kCancelled) 
+                    {
+                        timer->cb_ = nullptr;
+                        timer->Disarm();
+                        ++removed;
+                    } 
+                    else 
+                    {
+                        //Reset的消息还没到, 留在原位置, 由DrainOps按新时间重新插入
+                        timers.insert(timer);
+                    }
+                    continue;
+                }
                 cbs.push_back(timer->cb_);
                 if (timer->recurring_) 
                 {
-                    timer->next_ = now_ms + timer->ms_;
-                    timers_.insert(timer);
+                    timer->deadline_ = now_ms + timer->ms_;
+                    timer->next_ = CoalesceDeadline(timer->deadline_, timer->slack_);
+                    timers.insert(timer);
                 } 
                 else 
                 {
                     timer->cb_ = nullptr;
+                    ++removed;
                 }
             }
+            return removed;
         }
 
         void TimerManager::AddTimer(Timer::ptr val, RWMutexType::WriteLock& lock) 
         {
-            auto it = timers_.insert(val).first;
-            bool at_front = (it == timers_.begin()) && !tickled_;
+            val->shard_ = &shared_;
+            val->state_ = Timer::kArmed;
+            auto it = shared_.timers.insert(val).first;
+            ++shared_count_;
+            ++timer_count_;
+            bool at_front = (it == shared_.timers.begin()) && !tickled_;
             if (at_front) 
             {
                 tickled_ = true;
@@ -251,22 +575,275 @@ namespace ygw {
             }
         }
 
-        bool TimerManager::DetectClockRollover(uint64_t now_ms) 
+        void TimerManager::InsertLocal(TimerShard* shard, Timer::ptr val) 
+        {
+            val->shard_ = shard;
+            val->state_ = Timer::kArmed;
+            shard->timers.insert(val);
+            ++timer_count_;
+        }
+
+        void TimerManager::PostOp(TimerShard* shard, TimerOp* op) 
+        {
+            TimerOp* head = shard->inbox.load(std::memory_order_relaxed);
+            do 
+            {
+                op->next = head;
+            } while (!shard->inbox.compare_exchange_weak(head, op
+                        ,std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        void TimerManager::DrainOps(TimerShard* shard) 
         {
-            bool rollover = false;
-            if (now_ms < previouse_time_ &&
-                    now_ms < (previouse_time_ - 60 * 60 * 1000)) 
+            TimerOp* op = shard->inbox.exchange(nullptr, std::memory_order_acquire);
+            if (!op) 
             {
-                rollover = true;
+                return;
+            }
+            //无锁栈是后进先出, 反转成投递顺序
+            TimerOp* ordered = nullptr;
+            while (op) 
+            {
+                TimerOp* next = op->next;
+                op->next = ordered;
+                ordered = op;
+                op = next;
+            }
+
+            while (ordered) 
+            {
+                std::unique_ptr<TimerOp> cur(ordered);
+                ordered = ordered->next;
+                Timer::ptr& timer = cur->timer;
+                if (cur->type == TimerOp::kReset) 
+                {
+                    //归属线程上不会和到期执行并发, 先减计数再重新插入
+                    timer->state_ -= Timer::kResetUnit;
+                }
+                auto it = shard->timers.find(timer);
+                if (it == shard->timers.end()) 
+                {
+                    continue;
+                }
+                if ((timer->state_ & Timer::kStateMask) == Timer::kCancelled) 
+                {
+                    shard->timers.erase(it);
+                    timer->cb_ = nullptr;
+                    timer->Disarm();
+                    --timer_count_;
+                    continue;
+                }
+                shard->timers.erase(it);
+                uint64_t start = cur->from_now ? ygw::util::TimeUtil::GetMonotonicMS()
+                    : timer->deadline_ - timer->ms_;
+                timer->ms_ = cur->ms;
+                timer->deadline_ = start + timer->ms_;
+                timer->next_ = CoalesceDeadline(timer->deadline_, timer->slack_);
+                shard->timers.insert(timer);
+            }
+        }
+
+        uint64_t TimerManager::ArmTimeout(TimeoutNode* node, uint64_t ms, uint64_t slack_ms) 
+        {
+            TimerShard* shard = GetLocalShard();
+            bool shared = false;
+            if (!shard) 
+            {
+                shard = &shared_;
+                shared = true;
+            }
+            uint64_t seq = 0;
+            {
+                thread::Spinlock::Lock lock(shard->timeout_mutex);
+                YGW_ASSERT(!node->shard.load(std::memory_order_relaxed));
+                std::vector<TimeoutQueue>& queues = shard->timeout_queues;
+                size_t idx = 0;
+                while (idx < queues.size() 
+                        && (queues[idx].ms != ms || queues[idx].slack != slack_ms)) 
+                {
+                    ++idx;
+                }
+                if (idx == queues.size()) 
+                {
+                    //超时时长种类很少(通常就是几个socket超时配置), 只在首次出现时扩容
+                    queues.push_back(TimeoutQueue());
+                    queues.back().ms = ms;
+                    queues.back().slack = slack_ms;
+                }
+                TimeoutQueue& queue = queues[idx];
+                //对齐后仍单调不减, 队列保持有序
+                node->deadline = CoalesceDeadline(ygw::util::TimeUtil::GetMonotonicMS() + ms, slack_ms);
+                seq = ++node->seq;
+                node->queue = idx;
+                node->prev = queue.tail;
+                node->next = nullptr;
+                if (queue.tail) 
+                {
+                    queue.tail->next = node;
+                } 
+                else 
+                {
+                    queue.head = node;
+                }
+                queue.tail = node;
+                node->shard.store(shard, std::memory_order_relaxed);
+                ++shard->timeout_count;
+            }
+            if (shared) 
+            {
+                //共享分片没有归属线程, 唤醒idle线程重新计算等待时间
+                OnTimerInsertedAtFront();
+            }
+            return seq;
+        }
+
+        bool TimerManager::CancelTimeout(TimeoutNode* node) 
+        {
+            TimerShard* shard = node->shard.load(std::memory_order_relaxed);
+            if (!shard) 
+            {
+                return false;
+            }
+            thread::Spinlock::Lock lock(shard->timeout_mutex);
+            //加锁前节点可能已经到期被摘除
+            if (node->shard.load(std::memory_order_relaxed) != shard) 
+            {
+                return false;
+            }
+            TimeoutQueue& queue = shard->timeout_queues[node->queue];
+            if (node->prev) 
+            {
+                node->prev->next = node->next;
+            } 
+            else 
+            {
+                queue.head = node->next;
+            }
+            if (node->next) 
+            {
+                node->next->prev = node->prev;
+            } 
+            else 
+            {
+                queue.tail = node->prev;
+            }
+            node->prev = nullptr;
+            node->next = nullptr;
+            node->shard.store(nullptr, std::memory_order_relaxed);
+            --shard->timeout_count;
+            return true;
+        }
+
+        void TimerManager::ProcessExpiredTimeouts() 
+        {
+            uint64_t now_ms = ygw::util::TimeUtil::GetCachedMS();
+            TimerShard* local = GetLocalShard();
+            if (local) 
+            {
+                ProcessExpiredTimeouts(local, now_ms);
+            }
+            ProcessExpiredTimeouts(&shared_, now_ms);
+        }
+
+        uint64_t TimerManager::NextTimeout(TimerShard* shard) 
+        {
+            if (shard->timeout_count == 0) 
+            {
+                return ~0ull;
+            }
+            uint64_t next = ~0ull;
+            thread::Spinlock::Lock lock(shard->timeout_mutex);
+            for (auto& queue : shard->timeout_queues) 
+            {
+                if (queue.head) 
+                {
+                    next = std::min(next, queue.head->deadline);
+                }
+            }
+            return next;
+        }
+
+        void TimerManager::ProcessExpiredTimeouts(TimerShard* shard, uint64_t now_ms) 
+        {
+            //分批在锁内摘除, 锁外回调; 栈上数组避免分配内存
+            static const size_t kBatch = 64;
+            TimeoutNode* nodes[kBatch];
+            uint64_t seqs[kBatch];
+            while (shard->timeout_count > 0) 
+            {
+                size_t n = 0;
+                {
+                    thread::Spinlock::Lock lock(shard->timeout_mutex);
+                    for (auto& queue : shard->timeout_queues) 
+                    {
+                        while (n < kBatch && queue.head && queue.head->deadline <= now_ms) 
+                        {
+                            TimeoutNode* node = queue.head;
+                            queue.head = node->next;
+                            if (queue.head) 
+                            {
+                                queue.head->prev = nullptr;
+                            } 
+                            else 
+                            {
+                                queue.tail = nullptr;
+                            }
+                            node->next = nullptr;
+                            node->shard.store(nullptr, std::memory_order_relaxed);
+                            nodes[n] = node;
+                            seqs[n] = node->seq;
+                            ++n;
+                        }
+                    }
+                    shard->timeout_count -= n;
+                }
+                for (size_t i = 0; i < n; ++i) 
+                {
+                    nodes[i]->cb(nodes[i], seqs[i]);
+                }
+                if (n < kBatch) 
+                {
+                    break;
+                }
+            }
+        }
+
+        TimerShard* TimerManager::GetLocalShard() const 
+        {
+            return t_timer_manager == this ? t_timer_shard : nullptr;
+        }
+
+        void TimerManager::AttachTimerShard() 
+        {
+            if (GetLocalShard()) 
+            {
+                return;
+            }
+            TimerShard* shard = new TimerShard;
+            {
+                thread::Mutex::Lock lock(shards_mutex_);
+                shards_.push_back(shard);
+            }
+            t_timer_manager = this;
+            t_timer_shard = shard;
+        }
+
+        void TimerManager::DetachTimerShard() 
+        {
+            TimerShard* local = GetLocalShard();
+            if (!local) 
+            {
+                return;
             }
-            previouse_time_ = now_ms;
-            return rollover;
+            DrainOps(local);
+            //分片由管理器持有, 析构时释放
+            t_timer_manager = nullptr;
+            t_timer_shard = nullptr;
         }
 
         bool TimerManager::HasTimer() 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            return !timers_.empty();
+            return timer_count_ > 0;
         }
 
     } // namespace timer
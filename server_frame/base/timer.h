@@ -11,6 +11,7 @@
 #ifndef __YGW_TIMER_H__
 #define __YGW_TIMER_H__
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <vector>
@@ -26,29 +27,42 @@ namespace ygw {
         //-------------------------------------------------------
 
         class TimerManager;
+        struct TimerShard;
+        struct TimerOp;
+        struct TimeoutNode;
 
         /**
          * @brief 定时器
+         * @details 定时器归属于创建它的工作线程(TimerShard),
+         *          归属线程内的操作无锁, 其他线程的操作通过消息投递给归属线程执行
          */
         class Timer : public std::enable_shared_from_this<Timer> 
         {
         friend class TimerManager;
+        friend struct TimerShard;
         public:
             /// 定时器的智能指针类型
             using ptr = std::shared_ptr<Timer>;
 
             /**
              * @brief 取消定时器
+             * @details 其他线程的取消和归属线程的到期执行竞争同一个状态, 只有一方成功
+             * @return 返回true时回调不会再被执行(循环定时器本周期已取出的回调除外);
+             *         定时器已执行或已被取消返回false
              */
             bool Cancel();
 
             /**
              * @brief 刷新设置定时器的执行时间
+             * @details 只推后期限, 不调整定时器集合, 原执行时间到达时再按新期限重新插入.
+             *          可在任意线程调用, 不加锁也不投递消息
              */
             bool Refresh();
 
             /**
              * @brief 重置定时器时间
+             * @details 其他线程的重置投递给归属线程执行, 返回true后定时器按新时间执行,
+             *          投递期间到期也不会按旧时间执行
              * @param[in] ms 定时器执行间隔时间(毫秒)
              * @param[in] from_now 是否从当前时间开始计算
              */
@@ -60,25 +74,73 @@ namespace ygw {
              * @param[in] cb 回调函数
              * @param[in] recurring 是否循环
              * @param[in] manager 定时器管理器
+             * @param[in] slack_ms 允许推迟执行的时间(毫秒)
              */
             Timer(uint64_t ms, std::function<void()> cb,
-                    bool recurring, TimerManager* manager);
+                    bool recurring, TimerManager* manager, uint64_t slack_ms);
             /**
              * @brief 构造函数
-             * @param[in] next 执行的时间戳(毫秒)
+             * @param[in] next 执行的单调时钟时间戳(毫秒)
              */
             Timer(uint64_t next);
+
+            /**
+             * @brief 当前时间, 微秒定时器返回单调时钟微秒, 否则返回缓存的毫秒
+             */
+            uint64_t Now() const;
+
+            /**
+             * @brief 定时器状态, 保存在state_的低2位
+             */
+            enum State {
+                /// 不在分片中(未添加, 已执行或已回收)
+                kIdle = 0,
+                /// 在分片中等待执行
+                kArmed = 1,
+                /// 已被其他线程取消, 等待归属线程回收
+                kCancelled = 2,
+                /// 状态位掩码
+                kStateMask = 3,
+                /// 高位计数的单位: 其他线程投递了, 归属线程还未执行的Reset
+                kResetUnit = 4,
+            };
+
+            /**
+             * @brief 是否在分片中等待执行
+             */
+            bool IsArmed() const { return (state_ & kStateMask) == kArmed; }
+
+            /**
+             * @brief 从kArmed转换到state, 保留Reset计数
+             * @return 当前不是kArmed时返回false
+             */
+            bool Transit(uint32_t state);
+
+            /**
+             * @brief 转换到kIdle, 保留Reset计数
+             */
+            void Disarm() { state_.fetch_and(~(uint32_t)kStateMask); }
         private:
             /// 是否循环定时器
             bool recurring_ = false;
+            /// 是否微秒定时器, 是则ms_/next_/deadline_的单位均为微秒
+            bool precise_ = false;
             /// 执行周期
             uint64_t ms_ = 0;
-            /// 精确的执行时间
+            /// 允许推迟执行的时间(毫秒)
+            uint64_t slack_ = 0;
+            /// 在分片中排序用的执行时间(按slack_对齐到桶边界)
             uint64_t next_ = 0;
+            /// 期限(单调时钟毫秒), Refresh只修改它, 到期时与next_比较
+            std::atomic<uint64_t> deadline_ = {0};
             /// 回调函数
             std::function<void()> cb_;
             /// 定时器管理器
             TimerManager* manager_ = nullptr;
+            /// 所属分片, 插入后不再改变
+            TimerShard* shard_ = nullptr;
+            /// 状态(State)和待执行的跨线程Reset计数
+            std::atomic<uint32_t> state_ = {kIdle};
         private:
             //--------------------------------------------------------------
             /**
@@ -101,8 +163,111 @@ namespace ygw {
 
         //------------------------------------------------------------------
 
+        /**
+         * @brief 跨线程定时器操作消息
+         */
+        struct TimerOp 
+        {
+            /**
+             * @brief 操作类型
+             */
+            enum Type {
+                /// 取消
+                kCancel,
+                /// 重置
+                kReset
+            };
+            /// 操作类型
+            Type type;
+            /// 目标定时器
+            Timer::ptr timer;
+            /// kReset: 新的执行间隔
+            uint64_t ms = 0;
+            /// kReset: 是否从当前时间开始计算
+            bool from_now = false;
+            /// 无锁栈的下一个节点
+            TimerOp* next = nullptr;
+        };
+
+        /**
+         * @brief 侵入式超时节点
+         * @details 节点内嵌在等待者自己的上下文中(如IO事件上下文), 挂入/取消不分配内存.
+         *          同一分片中相同时长的节点按到期先后串成一条双向链表,
+         *          挂入为尾插, 取消为摘链, 都是O(1)
+         */
+        struct TimeoutNode 
+        {
+            /**
+             * @brief 到期回调
+             * @param[in] node 到期的节点
+             * @param[in] seq 到期时节点的序号, 用于识别节点是否已被重新挂入
+             * @attention 在分片锁之外调用, 回调返回前节点可能已被重新挂入
+             */
+            using Callback = void (*)(TimeoutNode* node, uint64_t seq);
+
+            /// 到期时间(单调时钟毫秒)
+            uint64_t deadline = 0;
+            /// 每次挂入递增的序号
+            uint64_t seq = 0;
+            /// 到期回调
+            Callback cb = nullptr;
+            /// 回调使用的参数
+            void* owner = nullptr;
+            /// 回调使用的参数
+            void* data = nullptr;
+            /// 所在分片, 未挂入时为nullptr
+            std::atomic<TimerShard*> shard = {nullptr};
+            /// 所在队列的下标
+            size_t queue = 0;
+            /// 队列中的前一个节点
+            TimeoutNode* prev = nullptr;
+            /// 队列中的后一个节点
+            TimeoutNode* next = nullptr;
+        };
+
+        /**
+         * @brief 相同时长的超时节点队列
+         * @details 同一线程的缓存时钟单调不减, 尾插即保持按到期时间有序
+         */
+        struct TimeoutQueue 
+        {
+            /// 超时时长(毫秒)
+            uint64_t ms = 0;
+            /// 允许推迟的时间(毫秒)
+            uint64_t slack = 0;
+            /// 最早到期的节点
+            TimeoutNode* head = nullptr;
+            /// 最晚到期的节点
+            TimeoutNode* tail = nullptr;
+        };
+
+        /**
+         * @brief 定时器分片
+         * @details 每个IOManager工作线程拥有一个分片, 只有归属线程修改timers
+         *          其他线程通过inbox(无锁栈)投递操作.
+         *          超时节点队列由timeout_mutex保护, 其他线程可以直接O(1)摘除节点
+         */
+        struct TimerShard 
+        {
+            /// 定时器集合
+            std::set<Timer::ptr, Timer::Comparator> timers;
+            /// 跨线程投递的操作
+            std::atomic<TimerOp*> inbox = {nullptr};
+            /// 超时节点队列的锁
+            thread::Spinlock timeout_mutex;
+            /// 按时长划分的超时节点队列
+            std::vector<TimeoutQueue> timeout_queues;
+            /// 已挂入的超时节点数量
+            std::atomic<size_t> timeout_count = {0};
+        };
+
+        //------------------------------------------------------------------
+
         /**
          * @brief 定时器管理器
+         * @details 工作线程调用AttachTimerShard后, 该线程添加的定时器进入线程私有分片,
+         *          GetNextTimer/ListExpiredCb只处理本线程分片和共享分片.
+         *          非工作线程添加的定时器进入共享分片(由mutex_保护)
          */
         class TimerManager 
         {
@@ -126,9 +291,12 @@ namespace ygw {
              * @param[in] ms 定时器执行间隔时间
              * @param[in] cb 定时器回调函数
              * @param[in] recurring 是否循环定时器
+             * @param[in] slack_ms 允许推迟执行的时间(毫秒)
+             * @details slack_ms不为0时执行时间向上对齐到不超过slack_ms的2的幂,
+             *          对齐到同一时间点的定时器在同一次唤醒中执行
              */
             Timer::ptr AddTimer(uint64_t ms, std::function<void()> cb
-                    ,bool recurring = false);
+                    ,bool recurring = false, uint64_t slack_ms = 0);
 
             /**
              * @brief 添加条件定时器
@@ -136,51 +304,168 @@ namespace ygw {
              * @param[in] cb 定时器回调函数
              * @param[in] weak_cond 条件
              * @param[in] recurring 是否循环
+             * @param[in] slack_ms 允许推迟执行的时间(毫秒)
              */
             Timer::ptr AddConditionTimer(uint64_t ms, std::function<void()> cb
                     ,std::weak_ptr<void> weak_cond
+                    ,bool recurring = false, uint64_t slack_ms = 0);
+
+            /**
+             * @brief 添加微秒定时器
+             * @param[in] us 定时器执行间隔时间(微秒)
+             * @param[in] cb 定时器回调函数
+             * @param[in] recurring 是否循环定时器
+             * @details 微秒定时器单独存放, 由子类用高精度时钟源(如timerfd)唤醒,
+             *          适合限速/节拍等需要亚毫秒精度的场景, 数量不宜过多
+             */
+            Timer::ptr AddTimerUs(uint64_t us, std::function<void()> cb
                     ,bool recurring = false);
 
             /**
-             * @brief 到最近一个定时器执行的时间间隔(毫秒)
+             * @brief 获取已到期的微秒定时器的回调函数列表
+             * @param[out] cbs 回调函数数组
+             */
+            void ListExpiredPreciseCb(std::vector<std::function<void()> >& cbs);
+
+            /**
+             * @brief 将期限按slack对齐到桶边界
+             * @param[in] deadline 期限(毫秒)
+             * @param[in] slack_ms 允许推迟的时间(毫秒)
+             * @return [deadline, deadline + slack_ms]内对齐到2的幂的时间点
+             */
+            static uint64_t CoalesceDeadline(uint64_t deadline, uint64_t slack_ms);
+
+            /**
+             * @brief 当前线程到最近一个定时器执行的时间间隔(毫秒)
+             * @details 只计算本线程分片和共享分片
              */
             uint64_t GetNextTimer();
 
             /**
-             * @brief 获取需要执行的定时器的回调函数列表
+             * @brief 获取本线程分片和共享分片中需要执行的定时器的回调函数列表
              * @param[out] cbs 回调函数数组
              */
             void ListExpiredCb(std::vector<std::function<void()> >& cbs);
 
             /**
-             * @brief 是否有定时器
+             * @brief 是否有定时器(所有分片)
              */
             bool HasTimer();
         protected:
 
             /**
-             * @brief 当有新的定时器插入到定时器的首部,执行该函数
+             * @brief 当有新的定时器插入到共享分片的首部,执行该函数
              */
             virtual void OnTimerInsertedAtFront() = 0;
 
             /**
-             * @brief 将定时器添加到管理器中
+             * @brief 最早的微秒定时器发生变化时执行该函数
+             * @param[in] next_us 最早的执行时间(单调时钟微秒), 0表示没有微秒定时器
+             * @attention 在precise_mutex_内调用
+             */
+            virtual void OnPreciseTimerChanged(uint64_t next_us) {}
+
+            /**
+             * @brief 微秒定时器首部变化后调用, 与上次通知的时间不同才执行OnPreciseTimerChanged
+             * @attention 在precise_mutex_内调用
+             */
+            void SetPreciseNext(uint64_t next_us);
+
+            /**
+             * @brief 将定时器添加到共享分片中
              */
             void AddTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+
+            /**
+             * @brief 挂入超时节点
+             * @param[in, out] node 未挂入的超时节点, 调用前需设置cb/owner/data
+             * @param[in] ms 超时时长(毫秒)
+             * @param[in] slack_ms 允许推迟的时间(毫秒)
+             * @return 本次挂入的序号
+             * @details 工作线程挂入本线程分片, 其他线程挂入共享分片
+             */
+            uint64_t ArmTimeout(TimeoutNode* node, uint64_t ms, uint64_t slack_ms = 0);
+
+            /**
+             * @brief 摘除超时节点, 可在任意线程调用
+             * @return 节点挂入中并被摘除返回true, 已到期或未挂入返回false
+             */
+            static bool CancelTimeout(TimeoutNode* node);
+
+            /**
+             * @brief 执行本线程分片和共享分片中到期的超时节点回调
+             */
+            void ProcessExpiredTimeouts();
+
+            /**
+             * @brief 为当前线程创建私有分片
+             * @attention 在工作线程的idle循环开始时调用
+             */
+            void AttachTimerShard();
+
+            /**
+             * @brief 解除当前线程的私有分片
+             */
+            void DetachTimerShard();
         private:
             /**
-             * @brief 检测服务器时间是否被调后了
+             * @brief 返回当前线程在本管理器中的私有分片, 没有返回nullptr
+             */
+            TimerShard* GetLocalShard() const;
+
+            /**
+             * @brief 将定时器插入归属线程的私有分片(归属线程调用)
+             */
+            void InsertLocal(TimerShard* shard, Timer::ptr val);
+
+            /**
+             * @brief 投递跨线程操作到分片
              */
-            bool DetectClockRollover(uint64_t now_ms);
+            void PostOp(TimerShard* shard, TimerOp* op);
+
+            /**
+             * @brief 执行分片上投递的操作(归属线程调用)
+             */
+            void DrainOps(TimerShard* shard);
+
+            /**
+             * @brief 取出分片中已到期的定时器回调
+             * @return 从分片移除的定时器数量
+             */
+            size_t ListExpired(TimerShard* shard, uint64_t now_ms
+                    ,std::vector<std::function<void()> >& cbs);
+
+            /**
+             * @brief 分片中最早到期的超时节点的到期时间, 没有返回~0ull
+             */
+            static uint64_t NextTimeout(TimerShard* shard);
+
+            /**
+             * @brief 执行分片中到期的超时节点回调
+             */
+            static void ProcessExpiredTimeouts(TimerShard* shard, uint64_t now_ms);
         private:
-            /// Mutex
+            /// 共享分片的Mutex
             RWMutexType mutex_;
-            /// 定时器集合
-            std::set<Timer::ptr, Timer::Comparator> timers_;
+            /// 共享分片(非工作线程添加的定时器)
+            TimerShard shared_;
             /// 是否触发onTimerInsertedAtFront
             bool tickled_ = false;
-            /// 上次执行时间
-            uint64_t previouse_time_ = 0;
+            /// 共享分片中的定时器数量
+            std::atomic<size_t> shared_count_ = {0};
+            /// 所有分片中的定时器数量
+            std::atomic<size_t> timer_count_ = {0};
+            /// 微秒定时器的Mutex
+            thread::Mutex precise_mutex_;
+            /// 微秒定时器集合
+            std::set<Timer::ptr, Timer::Comparator> precise_timers_;
+            /// 最近一次通知的微秒定时器首部时间, 0表示没有. 只在precise_mutex_内修改,
+            /// 取消时不更新, 所以只可能早于实际首部; idle循环据此无锁跳过扫描
+            std::atomic<uint64_t> precise_next_us_ = {0};
+            /// 私有分片列表的Mutex
+            thread::Mutex shards_mutex_;
+            /// 所有私有分片
+            std::vector<TimerShard*> shards_;
 
         };// class TimerManager
 
@@ -0,0 +1,199 @@
+/**
+ * @file server_frame/concurrency_limiter.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-08
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <math.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "concurrency_limiter.h"
+#include "util.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace limiter {
+
+        ConcurrencyLimiter::Algorithm ConcurrencyLimiter::AlgorithmFromString(const std::string& v)
+        {
+            if (v == "aimd")
+            {
+                return kAimd;
+            }
+            return kGradient;
+        }
+
+        const char* ConcurrencyLimiter::AlgorithmToString(Algorithm v)
+        {
+            switch (v)
+            {
+            case kAimd:
+                return "aimd";
+            default:
+                return "gradient";
+            }
+        }
+
+        ConcurrencyLimiter::ConcurrencyLimiter()
+            : ConcurrencyLimiter(Options())
+        {
+        }
+
+        ConcurrencyLimiter::ConcurrencyLimiter(const Options& opts)
+            : opts_(opts)
+        {
+            opts_.min_limit = std::max<uint32_t>(opts_.min_limit, 1);
+            opts_.max_limit = std::max(opts_.max_limit, opts_.min_limit);
+            opts_.window = std::max<uint32_t>(opts_.window, 1);
+            opts_.long_window = std::max<uint32_t>(opts_.long_window, 1);
+            estimated_limit_ = std::min(std::max(opts_.initial_limit, opts_.min_limit), opts_.max_limit);
+            limit_ = estimated_limit_;
+        }
+
+        bool ConcurrencyLimiter::TryAcquire()
+        {
+            //先占名额再比较, 并发申请时不会超过上限
+            uint32_t inflight = ++inflight_;
+            if (inflight > limit_)
+            {
+                --inflight_;
+                ++rejected_;
+                return false;
+            }
+            return true;
+        }
+
+        void ConcurrencyLimiter::Release(uint64_t rtt_us, Result result)
+        {
+            uint32_t inflight = inflight_--;
+            if (result == kIgnore)
+            {
+                return;
+            }
+            MutexType::Lock lock(mutex_);
+            if (opts_.algorithm == kAimd)
+            {
+                UpdateAimd(rtt_us, result, inflight);
+            }
+            else
+            {
+                //超时的请求耗时本身就很长, 梯度算法不单独处理kDropped
+                UpdateGradient(rtt_us, inflight);
+            }
+        }
+
+        void ConcurrencyLimiter::UpdateGradient(uint64_t rtt_us, uint32_t inflight)
+        {
+            window_sum_ += rtt_us;
+            window_max_inflight_ = std::max(window_max_inflight_, inflight);
+            if (++window_count_ < opts_.window)
+            {
+                return;
+            }
+            double short_rtt = window_sum_ / window_count_;
+            uint32_t max_inflight = window_max_inflight_;
+            window_sum_ = 0;
+            window_count_ = 0;
+            window_max_inflight_ = 0;
+            if (short_rtt <= 0)
+            {
+                return;
+            }
+
+            if (long_rtt_ <= 0)
+            {
+                long_rtt_ = short_rtt;
+            }
+            else
+            {
+                long_rtt_ += (short_rtt - long_rtt_) / opts_.long_window;
+            }
+            //负载退去后耗时回落, 长期耗时跟着快速下降, 否则上限会一直偏大
+            if (long_rtt_ > short_rtt * 2)
+            {
+                long_rtt_ *= 0.95;
+            }
+            //请求量本身不足上限的一半, 样本说明不了上限是否合适
+            if (max_inflight < estimated_limit_ / 2)
+            {
+                return;
+            }
+
+            double gradient = std::max(0.5, std::min(1.0, opts_.tolerance * long_rtt_ / short_rtt));
+            double queue = sqrt(estimated_limit_);
+            double new_limit = estimated_limit_ * gradient + queue;
+            SetLimit(estimated_limit_ * (1 - opts_.smoothing) + new_limit * opts_.smoothing);
+        }
+
+        void ConcurrencyLimiter::UpdateAimd(uint64_t rtt_us, Result result, uint32_t inflight)
+        {
+            if (result == kDropped || (opts_.timeout_us && rtt_us > opts_.timeout_us))
+            {
+                SetLimit(estimated_limit_ * opts_.backoff);
+            }
+            else if (inflight * 2 >= estimated_limit_)
+            {
+                SetLimit(estimated_limit_ + 1);
+            }
+        }
+
+        void ConcurrencyLimiter::SetLimit(double v)
+        {
+            estimated_limit_ = std::min<double>(std::max<double>(v, opts_.min_limit), opts_.max_limit);
+            limit_ = (uint32_t)estimated_limit_;
+        }
+
+        std::string ConcurrencyLimiter::ToString() const
+        {
+            std::stringstream ss;
+            ss << "[ConcurrencyLimiter algorithm=" << AlgorithmToString(opts_.algorithm)
+                << " limit=" << limit_
+                << " inflight=" << inflight_
+                << " rejected=" << rejected_
+                << " min_limit=" << opts_.min_limit
+                << " max_limit=" << opts_.max_limit << "]";
+            return ss.str();
+        }
+
+        //-------------------------------------------------------------------
+
+        LimiterGuard::LimiterGuard(ConcurrencyLimiter::ptr limiter, ConcurrencyLimiter::Result unwind)
+            :limiter_(limiter)
+            ,unwind_(unwind)
+            ,acquired_(!limiter || limiter->TryAcquire())
+        {
+            if (limiter_ && acquired_)
+            {
+                start_ = ygw::util::TimeUtil::GetCurrentUS();
+            }
+        }
+
+        LimiterGuard::~LimiterGuard()
+        {
+            Release(unwind_);
+        }
+
+        void LimiterGuard::Release(ConcurrencyLimiter::Result result)
+        {
+            if (limiter_ && acquired_)
+            {
+                limiter_->Release(ygw::util::TimeUtil::GetCurrentUS() - start_, result);
+                limiter_.reset();
+            }
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace limiter
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
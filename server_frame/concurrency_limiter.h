@@ -0,0 +1,239 @@
+/**
+ * @file concurrency_limiter.h
+ * @brief 自适应并发限制器
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-08
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_CONCURRENCY_LIMITER_H__
+#define __YGW_CONCURRENCY_LIMITER_H__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "base/mutex.h"
+#include "noncopyable.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace limiter {
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 自适应并发限制器
+         * @details 限制同时在途的请求数, 上限根据请求耗时自动调整, 超出上限的请求直接拒绝.
+         *          kGradient: 比较长期平均耗时和最近一个窗口的耗时, 耗时变长说明开始排队,
+         *                     按比例降低上限; 耗时稳定时每个窗口增加sqrt(limit)的余量去探测.
+         *          kAimd: 请求成功且上限被用满一半以上时加1, 请求超时或失败时乘以backoff.
+         *          限制器不读时钟, 耗时由调用方传入, 服务端和客户端(连接池)都可以使用
+         */
+        class ConcurrencyLimiter
+        {
+        public:
+            using ptr = std::shared_ptr<ConcurrencyLimiter>;
+            using MutexType = thread::Mutex;
+
+            /**
+             * @brief 调整算法
+             */
+            enum Algorithm {
+                /// 按耗时梯度调整
+                kGradient = 0,
+                /// 加性增乘性减
+                kAimd = 1,
+            };
+
+            /**
+             * @brief 请求结果
+             */
+            enum Result {
+                /// 正常完成, 耗时计入样本
+                kSuccess = 0,
+                /// 超时或者因过载失败, 视为拥塞信号
+                kDropped = 1,
+                /// 与负载无关的失败, 不计入样本
+                kIgnore = 2,
+            };
+
+            /**
+             * @brief 参数
+             */
+            struct Options
+            {
+                Algorithm algorithm = kGradient;
+                /// 初始上限
+                uint32_t initial_limit = 20;
+                /// 最小上限
+                uint32_t min_limit = 1;
+                /// 最大上限
+                uint32_t max_limit = 1000;
+                /// 每个窗口的样本数, 一个窗口调整一次上限(kGradient)
+                uint32_t window = 100;
+                /// 长期平均耗时的窗口数(kGradient)
+                uint32_t long_window = 600;
+                /// 允许最近耗时比长期耗时高出的倍数(kGradient)
+                double tolerance = 1.5;
+                /// 新上限的平滑系数(kGradient)
+                double smoothing = 0.2;
+                /// 乘性减的系数(kAimd)
+                double backoff = 0.9;
+                /// 耗时超过它按kDropped处理(kAimd), 0不判断
+                uint64_t timeout_us = 0;
+            };
+
+            /**
+             * @brief 字符串转算法, 不认识的按kGradient
+             */
+            static Algorithm AlgorithmFromString(const std::string& v);
+
+            /**
+             * @brief 算法转字符串
+             */
+            static const char* AlgorithmToString(Algorithm v);
+
+            /**
+             * @brief 构造函数, 使用默认参数
+             */
+            ConcurrencyLimiter();
+
+            /**
+             * @brief 构造函数
+             */
+            ConcurrencyLimiter(const Options& opts);
+
+            /**
+             * @brief 申请一个在途名额
+             * @return 达到上限返回false, 请求应当被拒绝
+             */
+            bool TryAcquire();
+
+            /**
+             * @brief 归还名额并提交一次样本
+             * @param[in] rtt_us 请求耗时微秒
+             * @param[in] result 请求结果
+             * @pre TryAcquire返回true
+             */
+            void Release(uint64_t rtt_us, Result result = kSuccess);
+
+            /**
+             * @brief 返回当前上限
+             */
+            uint32_t GetLimit() const { return limit_; }
+
+            /**
+             * @brief 返回在途请求数
+             */
+            uint32_t GetInflight() const { return inflight_; }
+
+            /**
+             * @brief 返回被拒绝的请求数
+             */
+            uint64_t GetRejected() const { return rejected_; }
+
+            /**
+             * @brief 返回参数
+             */
+            const Options& GetOptions() const { return opts_; }
+
+            /**
+             * @brief 转字符串
+             */
+            std::string ToString() const;
+        private:
+            /**
+             * @brief 按梯度算法处理样本
+             */
+            void UpdateGradient(uint64_t rtt_us, uint32_t inflight);
+
+            /**
+             * @brief 按AIMD算法处理样本
+             */
+            void UpdateAimd(uint64_t rtt_us, Result result, uint32_t inflight);
+
+            /**
+             * @brief 设置上限, 限制在[min_limit, max_limit]内
+             */
+            void SetLimit(double v);
+        private:
+            /// 参数
+            Options opts_;
+            /// 保护下面的统计量和estimated_limit_
+            MutexType mutex_;
+            /// 当前上限, 读取不加锁
+            std::atomic<uint32_t> limit_;
+            /// 在途请求数
+            std::atomic<uint32_t> inflight_ {0};
+            /// 被拒绝的请求数
+            std::atomic<uint64_t> rejected_ {0};
+            /// 未取整的上限
+            double estimated_limit_;
+            /// 长期平均耗时
+            double long_rtt_ = 0;
+            /// 当前窗口的耗时和
+            double window_sum_ = 0;
+            /// 当前窗口的样本数
+            uint32_t window_count_ = 0;
+            /// 当前窗口中最大的在途数
+            uint32_t window_max_inflight_ = 0;
+        }; // class ConcurrencyLimiter
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 限制器名额的作用域守卫
+         * @details 构造时申请名额, 析构时还没有Release就按unwind结果归还,
+         *          请求处理抛出异常时名额不会泄漏. limiter为空时总是通过
+         */
+        class LimiterGuard : able::Noncopyable
+        {
+        public:
+            /**
+             * @brief 构造函数, 申请名额
+             * @param[in] limiter 限制器, 可以为空
+             * @param[in] unwind 没有显式Release时提交的结果
+             */
+            LimiterGuard(ConcurrencyLimiter::ptr limiter
+                    ,ConcurrencyLimiter::Result unwind = ConcurrencyLimiter::kIgnore);
+
+            /**
+             * @brief 析构函数, 名额还没归还时按unwind结果归还
+             */
+            ~LimiterGuard();
+
+            /**
+             * @brief 是否拿到了名额
+             */
+            bool IsAcquired() const { return acquired_; }
+
+            /**
+             * @brief 归还名额, 耗时从构造开始计算
+             * @param[in] result 请求结果
+             */
+            void Release(ConcurrencyLimiter::Result result = ConcurrencyLimiter::kSuccess);
+        private:
+            /// 限制器
+            ConcurrencyLimiter::ptr limiter_;
+            /// 没有显式归还时的结果
+            ConcurrencyLimiter::Result unwind_;
+            /// 是否拿到了名额
+            bool acquired_;
+            /// 开始时间微秒
+            uint64_t start_ = 0;
+        }; // class LimiterGuard
+
+        //--------------------------------------------------------------------
+
+    } // namespace limiter
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_CONCURRENCY_LIMITER_H__
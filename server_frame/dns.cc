@@ -0,0 +1,659 @@
+/**
+ * @file server_frame/dns.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-09-23
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+
+#include "config.h"
+#include "dns.h"
+#include "macro.h"
+#include "socket.h"
+#include "util.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------
+
+    namespace socket {
+
+        static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        static ygw::config::ConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+                ygw::config::Config::Lookup("dns.negative_ttl", (uint32_t)30
+                        , "dns negative cache ttl seconds when server gives no SOA");
+
+        static ygw::config::ConfigVar<uint32_t>::ptr g_dns_max_ttl =
+                ygw::config::Config::Lookup("dns.max_ttl", (uint32_t)3600
+                        , "dns cache ttl upper bound seconds");
+
+        static ygw::config::ConfigVar<uint32_t>::ptr g_dns_cache_size =
+                ygw::config::Config::Lookup("dns.cache_size", (uint32_t)10000
+                        , "dns cache max entries");
+
+        static const uint16_t kTypeA = 1;
+        static const uint16_t kTypeSOA = 6;
+        static const uint16_t kTypeAAAA = 28;
+        static const uint16_t kClassIN = 1;
+        static const size_t kHeaderSize = 12;
+
+        //------------------------------------------------------------------------------------------
+        //              报文编解码
+        //------------------------------------------------------------------------------------------
+
+        static uint16_t ReadU16(const uint8_t* p)
+        {
+            return (uint16_t)((p[0] << 8) | p[1]);
+        }
+
+        static uint32_t ReadU32(const uint8_t* p)
+        {
+            return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+                | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+        }
+
+        static void WriteU16(std::string& out, uint16_t v)
+        {
+            out.push_back((char)(v >> 8));
+            out.push_back((char)(v & 0xff));
+        }
+
+        // 编码查询报文, 域名不合法返回false
+        static bool BuildQuery(std::string& out, uint16_t id, const std::string& name, uint16_t qtype)
+        {
+            if (name.empty() || name.size() > 253)
+            {
+                return false;
+            }
+            out.clear();
+            WriteU16(out, id);
+            WriteU16(out, 0x0100);  //RD: 请求递归
+            WriteU16(out, 1);       //QDCOUNT
+            WriteU16(out, 0);
+            WriteU16(out, 0);
+            WriteU16(out, 0);
+
+            size_t begin = 0;
+            while (begin < name.size())
+            {
+                size_t end = name.find('.', begin);
+                if (end == std::string::npos)
+                {
+                    end = name.size();
+                }
+                size_t len = end - begin;
+                if (len == 0 || len > 63)
+                {
+                    return false;
+                }
+                out.push_back((char)len);
+                out.append(name, begin, len);
+                begin = end + 1;
+            }
+            out.push_back('\0');
+            WriteU16(out, qtype);
+            WriteU16(out, kClassIN);
+            return true;
+        }
+
+        // 跳过报文中的域名(可能是压缩指针), 返回域名之后的位置, 越界返回0
+        static size_t SkipName(const uint8_t* data, size_t size, size_t pos)
+        {
+            while (pos < size)
+            {
+                uint8_t len = data[pos];
+                if ((len & 0xc0) == 0xc0)
+                {
+                    return pos + 2 <= size ? pos + 2 : 0;
+                }
+                if (len == 0)
+                {
+                    return pos + 1;
+                }
+                pos += len + 1;
+            }
+            return 0;
+        }
+
+        // 应答的问题部分必须和查询一致(域名不区分大小写), 返回问题部分之后的位置, 不一致返回0
+        static size_t MatchQuestion(const uint8_t* data, size_t size, const std::string& query)
+        {
+            size_t qlen = query.size() - kHeaderSize;
+            if (ReadU16(data + 4) != 1 || size < kHeaderSize + qlen)
+            {
+                return 0;
+            }
+            const uint8_t* q = (const uint8_t*)query.data() + kHeaderSize;
+            const uint8_t* r = data + kHeaderSize;
+            //QNAME按字节比较, 标签长度不超过63, 不受tolower影响; 压缩指针不会和查询一致
+            for (size_t i = 0; i < qlen - 4; ++i)
+            {
+                if (::tolower(q[i]) != ::tolower(r[i]))
+                {
+                    return 0;
+                }
+            }
+            //QTYPE和QCLASS
+            if (memcmp(q + qlen - 4, r + qlen - 4, 4) != 0)
+            {
+                return 0;
+            }
+            return kHeaderSize + qlen;
+        }
+
+        /**
+         * @brief 解析应答报文
+         * @param[in] query 本次查询的报文, 应答的id和问题部分必须与之一致
+         * @param[in] qtype 查询的记录类型
+         * @param[out] addrs 应答中qtype类型的地址
+         * @param[out] ttl 缓存时间秒, 地址取最小的TTL, 否定应答取SOA的minimum
+         * @retval 1 得到有效应答
+         * @retval 0 报文不属于本次查询
+         * @retval -1 服务器失败, 需要换服务器
+         */
+        static int ParseResponse(const uint8_t* data, size_t size, const std::string& query
+                ,uint16_t qtype, std::vector<IPAddress::ptr>& addrs, uint32_t& ttl)
+        {
+            if (size < kHeaderSize || ReadU16(data) != ReadU16((const uint8_t*)query.data()))
+            {
+                return 0;
+            }
+            uint16_t flags = ReadU16(data + 2);
+            if (!(flags & 0x8000))
+            {
+                return 0;
+            }
+            //只匹配id时伪造者猜中16位id即可投毒, 问题部分也要一致
+            size_t pos = MatchQuestion(data, size, query);
+            if (!pos)
+            {
+                return 0;
+            }
+            uint16_t rcode = flags & 0x000f;
+            if (rcode != 0 && rcode != 3) //不是NOERROR/NXDOMAIN, 换服务器
+            {
+                return -1;
+            }
+
+            uint16_t ancount = ReadU16(data + 6);
+            uint16_t nscount = ReadU16(data + 8);
+
+            uint32_t min_ttl = (uint32_t)-1;
+            uint32_t soa_ttl = (uint32_t)-1;
+            for (uint32_t i = 0; i < (uint32_t)ancount + nscount; ++i)
+            {
+                pos = SkipName(data, size, pos);
+                if (!pos || pos + 10 > size)
+                {
+                    break;
+                }
+                uint16_t type = ReadU16(data + pos);
+                uint16_t klass = ReadU16(data + pos + 2);
+                uint32_t rttl = ReadU32(data + pos + 4);
+                uint16_t rdlen = ReadU16(data + pos + 8);
+                pos += 10;
+                if (pos + rdlen > size)
+                {
+                    break;
+                }
+                const uint8_t* rdata = data + pos;
+                if (i < ancount && klass == kClassIN && type == qtype)
+                {
+                    //CNAME链上的A/AAAA都在answer中, 直接收集
+                    if (type == kTypeA && rdlen == 4)
+                    {
+                        sockaddr_in addr;
+                        memset(&addr, 0, sizeof(addr));
+                        addr.sin_family = AF_INET;
+                        memcpy(&addr.sin_addr, rdata, 4);
+                        addrs.push_back(std::make_shared<IPv4Address>(addr));
+                        min_ttl = std::min(min_ttl, rttl);
+                    }
+                    else if (type == kTypeAAAA && rdlen == 16)
+                    {
+                        addrs.push_back(std::make_shared<IPv6Address>(rdata));
+                        min_ttl = std::min(min_ttl, rttl);
+                    }
+                }
+                else if (i >= ancount && type == kTypeSOA)
+                {
+                    //mname, rname, serial, refresh, retry, expire, minimum
+                    size_t p = SkipName(data, size, pos);
+                    p = p ? SkipName(data, size, p) : 0;
+                    if (p && p + 20 <= pos + rdlen)
+                    {
+                        soa_ttl = std::min(rttl, ReadU32(data + p + 16));
+                    }
+                }
+                pos += rdlen;
+            }
+
+            if (!addrs.empty())
+            {
+                ttl = min_ttl;
+            }
+            else
+            {
+                ttl = soa_ttl != (uint32_t)-1 ? soa_ttl : g_dns_negative_ttl->GetValue();
+            }
+            return 1;
+        }
+
+        // 复制一份地址, 缓存中的地址不能交给调用方修改端口
+        static IPAddress::ptr CloneAddress(const IPAddress::ptr& addr)
+        {
+            return std::dynamic_pointer_cast<IPAddress>(
+                    Address::Create(addr->GetAddr(), addr->GetAddrLen()));
+        }
+
+        // 数字地址直接转换, 不是数字地址返回nullptr
+        static IPAddress::ptr ParseNumeric(const std::string& name)
+        {
+            sockaddr_in addr4;
+            memset(&addr4, 0, sizeof(addr4));
+            if (inet_pton(AF_INET, name.c_str(), &addr4.sin_addr) == 1)
+            {
+                addr4.sin_family = AF_INET;
+                return std::make_shared<IPv4Address>(addr4);
+            }
+            sockaddr_in6 addr6;
+            memset(&addr6, 0, sizeof(addr6));
+            if (inet_pton(AF_INET6, name.c_str(), &addr6.sin6_addr) == 1)
+            {
+                addr6.sin6_family = AF_INET6;
+                return std::make_shared<IPv6Address>(addr6);
+            }
+            return nullptr;
+        }
+
+        static bool MatchFamily(const IPAddress::ptr& addr, int family)
+        {
+            return family == AF_UNSPEC || addr->GetFamily() == family;
+        }
+
+        //------------------------------------------------------------------------------------------
+        //              class DnsResolver method
+        //------------------------------------------------------------------------------------------
+
+        DnsResolver::DnsResolver()
+            :timeout_ms_(5000)
+            ,attempts_(2)
+            ,hosts_file_("/etc/hosts")
+        {
+            LoadResolvConf("/etc/resolv.conf");
+            if (nameservers_.empty())
+            {
+                nameservers_.push_back(std::make_shared<IPv4Address>(INADDR_LOOPBACK, 53));
+            }
+            ReloadHosts();
+        }
+
+        DnsResolver::DnsResolver(const std::vector<IPAddress::ptr>& nameservers
+                ,const std::string& hosts_file)
+            :timeout_ms_(5000)
+            ,attempts_(2)
+            ,hosts_file_(hosts_file)
+        {
+            for (auto& i : nameservers)
+            {
+                IPAddress::ptr addr = CloneAddress(i);
+                if (!addr->GetPort())
+                {
+                    addr->SetPort(53);
+                }
+                nameservers_.push_back(addr);
+            }
+            ReloadHosts();
+        }
+
+        void DnsResolver::LoadResolvConf(const std::string& path)
+        {
+            std::ifstream ifs(path);
+            std::string line;
+            while (std::getline(ifs, line))
+            {
+                std::stringstream ss(line);
+                std::string key;
+                ss >> key;
+                if (key == "nameserver")
+                {
+                    std::string value;
+                    ss >> value;
+                    IPAddress::ptr addr = ParseNumeric(value);
+                    if (addr)
+                    {
+                        addr->SetPort(53);
+                        nameservers_.push_back(addr);
+                    }
+                }
+                else if (key == "options")
+                {
+                    std::string opt;
+                    while (ss >> opt)
+                    {
+                        if (opt.compare(0, 8, "timeout:") == 0)
+                        {
+                            timeout_ms_ = std::max(1, atoi(opt.c_str() + 8)) * 1000;
+                        }
+                        else if (opt.compare(0, 9, "attempts:") == 0)
+                        {
+                            attempts_ = std::max(1, atoi(opt.c_str() + 9));
+                        }
+                    }
+                }
+            }
+        }
+
+        void DnsResolver::ReloadHosts()
+        {
+            std::unordered_map<std::string, std::vector<IPAddress::ptr> > hosts;
+            if (!hosts_file_.empty())
+            {
+                std::ifstream ifs(hosts_file_);
+                std::string line;
+                while (std::getline(ifs, line))
+                {
+                    size_t comment = line.find('#');
+                    if (comment != std::string::npos)
+                    {
+                        line.resize(comment);
+                    }
+                    std::stringstream ss(line);
+                    std::string ip;
+                    ss >> ip;
+                    IPAddress::ptr addr = ParseNumeric(ip);
+                    if (!addr)
+                    {
+                        continue;
+                    }
+                    std::string name;
+                    while (ss >> name)
+                    {
+                        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                        hosts[name].push_back(addr);
+                    }
+                }
+            }
+            thread::RWMutex::WriteLock lock(hosts_mutex_);
+            hosts_.swap(hosts);
+        }
+
+        void DnsResolver::ClearCache()
+        {
+            for (auto& shard : shards_)
+            {
+                MutexType::Lock lock(shard.mutex);
+                shard.cache.clear();
+            }
+        }
+
+        DnsResolver::Status DnsResolver::Resolve(std::vector<IPAddress::ptr>& result, const std::string& name
+                ,int family)
+        {
+            IPAddress::ptr numeric = ParseNumeric(name);
+            if (numeric)
+            {
+                if (!MatchFamily(numeric, family))
+                {
+                    return kNegative;
+                }
+                result.push_back(numeric);
+                return kAnswer;
+            }
+
+            std::string key = name;
+            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+            if (!key.empty() && key.back() == '.')
+            {
+                key.pop_back();
+            }
+
+            {
+                thread::RWMutex::ReadLock lock(hosts_mutex_);
+                auto it = hosts_.find(key);
+                if (it != hosts_.end())
+                {
+                    size_t old_size = result.size();
+                    for (auto& i : it->second)
+                    {
+                        if (MatchFamily(i, family))
+                        {
+                            result.push_back(CloneAddress(i));
+                        }
+                    }
+                    if (result.size() != old_size)
+                    {
+                        return kAnswer;
+                    }
+                }
+            }
+
+            //任一类型有地址即为有地址, 否则只要有一个类型没有应答就不能确定不存在
+            bool answer = false;
+            bool unknown = false;
+            auto merge = [&answer, &unknown](Status v) {
+                answer = answer || v == kAnswer;
+                unknown = unknown || v == kNoAnswer;
+            };
+            if (family == AF_INET || family == AF_UNSPEC)
+            {
+                merge(ResolveType(result, key, kTypeA));
+            }
+            if (family == AF_INET6 || family == AF_UNSPEC)
+            {
+                merge(ResolveType(result, key, kTypeAAAA));
+            }
+            if (answer)
+            {
+                return kAnswer;
+            }
+            return unknown ? kNoAnswer : kNegative;
+        }
+
+        DnsResolver::Status DnsResolver::ToStatus(std::vector<IPAddress::ptr>& result, const Entry& entry)
+        {
+            for (auto& i : entry.addrs)
+            {
+                result.push_back(CloneAddress(i));
+            }
+            if (!entry.addrs.empty())
+            {
+                return kAnswer;
+            }
+            return entry.answered ? kNegative : kNoAnswer;
+        }
+
+        DnsResolver::Status DnsResolver::ResolveType(std::vector<IPAddress::ptr>& result, const std::string& name
+                ,uint16_t qtype)
+        {
+            std::string key = name + (qtype == kTypeA ? "#A" : "#AAAA");
+            Shard& shard = shards_[std::hash<std::string>()(key) % kShardCount];
+
+            Inflight::ptr inflight;
+            bool leader = false;
+            {
+                MutexType::Lock lock(shard.mutex);
+                auto it = shard.cache.find(key);
+                if (it != shard.cache.end())
+                {
+                    if (it->second.expire > util::TimeUtil::GetMonotonicMS())
+                    {
+                        return ToStatus(result, it->second);
+                    }
+                    shard.cache.erase(it);
+                }
+
+                auto& slot = shard.inflight[key];
+                if (!slot)
+                {
+                    slot = std::make_shared<Inflight>();
+                    leader = true;
+                }
+                inflight = slot;
+            }
+
+            if (leader)
+            {
+                Entry entry;
+                Query(entry, name, qtype);
+                Complete(shard, key, inflight, std::move(entry));
+            }
+            else if (scheduler::Scheduler::IsInTaskFiber())
+            {
+                //切出后再登记, 查询协程在别的线程完成时不会调度到还没切出的协程
+                scheduler::Scheduler* sched = scheduler::Scheduler::GetThis();
+                scheduler::Fiber::ptr self = scheduler::Fiber::GetThis();
+                scheduler::Scheduler::YieldToHoldThen([&shard, &inflight, sched, self]() {
+                    MutexType::Lock lock(shard.mutex);
+                    if (inflight->done)
+                    {
+                        lock.unlock();
+                        sched->Schedule(self);
+                        return;
+                    }
+                    inflight->waiters.push_back(std::make_pair(sched, self));
+                });
+            }
+            else
+            {
+                //不在协程中无法挂起等待, 自己查一次
+                Entry entry;
+                Query(entry, name, qtype);
+                return ToStatus(result, entry);
+            }
+
+            return ToStatus(result, inflight->entry);
+        }
+
+        void DnsResolver::Complete(Shard& shard, const std::string& key, Inflight::ptr inflight
+                ,Entry&& entry)
+        {
+            std::vector<std::pair<scheduler::Scheduler*, scheduler::Fiber::ptr> > waiters;
+            {
+                MutexType::Lock lock(shard.mutex);
+                uint64_t now = util::TimeUtil::GetMonotonicMS();
+                if (entry.expire > now)
+                {
+                    size_t max_size = std::max<size_t>(g_dns_cache_size->GetValue() / kShardCount, 1);
+                    if (shard.cache.size() >= max_size)
+                    {
+                        for (auto it = shard.cache.begin(); it != shard.cache.end();)
+                        {
+                            if (it->second.expire <= now)
+                            {
+                                it = shard.cache.erase(it);
+                            }
+                            else
+                            {
+                                ++it;
+                            }
+                        }
+                        if (shard.cache.size() >= max_size)
+                        {
+                            shard.cache.erase(shard.cache.begin());
+                        }
+                    }
+                    shard.cache[key] = entry;
+                }
+                inflight->entry = std::move(entry);
+                inflight->done = true;
+                inflight->waiters.swap(waiters);
+                shard.inflight.erase(key);
+            }
+            for (auto& i : waiters)
+            {
+                i.first->Schedule(i.second);
+            }
+        }
+
+        void DnsResolver::Query(Entry& entry, const std::string& name, uint16_t qtype)
+        {
+            for (uint32_t attempt = 0; attempt < attempts_; ++attempt)
+            {
+                for (auto& server : nameservers_)
+                {
+                    if (QueryOne(entry, server, name, qtype))
+                    {
+                        return;
+                    }
+                }
+            }
+            YGW_LOG_DEBUG(g_logger) << "DnsResolver::Query(" << name << ", " << qtype
+                << ") no server answered";
+        }
+
+        int DnsResolver::QueryOne(Entry& entry, IPAddress::ptr server, const std::string& name
+                ,uint16_t qtype)
+        {
+            static thread_local std::mt19937 s_random(std::random_device{}());
+            uint16_t id = (uint16_t)s_random();
+            std::string query;
+            if (!BuildQuery(query, id, name, qtype))
+            {
+                //域名不合法, 当作不存在
+                entry.expire = util::TimeUtil::GetMonotonicMS() + g_dns_negative_ttl->GetValue() * 1000ull;
+                entry.answered = true;
+                return 1;
+            }
+
+            //每次查询新建socket, connect时内核随机分配源端口, 和随机id一起防止应答被伪造.
+            //connect之后只收这个服务器的应答, 端口不可达也能立即返回错误
+            Socket::ptr sock = Socket::CreateUDP(server);
+            if (!sock->Connect(server))
+            {
+                return 0;
+            }
+            sock->SetRecvTimeout(timeout_ms_);
+            ++query_count_;
+            if (sock->Send(query.data(), query.size()) != (int)query.size())
+            {
+                return 0;
+            }
+
+            uint8_t buf[1500];
+            while (true)
+            {
+                int n = sock->Recv(buf, sizeof(buf));
+                if (n <= 0)
+                {
+                    YGW_LOG_DEBUG(g_logger) << "DnsResolver query " << name << " to "
+                        << server->ToString() << " errno=" << errno << " errstr=" << strerror(errno);
+                    return 0;
+                }
+                std::vector<IPAddress::ptr> addrs;
+                uint32_t ttl = 0;
+                int rt = ParseResponse(buf, n, query, qtype, addrs, ttl);
+                if (rt == 0) //不是本次查询的应答, 继续等
+                {
+                    continue;
+                }
+                if (rt < 0)
+                {
+                    return 0;
+                }
+                ttl = std::min(ttl, g_dns_max_ttl->GetValue());
+                entry.addrs.swap(addrs);
+                entry.expire = util::TimeUtil::GetMonotonicMS() + ttl * 1000ull;
+                entry.answered = true;
+                return 1;
+            }
+        }
+
+        //------------------------------------------------------------------------------------------
+
+    } // namespace socket
+
+    //------------------------------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,214 @@
+/**
+ * @file dns.h
+ * @brief 协程DNS解析器, 带TTL缓存
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-09-23
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_DNS_H__
+#define __YGW_DNS_H__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "address.h"
+#include "base/fiber.h"
+#include "base/mutex.h"
+#include "base/scheduler.h"
+#include "singleton.h"
+
+namespace ygw {
+
+    //------------------------------------------------------------------
+
+    namespace socket {
+
+        //------------------------------------------------------------------
+
+        /**
+         * @brief DNS解析器
+         * @details getaddrinfo没有被hook, 会卡住整个IO线程. 解析器先查hosts文件,
+         *          再通过hook过的UDP socket向resolv.conf中的服务器查询, 查询期间只挂起当前协程.
+         *          结果按TTL缓存在分片缓存中, 查不到的域名也缓存一段时间(负缓存),
+         *          同一域名同时只有一个查询在途, 其余协程等待这次查询的结果
+         */
+        class DnsResolver
+        {
+        public:
+            using ptr = std::shared_ptr<DnsResolver>;
+            using MutexType = thread::Mutex;
+
+            /**
+             * @brief 解析结果
+             */
+            enum Status {
+                /// 解析出地址
+                kAnswer = 0,
+                /// 确定没有地址: 服务器否定应答(NXDOMAIN/NODATA)或者命中负缓存
+                kNegative = 1,
+                /// 没有服务器应答(超时, 服务器失败等), 结果未知
+                kNoAnswer = 2,
+            };
+
+            /**
+             * @brief 构造函数, 读取/etc/hosts和/etc/resolv.conf
+             */
+            DnsResolver();
+
+            /**
+             * @brief 构造函数
+             * @param[in] nameservers DNS服务器地址(端口为0时使用53)
+             * @param[in] hosts_file hosts文件路径, 为空不读取
+             */
+            DnsResolver(const std::vector<IPAddress::ptr>& nameservers
+                    ,const std::string& hosts_file = "");
+
+            /**
+             * @brief 解析域名
+             * @param[out] result 解析出的地址(端口为0), 追加在末尾
+             * @param[in] name 域名或者数字地址
+             * @param[in] family AF_INET查A记录, AF_INET6查AAAA记录, AF_UNSPEC两者都查
+             * @return 解析结果, AF_UNSPEC时任一类型有地址即为kAnswer,
+             *         都没有地址时只要有一个类型没有应答即为kNoAnswer
+             */
+            Status Resolve(std::vector<IPAddress::ptr>& result, const std::string& name
+                    ,int family = AF_INET);
+
+            /**
+             * @brief 重新读取hosts文件
+             */
+            void ReloadHosts();
+
+            /**
+             * @brief 清空缓存
+             */
+            void ClearCache();
+
+            /**
+             * @brief 设置单次查询超时时间(毫秒)
+             */
+            void SetTimeout(uint64_t v) { timeout_ms_ = v; }
+
+            /**
+             * @brief 设置每个服务器的尝试次数
+             */
+            void SetAttempts(uint32_t v) { attempts_ = v; }
+
+            /**
+             * @brief 已发出的查询数
+             */
+            uint64_t GetQueryCount() const { return query_count_; }
+
+            /**
+             * @brief 服务器列表
+             */
+            const std::vector<IPAddress::ptr>& GetNameservers() const { return nameservers_; }
+        private:
+            /**
+             * @brief 缓存项
+             */
+            struct Entry
+            {
+                /// 解析结果, 为空表示负缓存
+                std::vector<IPAddress::ptr> addrs;
+                /// 过期时间(单调时钟毫秒)
+                uint64_t expire = 0;
+                /// 是否得到应答(包括否定应答), 没有应答时不缓存
+                bool answered = false;
+            };
+
+            /**
+             * @brief 在途的查询
+             */
+            struct Inflight
+            {
+                using ptr = std::shared_ptr<Inflight>;
+                /// 查询是否完成
+                bool done = false;
+                /// 查询结果
+                Entry entry;
+                /// 等待结果的协程
+                std::vector<std::pair<scheduler::Scheduler*, scheduler::Fiber::ptr> > waiters;
+            };
+
+            /**
+             * @brief 缓存分片, 按key的哈希分散锁竞争
+             */
+            struct Shard
+            {
+                MutexType mutex;
+                std::unordered_map<std::string, Entry> cache;
+                std::unordered_map<std::string, Inflight::ptr> inflight;
+            };
+
+            static constexpr size_t kShardCount = 16;
+
+            /**
+             * @brief 读取resolv.conf
+             */
+            void LoadResolvConf(const std::string& path);
+
+            /**
+             * @brief 查询单个记录类型, 走缓存和在途合并
+             * @param[in] qtype 1:A 28:AAAA
+             */
+            Status ResolveType(std::vector<IPAddress::ptr>& result, const std::string& name, uint16_t qtype);
+
+            /**
+             * @brief 依次向服务器发出查询
+             * @param[out] entry 查询结果和过期时间
+             */
+            void Query(Entry& entry, const std::string& name, uint16_t qtype);
+
+            /**
+             * @brief 向单个服务器发出一次查询
+             * @retval 1 得到应答(包括域名不存在)
+             * @retval 0 超时或者服务器失败, 换下一个服务器
+             */
+            int QueryOne(Entry& entry, IPAddress::ptr server, const std::string& name, uint16_t qtype);
+
+            /**
+             * @brief 把查询结果追加到result并转换成解析结果
+             */
+            static Status ToStatus(std::vector<IPAddress::ptr>& result, const Entry& entry);
+
+            /**
+             * @brief 把结果写入缓存, 唤醒等待的协程
+             */
+            void Complete(Shard& shard, const std::string& key, Inflight::ptr inflight, Entry&& entry);
+        private:
+            /// DNS服务器
+            std::vector<IPAddress::ptr> nameservers_;
+            /// 单次查询超时时间毫秒
+            uint64_t timeout_ms_;
+            /// 每个服务器的尝试次数
+            uint32_t attempts_;
+            /// hosts文件路径
+            std::string hosts_file_;
+            /// hosts文件的内容, 读写锁保护
+            thread::RWMutex hosts_mutex_;
+            std::unordered_map<std::string, std::vector<IPAddress::ptr> > hosts_;
+            /// 缓存分片
+            Shard shards_[kShardCount];
+            /// 已发出的查询数
+            std::atomic<uint64_t> query_count_ {0};
+        }; // class DnsResolver
+
+        /// 全局DNS解析器
+        using DnsResolverMgr = mode::Singleton<DnsResolver>;
+
+        //------------------------------------------------------------------
+
+    } // namespace socket
+
+    //------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_DNS_H__
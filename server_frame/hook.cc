@@ -15,13 +15,17 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 
 #include <memory>
 
 #include "config.h" // log.h 在里面包含了 
+#include "base/block_detector.h"
+#include "base/blocking_executor.h"
 #include "base/fd_manager.h"
 #include "hook.h"
 #include "iomanager.h"
@@ -38,6 +42,13 @@ namespace ygw {
         static ygw::config::ConfigVar<int>::ptr g_tcp_connect_timeout =
                 ygw::config::Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
 
+        static ygw::config::ConfigVar<int>::ptr g_tcp_timeout_slack =
+                ygw::config::Config::Lookup("tcp.timeout.slack", 0, "tcp recv/send timeout slack ms");
+
+        static ygw::config::ConfigVar<bool>::ptr g_offload_file_io =
+                ygw::config::Config::Lookup("blocking.offload_file_io", false
+                        , "route regular file read/write/fsync/stat to blocking executor");
+
         static thread_local bool t_hook_enable = false;
 
 #define HOOK_FUNC(XX) \
@@ -47,16 +58,27 @@ namespace ygw {
         XX(socket) \
         XX(connect) \
         XX(accept) \
+        XX(accept4) \
         XX(read) \
         XX(readv) \
         XX(recv) \
         XX(recvfrom) \
         XX(recvmsg) \
+        XX(recvmmsg) \
+        XX(pread) \
         XX(write) \
         XX(writev) \
         XX(send) \
         XX(sendto) \
         XX(sendmsg) \
+        XX(sendmmsg) \
+        XX(pwrite) \
+        XX(sendfile) \
+        XX(splice) \
+        XX(fsync) \
+        XX(fdatasync) \
+        XX(stat) \
+        XX(lstat) \
         XX(close) \
         XX(fcntl) \
         XX(ioctl) \
@@ -78,6 +100,10 @@ namespace ygw {
 
         //---------------------------------
         static uint64_t s_connect_timeout = -1;
+        /// SO_RCVTIMEO/SO_SNDTIMEO超时允许推迟的时间, 空闲超时不需要精确, 对齐后合并唤醒
+        static uint64_t s_timeout_slack = 0;
+        /// 普通文件的读写/fsync/stat是否交给阻塞任务执行器, 避免卡住IO线程
+        static bool s_offload_file_io = false;
         class _HookIniter 
         {
         public:
@@ -91,6 +117,20 @@ namespace ygw {
                     << old_value << " to " << new_value;
                     s_connect_timeout = new_value;
                 });
+
+                s_timeout_slack = g_tcp_timeout_slack->GetValue();
+                g_tcp_timeout_slack->AddListener( [] (const int& old_value, const int& new_value) {
+                    YGW_LOG_INFO(g_logger) << "tcp timeout slack changed from "
+                    << old_value << " to " << new_value;
+                    s_timeout_slack = new_value;
+                });
+
+                s_offload_file_io = g_offload_file_io->GetValue();
+                g_offload_file_io->AddListener( [] (const bool& old_value, const bool& new_value) {
+                    YGW_LOG_INFO(g_logger) << "blocking offload file io changed from "
+                    << old_value << " to " << new_value;
+                    s_offload_file_io = new_value;
+                });
             }
         }; // class _HookIniter
         static _HookIniter s_hook_initer;
@@ -105,6 +145,29 @@ namespace ygw {
         {
             t_hook_enable = flag;
         }
+
+        /**
+         * @brief 当前调用是否需要交给阻塞任务执行器
+         * @details 只在调度器的任务协程中转交, 调度协程/idle协程挂起会卡死调度
+         */
+        static bool ShouldOffload()
+        {
+            return t_hook_enable && s_offload_file_io
+                && ygw::scheduler::Scheduler::IsInTaskFiber();
+        }
+
+        /**
+         * @brief fd是否普通文件且需要转交执行器
+         */
+        static bool ShouldOffloadFd(int fd)
+        {
+            if (!ShouldOffload())
+            {
+                return false;
+            }
+            struct stat st;
+            return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        }
         
 //#undef HOOK_FUNC
 
@@ -121,10 +184,26 @@ namespace ygw {
 //-----------------------------------------------------------------
 //                      io操作模板函数
 //-----------------------------------------------------------------
-struct TimerInfo
+//协程挂起后可能在其他线程恢复, 编译器会复用挂起前算出的errno地址,
+//恢复后必须经过不内联的函数重新取当前线程的errno
+static __attribute__((noinline)) void SetErrno(int err)
 {
-    int cancelled = 0;;
-};
+    errno = err;
+}
+
+//在阻塞任务执行器中调用, 挂起当前协程直到完成, errno带回调用方
+template<typename Ret, typename Func>
+static Ret OffloadCall(Func&& func)
+{
+    Ret rt;
+    int err = 0;
+    ygw::scheduler::RunBlocking([&rt, &err, &func]() {
+        rt = func();
+        err = errno;
+    });
+    SetErrno(err);
+    return rt;
+}
 
 template<typename OriginFunc, typename ... Args>
 static ssize_t DoIo(
@@ -142,8 +221,13 @@ static ssize_t DoIo(
 
     //获取对应fd的文件上下文
     ygw::handle::FdContext::ptr ctx = ygw::handle::FdManager::GetInstance()->Get(fd);
-    if (!ctx)//获取失败就调用原来的函数
+    if (!ctx)//获取失败就调用原来的函数, 普通文件可能交给阻塞任务执行器
     {
+        if (ygw::hook::ShouldOffloadFd(fd))
+        {
+            return OffloadCall<ssize_t>([&]() { return func(fd, args...); });
+        }
+        ygw::scheduler::BlockGuard guard(hook_func_name);
         return func(fd, std::forward<Args>(args)...);
     }
 
@@ -157,12 +241,20 @@ static ssize_t DoIo(
     //如果文件不是套接字文件或者 是用户设置了非阻塞，就调用原来的函数
     if (!ctx->IsSocket() || ctx->IsUserNonblock())
     {
+        if (!ctx->IsSocket())
+        {
+            if (ygw::hook::ShouldOffloadFd(fd))
+            {
+                return OffloadCall<ssize_t>([&]() { return func(fd, args...); });
+            }
+            ygw::scheduler::BlockGuard guard(hook_func_name);
+            return func(fd, std::forward<Args>(args)...);
+        }
         return func(fd, std::forward<Args>(args)...);
     }
 
     //获取超时毫秒
     uint64_t to = ctx->GetTimeout(timeout_so);
-    std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
 
 
 retry:
@@ -177,31 +269,25 @@ retry:
     if (n == -1 && errno == EAGAIN) //执行失败且，需要再来一次
     {
         ygw::scheduler::IOManager* iom = ygw::scheduler::IOManager::GetThis();
-        ygw::timer::Timer::ptr timer;
-        std::weak_ptr<TimerInfo> winfo(tinfo);
+        //等待结果在本协程栈上, 超时节点内嵌在fd的事件上下文中, 整个等待不分配内存
+        int wait_result = 0;
 
-        if (to != static_cast<uint64_t>(-1))//如果获取超时毫秒成功
+        //其他线程正在关闭句柄, 不再注册事件
+        if (ctx->IsClose())
         {
-            timer = iom->AddConditionTimer(to, [winfo, fd, iom, event]() {
-                auto t = winfo.lock();      //拿出条件尝试唤醒
-                if (!t || t->cancelled)     //如果没有条件 或者 设置了错误
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;   //将s错误设置为超时
-                iom->CancelEvent(fd, (ygw::scheduler::IOManager::Event)(event)); //取消事件
-            }, winfo);//添加条件定时器
+            errno = EBADF;
+            return -1;
         }
 
         //添加事件， 不传回调函数，就是把当前协程作为事件唤醒对象
-        int rt = iom->AddEvent(fd, (ygw::scheduler::IOManager::Event)(event));
+        int rt = iom->AddEvent(fd, (ygw::scheduler::IOManager::Event)(event)
+                ,nullptr, to, &wait_result, ygw::hook::s_timeout_slack);
         if (YGW_UNLIKELY(rt)) //添加失败
         {
-            YGW_LOG_ERROR(g_logger) << hook_func_name << " AddEvent("
-                << fd << ", " << event << ")";
-            if (timer)//有设定定时器就取消掉
+            if (!ctx->IsClose())
             {
-                timer->Cancel();
+                YGW_LOG_ERROR(g_logger) << hook_func_name << " AddEvent("
+                    << fd << ", " << event << ")";
             }
             return -1;
         }
@@ -209,14 +295,16 @@ retry:
         {
             ygw::scheduler::Fiber::YieldToHold();//让出资源
 
-            if (timer)              //如果有设定定时器就取消掉
+            if (wait_result)  //被超时唤醒, 事件已从epoll中移除
             {
-                timer->Cancel();
+                SetErrno(wait_result);
+                return -1;         //直接返回 -1
             }
-            if (tinfo->cancelled)  //cancelled有值就说明超时了
+
+            if (ctx->IsClose())  //被close唤醒, 句柄可能已被复用, 不能再重试
             {
-                errno = tinfo->cancelled;
-                return -1;         //直接返回 -1
+                errno = EBADF;
+                return -1;
             }
 
             goto retry;             //没操作完或者出错了就回到retry再次操作
@@ -239,6 +327,22 @@ extern "C" {
     //-----------------------------------------------------------------------
     //                          Sleep
     //-----------------------------------------------------------------------
+    //整毫秒走分片的毫秒定时器, 否则走timerfd驱动的微秒定时器
+    static void SleepUs(ygw::scheduler::IOManager* iom, ygw::scheduler::Fiber::ptr fiber, uint64_t us)
+    {
+        auto cb = std::bind((void(ygw::scheduler::Scheduler::*)
+                    (ygw::scheduler::Fiber::ptr, int thread))&ygw::scheduler::IOManager::Schedule
+                , iom, fiber, -1);
+        if (us % 1000 == 0) 
+        {
+            iom->AddTimer(us / 1000, cb);
+        } 
+        else 
+        {
+            iom->AddTimerUs(us, cb);
+        }
+    }
+
     unsigned int sleep(unsigned int seconds) 
     {
         if (!ygw::hook::t_hook_enable) 
@@ -271,9 +375,7 @@ extern "C" {
         //iom->AddTimer(usec / 1000, [iom, fiber](){
         //    iom->Schedule(fiber);
         //});
-        iom->AddTimer(usec / 1000, std::bind((void(ygw::scheduler::Scheduler::*)
-                        (ygw::scheduler::Fiber::ptr, int thread))&ygw::scheduler::IOManager::Schedule
-                    , iom, fiber, -1));
+        SleepUs(iom, fiber, usec);
         ygw::scheduler::Fiber::YieldToHold();
         return 0;
     }
@@ -285,15 +387,14 @@ extern "C" {
             return nanosleep_f(req, rem);
         }
 
-        int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+        //不足1微秒的部分向上取整, 不会比请求的时间睡得短
+        uint64_t timeout_us = req->tv_sec * 1000000ull + (req->tv_nsec + 999) / 1000;
         ygw::scheduler::Fiber::ptr fiber = ygw::scheduler::Fiber::GetThis();
         ygw::scheduler::IOManager* iom = ygw::scheduler::IOManager::GetThis(); 
         //iom->AddTimer(timeout_ms, [iom, fiber](){
         //    iom->Schedule(fiber);
         //});
-        iom->AddTimer(timeout_ms, std::bind((void(ygw::scheduler::Scheduler::*)
-                        (ygw::scheduler::Fiber::ptr, int thread))&ygw::scheduler::IOManager::Schedule
-                    , iom, fiber, -1));
+        SleepUs(iom, fiber, timeout_us);
         ygw::scheduler::Fiber::YieldToHold();
         return 0;
     }
@@ -350,43 +451,20 @@ extern "C" {
         }
 
         ygw::scheduler::IOManager* iom = ygw::scheduler::IOManager::GetThis();
-        ygw::timer::Timer::ptr timer;
-        std::shared_ptr<TimerInfo> tinfo(new TimerInfo);
-        std::weak_ptr<TimerInfo> winfo(tinfo);
-
-        if (timeout_ms != (uint64_t)-1) 
-        {
-            timer = iom->AddConditionTimer(timeout_ms, [winfo, fd, iom]() {
-                auto t = winfo.lock();
-                if (!t || t->cancelled) 
-                {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;
-                iom->CancelEvent(fd, ygw::scheduler::IOManager::Event::kWrite);
-            }, winfo);
-        }
-
-        int rt = iom->AddEvent(fd, ygw::scheduler::IOManager::Event::kWrite);
+        int wait_result = 0;
+        int rt = iom->AddEvent(fd, ygw::scheduler::IOManager::Event::kWrite
+                ,nullptr, timeout_ms, &wait_result);
         if (rt == 0) 
         {
             ygw::scheduler::Fiber::YieldToHold();
-            if (timer) 
-            {
-                timer->Cancel();
-            }
-            if (tinfo->cancelled) 
+            if (wait_result) 
             {
-                errno = tinfo->cancelled;
+                SetErrno(wait_result);
                 return -1;
             }
         } 
         else 
         {
-            if (timer) 
-            {
-                timer->Cancel();
-            }
             YGW_LOG_ERROR(g_logger) << "connect addEvent(" << fd << ", WRITE) error";
         }
 
@@ -424,6 +502,21 @@ extern "C" {
 
 
 
+    int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+    {
+        int fd = DoIo(sockfd, accept4_f, "accept4", ygw::scheduler::IOManager::Event::kRead, SO_RCVTIMEO, addr, addrlen, flags);
+        if (fd >= 0)
+        {
+            ygw::handle::FdContext::ptr ctx = ygw::handle::FdManager::GetInstance()->Get(fd, true);
+            if (ctx && (flags & SOCK_NONBLOCK))
+            {
+                //调用方自己要求非阻塞, 不再由hook挂起协程
+                ctx->SetUserNonblock(true);
+            }
+        }
+        return fd;
+    }
+
     ssize_t read(int fd, void *buf, size_t count) 
     {
         return DoIo(fd, read_f, "read", ygw::scheduler::IOManager::Event::kRead, SO_RCVTIMEO, buf, count);
@@ -475,6 +568,92 @@ extern "C" {
         return DoIo(s, sendmsg_f, "sendmsg", ygw::scheduler::IOManager::Event::kWrite, SO_SNDTIMEO, msg, flags);
     }
 
+    int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+    {
+        return DoIo(sockfd, recvmmsg_f, "recvmmsg", ygw::scheduler::IOManager::Event::kRead, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
+    }
+
+    int sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+    {
+        return DoIo(s, sendmmsg_f, "sendmmsg", ygw::scheduler::IOManager::Event::kWrite, SO_SNDTIMEO, msgvec, vlen, flags);
+    }
+
+    ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+    {
+        return DoIo(fd, pread_f, "pread", ygw::scheduler::IOManager::Event::kRead, SO_RCVTIMEO, buf, count, offset);
+    }
+
+    ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+    {
+        return DoIo(fd, pwrite_f, "pwrite", ygw::scheduler::IOManager::Event::kWrite, SO_SNDTIMEO, buf, count, offset);
+    }
+
+    //-----------------------------------------------------------------------
+    //                          File
+    //-----------------------------------------------------------------------
+    int fsync(int fd)
+    {
+        if (ygw::hook::ShouldOffload())
+        {
+            return OffloadCall<int>([fd]() { return fsync_f(fd); });
+        }
+        ygw::scheduler::BlockGuard guard("fsync");
+        return fsync_f(fd);
+    }
+
+    int fdatasync(int fd)
+    {
+        if (ygw::hook::ShouldOffload())
+        {
+            return OffloadCall<int>([fd]() { return fdatasync_f(fd); });
+        }
+        ygw::scheduler::BlockGuard guard("fdatasync");
+        return fdatasync_f(fd);
+    }
+
+    int stat(const char *pathname, struct stat *statbuf)
+    {
+        if (ygw::hook::ShouldOffload())
+        {
+            return OffloadCall<int>([pathname, statbuf]() { return stat_f(pathname, statbuf); });
+        }
+        ygw::scheduler::BlockGuard guard("stat");
+        return stat_f(pathname, statbuf);
+    }
+
+    int lstat(const char *pathname, struct stat *statbuf)
+    {
+        if (ygw::hook::ShouldOffload())
+        {
+            return OffloadCall<int>([pathname, statbuf]() { return lstat_f(pathname, statbuf); });
+        }
+        ygw::scheduler::BlockGuard guard("lstat");
+        return lstat_f(pathname, statbuf);
+    }
+
+    ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+    {
+        //只有输出端是socket, 在输出端上等待可写
+        return DoIo(out_fd, sendfile_f, "sendfile", ygw::scheduler::IOManager::Event::kWrite, SO_SNDTIMEO, in_fd, offset, count);
+    }
+
+    ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)
+    {
+        //splice一端必须是管道, 管道不经过hook; 在socket一端上等待:
+        //输入端是socket等可读, 否则等输出端可写.
+        //管道满/空时应带SPLICE_F_NONBLOCK, 并由同一协程另一次splice排空/填充
+        ygw::handle::FdContext::ptr in_ctx = ygw::handle::FdManager::GetInstance()->Get(fd_in);
+        if (in_ctx && in_ctx->IsSocket())
+        {
+            return DoIo(fd_in, [=](int fd) {
+                        return splice_f(fd, off_in, fd_out, off_out, len, flags);
+                    }, "splice", ygw::scheduler::IOManager::Event::kRead, SO_RCVTIMEO);
+        }
+        return DoIo(fd_out, [=](int fd) {
+                    return splice_f(fd_in, off_in, fd, off_out, len, flags);
+                }, "splice", ygw::scheduler::IOManager::Event::kWrite, SO_SNDTIMEO);
+    }
+
     int close(int fd)
     {
         if (!ygw::hook::t_hook_enable)
@@ -484,6 +663,7 @@ extern "C" {
         ygw::handle::FdContext::ptr ctx = ygw::handle::FdManager::GetInstance()->Get(fd);
         if (ctx)
         {
+            ctx->SetClose();
             auto iom = ygw::scheduler::IOManager::GetThis();
             if (iom)
             {
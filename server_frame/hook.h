@@ -12,7 +12,10 @@
 #define __YGW_HOOK_H__
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <stdint.h>
 
 namespace ygw {
@@ -62,6 +65,10 @@ extern "C" {
     typedef int (*accept_func)(int s, struct sockaddr *addr, socklen_t *addrlen);
     extern accept_func accept_f;
 
+    //accept4
+    typedef int (*accept4_func)(int s, struct sockaddr *addr, socklen_t *addrlen, int flags);
+    extern accept4_func accept4_f;
+
     //read
     typedef ssize_t (*read_func)(int fd, void *buf, size_t count);
     extern read_func read_f;
@@ -82,6 +89,14 @@ extern "C" {
     typedef ssize_t (*recvmsg_func)(int sockfd, struct msghdr *msg, int flags);
     extern recvmsg_func recvmsg_f;
 
+    //recvmmsg
+    typedef int (*recvmmsg_func)(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
+    extern recvmmsg_func recvmmsg_f;
+
+    //pread
+    typedef ssize_t (*pread_func)(int fd, void *buf, size_t count, off_t offset);
+    extern pread_func pread_f;
+
     //write
     typedef ssize_t (*write_func)(int fd, const void *buf, size_t count);
     extern write_func write_f;
@@ -102,6 +117,38 @@ extern "C" {
     typedef ssize_t (*sendmsg_func)(int s, const struct msghdr *msg, int flags);
     extern sendmsg_func sendmsg_f;
 
+    //sendmmsg
+    typedef int (*sendmmsg_func)(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+    extern sendmmsg_func sendmmsg_f;
+
+    //pwrite
+    typedef ssize_t (*pwrite_func)(int fd, const void *buf, size_t count, off_t offset);
+    extern pwrite_func pwrite_f;
+
+    //sendfile
+    typedef ssize_t (*sendfile_func)(int out_fd, int in_fd, off_t *offset, size_t count);
+    extern sendfile_func sendfile_f;
+
+    //splice
+    typedef ssize_t (*splice_func)(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+    extern splice_func splice_f;
+
+    //fsync
+    typedef int (*fsync_func)(int fd);
+    extern fsync_func fsync_f;
+
+    //fdatasync
+    typedef int (*fdatasync_func)(int fd);
+    extern fdatasync_func fdatasync_f;
+
+    //stat
+    typedef int (*stat_func)(const char *pathname, struct stat *statbuf);
+    extern stat_func stat_f;
+
+    //lstat
+    typedef int (*lstat_func)(const char *pathname, struct stat *statbuf);
+    extern lstat_func lstat_f;
+
     //close
     typedef int (*close_func)(int fd);
     extern close_func close_f;
@@ -0,0 +1,176 @@
+/**
+ * @file server_frame/http/asset_cache.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-13
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "asset_cache.h"
+#include "server_frame/log.h"
+#include "server_frame/stream/zlib_stream.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace http {
+
+        static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        AssetCache::AssetCache(uint64_t max_bytes, uint64_t max_file_size, uint64_t min_gzip_size)
+            : max_bytes_(max_bytes)
+            , max_file_size_(max_file_size)
+            , min_gzip_size_(min_gzip_size)
+        {
+        }
+
+        bool AssetCache::IsCompressible(const char* content_type)
+        {
+            if (!content_type)
+            {
+                return false;
+            }
+            return strncmp(content_type, "text/", 5) == 0
+                || strcmp(content_type, "application/javascript") == 0
+                || strcmp(content_type, "application/json") == 0
+                || strcmp(content_type, "image/svg+xml") == 0;
+        }
+
+        AssetCache::Asset::ptr AssetCache::Get(const CachedFile::ptr& file)
+        {
+            if (!file->IsFile() || (uint64_t)file->st.st_size > max_file_size_)
+            {
+                return nullptr;
+            }
+            {
+                MutexType::Lock lock(mutex_);
+                auto it = assets_.find(file->path);
+                if (it != assets_.end())
+                {
+                    const Asset::ptr& asset = *it->second;
+                    if (asset->dev == file->st.st_dev && asset->ino == file->st.st_ino
+                            && asset->size == file->st.st_size && asset->mtime == file->st.st_mtime)
+                    {
+                        lru_.splice(lru_.begin(), lru_, it->second);
+                        ++hits_;
+                        return asset;
+                    }
+                }
+            }
+            ++misses_;
+            Asset::ptr asset = Load(file);
+            if (asset)
+            {
+                Insert(asset);
+            }
+            return asset;
+        }
+
+        AssetCache::Asset::ptr AssetCache::Load(const CachedFile::ptr& file)
+        {
+            std::shared_ptr<std::string> data = std::make_shared<std::string>();
+            data->resize(file->st.st_size);
+            size_t offset = 0;
+            while (offset < data->size())
+            {
+                ssize_t n = pread(file->fd, &(*data)[offset], data->size() - offset, offset);
+                if (n <= 0)
+                {
+                    YGW_LOG_ERROR(g_logger) << "AssetCache pread " << file->path << " n=" << n
+                        << " errno=" << errno << " errstr=" << strerror(errno);
+                    return nullptr;
+                }
+                offset += n;
+            }
+
+            Asset::ptr asset = std::make_shared<Asset>();
+            asset->path = file->path;
+            asset->dev = file->st.st_dev;
+            asset->ino = file->st.st_ino;
+            asset->size = file->st.st_size;
+            asset->mtime = file->st.st_mtime;
+            asset->data = data;
+            if (data->size() >= min_gzip_size_ && IsCompressible(file->content_type))
+            {
+                //只压缩一次, 用最高压缩率
+                auto zs = stream::ZlibStream::Create(true, 64 * 1024, stream::ZlibStream::kGZip
+                        ,stream::ZlibStream::kBestCompression);
+                if (zs->Write(data->c_str(), data->size()) >= 0 && zs->Flush() == 0)
+                {
+                    std::shared_ptr<std::string> gzip = std::make_shared<std::string>(zs->GetResult());
+                    //压缩后没有明显变小就不值得让客户端解压
+                    if (gzip->size() < data->size() * 9 / 10)
+                    {
+                        asset->gzip = gzip;
+                    }
+                }
+            }
+            return asset;
+        }
+
+        void AssetCache::Insert(const Asset::ptr& asset)
+        {
+            uint64_t bytes = asset->GetBytes();
+            if (bytes > max_bytes_)
+            {
+                return;
+            }
+            MutexType::Lock lock(mutex_);
+            auto it = assets_.find(asset->path);
+            if (it != assets_.end())
+            {
+                bytes_ -= (*it->second)->GetBytes();
+                lru_.erase(it->second);
+                assets_.erase(it);
+            }
+            lru_.push_front(asset);
+            assets_[asset->path] = lru_.begin();
+            bytes_ += bytes;
+            while (bytes_ > max_bytes_)
+            {
+                bytes_ -= lru_.back()->GetBytes();
+                assets_.erase(lru_.back()->path);
+                lru_.pop_back();
+            }
+        }
+
+        void AssetCache::Clear()
+        {
+            MutexType::Lock lock(mutex_);
+            assets_.clear();
+            lru_.clear();
+            bytes_ = 0;
+        }
+
+        std::string AssetCache::ToString()
+        {
+            size_t size = 0;
+            {
+                MutexType::Lock lock(mutex_);
+                size = lru_.size();
+            }
+            std::stringstream ss;
+            ss << "[AssetCache size=" << size
+                << " bytes=" << bytes_
+                << " max_bytes=" << max_bytes_
+                << " max_file_size=" << max_file_size_
+                << " hits=" << hits_
+                << " misses=" << misses_ << "]";
+            return ss.str();
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace http
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,162 @@
+/**
+ * @file asset_cache.h
+ * @brief 静态小文件的内存缓存, 带预先压缩好的gzip副本
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-13
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_HTTP_ASSET_CACHE_H__
+#define __YGW_HTTP_ASSET_CACHE_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "file_cache.h"
+#include "server_frame/base/mutex.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace http {
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 文件内容的内存缓存, 按字节数限制大小, 按LRU淘汰
+         * @details 只缓存不超过max_file_size的文件. 文本类文件同时压缩一份gzip,
+         *          只在加载时压缩一次. 内容放在只读的shared_ptr里, 响应直接引用,
+         *          每个请求既不拷贝也不压缩. 文件是否变化由传入的CachedFile判断
+         *          (dev/ino/大小/修改时间), 有效期跟随FileCache
+         */
+        class AssetCache
+        {
+        public:
+            using ptr = std::shared_ptr<AssetCache>;
+            using MutexType = thread::Mutex;
+
+            /**
+             * @brief 缓存的文件内容
+             */
+            struct Asset
+            {
+                using ptr = std::shared_ptr<Asset>;
+                /// 路径
+                std::string path;
+                /// 加载时文件的dev/ino/大小/修改时间
+                dev_t dev;
+                ino_t ino;
+                off_t size;
+                time_t mtime;
+                /// 原始内容
+                std::shared_ptr<const std::string> data;
+                /// gzip内容, 不压缩或者压缩后没有变小时为空
+                std::shared_ptr<const std::string> gzip;
+
+                /**
+                 * @brief 返回占用的字节数
+                 */
+                uint64_t GetBytes() const { return data->size() + (gzip ? gzip->size() : 0); }
+            };
+
+            /**
+             * @brief 构造函数
+             * @param[in] max_bytes 缓存内容的总字节数上限
+             * @param[in] max_file_size 只缓存不超过这个大小的文件
+             * @param[in] min_gzip_size 小于这个大小的文件不压缩
+             */
+            AssetCache(uint64_t max_bytes = 32 * 1024 * 1024
+                    ,uint64_t max_file_size = 256 * 1024
+                    ,uint64_t min_gzip_size = 256);
+
+            /**
+             * @brief 内容类型是否值得压缩(文本, js, json, svg)
+             */
+            static bool IsCompressible(const char* content_type);
+
+            /**
+             * @brief 返回文件的缓存内容, 不在缓存中或者文件变了时重新读取
+             * @param[in] file FileCache返回的普通文件
+             * @return 文件超过max_file_size或者读取失败返回nullptr
+             */
+            Asset::ptr Get(const CachedFile::ptr& file);
+
+            /**
+             * @brief 清空缓存
+             */
+            void Clear();
+
+            /**
+             * @brief 返回缓存的总字节数
+             */
+            uint64_t GetBytes() const { return bytes_; }
+
+            /**
+             * @brief 返回只缓存不超过这个大小的文件
+             */
+            uint64_t GetMaxFileSize() const { return max_file_size_; }
+
+            /**
+             * @brief 返回命中次数
+             */
+            uint64_t GetHits() const { return hits_; }
+
+            /**
+             * @brief 返回未命中次数
+             */
+            uint64_t GetMisses() const { return misses_; }
+
+            /**
+             * @brief 转字符串
+             */
+            std::string ToString();
+        private:
+            using List = std::list<Asset::ptr>;
+
+            /**
+             * @brief 读取文件并压缩
+             */
+            Asset::ptr Load(const CachedFile::ptr& file);
+
+            /**
+             * @brief 放入缓存, 替换同路径的旧内容, 超过字节上限时淘汰最久没用的
+             */
+            void Insert(const Asset::ptr& asset);
+        private:
+            /// 总字节数上限
+            uint64_t max_bytes_;
+            /// 单个文件大小上限
+            uint64_t max_file_size_;
+            /// 压缩的最小文件大小
+            uint64_t min_gzip_size_;
+            /// 保护lru_/assets_
+            MutexType mutex_;
+            /// 最近使用的在前面
+            List lru_;
+            /// 路径到lru_位置
+            std::unordered_map<std::string, List::iterator> assets_;
+            /// 缓存的总字节数
+            std::atomic<uint64_t> bytes_ {0};
+            /// 命中次数
+            std::atomic<uint64_t> hits_ {0};
+            /// 未命中次数
+            std::atomic<uint64_t> misses_ {0};
+        }; // class AssetCache
+
+        //--------------------------------------------------------------------
+
+    } // namespace http
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_HTTP_ASSET_CACHE_H__
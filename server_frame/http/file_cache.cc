@@ -0,0 +1,160 @@
+/**
+ * @file server_frame/http/file_cache.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-12
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include "file_cache.h"
+#include "http.h"
+#include "server_frame/util.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace http {
+
+        CachedFile::~CachedFile()
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+
+        FileCache::FileCache(size_t max_entries, uint64_t valid_ms)
+            : max_entries_(std::max<size_t>(max_entries, 1))
+            , valid_ms_(valid_ms)
+        {
+        }
+
+        CachedFile::ptr FileCache::Load(const std::string& path)
+        {
+            CachedFile::ptr file = std::make_shared<CachedFile>();
+            file->path = path;
+            if (stat(path.c_str(), &file->st) < 0)
+            {
+                file->err = errno;
+                return file;
+            }
+            if (!S_ISREG(file->st.st_mode))
+            {
+                return file;
+            }
+            file->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            //stat和open之间文件可能被替换, 以打开的fd为准
+            if (file->fd < 0 || fstat(file->fd, &file->st) < 0)
+            {
+                file->err = errno;
+                return file;
+            }
+            file->etag = ygw::util::StringUtil::Format("\"%lx-%llx\""
+                    ,(unsigned long)file->st.st_mtime, (unsigned long long)file->st.st_size);
+            file->last_modified = FormatHttpDate(file->st.st_mtime);
+            file->content_type = ygw::util::StringUtil::GuessContentType(path);
+            return file;
+        }
+
+        CachedFile::ptr FileCache::Get(const std::string& path)
+        {
+            uint64_t now = ygw::util::TimeUtil::GetCurrentMS();
+            CachedFile::ptr old;
+            {
+                MutexType::Lock lock(mutex_);
+                auto it = files_.find(path);
+                if (it != files_.end())
+                {
+                    lru_.splice(lru_.begin(), lru_, it->second);
+                    if (now < (*it->second)->expire_ms)
+                    {
+                        ++hits_;
+                        return *it->second;
+                    }
+                    old = *it->second;
+                }
+            }
+            ++misses_;
+
+            //过期的普通文件先stat比较, 没变就续期, 省掉open和重新计算响应头
+            if (old && old->IsFile())
+            {
+                struct stat st;
+                if (stat(path.c_str(), &st) == 0
+                        && st.st_dev == old->st.st_dev
+                        && st.st_ino == old->st.st_ino
+                        && st.st_size == old->st.st_size
+                        && st.st_mtime == old->st.st_mtime)
+                {
+                    MutexType::Lock lock(mutex_);
+                    old->expire_ms = now + valid_ms_;
+                    return old;
+                }
+            }
+
+            CachedFile::ptr file = Load(path);
+            file->expire_ms = now + valid_ms_;
+            Insert(file);
+            return file;
+        }
+
+        void FileCache::Insert(const CachedFile::ptr& file)
+        {
+            MutexType::Lock lock(mutex_);
+            auto it = files_.find(file->path);
+            if (it != files_.end())
+            {
+                lru_.erase(it->second);
+                files_.erase(it);
+            }
+            lru_.push_front(file);
+            files_[file->path] = lru_.begin();
+            while (lru_.size() > max_entries_)
+            {
+                files_.erase(lru_.back()->path);
+                lru_.pop_back();
+            }
+        }
+
+        void FileCache::Clear()
+        {
+            MutexType::Lock lock(mutex_);
+            files_.clear();
+            lru_.clear();
+        }
+
+        size_t FileCache::GetSize()
+        {
+            MutexType::Lock lock(mutex_);
+            return lru_.size();
+        }
+
+        std::string FileCache::ToString()
+        {
+            std::stringstream ss;
+            ss << "[FileCache size=" << GetSize()
+                << " max_entries=" << max_entries_
+                << " valid_ms=" << valid_ms_
+                << " hits=" << hits_
+                << " misses=" << misses_ << "]";
+            return ss.str();
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace http
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,162 @@
+/**
+ * @file file_cache.h
+ * @brief 静态文件的打开文件和元数据缓存
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-12
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_HTTP_FILE_CACHE_H__
+#define __YGW_HTTP_FILE_CACHE_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "server_frame/base/mutex.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace http {
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 一个路径的stat结果, 普通文件同时持有打开的fd和预先算好的响应头
+         * @details 多个请求共用fd, 发送时用sendfile/pread指定偏移, 不改变文件位置.
+         *          最后一个引用释放时关闭fd, 缓存淘汰不影响正在发送的请求
+         */
+        struct CachedFile
+        {
+            using ptr = std::shared_ptr<CachedFile>;
+
+            /**
+             * @brief 析构函数, 关闭fd
+             */
+            ~CachedFile();
+
+            /**
+             * @brief 是否为普通文件
+             */
+            bool IsFile() const { return !err && S_ISREG(st.st_mode); }
+
+            /**
+             * @brief 是否为目录
+             */
+            bool IsDir() const { return !err && S_ISDIR(st.st_mode); }
+
+            /// 路径
+            std::string path;
+            /// stat/open失败时的errno, 0表示成功
+            int err = 0;
+            /// stat结果
+            struct stat st;
+            /// 普通文件的fd, 其他为-1
+            int fd = -1;
+            /// ETag, "mtime-size"的十六进制
+            std::string etag;
+            /// Last-Modified
+            std::string last_modified;
+            /// Content-Type
+            const char* content_type = nullptr;
+            /// 过期时间(毫秒), 只在FileCache的锁内读写
+            uint64_t expire_ms = 0;
+        };
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 按路径缓存CachedFile, 条目数有上限, 按LRU淘汰
+         * @details 条目过了有效期后重新stat, inode/大小/修改时间都没变就继续用原来的fd,
+         *          否则重新打开. 不存在的路径也缓存(err=ENOENT), servlet的路径不用每次都stat.
+         *          文件在有效期内被修改, 最多要等一个有效期才能看到
+         */
+        class FileCache
+        {
+        public:
+            using ptr = std::shared_ptr<FileCache>;
+            using MutexType = thread::Mutex;
+
+            /**
+             * @brief 构造函数
+             * @param[in] max_entries 最多缓存的条目数
+             * @param[in] valid_ms 条目的有效期毫秒
+             */
+            FileCache(size_t max_entries = 1024, uint64_t valid_ms = 1000);
+
+            /**
+             * @brief 不经过缓存, stat并打开path
+             * @return 不会返回空, 失败时err不为0
+             */
+            static CachedFile::ptr Load(const std::string& path);
+
+            /**
+             * @brief 查找path, 不在缓存中或者已过期时重新加载
+             * @return 不会返回空, 失败时err不为0
+             */
+            CachedFile::ptr Get(const std::string& path);
+
+            /**
+             * @brief 清空缓存
+             */
+            void Clear();
+
+            /**
+             * @brief 返回条目数
+             */
+            size_t GetSize();
+
+            /**
+             * @brief 返回命中次数
+             */
+            uint64_t GetHits() const { return hits_; }
+
+            /**
+             * @brief 返回未命中(包括过期)次数
+             */
+            uint64_t GetMisses() const { return misses_; }
+
+            /**
+             * @brief 转字符串
+             */
+            std::string ToString();
+        private:
+            using List = std::list<CachedFile::ptr>;
+
+            /**
+             * @brief 放入缓存, 替换同路径的旧条目, 超过上限时淘汰最久没用的
+             */
+            void Insert(const CachedFile::ptr& file);
+        private:
+            /// 最多缓存的条目数
+            size_t max_entries_;
+            /// 有效期毫秒
+            uint64_t valid_ms_;
+            /// 保护lru_/files_和条目的expire_ms
+            MutexType mutex_;
+            /// 最近使用的在前面
+            List lru_;
+            /// 路径到lru_位置
+            std::unordered_map<std::string, List::iterator> files_;
+            /// 命中次数
+            std::atomic<uint64_t> hits_ {0};
+            /// 未命中次数
+            std::atomic<uint64_t> misses_ {0};
+        }; // class FileCache
+
+        //--------------------------------------------------------------------
+
+    } // namespace http
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_HTTP_FILE_CACHE_H__
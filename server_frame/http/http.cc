@@ -10,6 +10,8 @@
  *  Description: 
  * ====================================================
  */
+#include <unistd.h>
+
 #include "http.h"
 #include "server_frame/util.h"
 
@@ -73,6 +75,35 @@ namespace ygw {
             }
         }
 
+        std::string FormatHttpDate(time_t ts) 
+        {
+            struct tm tm;
+            gmtime_r(&ts, &tm);
+            char buf[64];
+            size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            return std::string(buf, n);
+        }
+
+        time_t ParseHttpDate(const std::string& v) 
+        {
+            struct tm tm;
+            memset(&tm, 0, sizeof(tm));
+            const char* end = strptime(v.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            if (!end || *end) 
+            {
+                return -1;
+            }
+            return timegm(&tm);
+        }
+
+        HttpFileBody::~HttpFileBody() 
+        {
+            if (!owner && fd >= 0) 
+            {
+                close(fd);
+            }
+        }
+
         bool CaseInsensitiveLess::operator()(const std::string& lhs
                 ,const std::string& rhs) const 
         {
@@ -95,8 +126,14 @@ namespace ygw {
         std::string HttpRequest::GetHeader(const std::string& key
                                           ,const std::string& def) const 
         {
-            auto it = headers_.find(key);
-            return it == headers_.end() ? def : it->second;
+            const StringRef* v = headers_.Get(key);
+            return v ? v->str() : def;
+        }
+
+        std::string HttpRequest::GetHeader(HttpHeader id, const std::string& def) const
+        {
+            const StringRef* v = headers_.Get(id);
+            return v ? v->str() : def;
         }
 
         std::shared_ptr<HttpResponse> HttpRequest::CreateResponse() 
@@ -115,6 +152,19 @@ namespace ygw {
             return it == params_.end() ? def : it->second;
         }
 
+        std::string HttpRequest::GetPathParam(const std::string& key
+                ,const std::string& def) const
+        {
+            for (auto& i : path_params_)
+            {
+                if (i.first == key)
+                {
+                    return i.second;
+                }
+            }
+            return def;
+        }
+
         std::string HttpRequest::GetCookie(const std::string& key
                                           ,const std::string& def) 
         {
@@ -125,7 +175,17 @@ namespace ygw {
 
         void HttpRequest::SetHeader(const std::string& key, const std::string& val) 
         {
-            headers_[key] = val;
+            headers_.Set(key, val);
+        }
+
+        void HttpRequest::SetHeader(const char* key, size_t klen, const char* val, size_t vlen)
+        {
+            headers_.Set(key, klen, val, vlen);
+        }
+
+        void HttpRequest::SetHeader(HttpHeader id, const std::string& val)
+        {
+            headers_.Set(id, val);
         }
 
         void HttpRequest::SetParam(const std::string& key, const std::string& val) 
@@ -140,7 +200,7 @@ namespace ygw {
 
         void HttpRequest::DelHeader(const std::string& key) 
         {
-            headers_.erase(key);
+            headers_.Del(key);
         }
 
         void HttpRequest::DelParam(const std::string& key) 
@@ -155,14 +215,14 @@ namespace ygw {
 
         bool HttpRequest::HasHeader(const std::string& key, std::string* val)
         {
-            auto it = headers_.find(key);
-            if (it == headers_.end()) 
+            const StringRef* v = headers_.Get(key);
+            if (!v) 
             {
                 return false;
             }
             if (val) 
             {
-                *val = it->second;
+                val->assign(v->data(), v->size());
             }
             return true;
         }
@@ -183,6 +243,22 @@ namespace ygw {
             return true;
         }
 
+        bool HttpRequest::HasPathParam(const std::string& key, std::string* val) const
+        {
+            for (auto& i : path_params_)
+            {
+                if (i.first == key)
+                {
+                    if (val)
+                    {
+                        *val = i.second;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
         bool HttpRequest::HasCookie(const std::string& key, std::string* val) {
             InitCookies();
             auto it = cookies_.find(key);
@@ -226,7 +302,7 @@ namespace ygw {
             //请求头
             for (auto& i : headers_) 
             {
-                if (!websocket_ && strcasecmp(i.first.c_str(), "connection") == 0) 
+                if (!websocket_ && i.id == HttpHeader::CONNECTION) 
                 {
                     continue;
                 }
@@ -248,10 +324,10 @@ namespace ygw {
 
         void HttpRequest::Init() 
         {
-            std::string conn = GetHeader("connection");
-            if (!conn.empty()) 
+            const StringRef* conn = headers_.Get(HttpHeader::CONNECTION);
+            if (conn && !conn->empty()) 
             {
-                if (strcasecmp(conn.c_str(), "keep-alive") == 0) 
+                if (strcasecmp(conn->c_str(), "keep-alive") == 0) 
                 {
                     close_ = false;
                 } 
@@ -260,6 +336,11 @@ namespace ygw {
                     close_ = true;
                 }
             }
+            else 
+            {
+                //没有Connection头时HTTP/1.1默认长连接, HTTP/1.0默认短连接
+                close_ = version_ < 0x11;
+            }
         }
 
         void HttpRequest::InitParam() 
@@ -304,8 +385,9 @@ namespace ygw {
             {
                 return;
             }
-            std::string content_type = GetHeader("content-type");
-            if (strcasestr(content_type.c_str(), "application/x-www-form-urlencoded") == nullptr) 
+            const StringRef* content_type = headers_.Get(HttpHeader::CONTENT_TYPE);
+            if (!content_type
+                    || strcasestr(content_type->c_str(), "application/x-www-form-urlencoded") == nullptr) 
             {
                 parser_param_flag_ |= 0x2;
                 return;
@@ -319,7 +401,7 @@ namespace ygw {
             if (parser_param_flag_ & 0x4) {
                 return;
             }
-            std::string cookie = GetHeader("cookie");
+            std::string cookie = GetHeader(HttpHeader::COOKIE);
             if (cookie.empty()) {
                 parser_param_flag_ |= 0x4;
                 return;
@@ -343,18 +425,34 @@ namespace ygw {
 
         std::string HttpResponse::GetHeader(const std::string& key, const std::string& def) const 
         {
-            auto it = headers_.find(key);
-            return it == headers_.end() ? def : it->second;
+            const StringRef* v = headers_.Get(key);
+            return v ? v->str() : def;
+        }
+
+        std::string HttpResponse::GetHeader(HttpHeader id, const std::string& def) const
+        {
+            const StringRef* v = headers_.Get(id);
+            return v ? v->str() : def;
         }
 
         void HttpResponse::SetHeader(const std::string& key, const std::string& val) 
         {
-            headers_[key] = val;
+            headers_.Set(key, val);
+        }
+
+        void HttpResponse::SetHeader(const char* key, size_t klen, const char* val, size_t vlen)
+        {
+            headers_.Set(key, klen, val, vlen);
+        }
+
+        void HttpResponse::SetHeader(HttpHeader id, const std::string& val)
+        {
+            headers_.Set(id, val);
         }
 
         void HttpResponse::DelHeader(const std::string& key) 
         {
-            headers_.erase(key);
+            headers_.Del(key);
         }
 
         void HttpResponse::SetRedirect(const std::string& uri) 
@@ -396,45 +494,75 @@ namespace ygw {
             return ss.str();
         }
 
-        std::ostream& HttpResponse::Dump(std::ostream& os) const 
+        /**
+         * @brief 把无符号整数追加到字符串
+         */
+        static void AppendUInt(std::string& out, uint64_t v) 
         {
-            os << "HTTP/"
-                << ((uint32_t)(version_ >> 4))
-                << "."
-                << ((uint32_t)(version_ & 0x0F))
-                << " "
-                << (uint32_t)status_
-                << " "
-                << (reason_.empty() ? HttpStatusToString(status_) : reason_)
-                << "\r\n";
+            char buf[24];
+            char* p = buf + sizeof(buf);
+            do {
+                *--p = '0' + v % 10;
+                v /= 10;
+            } while (v);
+            out.append(p, buf + sizeof(buf) - p);
+        }
+
+        void HttpResponse::DumpHeader(std::string& out) const 
+        {
+            out.append("HTTP/");
+            AppendUInt(out, version_ >> 4);
+            out.push_back('.');
+            AppendUInt(out, version_ & 0x0F);
+            out.push_back(' ');
+            AppendUInt(out, (uint32_t)status_);
+            out.push_back(' ');
+            if (reason_.empty()) 
+            {
+                out.append(HttpStatusToString(status_));
+            } 
+            else 
+            {
+                out.append(reason_);
+            }
+            out.append("\r\n");
 
             // 响应头
             for (auto& i : headers_) 
             {
-                if (!websocket_ && strcasecmp(i.first.c_str(), "connection") == 0) {
+                if (!websocket_ && i.id == HttpHeader::CONNECTION) {
                     continue;
                 }
-                os << i.first << ": " << i.second << "\r\n";
+                out.append(i.first.data(), i.first.size()).append(": ")
+                    .append(i.second.data(), i.second.size()).append("\r\n");
             }
-            // 响应体 
             for (auto& i : cookies_)  // cookie
             {
-                os << "Set-Cookie: " << i << "\r\n";
+                out.append("Set-Cookie: ").append(i).append("\r\n");
             }
             if (!websocket_) 
             {
-                os << "connection: " << (close_ ? "close" : "keep-alive") << "\r\n";
+                out.append(close_ ? "connection: close\r\n" : "connection: keep-alive\r\n");
             }
-            if (!body_.empty())  // body
+            // 1xx/204/304不能带消息体; HEAD和文件消息体按实际长度填写
+            uint32_t status = (uint32_t)status_;
+            bool no_body = status < 200 || status == 204 || status == 304;
+            if (!no_body && (file_body_ || !GetBody().empty() || (!websocket_ && !close_))
+                    && !headers_.Get(HttpHeader::CONTENT_LENGTH)
+                    && !headers_.Get(HttpHeader::TRANSFER_ENCODING)) 
             {
-                os << "content-length: " << body_.size() << "\r\n\r\n"
-                    << body_;
+                out.append("content-length: ");
+                AppendUInt(out, GetContentLength());
+                out.append("\r\n");
             } 
-            else 
-            {
-                os << "\r\n";
-            }
-            return os;
+            out.append("\r\n");
+        }
+
+        std::ostream& HttpResponse::Dump(std::ostream& os) const 
+        {
+            std::string header;
+            DumpHeader(header);
+            return os << header << GetBody();
         }
 
         std::ostream& operator<<(std::ostream& os, const HttpRequest& req) 
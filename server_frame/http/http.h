@@ -10,14 +10,20 @@
 #ifndef __YGW_HTTP_HTTP_H__
 #define __YGW_HTTP_HTTP_H__
 
+#include <time.h>
+
 #include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include <iostream>
 #include <sstream>
 
 #include <boost/lexical_cast.hpp>
 
+#include "http_header.h"
+#include "server_frame/noncopyable.h"
+
 namespace ygw {
 
     namespace http {
@@ -183,15 +189,32 @@ namespace ygw {
         const char* HttpStatusToString(const HttpStatus& s);
 
         /**
-         * @brief 忽略大小写比较仿函数
+         * @brief 格式化HTTP日期(RFC 7231 IMF-fixdate, GMT)
+         * @param[in] ts 时间戳
+         * @return 如 Sun, 06 Nov 1994 08:49:37 GMT
          */
-        struct CaseInsensitiveLess {
-            /**
-             * @brief 忽略大小写比较字符串
-             */
-            bool operator()(const std::string& lhs, const std::string& rhs) const;
-        };
+        std::string FormatHttpDate(time_t ts);
+
+        /**
+         * @brief 解析HTTP日期(IMF-fixdate)
+         * @return 解析失败返回-1
+         */
+        time_t ParseHttpDate(const std::string& v);
+
+        /**
+         * @brief 把Map中的值转成对应类型, 失败抛出boost::bad_lexical_cast
+         */
+        template<class T>
+        T LexicalCast(const std::string& v)
+        {
+            return boost::lexical_cast<T>(v);
+        }
 
+        template<class T>
+        T LexicalCast(const StringRef& v)
+        {
+            return boost::lexical_cast<T>(v.data(), v.size());
+        }
 
         /**
          * @brief 获取Map中的key值,并转成对应类型,返回是否成功
@@ -214,7 +237,7 @@ namespace ygw {
             }
             try 
             {
-                val = boost::lexical_cast<T>(it->second);
+                val = LexicalCast<T>(it->second);
                 return true;
             } 
             catch (...) 
@@ -241,7 +264,7 @@ namespace ygw {
             }
             try 
             {
-                return boost::lexical_cast<T>(it->second);
+                return LexicalCast<T>(it->second);
             } 
             catch (...) 
             {
@@ -262,6 +285,8 @@ namespace ygw {
             using ptr = std::shared_ptr<HttpRequest>;
             /// MAP结构
             using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+            /// 路由匹配出的路径参数, 按在路由中出现的顺序排列
+            using PathParams = std::vector<std::pair<std::string, std::string> >;
 
             /**
              * @brief 构造函数
@@ -304,13 +329,18 @@ namespace ygw {
             /**
              * @brief 返回HTTP请求的消息头MAP
              */
-            const MapType& GetHeaders() const { return headers_; }
+            const HeaderMap& GetHeaders() const { return headers_; }
 
             /**
              * @brief 返回HTTP请求的参数MAP
              */
             const MapType& GetParams() const { return params_; }
 
+            /**
+             * @brief 返回路由匹配出的路径参数(:id和*rest匹配到的内容)
+             */
+            const PathParams& GetPathParams() const { return path_params_; }
+
             /**
              * @brief 返回HTTP请求的cookie MAP
              */
@@ -377,6 +407,7 @@ namespace ygw {
              * @param[in] v map
              */
             void SetHeaders(const MapType& v) { headers_ = v; }
+            void SetHeaders(const HeaderMap& v) { headers_ = v; }
 
             /**
              * @brief 设置HTTP请求的参数MAP
@@ -384,6 +415,12 @@ namespace ygw {
              */
             void SetParams(const MapType& v) { params_ = v; }
 
+            /**
+             * @brief 设置路由匹配出的路径参数
+             * @param[in] v 路径参数
+             */
+            void SetPathParams(PathParams&& v) { path_params_ = std::move(v); }
+
             /**
              * @brief 设置HTTP请求的Cookie MAP
              * @param[in] v map
@@ -398,6 +435,21 @@ namespace ygw {
              */
             std::string GetHeader(const std::string& key, const std::string& def="") const;
 
+            /**
+             * @brief 获取常用头部, 按枚举下标查找, 不用比较名字
+             * @param[in] id 头部枚举
+             * @param[in] def 默认值
+             * @return 如果存在则返回对应值，否则返回默认值
+             */
+            std::string GetHeader(HttpHeader id, const std::string& def="") const;
+
+            /**
+             * @brief 返回头部的值, 不拷贝, 修改头部后失效
+             * @return 不存在返回nullptr
+             */
+            const StringRef* FindHeader(HttpHeader id) const { return headers_.Get(id); }
+            const StringRef* FindHeader(const std::string& key) const { return headers_.Get(key); }
+
             /**
              * @breif 获取HTTP请求的请求参数
              * @param[in] key 关键字
@@ -406,6 +458,14 @@ namespace ygw {
              */
             std::string GetParam(const std::string& key, const std::string& def="");
 
+            /**
+             * @brief 获取路由匹配出的路径参数
+             * @param[in] key 参数名, 区分大小写
+             * @param[in] def 默认值
+             * @return 如果存在则返回对应值，否则返回默认值
+             */
+            std::string GetPathParam(const std::string& key, const std::string& def="") const;
+
             /**
              * @brief 获取HTTP请求的Cookie参数
              * @param[in] key 关键字
@@ -421,6 +481,22 @@ namespace ygw {
              */
             void SetHeader(const std::string& key, const std::string& val);
 
+            /**
+             * @brief 设置头部, 名字和值直接从解析缓冲区拷到头部存储中
+             * @param[in] key 名字
+             * @param[in] klen 名字长度
+             * @param[in] val 值
+             * @param[in] vlen 值长度
+             */
+            void SetHeader(const char* key, size_t klen, const char* val, size_t vlen);
+
+            /**
+             * @brief 设置常用头部
+             * @param[in] id 头部枚举
+             * @param[in] val 值
+             */
+            void SetHeader(HttpHeader id, const std::string& val);
+
             /**
              * @brief 设置HTTP请求的请求参数
              * @param[in] key 关键字
@@ -469,6 +545,14 @@ namespace ygw {
              */
             bool HasParam(const std::string& key, std::string* val = nullptr);
 
+            /**
+             * @brief 判断路由匹配出的路径参数是否存在
+             * @param[in] key 参数名, 区分大小写
+             * @param[out] val 如果存在,val非空则赋值
+             * @return 是否存在
+             */
+            bool HasPathParam(const std::string& key, std::string* val = nullptr) const;
+
             /**
              * @brief 判断HTTP请求的Cookie参数是否存在
              * @param[in] key 关键字
@@ -602,14 +686,46 @@ namespace ygw {
             /// 请求消息体
             std::string body_;
             /// 请求头部MAP
-            MapType headers_;
+            HeaderMap headers_;
             /// 请求参数MAP
             MapType params_;
+            /// 路径参数
+            PathParams path_params_;
             /// 请求Cookie MAP
             MapType cookies_;
         };  // class HttpRequest
 
         //-------------------------------------------------------------------------------
+        /**
+         * @brief 文件消息体, 由HttpSession直接从文件发送(sendfile), 不读入内存
+         * @details 没有所有者时析构会关闭fd, 所以不能拷贝, 只通过智能指针共享
+         */
+        struct HttpFileBody : able::Noncopyable 
+        {
+            using ptr = std::shared_ptr<HttpFileBody>;
+            /**
+             * @brief 构造函数
+             * @param[in] _owner fd的所有者, 为空时由HttpFileBody接管fd
+             */
+            HttpFileBody(int _fd, uint64_t _offset, uint64_t _length
+                    ,std::shared_ptr<void> _owner = nullptr)
+                : fd(_fd), offset(_offset), length(_length), owner(_owner)
+            {
+            }
+            /**
+             * @brief 析构函数, 没有所有者时关闭fd
+             */
+            ~HttpFileBody();
+            /// 文件句柄
+            int fd;
+            /// 起始偏移
+            uint64_t offset;
+            /// 发送长度
+            uint64_t length;
+            /// fd的所有者(如缓存的打开文件), 发送期间保持fd有效
+            std::shared_ptr<void> owner;
+        };
+
         /**
          * @brief HTTP响应结构体
          */
@@ -641,9 +757,9 @@ namespace ygw {
 
             /**
              * @brief 返回响应消息体
-             * @return 消息体
+             * @return 消息体, 设置了共享消息体时返回共享消息体
              */
-            const std::string& GetBody() const { return body_;}
+            const std::string& GetBody() const { return shared_body_ ? *shared_body_ : body_;}
 
             /**
              * @brief 返回响应原因
@@ -654,7 +770,7 @@ namespace ygw {
              * @brief 返回响应头部MAP
              * @return MAP
              */
-            const MapType& GetHeaders() const { return headers_;}
+            const HeaderMap& GetHeaders() const { return headers_;}
 
             /**
              * @brief 设置响应状态
@@ -672,7 +788,13 @@ namespace ygw {
              * @brief 设置响应消息体
              * @param[in] v 消息体
              */
-            void SetBody(const std::string& v) { body_ = v;}
+            void SetBody(const std::string& v) { body_ = v; shared_body_.reset();}
+
+            /**
+             * @brief 设置共享的只读消息体, 发送时直接引用, 不拷贝
+             * @param[in] v 消息体, 发送完之前不能修改
+             */
+            void SetSharedBody(std::shared_ptr<const std::string> v) { shared_body_ = v;}
 
             /**
              * @brief 设置响应原因
@@ -685,6 +807,7 @@ namespace ygw {
              * @param[in] v MAP
              */
             void SetHeaders(const MapType& v) { headers_ = v;}
+            void SetHeaders(const HeaderMap& v) { headers_ = v;}
 
             /**
              * @brief 是否自动关闭
@@ -706,6 +829,41 @@ namespace ygw {
              */
             void SetWebsocket(bool v) { websocket_ = v;}
 
+            /**
+             * @brief 返回文件消息体
+             */
+            HttpFileBody::ptr GetFileBody() const { return file_body_;}
+
+            /**
+             * @brief 设置文件消息体, 发送时代替body
+             */
+            void SetFileBody(HttpFileBody::ptr v) { file_body_ = v;}
+
+            /**
+             * @brief 是否只发送响应头(HEAD请求), content-length仍按消息体计算
+             */
+            bool IsHead() const { return head_;}
+
+            /**
+             * @brief 设置是否只发送响应头
+             */
+            void SetHead(bool v) { head_ = v;}
+
+            /**
+             * @brief 消息体是否由servlet通过HttpSession分块写出
+             */
+            bool IsStreaming() const { return streaming_;}
+
+            /**
+             * @brief 设置消息体是否分块写出
+             */
+            void SetStreaming(bool v) { streaming_ = v;}
+
+            /**
+             * @brief 消息体长度, 有文件消息体时返回文件消息体的长度
+             */
+            uint64_t GetContentLength() const { return file_body_ ? file_body_->length : GetBody().size();}
+
             /**
              * @brief 获取响应头部参数
              * @param[in] key 关键字
@@ -714,6 +872,21 @@ namespace ygw {
              */
             std::string GetHeader(const std::string& key, const std::string& def = "") const;
 
+            /**
+             * @brief 获取常用头部, 按枚举下标查找, 不用比较名字
+             * @param[in] id 头部枚举
+             * @param[in] def 默认值
+             * @return 如果存在则返回对应值，否则返回默认值
+             */
+            std::string GetHeader(HttpHeader id, const std::string& def="") const;
+
+            /**
+             * @brief 返回头部的值, 不拷贝, 修改头部后失效
+             * @return 不存在返回nullptr
+             */
+            const StringRef* FindHeader(HttpHeader id) const { return headers_.Get(id); }
+            const StringRef* FindHeader(const std::string& key) const { return headers_.Get(key); }
+
             /**
              * @brief 设置响应头部参数
              * @param[in] key 关键字
@@ -721,6 +894,22 @@ namespace ygw {
              */
             void SetHeader(const std::string& key, const std::string& val);
 
+            /**
+             * @brief 设置头部, 名字和值直接从解析缓冲区拷到头部存储中
+             * @param[in] key 名字
+             * @param[in] klen 名字长度
+             * @param[in] val 值
+             * @param[in] vlen 值长度
+             */
+            void SetHeader(const char* key, size_t klen, const char* val, size_t vlen);
+
+            /**
+             * @brief 设置常用头部
+             * @param[in] id 头部枚举
+             * @param[in] val 值
+             */
+            void SetHeader(HttpHeader id, const std::string& val);
+
             /**
              * @brief 删除响应头部参数
              * @param[in] key 关键字
@@ -761,6 +950,13 @@ namespace ygw {
              */
             std::ostream& Dump(std::ostream& os) const;
 
+            /**
+             * @brief 把状态行和响应头(包括结尾的空行)追加到out, 不包括消息体
+             * @details 不经过stringstream, 整数直接格式化, out可以跨响应复用
+             * @param[in, out] out 输出缓冲区
+             */
+            void DumpHeader(std::string& out) const;
+
             /**
              * @brief 转成字符串
              */
@@ -793,12 +989,20 @@ namespace ygw {
             bool close_;
             /// 是否为websocket
             bool websocket_;
+            /// 是否只发送响应头
+            bool head_ = false;
+            /// 消息体是否分块写出
+            bool streaming_ = false;
             /// 响应消息体
             std::string body_;
+            /// 共享的只读消息体, 优先于body_
+            std::shared_ptr<const std::string> shared_body_;
+            /// 文件消息体
+            HttpFileBody::ptr file_body_;
             /// 响应原因
             std::string reason_;
             /// 响应头部MAP
-            MapType headers_;
+            HeaderMap headers_;
             /// cookies
             std::vector<std::string> cookies_;
         };
@@ -558,6 +558,35 @@ namespace ygw {
 
         HttpResult::ptr HttpConnectionPool::DoRequest(HttpRequest::ptr req
                 , uint64_t timeout_ms) 
+        {
+            limiter::ConcurrencyLimiter::ptr limiter = limiter_;
+            if (!limiter) 
+            {
+                return DoRequestNoLimit(req, timeout_ms);
+            }
+            limiter::LimiterGuard admit(limiter);
+            if (!admit.IsAcquired()) 
+            {
+                return std::make_shared<HttpResult>((int)HttpResult::Error::kLimited
+                        , nullptr, "pool host:" + host_ + " limit:" + std::to_string(limiter->GetLimit()));
+            }
+            auto result = DoRequestNoLimit(req, timeout_ms);
+            limiter::ConcurrencyLimiter::Result r = limiter::ConcurrencyLimiter::kIgnore;
+            if (result->result == (int)HttpResult::Error::kTimeout
+                    || (result->response && result->response->GetStatus() == HttpStatus::SERVICE_UNAVAILABLE)) 
+            {
+                r = limiter::ConcurrencyLimiter::kDropped;
+            }
+            else if (result->result == (int)HttpResult::Error::kOK) 
+            {
+                r = limiter::ConcurrencyLimiter::kSuccess;
+            }
+            admit.Release(r);
+            return result;
+        }
+
+        HttpResult::ptr HttpConnectionPool::DoRequestNoLimit(HttpRequest::ptr req
+                , uint64_t timeout_ms) 
         {
             auto conn = GetConnection();
             if (!conn) 
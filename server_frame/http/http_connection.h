@@ -16,6 +16,7 @@
 #include "http.h"
 #include "uri.h"
 #include "server_frame/base/thread.h"
+#include "server_frame/concurrency_limiter.h"
 #include "server_frame/stream/socket_stream.h"
 
 namespace ygw {
@@ -54,6 +55,8 @@ namespace ygw {
                 kPoolGetConnection = 8,
                 /// 无效的连接
                 kPoolInvalidConnection= 9,
+                /// 被并发限制器拒绝
+                kLimited           = 10,
             };
 
             /**
@@ -324,7 +327,24 @@ namespace ygw {
              */
             HttpResult::ptr DoRequest(HttpRequest::ptr req
                     , uint64_t timeout_ms);
+
+            /**
+             * @brief 设置并发限制器, 超出上限的请求不发出, 直接返回kLimited
+             * @details 超时和503响应作为过载信号反馈给限制器
+             */
+            void SetLimiter(limiter::ConcurrencyLimiter::ptr v) { limiter_ = v; }
+
+            /**
+             * @brief 返回并发限制器
+             */
+            limiter::ConcurrencyLimiter::ptr GetLimiter() const { return limiter_; }
         private:
+            /**
+             * @brief 不经过并发限制器发送请求
+             */
+            HttpResult::ptr DoRequestNoLimit(HttpRequest::ptr req
+                    , uint64_t timeout_ms);
+
             static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool);
         private:
             std::string host_;
@@ -338,6 +358,8 @@ namespace ygw {
             MutexType mutex_;
             std::list<HttpConnection*> conns_;
             std::atomic<int32_t> total_ = {0};
+            /// 并发限制器
+            limiter::ConcurrencyLimiter::ptr limiter_;
         }; 
 
         //-----------------------------------------------------------------------
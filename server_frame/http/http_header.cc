@@ -0,0 +1,294 @@
+/**
+ * @file server_frame/http/http_header.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-18
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <strings.h>
+
+#include <algorithm>
+
+#include "http_header.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace http {
+
+        static const char* s_header_names[] = {
+#define XX(name, string) string,
+            HTTP_HEADER_MAP(XX)
+#undef XX
+        };
+
+        static const size_t s_header_lens[] = {
+#define XX(name, string) sizeof(string) - 1,
+            HTTP_HEADER_MAP(XX)
+#undef XX
+        };
+
+        /**
+         * @brief 忽略大小写的FNV-1a
+         */
+        static inline uint32_t HashLower(const char* s, size_t len)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < len; ++i)
+            {
+                h ^= (uint8_t)(s[i] | 0x20);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        namespace {
+
+            /**
+             * @brief 常用头部的开放寻址hash表, 启动时建好
+             */
+            struct HeaderTable
+            {
+                static const size_t kSize = 128;
+                static const size_t kMask = kSize - 1;
+                /// 名字的hash
+                uint32_t hashs[kSize];
+                /// 枚举值+1, 0表示空位
+                uint8_t ids[kSize];
+
+                HeaderTable()
+                {
+                    memset(ids, 0, sizeof(ids));
+                    for (size_t id = 0; id < kHttpHeaderCount; ++id)
+                    {
+                        uint32_t h = HashLower(s_header_names[id], s_header_lens[id]);
+                        size_t i = h & kMask;
+                        while (ids[i])
+                        {
+                            i = (i + 1) & kMask;
+                        }
+                        hashs[i] = h;
+                        ids[i] = id + 1;
+                    }
+                }
+            };
+
+        } // namespace
+
+        HttpHeader LookupHttpHeader(const char* name, size_t len)
+        {
+            static const HeaderTable s_table;
+            uint32_t h = HashLower(name, len);
+            for (size_t i = h & HeaderTable::kMask; s_table.ids[i]; i = (i + 1) & HeaderTable::kMask)
+            {
+                size_t id = s_table.ids[i] - 1;
+                if (s_table.hashs[i] == h && s_header_lens[id] == len
+                        && strncasecmp(s_header_names[id], name, len) == 0)
+                {
+                    return (HttpHeader)id;
+                }
+            }
+            return HttpHeader::UNKNOWN;
+        }
+
+        const char* HttpHeaderToString(HttpHeader h)
+        {
+            size_t id = (size_t)h;
+            return id < kHttpHeaderCount ? s_header_names[id] : "<unknown>";
+        }
+
+        //-------------------------------------------------------------------
+
+        /// 内存块的最小字节数, 一般请求的头部一块就够
+        static const size_t kBlockSize = 1024;
+
+        HeaderMap::HeaderMap()
+        {
+            memset(known_, -1, sizeof(known_));
+        }
+
+        HeaderMap::HeaderMap(const HeaderMap& rhs)
+            : HeaderMap()
+        {
+            *this = rhs;
+        }
+
+        HeaderMap& HeaderMap::operator=(const HeaderMap& rhs)
+        {
+            if (this == &rhs)
+            {
+                return *this;
+            }
+            Clear();
+            fields_.reserve(rhs.fields_.size());
+            //rhs中没有重名的头部, 直接追加
+            for (auto& i : rhs.fields_)
+            {
+                Field f;
+                f.first = Store(i.first.data(), i.first.size());
+                f.second = Store(i.second.data(), i.second.size());
+                f.id = i.id;
+                fields_.push_back(f);
+            }
+            Reindex();
+            return *this;
+        }
+
+        HeaderMap& HeaderMap::operator=(const MapType& rhs)
+        {
+            Clear();
+            for (auto& i : rhs)
+            {
+                Set(i.first, i.second);
+            }
+            return *this;
+        }
+
+        HeaderMap::const_iterator HeaderMap::Find(const char* key, size_t len) const
+        {
+            int i = IndexOf(LookupHttpHeader(key, len), key, len);
+            return i < 0 ? fields_.end() : fields_.begin() + i;
+        }
+
+        const StringRef* HeaderMap::Get(HttpHeader id) const
+        {
+            if (id == HttpHeader::UNKNOWN)
+            {
+                return nullptr;
+            }
+            int i = known_[(size_t)id];
+            return i < 0 ? nullptr : &fields_[i].second;
+        }
+
+        const StringRef* HeaderMap::Get(const std::string& key) const
+        {
+            int i = IndexOf(LookupHttpHeader(key.c_str(), key.size()), key.c_str(), key.size());
+            return i < 0 ? nullptr : &fields_[i].second;
+        }
+
+        void HeaderMap::Set(const char* key, size_t klen, const char* val, size_t vlen)
+        {
+            HttpHeader id = LookupHttpHeader(key, klen);
+            int i = IndexOf(id, key, klen);
+            if (i >= 0)
+            {
+                fields_[i].second = Store(val, vlen);
+                return;
+            }
+            if (fields_.empty())
+            {
+                fields_.reserve(16);
+            }
+            Field f;
+            f.first = Store(key, klen);
+            f.second = Store(val, vlen);
+            f.id = id;
+            if (id != HttpHeader::UNKNOWN)
+            {
+                known_[(size_t)id] = fields_.size();
+            }
+            fields_.push_back(f);
+        }
+
+        void HeaderMap::Set(const std::string& key, const std::string& val)
+        {
+            Set(key.c_str(), key.size(), val.c_str(), val.size());
+        }
+
+        void HeaderMap::Set(HttpHeader id, const std::string& val)
+        {
+            if (id == HttpHeader::UNKNOWN)
+            {
+                return;
+            }
+            Set(s_header_names[(size_t)id], s_header_lens[(size_t)id], val.c_str(), val.size());
+        }
+
+        void HeaderMap::Del(const std::string& key)
+        {
+            int i = IndexOf(LookupHttpHeader(key.c_str(), key.size()), key.c_str(), key.size());
+            if (i >= 0)
+            {
+                fields_.erase(fields_.begin() + i);
+                Reindex();
+            }
+        }
+
+        void HeaderMap::Clear()
+        {
+            fields_.clear();
+            memset(known_, -1, sizeof(known_));
+            blocks_.clear();
+            cur_ = nullptr;
+            left_ = 0;
+        }
+
+        HeaderMap::MapType HeaderMap::ToMap() const
+        {
+            MapType m;
+            for (auto& i : fields_)
+            {
+                m[i.first.str()] = i.second.str();
+            }
+            return m;
+        }
+
+        StringRef HeaderMap::Store(const char* s, size_t len)
+        {
+            size_t need = len + 1;
+            if (need > left_)
+            {
+                size_t size = std::max(need, kBlockSize);
+                blocks_.emplace_back(new char[size]);
+                cur_ = blocks_.back().get();
+                left_ = size;
+            }
+            char* p = cur_;
+            memcpy(p, s, len);
+            p[len] = '\0';
+            cur_ += need;
+            left_ -= need;
+            return StringRef(p, len);
+        }
+
+        int HeaderMap::IndexOf(HttpHeader id, const char* key, size_t len) const
+        {
+            if (id != HttpHeader::UNKNOWN)
+            {
+                return known_[(size_t)id];
+            }
+            for (size_t i = 0; i < fields_.size(); ++i)
+            {
+                const Field& f = fields_[i];
+                if (f.id == HttpHeader::UNKNOWN && f.first.size() == len
+                        && strncasecmp(f.first.data(), key, len) == 0)
+                {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        void HeaderMap::Reindex()
+        {
+            memset(known_, -1, sizeof(known_));
+            for (size_t i = 0; i < fields_.size(); ++i)
+            {
+                if (fields_[i].id != HttpHeader::UNKNOWN)
+                {
+                    known_[(size_t)fields_[i].id] = i;
+                }
+            }
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace http
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,273 @@
+/**
+ * @file http_header.h
+ * @brief HTTP头部的扁平存储
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-18
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_HTTP_HEADER_H__
+#define __YGW_HTTP_HEADER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace http {
+
+        /* 常用头部, 预先算好hash, 按枚举下标直接查找 */
+#define HTTP_HEADER_MAP(XX)                                 \
+  XX(ACCEPT,                "Accept")                       \
+  XX(ACCEPT_ENCODING,       "Accept-Encoding")              \
+  XX(ACCEPT_LANGUAGE,       "Accept-Language")              \
+  XX(ACCEPT_RANGES,         "Accept-Ranges")                \
+  XX(AUTHORIZATION,         "Authorization")                \
+  XX(CACHE_CONTROL,         "Cache-Control")                \
+  XX(CONNECTION,            "Connection")                   \
+  XX(CONTENT_ENCODING,      "Content-Encoding")             \
+  XX(CONTENT_LENGTH,        "Content-Length")               \
+  XX(CONTENT_RANGE,         "Content-Range")                \
+  XX(CONTENT_TYPE,          "Content-Type")                 \
+  XX(COOKIE,                "Cookie")                       \
+  XX(DATE,                  "Date")                         \
+  XX(ETAG,                  "ETag")                         \
+  XX(EXPECT,                "Expect")                       \
+  XX(HOST,                  "Host")                         \
+  XX(IF_MATCH,              "If-Match")                     \
+  XX(IF_MODIFIED_SINCE,     "If-Modified-Since")            \
+  XX(IF_NONE_MATCH,         "If-None-Match")                \
+  XX(IF_RANGE,              "If-Range")                     \
+  XX(LAST_MODIFIED,         "Last-Modified")                \
+  XX(LOCATION,              "Location")                     \
+  XX(ORIGIN,                "Origin")                       \
+  XX(RANGE,                 "Range")                        \
+  XX(REFERER,               "Referer")                      \
+  XX(RETRY_AFTER,           "Retry-After")                  \
+  XX(SEC_WEBSOCKET_ACCEPT,  "Sec-WebSocket-Accept")         \
+  XX(SEC_WEBSOCKET_KEY,     "Sec-WebSocket-Key")            \
+  XX(SEC_WEBSOCKET_VERSION, "Sec-WebSocket-Version")        \
+  XX(SERVER,                "Server")                       \
+  XX(SET_COOKIE,            "Set-Cookie")                   \
+  XX(TRANSFER_ENCODING,     "Transfer-Encoding")            \
+  XX(UPGRADE,               "Upgrade")                      \
+  XX(USER_AGENT,            "User-Agent")                   \
+  XX(VARY,                  "Vary")                         \
+  XX(X_FORWARDED_FOR,       "X-Forwarded-For")              \
+
+        /**
+         * @brief 常用HTTP头部枚举
+         */
+        enum class HttpHeader : uint8_t
+        {
+#define XX(name, string) name,
+            HTTP_HEADER_MAP(XX)
+#undef XX
+            /// 不在常用头部中
+            UNKNOWN
+        };
+
+        /**
+         * @brief 常用头部的数量
+         */
+        static const size_t kHttpHeaderCount = (size_t)HttpHeader::UNKNOWN;
+
+        /**
+         * @brief 按名字(忽略大小写)查找常用头部
+         * @return 不是常用头部返回HttpHeader::UNKNOWN
+         */
+        HttpHeader LookupHttpHeader(const char* name, size_t len);
+
+        /**
+         * @brief 返回常用头部的标准写法
+         */
+        const char* HttpHeaderToString(HttpHeader h);
+
+        /**
+         * @brief 忽略大小写比较仿函数
+         */
+        struct CaseInsensitiveLess {
+            /**
+             * @brief 忽略大小写比较字符串
+             */
+            bool operator()(const std::string& lhs, const std::string& rhs) const;
+        };
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief HeaderMap中的字符串, 不拥有内存, 以'\0'结尾
+         */
+        class StringRef
+        {
+        public:
+            StringRef()
+                : data_(""), size_(0)
+            {
+            }
+
+            StringRef(const char* data, size_t size)
+                : data_(data), size_(size)
+            {
+            }
+
+            const char* data() const { return data_; }
+            const char* c_str() const { return data_; }
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+
+            /**
+             * @brief 拷贝成std::string
+             */
+            std::string str() const { return std::string(data_, size_); }
+            operator std::string() const { return str(); }
+        private:
+            const char* data_;
+            size_t size_;
+        };
+
+        inline bool operator==(const StringRef& lhs, const char* rhs)
+        {
+            return lhs.size() == strlen(rhs) && memcmp(lhs.data(), rhs, lhs.size()) == 0;
+        }
+
+        inline bool operator==(const StringRef& lhs, const std::string& rhs)
+        {
+            return lhs.size() == rhs.size() && memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+        }
+
+        inline bool operator!=(const StringRef& lhs, const char* rhs) { return !(lhs == rhs); }
+        inline bool operator!=(const StringRef& lhs, const std::string& rhs) { return !(lhs == rhs); }
+
+        inline std::ostream& operator<<(std::ostream& os, const StringRef& s)
+        {
+            return os.write(s.data(), s.size());
+        }
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief HTTP头部容器
+         * @details 头部按出现顺序放在一个数组里, 名字和值的字节连续拷贝到按块分配的内存中,
+         *          每个头部不再单独分配节点和两个字符串. 常用头部在加入时算出枚举,
+         *          按枚举下标直接找到, 其他头部忽略大小写顺序比较.
+         *          同名头部后设置的覆盖先设置的, 和原来的std::map一致.
+         *          提供begin/end/find/size, 原来按map遍历和查找的代码不用改
+         */
+        class HeaderMap
+        {
+        public:
+            /// 转成的map类型
+            using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+
+            /**
+             * @brief 一个头部
+             */
+            struct Field
+            {
+                /// 名字
+                StringRef first;
+                /// 值
+                StringRef second;
+                /// 常用头部枚举
+                HttpHeader id;
+            };
+            using const_iterator = std::vector<Field>::const_iterator;
+            using iterator = const_iterator;
+
+            HeaderMap();
+            HeaderMap(const HeaderMap& rhs);
+            HeaderMap& operator=(const HeaderMap& rhs);
+            HeaderMap& operator=(const MapType& rhs);
+
+            const_iterator begin() const { return fields_.begin(); }
+            const_iterator end() const { return fields_.end(); }
+            size_t size() const { return fields_.size(); }
+            bool empty() const { return fields_.empty(); }
+
+            /**
+             * @brief 按名字查找, 忽略大小写
+             */
+            const_iterator find(const std::string& key) const { return Find(key.c_str(), key.size()); }
+            const_iterator Find(const char* key, size_t len) const;
+
+            /**
+             * @brief 返回常用头部的值
+             * @return 不存在返回nullptr
+             */
+            const StringRef* Get(HttpHeader id) const;
+
+            /**
+             * @brief 返回头部的值
+             * @return 不存在返回nullptr
+             */
+            const StringRef* Get(const std::string& key) const;
+
+            /**
+             * @brief 设置头部, 已经存在时替换值
+             */
+            void Set(const char* key, size_t klen, const char* val, size_t vlen);
+            void Set(const std::string& key, const std::string& val);
+            void Set(HttpHeader id, const std::string& val);
+
+            /**
+             * @brief 删除头部
+             */
+            void Del(const std::string& key);
+
+            /**
+             * @brief 清空
+             */
+            void Clear();
+
+            /**
+             * @brief 拷贝成map
+             */
+            MapType ToMap() const;
+            operator MapType() const { return ToMap(); }
+        private:
+            /**
+             * @brief 把字符串拷到块内存中, 末尾补'\0'
+             */
+            StringRef Store(const char* s, size_t len);
+
+            /**
+             * @brief 在fields_中找头部的下标
+             * @return 不存在返回-1
+             */
+            int IndexOf(HttpHeader id, const char* key, size_t len) const;
+
+            /**
+             * @brief 重建常用头部下标
+             */
+            void Reindex();
+        private:
+            /// 头部数组
+            std::vector<Field> fields_;
+            /// 常用头部在fields_中的下标, -1表示不存在
+            int16_t known_[kHttpHeaderCount];
+            /// 存放字符串的内存块
+            std::vector<std::unique_ptr<char[]> > blocks_;
+            /// 当前块的空闲位置
+            char* cur_ = nullptr;
+            /// 当前块的剩余字节数
+            size_t left_ = 0;
+        }; // class HeaderMap
+
+        //--------------------------------------------------------------------
+
+    } // namespace http
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_HTTP_HEADER_H__
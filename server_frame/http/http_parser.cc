@@ -175,6 +175,59 @@ namespace ygw {
             //HttpRequestParser* parser = static_cast<HttpRequestParser*>(data);
         }
 
+        /**
+         * @brief Content-Length必须是纯数字(允许末尾空白)
+         */
+        static bool IsValidContentLength(const char* value, size_t vlen)
+        {
+            while (vlen > 0 && (value[vlen - 1] == ' ' || value[vlen - 1] == '\t'))
+            {
+                --vlen;
+            }
+            //20位以上会溢出uint64_t
+            if (vlen == 0 || vlen > 19)
+            {
+                return false;
+            }
+            for (size_t i = 0; i < vlen; ++i)
+            {
+                if (value[i] < '0' || value[i] > '9')
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief 检查决定消息体边界的头部, 前后端理解不一致会被用来夹带请求
+         * @return 错误码, 0表示没有问题
+         */
+        static int CheckBodyField(HttpRequest::ptr req, HttpHeader id, const char* value, size_t vlen)
+        {
+            if (id == HttpHeader::CONTENT_LENGTH)
+            {
+                if (!IsValidContentLength(value, vlen))
+                {
+                    return 1003;
+                }
+                const StringRef* old = req->FindHeader(HttpHeader::CONTENT_LENGTH);
+                if ((old && strtoull(old->c_str(), nullptr, 10) != strtoull(value, nullptr, 10))
+                        || req->FindHeader(HttpHeader::TRANSFER_ENCODING))
+                {
+                    return 1004;
+                }
+            }
+            else if (id == HttpHeader::TRANSFER_ENCODING)
+            {
+                if (req->FindHeader(HttpHeader::CONTENT_LENGTH))
+                {
+                    return 1004;
+                }
+            }
+            return 0;
+        }
+
         void OnRequestHttpField(void *data, const char *field, size_t flen
                 ,const char *value, size_t vlen) 
         {
@@ -187,8 +240,15 @@ namespace ygw {
                 // 在此处 当作错误比不当作错误，产生的问题会严重一点。
                 return;
             }
-            parser->GetData()->SetHeader(std::string(field, flen)
-                    ,std::string(value, vlen));
+            int error = CheckBodyField(parser->GetData(), LookupHttpHeader(field, flen), value, vlen);
+            if (error)
+            {
+                YGW_LOG_WARN(g_logger) << "invalid http request body field: "
+                    << std::string(field, flen) << ": " << std::string(value, vlen);
+                parser->SetError(error);
+                return;
+            }
+            parser->GetData()->SetHeader(field, flen, value, vlen);
         }
 
         HttpRequestParser::HttpRequestParser()
@@ -207,6 +267,14 @@ namespace ygw {
             parser_.data = this;
         }
 
+        void HttpRequestParser::Reset() 
+        {
+            //回调和parser_.data保留, 只重置状态机
+            error_ = 0;
+            data_.reset(new ygw::http::HttpRequest);
+            http_parser_init(&parser_);
+        }
+
         uint64_t HttpRequestParser::GetContentLength() 
         {
             return data_->GetHeaderAs<uint64_t>("content-length", 0);
@@ -295,8 +363,7 @@ namespace ygw {
                 //parser->SetError(1002);
                 return;
             }
-            parser->GetData()->SetHeader(std::string(field, flen)
-                    ,std::string(value, vlen));
+            parser->GetData()->SetHeader(field, flen, value, vlen);
         }
 
         HttpResponseParser::HttpResponseParser()
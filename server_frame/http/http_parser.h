@@ -35,6 +35,11 @@ namespace ygw {
              */
             HttpRequestParser();
 
+            /**
+             * @brief 重置解析器, 用于解析同一连接上的下一个请求
+             */
+            void Reset();
+
             /**
              * @brief 解析协议
              * @param[in, out] data 协议文本内存
@@ -96,6 +101,8 @@ namespace ygw {
             /// 1000: invalid method
             /// 1001: invalid version
             /// 1002: invalid field
+            /// 1003: invalid content-length
+            /// 1004: conflicting content-length/transfer-encoding
             int error_;
         };
 
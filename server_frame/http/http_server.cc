@@ -41,6 +41,17 @@ namespace ygw {
                  //dispatch_->AddServlet("/_/config", Servlet::ptr(new ConfigServlet));
         }
 
+        HttpServer::HttpServer(bool keepalive
+                ,ygw::scheduler::IOManagerGroup::ptr io_group
+                ,ygw::scheduler::IOManager* accept_worker)
+            :TcpServer(io_group, accept_worker)
+            ,is_keepalive_(keepalive) 
+            ,root_path_(ygw::sys::EnvManager::GetInstance()->GetAbsolutePath(""))
+        {
+                 dispatch_.reset(new ServletDispatch);
+                 type_ = "http";
+        }
+
         void HttpServer::SetName(const std::string& v) 
         {
             TcpServer::SetName(v);
@@ -52,7 +63,7 @@ namespace ygw {
             YGW_LOG_DEBUG(g_logger) << "HandleClient " << *client;
             HttpSession::ptr session(new HttpSession(client));
             do {
-                auto req = session->RecvRequest(); // 接受请求
+                auto req = session->RecvRequestHeader(); // 接受请求
                 if (!req) 
                 {
                     YGW_LOG_DEBUG(g_logger) << "recv http request fail, errno="
@@ -65,18 +76,52 @@ namespace ygw {
                 //    << " is_close=" << req->IsClose()
                 //    << " keep_alive=" << is_keepalive_;
 
+                //流式读取消息体的servlet自己读, 其他请求先把消息体整个读进来
+                Servlet::ptr slt = dispatch_->Route(req);
+                if (!(slt && slt->IsStreamBody()) && !session->RecvBody(req))
+                {
+                    YGW_LOG_DEBUG(g_logger) << "recv http body fail, errno="
+                        << errno << " errstr=" << strerror(errno)
+                        << " cliet:" << *client;
+                    break;
+                }
+
                 HttpResponse::ptr rsp(new HttpResponse(req->GetVersion()
                             ,req->IsClose() || !is_keepalive_));
 
                 rsp->SetHeader("Server", GetName());
-                if (!SendDocument(req, rsp, session))
+                rsp->SetHead(req->GetMethod() == HttpMethod::HEAD);
+                limiter::LimiterGuard admit(limiter_);
+                if (!admit.IsAcquired())
+                {
+                    //超出并发上限, 不占用servlet的时间
+                    rsp->SetStatus(HttpStatus::SERVICE_UNAVAILABLE);
+                    rsp->SetHeader("Retry-After", "1");
+                    SendResponse(session, rsp);
+                }
+                else
                 {
-                    dispatch_->Handle(req, rsp, session);
+                    {
+                        RequestGuard inflight(this);
+                        if (!SendDocument(req, rsp, session) && slt)
+                        {
+                            slt->Handle(req, rsp, session);
+                        }
+
+                        if (!rsp->IsStreaming())
+                        {
+                            SendResponse(session, rsp);
+                        }
+                        else if (session->IsStreaming())
+                        {
+                            //servlet没有结束流式响应时替它结束, 失败时rsp被标记为关闭
+                            session->FinishResponse();
+                        }
+                    }
+                    admit.Release();
                 }
-                
-                session->SendResponse(rsp);
 
-                if (!is_keepalive_ || req->IsClose()) 
+                if (!is_keepalive_ || req->IsClose() || rsp->IsClose()) 
                 {
                     break;
                 }
@@ -85,6 +130,30 @@ namespace ygw {
         }
 
 
+        void HttpServer::SendResponse(HttpSession::ptr session, HttpResponse::ptr rsp) 
+        {
+            //请求消息体没有读完时无法找到下一个请求的开头, 只能关闭连接
+            if (session->HasUnreadBody())
+            {
+                rsp->SetClose(true);
+            }
+            //管线化的下一个请求已经在缓冲区里时先不写, 和后面的响应一起写出
+            //写失败时连接已经不可用, 结束长连接循环
+            if (session->SendResponse(rsp, rsp->IsClose() || !session->HasBufferedRequest()) <= 0)
+            {
+                rsp->SetClose(true);
+            }
+        }
+
+        void HttpServer::RejectClient(socket::Socket::ptr client) 
+        {
+            //新连接的发送缓冲区是空的, 短响应一次写完, 不会挂起accept协程
+            static const char s_rsp[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                "Content-Length: 0\r\nConnection: close\r\n\r\n";
+            client->Send(s_rsp, sizeof(s_rsp) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            client->Close();
+        }
+
         bool HttpServer::SendDocument(HttpRequest::ptr request, HttpResponse::ptr response, HttpSession::ptr session)
         {
             //std::string cur_path = root_path_;// FSUtil::GetCurDir();
@@ -94,35 +163,22 @@ namespace ygw {
             if (strstr(obj_path.data(), ".."))
                 return false;
 
-            struct stat st;
-
-
-            if (stat(obj_path.data(), &st) < 0) {
+            CachedFile::ptr file = OpenFile(obj_path);
+            if (file->err) {
                 return false;
             }
-            bool is_file_path = (S_IFREG == (S_IFREG & st.st_mode));
-            bool is_dir_path = (S_IFDIR == (S_IFDIR & st.st_mode));
+            bool is_file_path = file->IsFile();
+            bool is_dir_path = file->IsDir();
 
             // index.html
-            //std::cout << cur_path << std::endl;
-            //std::cout << obj_path << std::endl;
             if (is_dir_path)
             {
-                std::string index_path = obj_path + "/index.html";
-                //if (!access(index_path.data(), F_OK))
-                int ret = stat(index_path.data(), &st); 
-                if (!ret)
-                {
-                    if (S_IFREG == (S_IFREG & st.st_mode))
-                    {
-                        is_file_path = true;
-                        is_dir_path = false;
-                        obj_path = index_path;
-                    }
-                }
-                else
+                CachedFile::ptr index = OpenFile(obj_path + "/index.html");
+                if (index->IsFile())
                 {
-                    std::cout << strerror(errno) << std::endl;
+                    is_file_path = true;
+                    is_dir_path = false;
+                    file = index;
                 }
             }
 
@@ -169,47 +225,221 @@ namespace ygw {
             }
             else if (is_file_path)
             {
-                const char* type = ygw::util::StringUtil::GuessContentType(obj_path);
-                //if (st.st_size > 256 * 1024 * 1024 && !strcmp(type, "application/misc")) // >8m and unknow type
-                if (st.st_size > 256 * 1024 * 1024) // >8m and unknow type
-                { 
-                    // too big
-                    // TODO transfer big file
-                    YGW_LOG_DEBUG(g_logger) << "SendDocument: transfer too large file";
+                return ServeFile(request, response, file);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        /**
+         * @brief 解析十进制无符号整数, 至少要有一位数字
+         */
+        static bool ParseUInt(const char*& p, uint64_t& v) 
+        {
+            if (*p < '0' || *p > '9') 
+            {
+                return false;
+            }
+            v = 0;
+            for (; *p >= '0' && *p <= '9'; ++p) 
+            {
+                if (v > (UINT64_MAX - 9) / 10) 
+                {
                     return false;
                 }
-                else
+                v = v * 10 + (*p - '0');
+            }
+            return true;
+        }
+
+        /**
+         * @brief 解析Range请求头
+         * @param[in] v Range请求头, 只支持bytes=a-b, bytes=a-, bytes=-n
+         * @param[in] size 文件大小
+         * @param[out] begin 区间开始
+         * @param[out] end 区间结束(不含)
+         * @return 1 区间有效, 0 格式不对或者多个区间, 忽略Range, -1 区间超出文件(416)
+         */
+        static int ParseRange(const std::string& v, uint64_t size, uint64_t& begin, uint64_t& end) 
+        {
+            if (v.compare(0, 6, "bytes=") != 0 || v.find(',') != std::string::npos) 
+            {
+                return 0;
+            }
+            const char* p = v.c_str() + 6;
+            uint64_t first = 0;
+            uint64_t last = 0;
+            if (*p == '-') 
+            {
+                ++p;
+                if (!ParseUInt(p, last) || *p) 
+                {
+                    return 0;
+                }
+                if (last == 0 || size == 0) 
+                {
+                    return -1;
+                }
+                begin = size > last ? size - last : 0;
+                end = size;
+                return 1;
+            }
+            if (!ParseUInt(p, first) || *p++ != '-') 
+            {
+                return 0;
+            }
+            if (*p) 
+            {
+                if (!ParseUInt(p, last) || *p || last < first) 
+                {
+                    return 0;
+                }
+            } 
+            else 
+            {
+                last = UINT64_MAX - 1;
+            }
+            if (first >= size) 
+            {
+                return -1;
+            }
+            begin = first;
+            end = std::min(last + 1, size);
+            return 1;
+        }
+
+        /**
+         * @brief If-None-Match中是否有与etag匹配的(弱比较)
+         */
+        static bool MatchETag(const std::string& v, const std::string& etag) 
+        {
+            size_t pos = 0;
+            while (pos < v.size()) 
+            {
+                size_t next = v.find(',', pos);
+                if (next == std::string::npos) 
+                {
+                    next = v.size();
+                }
+                std::string tag = ygw::util::StringUtil::Trim(v.substr(pos, next - pos));
+                if (tag.compare(0, 2, "W/") == 0) 
+                {
+                    tag = tag.substr(2);
+                }
+                if (tag == "*" || tag == etag) 
                 {
-                    auto fp = ygw::util::FSUtil::OpenFile(obj_path, "rb");
-                    int src_size = ygw::util::FSUtil::GetFileSize(fp.get());
-                    int size = src_size;
-                    std::string body;
-                    body.resize(size);
-                    constexpr int per_size = 4096;
-                    int offset;
-                    for (offset = 0; size > per_size; offset += per_size, size -= per_size)
-                    {
-                        if (fread(&body[0] + offset, 1, per_size, fp.get()) != per_size)
-                        {
-                            YGW_LOG_ERROR(g_logger) << "fread error";
-                            return false;
-                        }
-                    }
-                    if (fread(&body[0] + offset, 1, size, fp.get()) != (size_t)size)
-                    {
-                        YGW_LOG_ERROR(g_logger) << "fread error";
-                        return false;
-                    }
-                    response->SetBody(body);
-                    response->SetHeader("Content-Type", type);
                     return true;
                 }
+                pos = next + 1;
+            }
+            return false;
+        }
+
+        CachedFile::ptr HttpServer::OpenFile(const std::string& path)
+        {
+            return file_cache_ ? file_cache_->Get(path) : FileCache::Load(path);
+        }
+
+        /**
+         * @brief Accept-Encoding是否接受gzip(q=0表示不接受)
+         */
+        static bool AcceptGzip(const std::string& v) 
+        {
+            size_t pos = 0;
+            while (pos < v.size()) 
+            {
+                size_t next = v.find(',', pos);
+                if (next == std::string::npos) 
+                {
+                    next = v.size();
+                }
+                std::string item = v.substr(pos, next - pos);
+                size_t semi = item.find(';');
+                std::string coding = ygw::util::StringUtil::Trim(item.substr(0, semi));
+                if (strcasecmp(coding.c_str(), "gzip") == 0 || coding == "*") 
+                {
+                    size_t q = semi == std::string::npos ? std::string::npos : item.find("q=", semi);
+                    return q == std::string::npos || atof(item.c_str() + q + 2) > 0;
+                }
+                pos = next + 1;
+            }
+            return false;
+        }
 
+        bool HttpServer::ServeFile(HttpRequest::ptr request, HttpResponse::ptr response, CachedFile::ptr file)
+        {
+            const struct stat& st = file->st;
+            uint64_t size = st.st_size;
+            const std::string& etag = file->etag;
+            const std::string& last_modified = file->last_modified;
+            //小文件从内存发送, 有gzip副本时按Accept-Encoding选择, gzip副本用弱ETag区分
+            AssetCache::Asset::ptr asset = asset_cache_ ? asset_cache_->Get(file) : nullptr;
+            bool gzip = asset && asset->gzip && AcceptGzip(request->GetHeader(HttpHeader::ACCEPT_ENCODING));
+            response->SetHeader("Content-Type", file->content_type);
+            response->SetHeader("ETag", gzip ? "W/" + etag : etag);
+            response->SetHeader("Last-Modified", last_modified);
+            response->SetHeader("Accept-Ranges", "bytes");
+            if (asset && asset->gzip) 
+            {
+                response->SetHeader("Vary", "Accept-Encoding");
             }
-            else
+
+            //有If-None-Match时忽略If-Modified-Since
+            std::string inm = request->GetHeader(HttpHeader::IF_NONE_MATCH);
+            bool not_modified = false;
+            if (!inm.empty()) 
             {
-                return false;
+                not_modified = MatchETag(inm, etag);
+            } 
+            else 
+            {
+                time_t ims = ParseHttpDate(request->GetHeader(HttpHeader::IF_MODIFIED_SINCE));
+                not_modified = ims != -1 && st.st_mtime <= ims;
+            }
+            if (not_modified) 
+            {
+                response->SetStatus(HttpStatus::NOT_MODIFIED);
+                return true;
+            }
+
+            uint64_t begin = 0;
+            uint64_t end = size;
+            std::string range = request->GetHeader(HttpHeader::RANGE);
+            std::string if_range = request->GetHeader(HttpHeader::IF_RANGE);
+            //If-Range不匹配说明客户端缓存的部分已经过期, 回复整个文件
+            if (!range.empty() && (if_range.empty() || if_range == etag || if_range == last_modified)) 
+            {
+                int rt = ParseRange(range, size, begin, end);
+                if (rt < 0) 
+                {
+                    response->SetStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+                    response->SetHeader("Content-Range", "bytes */" + std::to_string(size));
+                    return true;
+                }
+                if (rt > 0) 
+                {
+                    //区间按原始内容计算, 用sendfile发送
+                    response->SetStatus(HttpStatus::PARTIAL_CONTENT);
+                    response->SetHeader("Content-Range", "bytes " + std::to_string(begin)
+                            + "-" + std::to_string(end - 1) + "/" + std::to_string(size));
+                    response->SetHeader("ETag", etag);
+                    asset.reset();
+                }
+            }
+            if (asset) 
+            {
+                if (gzip) 
+                {
+                    response->SetHeader("Content-Encoding", "gzip");
+                }
+                response->SetSharedBody(gzip ? asset->gzip : asset->data);
+                return true;
             }
+            //fd属于CachedFile, 发送完之前HttpFileBody一直持有它
+            response->SetFileBody(std::make_shared<HttpFileBody>(file->fd, begin, end - begin, file));
+            return true;
         }
 
         //-----------------------------------------------------------------------------
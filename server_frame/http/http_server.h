@@ -10,7 +10,10 @@
 #ifndef __YGE_HTTP_SERVER_H__
 #define __YGE_HTTP_SERVER_H__
 
+#include "server_frame/concurrency_limiter.h"
 #include "server_frame/tcp_server.h"
+#include "asset_cache.h"
+#include "file_cache.h"
 #include "http_session.h"
 #include "servlet.h"
 
@@ -67,6 +70,16 @@ namespace ygw {
                     ,ygw::scheduler::IOManager* io_worker = ygw::scheduler::IOManager::GetThis()
                     ,ygw::scheduler::IOManager* accept_worker = ygw::scheduler::IOManager::GetThis());
 
+            /**
+             * @brief 构造函数
+             * @param[in] keepalive 是否长连接
+             * @param[in] io_group 处理连接的调度器组
+             * @param[in] accept_worker 接收连接调度器, 为空使用组的第一个成员
+             */
+            HttpServer(bool keepalive
+                    ,ygw::scheduler::IOManagerGroup::ptr io_group
+                    ,ygw::scheduler::IOManager* accept_worker = ygw::scheduler::IOManager::GetThis());
+
             /**
              * @brief 获取ServletDispatch
              */
@@ -77,6 +90,39 @@ namespace ygw {
              */
             void SetServletDispatch(ServletDispatch::ptr v) { dispatch_ = v; }
 
+            /**
+             * @brief 设置并发限制器, 超出上限的请求不进入servlet, 直接回复503
+             * @details 在Start之前设置
+             */
+            void SetLimiter(limiter::ConcurrencyLimiter::ptr v) { limiter_ = v; }
+
+            /**
+             * @brief 返回并发限制器
+             */
+            limiter::ConcurrencyLimiter::ptr GetLimiter() const { return limiter_; }
+
+            /**
+             * @brief 设置静态文件的打开文件缓存, 为空时每个请求都stat/open
+             * @details 在Start之前设置
+             */
+            void SetFileCache(FileCache::ptr v) { file_cache_ = v; }
+
+            /**
+             * @brief 返回静态文件的打开文件缓存
+             */
+            FileCache::ptr GetFileCache() const { return file_cache_; }
+
+            /**
+             * @brief 设置静态小文件的内存缓存, 为空时文件都用sendfile发送
+             * @details 在Start之前设置, 一般和FileCache一起使用
+             */
+            void SetAssetCache(AssetCache::ptr v) { asset_cache_ = v; }
+
+            /**
+             * @brief 返回静态小文件的内存缓存
+             */
+            AssetCache::ptr GetAssetCache() const { return asset_cache_; }
+
             /**
              * @brief 设置root_path_
              */
@@ -88,12 +134,44 @@ namespace ygw {
             virtual void SetName(const std::string& v) override;
         protected:
             virtual void HandleClient(ygw::socket::Socket::ptr client) override;
+
+            /**
+             * @brief 达到连接上限时回复503后关闭连接
+             */
+            virtual void RejectClient(ygw::socket::Socket::ptr client) override;
             bool SendDocument(HttpRequest::ptr request, HttpResponse::ptr response, HttpSession::ptr session);
+
+            /**
+             * @brief 发送servlet处理完的响应, 管线化时攒起来和后面的响应一起写出
+             */
+            void SendResponse(HttpSession::ptr session, HttpResponse::ptr rsp);
+
+            /**
+             * @brief 发送普通文件
+             * @details 响应带ETag/Last-Modified, 按If-None-Match/If-Modified-Since回复304,
+             *          支持单个区间的Range(If-Range)回复206/416, 多区间按整个文件回复.
+             *          有asset_cache_时小文件从共享的内存副本发送(客户端接受时发gzip副本),
+             *          其他文件内容不读入内存, 由HttpSession用sendfile写出
+             * @param[in] file 打开的普通文件
+             * @return 总是返回true
+             */
+            bool ServeFile(HttpRequest::ptr request, HttpResponse::ptr response, CachedFile::ptr file);
+
+            /**
+             * @brief 查找路径, 有file_cache_时经过缓存
+             */
+            CachedFile::ptr OpenFile(const std::string& path);
         private:
             /// 是否支持长连接
             bool is_keepalive_;
             /// Servlet分发器
             ServletDispatch::ptr dispatch_;
+            /// 并发限制器
+            limiter::ConcurrencyLimiter::ptr limiter_;
+            /// 静态文件的打开文件缓存
+            FileCache::ptr file_cache_;
+            /// 静态小文件的内存缓存
+            AssetCache::ptr asset_cache_;
             /// 根路径
             std::string root_path_;
         };
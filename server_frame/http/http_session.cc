@@ -10,6 +10,14 @@
  *  Description: 
  * ====================================================
  */
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "http_parser.h"
 #include "http_session.h"
 
@@ -22,80 +30,653 @@ namespace ygw {
         {
         }
 
+		/// 攒下的响应超过这个大小就先写出
+		static constexpr size_t kMaxWriteBuffer = 64 * 1024;
+
+		/**
+		 * @brief 把iovec中的数据全部写到文件
+		 */
+		static bool WriteFileFully(int fd, std::vector<iovec>& iovs)
+		{
+			for (auto& i : iovs)
+			{
+				const char* p = (const char*)i.iov_base;
+				size_t left = i.iov_len;
+				while (left > 0)
+				{
+					ssize_t n = write(fd, p, left);
+					if (n <= 0)
+					{
+						return false;
+					}
+					p += n;
+					left -= n;
+				}
+			}
+			return true;
+		}
+
 		HttpRequest::ptr HttpSession::RecvRequest() 
         {
-			HttpRequestParser::ptr parser(new HttpRequestParser); //使用HttpParser解析
-			uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize(); // 获取缓冲区大小
-            std::shared_ptr<char[]> buffer(new char[buff_size]); // 创建缓存
-            // 缓冲区已经塞满，还没有解析完：恶意，有问题的请求 
-			char* data = buffer.get();
-			int offset = 0;
+			HttpRequest::ptr req = RecvRequestHeader();
+			if (!req || !RecvBody(req))
+			{
+				return nullptr;
+			}
+			return req;
+		}
+
+		HttpRequest::ptr HttpSession::RecvRequestHeader() 
+        {
+			//上一个请求的消息体没读完, 后面的数据已经对不上了
+			if (body_mode_ != kBodyNone)
+			{
+				Close();
+				return nullptr;
+			}
+			//解析器和缓冲区在长连接的多个请求之间复用
+			if (parser_)
+			{
+				parser_->Reset();
+			}
+			else
+			{
+				parser_.reset(new HttpRequestParser);
+				buffer_size_ = HttpRequestParser::GetHttpRequestBufferSize();
+				buffer_.reset(new char[buffer_size_]);
+			}
+			char* data = buffer_.get();
+			//上一个请求读多的字节先解析, 不够再读
+			size_t offset = buffer_len_;
+			buffer_len_ = 0;
 			do {
-				int len = Read(data + offset, buff_size - offset);
-				if (len <= 0)  //发生错误 读不到
-                {
+				if (offset > 0)
+				{
+					size_t nparse = parser_->Execute(data, offset);
+					if (parser_->HasError()) // 有错误
+					{
+						//回复400后关闭, 不再猜测消息体的边界
+						static const char s_bad_request[] = "HTTP/1.1 400 Bad Request\r\n"
+							"Content-Length: 0\r\nConnection: close\r\n\r\n";
+						if (pending_.empty() || Flush() > 0)
+						{
+							WriteFixSize(s_bad_request, sizeof(s_bad_request) - 1);
+						}
+						Close();
+						return nullptr;
+					}
+					offset -= nparse;
+					if (parser_->IsFinished())  //结束
+					{
+						break;
+					}
+					// 缓冲区已经塞满，还没有解析完：恶意，有问题的请求 
+					if (offset == buffer_size_)  //out of range
+					{
+						Close();
+						return nullptr;
+					}
+				}
+				//要阻塞读了, 先把攒下的响应写出去
+				if (!pending_.empty() && Flush() <= 0)
+				{
 					Close();
 					return nullptr;
 				}
-				len += offset;
-				size_t nparse = parser->Execute(data, len);
-				if (parser->HasError()) // 有错误
+				int len = Read(data + offset, buffer_size_ - offset);
+				if (len <= 0)  //发生错误 读不到
                 {
 					Close();
 					return nullptr;
 				}
-				offset = len - nparse;
-				if (offset == (int)buff_size)  //out of range
-                {
+				offset += len;
+			} while(true);
+
+			//解析器已经把请求头之后的字节移到了缓冲区开头, 它们属于消息体或者下一个请求
+			buffer_len_ = offset;
+			HttpRequest::ptr req = parser_->GetData();
+			req->Init();
+
+			body_remaining_ = 0;
+			chunk_crlf_ = false;
+			const StringRef* te = req->FindHeader(HttpHeader::TRANSFER_ENCODING);
+			if (te && strcasestr(te->c_str(), "chunked"))
+			{
+				body_mode_ = kBodyChunked;
+			}
+			else
+			{
+				body_remaining_ = parser_->GetContentLength();
+				body_mode_ = body_remaining_ > 0 ? kBodyLength : kBodyNone;
+			}
+			expect_continue_ = body_mode_ != kBodyNone && req->GetVersion() >= 0x11
+				&& strcasecmp(req->GetHeader(HttpHeader::EXPECT).c_str(), "100-continue") == 0;
+			return req;
+		}
+
+		bool HttpSession::RecvBody(HttpRequest::ptr req)
+		{
+			if (body_mode_ == kBodyNone)
+			{
+				return true;
+			}
+			uint64_t max_size = HttpRequestParser::GetHttpRequestMaxBodySize();
+			std::string body;
+			int n = 0;
+			if (body_mode_ == kBodyLength)
+			{
+				if (body_remaining_ > max_size)
+				{
 					Close();
-					return nullptr;
+					return false;
 				}
-				if (parser->IsFinished())  //结束
-                {
-					break;
+				body.resize(body_remaining_);
+				size_t offset = 0;
+				while (offset < body.size() && (n = ReadBody(&body[offset], body.size() - offset)) > 0)
+				{
+					offset += n;
 				}
-			} while(true);
+			}
+			else
+			{
+				char buffer[4096];
+				while ((n = ReadBody(buffer, sizeof(buffer))) > 0)
+				{
+					if (body.size() + n > max_size)
+					{
+						n = -1;
+						break;
+					}
+					body.append(buffer, n);
+				}
+			}
+			if (n < 0 || body_mode_ != kBodyNone)
+			{
+				Close();
+				return false;
+			}
+			req->SetBody(body);
+			return true;
+		}
+
+		int HttpSession::ReadBody(void* buffer, size_t length)
+		{
+			if (body_mode_ == kBodyNone)
+			{
+				return 0;
+			}
+			if (expect_continue_)
+			{
+				expect_continue_ = false;
+				static const char s_continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+				if ((!pending_.empty() && Flush() <= 0)
+						|| WriteFixSize(s_continue, sizeof(s_continue) - 1) <= 0)
+				{
+					return -1;
+				}
+			}
+			if (body_mode_ == kBodyChunked && body_remaining_ == 0)
+			{
+				int rt = ReadChunkSize();
+				if (rt <= 0)
+				{
+					return rt;
+				}
+			}
+			int n = ReadRaw(buffer, std::min<uint64_t>(length, body_remaining_));
+			if (n <= 0)
+			{
+				//对方在消息体中间关闭也是错误
+				return -1;
+			}
+			body_remaining_ -= n;
+			if (body_remaining_ == 0)
+			{
+				if (body_mode_ == kBodyLength)
+				{
+					body_mode_ = kBodyNone;
+				}
+				else
+				{
+					chunk_crlf_ = true;
+				}
+			}
+			return n;
+		}
 
-			int64_t length = parser->GetContentLength();
-			if (length > 0) // 有内容 
-            {
-				std::string body;
-				body.resize(length);
+		int HttpSession::ReadRaw(void* buffer, size_t length)
+		{
+			if (buffer_len_ > 0)
+			{
+				size_t n = std::min(length, buffer_len_);
+				memcpy(buffer, buffer_.get(), n);
+				Consume(n);
+				return n;
+			}
+			//缓冲区空了, 大块数据直接从socket读到调用方的内存
+			if (!pending_.empty() && Flush() <= 0)
+			{
+				return -1;
+			}
+			return Read(buffer, length);
+		}
 
-				int len = 0;
-				if (length >= offset) 
-                {
-					memcpy(&body[0], data, offset);
-					len = offset;
-				} 
-                else 
-                {
-					memcpy(&body[0], data, length);
-					len = length;
+		int HttpSession::FillBuffer()
+		{
+			if (buffer_len_ == buffer_size_)
+			{
+				return -1;
+			}
+			if (!pending_.empty() && Flush() <= 0)
+			{
+				return -1;
+			}
+			int n = Read(buffer_.get() + buffer_len_, buffer_size_ - buffer_len_);
+			if (n > 0)
+			{
+				buffer_len_ += n;
+			}
+			return n;
+		}
+
+		int HttpSession::FindLine()
+		{
+			size_t from = 0;
+			while (true)
+			{
+				char* data = buffer_.get();
+				for (size_t i = from; i + 1 < buffer_len_; ++i)
+				{
+					if (data[i] == '\r' && data[i + 1] == '\n')
+					{
+						return i;
+					}
 				}
-				length -= offset;
-				if (length > 0) 
-                {
-					if (ReadFixSize(&body[len], length) <= 0)
-                    {
-						Close();
-						return nullptr;
+				from = buffer_len_ > 0 ? buffer_len_ - 1 : 0;
+				if (FillBuffer() <= 0)
+				{
+					return -1;
+				}
+			}
+		}
+
+		void HttpSession::Consume(size_t n)
+		{
+			buffer_len_ -= n;
+			if (buffer_len_ > 0)
+			{
+				memmove(buffer_.get(), buffer_.get() + n, buffer_len_);
+			}
+		}
+
+		int HttpSession::ReadChunkSize()
+		{
+			if (chunk_crlf_)
+			{
+				if (FindLine() != 0)
+				{
+					return -1;
+				}
+				Consume(2);
+				chunk_crlf_ = false;
+			}
+			int pos = FindLine();
+			if (pos <= 0)
+			{
+				return -1;
+			}
+			//块长度是十六进制, 后面可能跟着;扩展
+			const char* data = buffer_.get();
+			uint64_t size = 0;
+			int i = 0;
+			for (; i < pos && isxdigit((unsigned char)data[i]); ++i)
+			{
+				if (size >> 60)
+				{
+					return -1;
+				}
+				char c = data[i];
+				size = size * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+			}
+			if (i == 0 || (i < pos && data[i] != ';' && data[i] != ' ' && data[i] != '\t'))
+			{
+				return -1;
+			}
+			Consume(pos + 2);
+			if (size > 0)
+			{
+				body_remaining_ = size;
+				return 1;
+			}
+			//最后一个块, 跳过trailer直到空行
+			while ((pos = FindLine()) > 0)
+			{
+				Consume(pos + 2);
+			}
+			if (pos < 0)
+			{
+				return -1;
+			}
+			Consume(2);
+			body_mode_ = kBodyNone;
+			return 0;
+		}
+
+		/**
+		 * @brief 读取请求消息体的Stream, 不能写
+		 */
+		class HttpBodyStream : public stream::Stream
+		{
+		public:
+			HttpBodyStream(HttpSession* session)
+				:session_(session)
+			{
+			}
+
+			virtual int Read(void* buffer, size_t length) override
+			{
+				return session_->ReadBody(buffer, length);
+			}
+
+			virtual int Read(container::ByteArray::ptr ba, size_t length) override
+			{
+				std::vector<iovec> iovs;
+				ba->GetWriteBuffers(iovs, length);
+				//和socket的readv一样: 依次填满每个缓冲, 读到的比缓冲少说明暂时没有更多数据
+				int total = 0;
+				for (auto& iov : iovs)
+				{
+					int rt = session_->ReadBody(iov.iov_base, iov.iov_len);
+					if (rt < 0)
+					{
+						if (total == 0)
+						{
+							return rt;
+						}
+						break;
+					}
+					total += rt;
+					if ((size_t)rt < iov.iov_len)
+					{
+						break;
 					}
 				}
-				parser->GetData()->SetBody(body);
+				if (total > 0)
+				{
+					ba->SetPosition(ba->GetPosition() + total);
+				}
+				return total;
 			}
 
-			parser->GetData()->Init();
-            
-			return parser->GetData();
+			virtual int Write(const void* buffer, size_t length) override { return -1; }
+			virtual int Write(container::ByteArray::ptr ba, size_t length) override { return -1; }
+			virtual void Close() override {}
+		private:
+			/// 所属会话
+			HttpSession* session_;
+		};
+
+		stream::Stream::ptr HttpSession::GetBodyStream()
+		{
+			return std::make_shared<HttpBodyStream>(this);
+		}
+
+		int64_t HttpSession::SpoolBody(container::ByteArray::ptr ba, uint64_t memory_limit
+				,const std::string& tmp_dir, std::string& file_path)
+		{
+			file_path.clear();
+			const size_t kBufferSize = 64 * 1024;
+			std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+			int64_t total = 0;
+			int fd = -1;
+			std::string path;
+			int n = 0;
+			while ((n = ReadBody(buffer.get(), kBufferSize)) > 0)
+			{
+				total += n;
+				if (fd < 0 && ba->GetSize() + n <= memory_limit)
+				{
+					ba->Write(buffer.get(), n);
+					continue;
+				}
+				if (fd < 0)
+				{
+					//超出内存上限, 已经在内存中的部分先写到临时文件
+					path = tmp_dir + "/ygw_body_XXXXXX";
+					fd = mkstemp(&path[0]);
+					if (fd < 0)
+					{
+						n = -1;
+						break;
+					}
+					std::vector<iovec> iovs;
+					ba->SetPosition(0);
+					ba->GetReadBuffers(iovs, ba->GetSize());
+					if (!WriteFileFully(fd, iovs))
+					{
+						n = -1;
+						break;
+					}
+					ba->Clear();
+				}
+				std::vector<iovec> iovs(1);
+				iovs[0].iov_base = buffer.get();
+				iovs[0].iov_len = n;
+				if (!WriteFileFully(fd, iovs))
+				{
+					n = -1;
+					break;
+				}
+			}
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			if (n < 0)
+			{
+				if (!path.empty())
+				{
+					unlink(path.c_str());
+				}
+				return -1;
+			}
+			ba->SetPosition(0);
+			file_path = path;
+			return total;
 		}
 
-		int HttpSession::SendResponse(HttpResponse::ptr rsp) 
+		int HttpSession::SendResponse(HttpResponse::ptr rsp, bool flush) 
         {
-			std::stringstream ss;
-			ss << *rsp;
-			std::string data = ss.str();
-			return WriteFixSize(data.c_str(), data.size());
+			PendingResponse pending;
+			pending.header_begin = header_buffer_.size();
+			rsp->DumpHeader(header_buffer_);
+			pending.header_end = header_buffer_.size();
+			pending.rsp = rsp;
+			pending_bytes_ += pending.header_end - pending.header_begin
+				+ (rsp->IsHead() ? 0 : rsp->GetContentLength());
+			pending_.push_back(std::move(pending));
+			if (flush || pending_bytes_ >= kMaxWriteBuffer)
+			{
+				return Flush();
+			}
+			return pending_bytes_;
+		}
+
+		int HttpSession::Flush()
+		{
+			if (pending_.empty())
+			{
+				return 0;
+			}
+			//header_buffer_不再追加, 这里取的指针在写出期间有效
+			iovs_.clear();
+			int64_t total = 0;
+			int64_t rt = 1;
+			for (auto& i : pending_)
+			{
+				iovec iov;
+				iov.iov_base = &header_buffer_[i.header_begin];
+				iov.iov_len = i.header_end - i.header_begin;
+				iovs_.push_back(iov);
+				if (i.rsp->IsHead())
+				{
+					continue;
+				}
+				auto file = i.rsp->GetFileBody();
+				if (file)
+				{
+					//文件之前的数据先写出, MSG_MORE让它和文件开头合并成满的报文
+					if (file->length == 0)
+					{
+						continue;
+					}
+					rt = WriteFixSizeV(&iovs_[0], iovs_.size(), MSG_MORE);
+					iovs_.clear();
+					if (rt <= 0)
+					{
+						break;
+					}
+					total += rt;
+					rt = SendFile(file->fd, file->offset, file->length);
+					if (rt <= 0)
+					{
+						break;
+					}
+					total += rt;
+					continue;
+				}
+				const std::string& body = i.rsp->GetBody();
+				if (!body.empty())
+				{
+					iov.iov_base = (void*)body.data();
+					iov.iov_len = body.size();
+					iovs_.push_back(iov);
+				}
+			}
+			if (rt > 0 && !iovs_.empty())
+			{
+				rt = WriteFixSizeV(&iovs_[0], iovs_.size());
+				total += rt;
+			}
+			pending_.clear();
+			header_buffer_.clear();
+			pending_bytes_ = 0;
+			if (rt <= 0)
+			{
+				//写了一部分(比如文件变短, sendfile提前返回0), 连接上的数据已经错位, 只能关闭
+				SocketStream::Close();
+				return rt;
+			}
+			return std::min<int64_t>(total, INT_MAX);
+		}
+
+		int HttpSession::SendResponseHeader(HttpResponse::ptr rsp)
+		{
+			rsp->SetStreaming(true);
+			stream_rsp_ = rsp;
+			stream_chunked_ = false;
+			stream_remaining_ = 0;
+			const StringRef* length = rsp->FindHeader(HttpHeader::CONTENT_LENGTH);
+			if (length && !length->empty())
+			{
+				stream_remaining_ = strtoull(length->c_str(), nullptr, 10);
+			}
+			else if (rsp->GetVersion() >= 0x11)
+			{
+				rsp->SetHeader("Transfer-Encoding", "chunked");
+				stream_chunked_ = true;
+			}
+			else
+			{
+				//HTTP/1.0没有chunked, 只能靠关闭连接标记结束
+				rsp->SetClose(true);
+				stream_remaining_ = UINT64_MAX;
+			}
+			//前面攒下的管线化响应和响应头一起写出, 尽早让客户端收到响应头
+			return SendResponse(rsp, true);
+		}
+
+		int HttpSession::SendBodyChunk(const void* data, size_t length)
+		{
+			if (!stream_rsp_)
+			{
+				return -1;
+			}
+			if (length == 0 || stream_rsp_->IsHead())
+			{
+				return 1;
+			}
+			if (!stream_chunked_)
+			{
+				if (length > stream_remaining_)
+				{
+					stream_rsp_->SetClose(true);
+					return -1;
+				}
+				if (stream_remaining_ != UINT64_MAX)
+				{
+					stream_remaining_ -= length;
+				}
+				int rt = WriteFixSize(data, length);
+				if (rt <= 0)
+				{
+					stream_rsp_->SetClose(true);
+				}
+				return rt;
+			}
+			//长度行和结尾的\r\n跟数据一起writev, 数据不拷贝
+			char size_line[24];
+			iovec iovs[3];
+			iovs[0].iov_base = size_line;
+			iovs[0].iov_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+			iovs[1].iov_base = (void*)data;
+			iovs[1].iov_len = length;
+			iovs[2].iov_base = (void*)"\r\n";
+			iovs[2].iov_len = 2;
+			int rt = WriteFixSizeV(iovs, 3);
+			if (rt <= 0)
+			{
+				stream_rsp_->SetClose(true);
+			}
+			return rt;
+		}
+
+		int HttpSession::FinishResponse()
+		{
+			if (!stream_rsp_)
+			{
+				return -1;
+			}
+			HttpResponse::ptr rsp = stream_rsp_;
+			stream_rsp_.reset();
+			if (rsp->IsHead())
+			{
+				return 1;
+			}
+			int rt = 1;
+			if (stream_chunked_)
+			{
+				rt = WriteFixSize("0\r\n\r\n", 5);
+			}
+			else if (stream_remaining_ > 0 && stream_remaining_ != UINT64_MAX)
+			{
+				rt = -1;
+			}
+			//写失败或者Content-Length没写够, 连接上的数据已经错位, 只能关闭
+			if (rt <= 0)
+			{
+				rsp->SetClose(true);
+			}
+			return rt;
+		}
+
+		void HttpSession::Close()
+		{
+			if (!pending_.empty() && IsConnected())
+			{
+				Flush();
+			}
+			SocketStream::Close();
 		}
     } // namespace http
 
@@ -11,6 +11,7 @@
 #define __YGW_HTTP_SESSION_H__
 
 #include "http.h"
+#include "http_parser.h"
 #include "server_frame/stream/socket_stream.h"
 
 namespace ygw {
@@ -19,6 +20,14 @@ namespace ygw {
 
     namespace http {
 
+        /**
+         * @brief 服务端HTTP会话
+         * @details 接收缓冲区和解析器在长连接的多个请求之间复用, 读多的字节留给下一个请求,
+         *          所以支持HTTP/1.1管线化. 缓冲区里已经有下一个请求时, 响应先攒起来,
+         *          等到要阻塞读之前或者关闭时再一起写出, 响应顺序与请求顺序一致.
+         *          响应头序列化到复用的缓冲区, 和消息体一起用一次writev写出, 消息体不拷贝;
+         *          文件消息体用sendfile从文件直接写到socket
+         */
         class HttpSession : public stream::SocketStream {
         public:
             /// 智能指针类型定义
@@ -32,19 +41,192 @@ namespace ygw {
             HttpSession(socket::Socket::ptr sock, bool owner = true);
 
             /**
-             * @brief 接收HTTP请求
+             * @brief 接收HTTP请求, 包括完整的消息体
              */
             HttpRequest::ptr RecvRequest();
 
+            /**
+             * @brief 只接收HTTP请求头, 消息体之后用RecvBody整个读入或者用ReadBody边读边处理
+             * @details 支持Content-Length和Transfer-Encoding: chunked的消息体
+             */
+            HttpRequest::ptr RecvRequestHeader();
+
+            /**
+             * @brief 把消息体整个读入req的body, 大小受http.request.max_body_size限制
+             * @return 失败时关闭连接返回false
+             */
+            bool RecvBody(HttpRequest::ptr req);
+
+            /**
+             * @brief 从socket读取一段消息体, chunked时已经解码
+             * @details 请求带Expect: 100-continue时, 第一次读之前先回复100 Continue
+             * @return >0 读到的字节数, =0 消息体已经读完, <0 出错或者消息体不完整
+             */
+            int ReadBody(void* buffer, size_t length);
+
+            /**
+             * @brief 当前请求的消息体是否还没读完
+             */
+            bool HasUnreadBody() const { return body_mode_ != kBodyNone; }
+
+            /**
+             * @brief 返回读取当前请求消息体的Stream, 不能在会话之外使用
+             */
+            stream::Stream::ptr GetBodyStream();
+
+            /**
+             * @brief 读完当前请求的消息体, 不超过memory_limit时放在ba中,
+             *        超过时连同ba中已有的数据一起写到tmp_dir下的临时文件, 内存占用不超过memory_limit
+             * @param[in, out] ba 内存中的消息体, 返回时position为0
+             * @param[in] memory_limit 内存中最多保存的字节数
+             * @param[in] tmp_dir 临时文件目录
+             * @param[out] file_path 写了临时文件时返回路径, 由调用方删除; 否则为空
+             * @return 消息体长度, <0 失败
+             */
+            int64_t SpoolBody(container::ByteArray::ptr ba, uint64_t memory_limit
+                    ,const std::string& tmp_dir, std::string& file_path);
+
             /**
              * @brief 发送HTTP响应
              * @param[in] rsp HTTP响应
+             * @param[in] flush 是否立即写出, false时先攒在发送缓冲区
              * @return >0 发送成功
              *         =0 对方关闭
              *         <0 Socket异常
              */
-            int SendResponse(HttpResponse::ptr rsp);
+            int SendResponse(HttpResponse::ptr rsp, bool flush = true);
+
+            /**
+             * @brief 写出发送缓冲区中攒下的响应
+             * @details 写失败时关闭连接
+             * @return >0 发送成功, =0 对方关闭或者没有数据, <0 Socket异常
+             */
+            int Flush();
+
+            /**
+             * @brief 开始流式响应, 写出响应头, 消息体之后用SendBodyChunk分块写出
+             * @details rsp设置了Content-Length时按这个长度写消息体; 否则HTTP/1.1用
+             *          Transfer-Encoding: chunked, HTTP/1.0写完后关闭连接.
+             *          写消息体时socket发送缓冲区满了会挂起当前协程, 直到对方读走数据,
+             *          生产者的速度被限制在连接的速度, 内存占用不随消息体大小增长
+             * @param[in] rsp HTTP响应, 不能有消息体
+             * @return >0 成功, =0 对方关闭, <0 Socket异常
+             */
+            int SendResponseHeader(HttpResponse::ptr rsp);
+
+            /**
+             * @brief 写出一段消息体
+             * @pre 已经调用SendResponseHeader
+             * @return >0 成功, =0 对方关闭, <0 Socket异常或者超出Content-Length
+             */
+            int SendBodyChunk(const void* data, size_t length);
+
+            /**
+             * @brief 写出一段消息体
+             */
+            int SendBodyChunk(const std::string& data) { return SendBodyChunk(data.data(), data.size()); }
 
+            /**
+             * @brief 结束流式响应, chunked时写出结束块
+             * @return >0 成功, =0 对方关闭, <0 Socket异常或者消息体短于Content-Length
+             */
+            int FinishResponse();
+
+            /**
+             * @brief 是否有没结束的流式响应
+             */
+            bool IsStreaming() const { return !!stream_rsp_; }
+
+            /**
+             * @brief 接收缓冲区里是否已经有下一个请求的数据(管线化)
+             */
+            bool HasBufferedRequest() const { return buffer_len_ > 0; }
+
+            /**
+             * @brief 写出攒下的响应后关闭
+             */
+            virtual void Close() override;
+        private:
+            /**
+             * @brief 消息体的编码
+             */
+            enum BodyMode {
+                /// 没有消息体或者已经读完
+                kBodyNone = 0,
+                /// Content-Length
+                kBodyLength = 1,
+                /// Transfer-Encoding: chunked
+                kBodyChunked = 2,
+            };
+
+            /**
+             * @brief 从接收缓冲区剩下的字节中读, 缓冲区空了直接从socket读到buffer
+             */
+            int ReadRaw(void* buffer, size_t length);
+
+            /**
+             * @brief 从socket读数据追加到接收缓冲区
+             */
+            int FillBuffer();
+
+            /**
+             * @brief 在接收缓冲区中找一行, 不够时继续读
+             * @return 行尾\r\n的位置, <0 出错或者行太长
+             */
+            int FindLine();
+
+            /**
+             * @brief 丢掉接收缓冲区开头的n个字节
+             */
+            void Consume(size_t n);
+
+            /**
+             * @brief 读下一个块的长度行, 最后一个块时跳过trailer
+             * @return >0 有下一个块, =0 消息体结束, <0 出错
+             */
+            int ReadChunkSize();
+        private:
+            /// 请求解析器, 每个请求前重置
+            HttpRequestParser::ptr parser_;
+            /// 接收缓冲区
+            std::unique_ptr<char[]> buffer_;
+            /// 接收缓冲区大小
+            size_t buffer_size_ = 0;
+            /// 接收缓冲区开头属于下一个请求的字节数
+            size_t buffer_len_ = 0;
+            /**
+             * @brief 等待写出的响应
+             */
+            struct PendingResponse
+            {
+                /// 响应头在header_buffer_中的起止位置
+                size_t header_begin;
+                size_t header_end;
+                /// 持有响应, 消息体直接从这里写出
+                HttpResponse::ptr rsp;
+            };
+            /// 攒下的响应头, 复用内存
+            std::string header_buffer_;
+            /// 攒下的响应
+            std::vector<PendingResponse> pending_;
+            /// 攒下的总字节数
+            size_t pending_bytes_ = 0;
+            /// writev用的iovec数组, 复用内存
+            std::vector<iovec> iovs_;
+            /// 正在流式发送的响应
+            HttpResponse::ptr stream_rsp_;
+            /// 是否chunked
+            bool stream_chunked_ = false;
+            /// Content-Length模式下还要写的字节数, 靠关闭连接结束时为UINT64_MAX
+            uint64_t stream_remaining_ = 0;
+            /// 当前请求消息体的编码
+            BodyMode body_mode_ = kBodyNone;
+            /// Content-Length时剩下的字节数, chunked时当前块剩下的字节数
+            uint64_t body_remaining_ = 0;
+            /// 当前块的数据已经读完, 还要跳过它结尾的\r\n
+            bool chunk_crlf_ = false;
+            /// 读消息体之前要先回复100 Continue
+            bool expect_continue_ = false;
         }; // class HttpSession
 
     } // namespace http
@@ -0,0 +1,378 @@
+/**
+ * @file server_frame/http/router.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-16
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include "router.h"
+#include "servlet.h"
+#include "server_frame/log.h"
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace http {
+
+        static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        /**
+         * @brief 树节点
+         * @details 从父节点经过静态边(prefix)、:param或*catch到达,
+         *          有servlet的节点是一个路由的终点
+         */
+        struct Router::Node
+        {
+            /// 静态边上的字符串, 参数节点为空
+            std::string prefix;
+            /// 每个静态子节点prefix的首字符, 和children一一对应
+            std::string indices;
+            /// 静态子节点
+            std::vector<std::unique_ptr<Node> > children;
+            /// :param子节点
+            std::unique_ptr<Node> param;
+            /// *catch子节点
+            std::unique_ptr<Node> catch_all;
+            /// 参数节点的参数名
+            std::string name;
+            /// 任意方法的servlet
+            CreatorPtr any;
+            /// 按方法注册的servlet
+            std::vector<std::pair<HttpMethod, CreatorPtr> > methods;
+
+            bool HasHandler() const { return any || !methods.empty(); }
+
+            /**
+             * @brief 返回方法对应的servlet, 依次找方法本身, HEAD找GET, 任意方法
+             */
+            CreatorPtr Get(HttpMethod method) const
+            {
+                for (auto& i : methods)
+                {
+                    if (i.first == method)
+                    {
+                        return i.second;
+                    }
+                }
+                if (method == HttpMethod::HEAD)
+                {
+                    for (auto& i : methods)
+                    {
+                        if (i.first == HttpMethod::GET)
+                        {
+                            return i.second;
+                        }
+                    }
+                }
+                return any;
+            }
+
+            /**
+             * @brief 返回注册过的方法, 用作405的Allow头部
+             */
+            std::string Allow() const
+            {
+                std::string allow;
+                bool has_get = false;
+                bool has_head = false;
+                for (auto& i : methods)
+                {
+                    has_get = has_get || i.first == HttpMethod::GET;
+                    has_head = has_head || i.first == HttpMethod::HEAD;
+                    if (!allow.empty())
+                    {
+                        allow += ", ";
+                    }
+                    allow += HttpMethodToString(i.first);
+                }
+                if (has_get && !has_head)
+                {
+                    allow += ", HEAD";
+                }
+                return allow;
+            }
+        };
+
+        Router::Router()
+            : root_(new Node)
+        {
+        }
+
+        Router::Router(const Router& rhs)
+            : root_(new Node)
+            , routes_(rhs.routes_)
+        {
+            for (auto& i : routes_)
+            {
+                Insert(i.first.first, i.first.second, i.second);
+            }
+        }
+
+        Router::~Router()
+        {
+        }
+
+        bool Router::Add(HttpMethod method, const std::string& pattern, CreatorPtr creator)
+        {
+            if (!Insert(method, pattern, creator))
+            {
+                return false;
+            }
+            for (auto& i : routes_)
+            {
+                if (i.first.first == method && i.first.second == pattern)
+                {
+                    i.second = creator;
+                    return true;
+                }
+            }
+            routes_.push_back(std::make_pair(std::make_pair(method, pattern), creator));
+            return true;
+        }
+
+        void Router::Del(HttpMethod method, const std::string& pattern)
+        {
+            for (auto it = routes_.begin(); it != routes_.end(); ++it)
+            {
+                if (it->first.first == method && it->first.second == pattern)
+                {
+                    routes_.erase(it);
+                    //删除不常用, 直接重建, 顺带去掉不再需要的分支
+                    root_.reset(new Node);
+                    for (auto& i : routes_)
+                    {
+                        Insert(i.first.first, i.first.second, i.second);
+                    }
+                    return;
+                }
+            }
+        }
+
+        void Router::Clear()
+        {
+            root_.reset(new Node);
+            routes_.clear();
+        }
+
+        void Router::ListAll(std::map<std::string, CreatorPtr>& infos) const
+        {
+            for (auto& i : routes_)
+            {
+                std::string method = i.first.first == HttpMethod::INVALID_METHOD
+                    ? "*" : HttpMethodToString(i.first.first);
+                infos[method + " " + i.first.second] = i.second;
+            }
+        }
+
+        Router::Node* Router::InsertStatic(Node* cur, std::string s)
+        {
+            while (!s.empty())
+            {
+                size_t i = cur->indices.find(s[0]);
+                if (i == std::string::npos)
+                {
+                    Node* child = new Node;
+                    child->prefix = s;
+                    cur->indices.push_back(s[0]);
+                    cur->children.emplace_back(child);
+                    return child;
+                }
+
+                Node* child = cur->children[i].get();
+                size_t l = 0;
+                while (l < s.size() && l < child->prefix.size() && s[l] == child->prefix[l])
+                {
+                    ++l;
+                }
+                if (l < child->prefix.size())
+                {
+                    //公共前缀比已有的边短, 拆成 公共前缀 -> 剩余部分
+                    Node* mid = new Node;
+                    mid->prefix = child->prefix.substr(0, l);
+                    child->prefix.erase(0, l);
+                    mid->indices.push_back(child->prefix[0]);
+                    mid->children.push_back(std::move(cur->children[i]));
+                    cur->children[i].reset(mid);
+                    child = mid;
+                }
+                s.erase(0, l);
+                cur = child;
+            }
+            return cur;
+        }
+
+        bool Router::Insert(HttpMethod method, const std::string& pattern, CreatorPtr creator)
+        {
+            if (pattern.empty() || pattern[0] != '/')
+            {
+                YGW_LOG_ERROR(g_logger) << "Router invalid pattern: " << pattern;
+                return false;
+            }
+
+            Node* cur = root_.get();
+            size_t pos = 0;
+            while (pos < pattern.size())
+            {
+                //静态部分一直到下一段开头的':'或'*'
+                size_t end = pos;
+                while (end < pattern.size()
+                        && !((pattern[end] == ':' || pattern[end] == '*') && pattern[end - 1] == '/'))
+                {
+                    ++end;
+                }
+                if (end > pos)
+                {
+                    cur = InsertStatic(cur, pattern.substr(pos, end - pos));
+                    pos = end;
+                    continue;
+                }
+
+                end = pattern.find('/', pos);
+                if (end == std::string::npos)
+                {
+                    end = pattern.size();
+                }
+                std::string name = pattern.substr(pos + 1, end - pos - 1);
+                if (name.empty())
+                {
+                    YGW_LOG_ERROR(g_logger) << "Router empty param name: " << pattern;
+                    return false;
+                }
+                if (pattern[pos] == '*' && end != pattern.size())
+                {
+                    YGW_LOG_ERROR(g_logger) << "Router catch-all must be the last: " << pattern;
+                    return false;
+                }
+
+                std::unique_ptr<Node>& wild = pattern[pos] == ':' ? cur->param : cur->catch_all;
+                if (!wild)
+                {
+                    wild.reset(new Node);
+                    wild->name = name;
+                }
+                else if (wild->name != name)
+                {
+                    YGW_LOG_ERROR(g_logger) << "Router param " << name << " in " << pattern
+                        << " conflicts with " << wild->name;
+                    return false;
+                }
+                cur = wild.get();
+                pos = end;
+            }
+
+            if (method == HttpMethod::INVALID_METHOD)
+            {
+                cur->any = creator;
+                return true;
+            }
+            for (auto& i : cur->methods)
+            {
+                if (i.first == method)
+                {
+                    i.second = creator;
+                    return true;
+                }
+            }
+            cur->methods.push_back(std::make_pair(method, creator));
+            return true;
+        }
+
+        Router::CreatorPtr Router::Match(HttpMethod method, const std::string& path
+                ,HttpRequest::PathParams* params, std::string* allow) const
+        {
+            const Node* allow_node = nullptr;
+            const Node* node = Find(root_.get(), method, path, 0, params, &allow_node);
+            if (node)
+            {
+                return node->Get(method);
+            }
+            if (allow_node && allow)
+            {
+                *allow = allow_node->Allow();
+            }
+            return nullptr;
+        }
+
+        const Router::Node* Router::Find(const Node* node, HttpMethod method, const std::string& path
+                ,size_t pos, HttpRequest::PathParams* params, const Node** allow_node) const
+        {
+            if (pos == path.size())
+            {
+                if (node->HasHandler())
+                {
+                    if (node->Get(method))
+                    {
+                        return node;
+                    }
+                    if (!*allow_node)
+                    {
+                        *allow_node = node;
+                    }
+                }
+            }
+            else
+            {
+                //同一个首字符最多只有一条静态边
+                size_t i = node->indices.find(path[pos]);
+                if (i != std::string::npos)
+                {
+                    const Node* child = node->children[i].get();
+                    if (path.compare(pos, child->prefix.size(), child->prefix) == 0)
+                    {
+                        const Node* rt = Find(child, method, path, pos + child->prefix.size()
+                                ,params, allow_node);
+                        if (rt)
+                        {
+                            return rt;
+                        }
+                    }
+                }
+
+                if (node->param)
+                {
+                    size_t end = path.find('/', pos);
+                    if (end == std::string::npos)
+                    {
+                        end = path.size();
+                    }
+                    if (end > pos)
+                    {
+                        size_t n = params->size();
+                        params->emplace_back(node->param->name, path.substr(pos, end - pos));
+                        const Node* rt = Find(node->param.get(), method, path, end, params, allow_node);
+                        if (rt)
+                        {
+                            return rt;
+                        }
+                        params->erase(params->begin() + n, params->end());
+                    }
+                }
+            }
+
+            if (node->catch_all)
+            {
+                const Node* c = node->catch_all.get();
+                if (c->Get(method))
+                {
+                    params->emplace_back(c->name, path.substr(pos));
+                    return c;
+                }
+                if (!*allow_node)
+                {
+                    *allow_node = c;
+                }
+            }
+            return nullptr;
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace http
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,133 @@
+/**
+ * @file router.h
+ * @brief 压缩前缀树(radix tree)路由, 支持路径参数和按方法分发
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-16
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_HTTP_ROUTER_H__
+#define __YGW_HTTP_ROUTER_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace http {
+
+        class IServletCreator;
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 路由表
+         * @details 路由写法:
+         *          - /user/list      静态路径
+         *          - /user/:id       :id匹配一段非空路径(不含'/')
+         *          - /static/\*path  *path匹配剩下的全部路径(可以为空, 可以含'/'), 只能放在最后
+         *          ':'和'*'只在一段路径的开头才有特殊含义.
+         *          静态部分按公共前缀压缩成一棵树, 查找只按路径逐字符向下走一遍,
+         *          和路由数量无关. 同一位置静态优先于:param, :param优先于*catch,
+         *          走不通时回退尝试下一种.
+         *          每个路由可以按方法注册不同的servlet, INVALID_METHOD表示任意方法,
+         *          HEAD没有注册时使用GET的.
+         *          不是线程安全的, ServletDispatch拷贝修改后整体替换
+         */
+        class Router
+        {
+        public:
+            using ptr = std::shared_ptr<Router>;
+            using CreatorPtr = std::shared_ptr<IServletCreator>;
+
+            Router();
+
+            /**
+             * @brief 拷贝构造, 按rhs的路由重建一棵树
+             */
+            Router(const Router& rhs);
+            ~Router();
+
+            /**
+             * @brief 添加路由
+             * @param[in] method HTTP方法, INVALID_METHOD表示任意方法
+             * @param[in] pattern 路由
+             * @param[in] creator servlet
+             * @return 路由格式错误, 或同一位置的参数名和已有路由冲突时返回false
+             */
+            bool Add(HttpMethod method, const std::string& pattern, CreatorPtr creator);
+
+            /**
+             * @brief 删除路由
+             * @param[in] method HTTP方法, 和添加时一致
+             * @param[in] pattern 路由, 和添加时一致
+             */
+            void Del(HttpMethod method, const std::string& pattern);
+
+            /**
+             * @brief 查找路由
+             * @param[in] method 请求的HTTP方法
+             * @param[in] path 请求路径
+             * @param[out] params 匹配成功时保存路径参数
+             * @param[out] allow 路径匹配但方法不匹配时, 保存允许的方法(Allow头部)
+             * @return 匹配的servlet, 没有时返回nullptr
+             */
+            CreatorPtr Match(HttpMethod method, const std::string& path
+                    ,HttpRequest::PathParams* params, std::string* allow = nullptr) const;
+
+            /**
+             * @brief 清空路由
+             */
+            void Clear();
+
+            /**
+             * @brief 返回路由数量
+             */
+            size_t GetSize() const { return routes_.size(); }
+
+            /**
+             * @brief 列出所有路由, key为"方法 路由", 任意方法为"* 路由"
+             */
+            void ListAll(std::map<std::string, CreatorPtr>& infos) const;
+        private:
+            struct Node;
+
+            /**
+             * @brief 沿静态边插入字符串s, 必要时拆分已有的边, 返回终点节点
+             */
+            static Node* InsertStatic(Node* cur, std::string s);
+
+            /**
+             * @brief 把路由插入到树中
+             */
+            bool Insert(HttpMethod method, const std::string& pattern, CreatorPtr creator);
+
+            /**
+             * @brief 从node开始匹配path[pos:], 返回方法也匹配的节点
+             * @param[out] allow_node 第一个路径匹配但方法不匹配的节点
+             */
+            const Node* Find(const Node* node, HttpMethod method, const std::string& path
+                    ,size_t pos, HttpRequest::PathParams* params, const Node** allow_node) const;
+        private:
+            /// 树根
+            std::unique_ptr<Node> root_;
+            /// 所有路由, 用于删除后重建和列出
+            std::vector<std::pair<std::pair<HttpMethod, std::string>, CreatorPtr> > routes_;
+        }; // class Router
+
+        //--------------------------------------------------------------------
+
+    } // namespace http
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_HTTP_ROUTER_H__
@@ -36,15 +36,18 @@ namespace ygw {
 
         ServletDispatch::ServletDispatch()
             :Servlet("ServletDispatch") 
+            ,table_(new Table)
         {
-            default_.reset(new NotFoundServlet("ygw/1.0"));
+            Update([](Table& t) {
+                t.default_servlet.reset(new NotFoundServlet("ygw/1.0"));
+            });
         }
 
         int32_t ServletDispatch::Handle(ygw::http::HttpRequest::ptr request
                 , ygw::http::HttpResponse::ptr response
                 , ygw::http::HttpSession::ptr session) 
         {
-            auto slt = GetMatchedServlet(request->GetPath());
+            auto slt = Route(request);
             if (slt) 
             {
                 slt->Handle(request, response, session);
@@ -52,56 +55,53 @@ namespace ygw {
             return 0;
         }
 
+        void ServletDispatch::Update(std::function<void(Table& table)> cb)
+        {
+            MutexType::Lock lock(mutex_);
+            //写锁内只有自己会替换table_, 可以直接读
+            Table* table = new Table(*table_.Get());
+            cb(*table);
+            table_.Update(table);
+        }
+
         void ServletDispatch::AddServlet(const std::string& uri, Servlet::ptr slt) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            datas_[uri] = std::make_shared<HoldServletCreator>(slt);
+            AddServletCreator(uri, std::make_shared<HoldServletCreator>(slt));
         }
 
         void ServletDispatch::AddServletCreator(const std::string& uri, IServletCreator::ptr creator) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            datas_[uri] = creator;
+            Update([&uri, &creator](Table& t) {
+                t.datas[uri] = creator;
+            });
         }
 
         void ServletDispatch::AddGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            for (auto it = globs_.begin();
-                    it != globs_.end(); ++it) 
-            {
-                if (it->first == uri) 
+            Update([&uri, &creator](Table& t) {
+                for (auto it = t.globs.begin();
+                        it != t.globs.end(); ++it) 
                 {
-                    globs_.erase(it);
-                    break;
+                    if (it->first == uri) 
+                    {
+                        t.globs.erase(it);
+                        break;
+                    }
                 }
-            }
-            globs_.push_back(std::make_pair(uri, creator));
+                t.globs.push_back(std::make_pair(uri, creator));
+            });
         }
 
         void ServletDispatch::AddServlet(const std::string& uri
                 ,FunctionServlet::callback cb) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            datas_[uri] = std::make_shared<HoldServletCreator>(
-                    std::make_shared<FunctionServlet>(cb));
+            AddServlet(uri, std::make_shared<FunctionServlet>(cb));
         }
 
         void ServletDispatch::AddGlobServlet(const std::string& uri
                 ,Servlet::ptr slt) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            for (auto it = globs_.begin();
-                    it != globs_.end(); ++it) 
-            {
-                if (it->first == uri)
-                {
-                    globs_.erase(it);
-                    break;
-                }
-            }
-            globs_.push_back(std::make_pair(uri
-                        , std::make_shared<HoldServletCreator>(slt)));
+            AddGlobServletCreator(uri, std::make_shared<HoldServletCreator>(slt));
         }
 
         void ServletDispatch::AddGlobServlet(const std::string& uri
@@ -110,38 +110,84 @@ namespace ygw {
             return AddGlobServlet(uri, std::make_shared<FunctionServlet>(cb));
         }
 
+        bool ServletDispatch::AddRoute(const std::string& pattern, Servlet::ptr slt
+                ,HttpMethod method)
+        {
+            return AddRouteCreator(pattern, std::make_shared<HoldServletCreator>(slt), method);
+        }
+
+        bool ServletDispatch::AddRoute(const std::string& pattern, FunctionServlet::callback cb
+                ,HttpMethod method)
+        {
+            return AddRoute(pattern, std::make_shared<FunctionServlet>(cb), method);
+        }
+
+        bool ServletDispatch::AddRouteCreator(const std::string& pattern, IServletCreator::ptr creator
+                ,HttpMethod method)
+        {
+            bool rt = false;
+            Update([&](Table& t) {
+                rt = t.routes.Add(method, pattern, creator);
+            });
+            return rt;
+        }
+
+        void ServletDispatch::DelRoute(const std::string& pattern, HttpMethod method)
+        {
+            Update([&pattern, method](Table& t) {
+                t.routes.Del(method, pattern);
+            });
+        }
+
         void ServletDispatch::DelServlet(const std::string& uri) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            datas_.erase(uri);
+            Update([&uri](Table& t) {
+                t.datas.erase(uri);
+            });
         }
 
         void ServletDispatch::DelGlobServlet(const std::string& uri) 
         {
-            RWMutexType::WriteLock lock(mutex_);
-            for (auto it = globs_.begin();
-                    it != globs_.end(); ++it)
-            {
-                if (it->first == uri) 
+            Update([&uri](Table& t) {
+                for (auto it = t.globs.begin();
+                        it != t.globs.end(); ++it)
                 {
-                    globs_.erase(it);
-                    break;
+                    if (it->first == uri) 
+                    {
+                        t.globs.erase(it);
+                        break;
+                    }
                 }
-            }
+            });
+        }
+
+        Servlet::ptr ServletDispatch::GetDefault()
+        {
+            thread::RcuReadLock lock;
+            return table_.Get()->default_servlet;
+        }
+
+        void ServletDispatch::SetDefault(Servlet::ptr v)
+        {
+            Update([&v](Table& t) {
+                t.default_servlet = v;
+            });
         }
 
         Servlet::ptr ServletDispatch::GetServlet(const std::string& uri) 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            auto it = datas_.find(uri);
-            return it == datas_.end() ? nullptr : it->second->Get();
+            thread::RcuReadLock lock;
+            const Table* t = table_.Get();
+            auto it = t->datas.find(uri);
+            return it == t->datas.end() ? nullptr : it->second->Get();
         }
 
         Servlet::ptr ServletDispatch::GetGlobServlet(const std::string& uri) 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            for (auto it = globs_.begin();
-                    it != globs_.end(); ++it) 
+            thread::RcuReadLock lock;
+            const Table* t = table_.Get();
+            for (auto it = t->globs.begin();
+                    it != t->globs.end(); ++it) 
             {
                 if (it->first == uri) 
                 {
@@ -153,27 +199,64 @@ namespace ygw {
 
         Servlet::ptr ServletDispatch::GetMatchedServlet(const std::string& uri) 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            auto mit = datas_.find(uri);
-            if (mit != datas_.end()) 
+            thread::RcuReadLock lock;
+            const Table* t = table_.Get();
+            auto mit = t->datas.find(uri);
+            if (mit != t->datas.end()) 
             {
                 return mit->second->Get();
             }
-            for (auto it = globs_.begin();
-                    it != globs_.end(); ++it) 
+            for (auto it = t->globs.begin();
+                    it != t->globs.end(); ++it) 
             {
                 if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) 
                 {
                     return it->second->Get();
                 }
             }
-            return default_;
+            return t->default_servlet;
+        }
+
+        Servlet::ptr ServletDispatch::Route(HttpRequest::ptr request)
+        {
+            const std::string& uri = request->GetPath();
+            HttpRequest::PathParams params;
+            std::string allow;
+            thread::RcuReadLock lock;
+            const Table* t = table_.Get();
+            auto mit = t->datas.find(uri);
+            if (mit != t->datas.end()) 
+            {
+                return mit->second->Get();
+            }
+            IServletCreator::ptr creator = t->routes.Match(request->GetMethod(), uri, &params, &allow);
+            if (creator)
+            {
+                if (!params.empty())
+                {
+                    request->SetPathParams(std::move(params));
+                }
+                return creator->Get();
+            }
+            for (auto it = t->globs.begin();
+                    it != t->globs.end(); ++it) 
+            {
+                if (!fnmatch(it->first.c_str(), uri.c_str(), 0)) 
+                {
+                    return it->second->Get();
+                }
+            }
+            if (!allow.empty())
+            {
+                return std::make_shared<MethodNotAllowedServlet>(allow);
+            }
+            return t->default_servlet;
         }
 
         void ServletDispatch::ListAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos) 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            for (auto& i : datas_) 
+            thread::RcuReadLock lock;
+            for (auto& i : table_.Get()->datas) 
             {
                 infos[i.first] = i.second;
             }
@@ -181,13 +264,19 @@ namespace ygw {
 
         void ServletDispatch::ListAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos) 
         {
-            RWMutexType::ReadLock lock(mutex_);
-            for (auto& i : globs_) 
+            thread::RcuReadLock lock;
+            for (auto& i : table_.Get()->globs) 
             {
                 infos[i.first] = i.second;
             }
         }
 
+        void ServletDispatch::ListAllRouteCreator(std::map<std::string, IServletCreator::ptr>& infos)
+        {
+            thread::RcuReadLock lock;
+            table_.Get()->routes.ListAll(infos);
+        }
+
         NotFoundServlet::NotFoundServlet(const std::string& name)
             :Servlet("NotFoundServlet")
             ,name_(name)
@@ -209,6 +298,21 @@ namespace ygw {
             return 0;
         }
 
+        MethodNotAllowedServlet::MethodNotAllowedServlet(const std::string& allow)
+            :Servlet("MethodNotAllowedServlet")
+            ,allow_(allow)
+        {
+        }
+
+        int32_t MethodNotAllowedServlet::Handle(ygw::http::HttpRequest::ptr request
+                , ygw::http::HttpResponse::ptr response
+                , ygw::http::HttpSession::ptr session) 
+        {
+            response->SetStatus(ygw::http::HttpStatus::METHOD_NOT_ALLOWED);
+            response->SetHeader("Allow", allow_);
+            return 0;
+        }
+
     } // namespace http
 
     //-----------------------------------------------------
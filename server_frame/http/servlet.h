@@ -17,6 +17,8 @@
 #include <unordered_map>
 #include "http.h"
 #include "http_session.h"
+#include "router.h"
+#include "server_frame/base/rcu.h"
 #include "server_frame/base/thread.h"
 #include "server_frame/util.h"
 
@@ -63,9 +65,23 @@ namespace ygw {
              * @brief 返回Servlet名称
              */
             const std::string& GetName() const { return name_; }
+
+            /**
+             * @brief 是否自己读取请求消息体
+             * @details 为true时HttpServer不预先读入消息体, 也不受max_body_size限制,
+             *          Handle中通过session->GetBodyStream()/ReadBody()/SpoolBody()读取
+             */
+            bool IsStreamBody() const { return stream_body_; }
+
+            /**
+             * @brief 设置是否自己读取请求消息体
+             */
+            void SetStreamBody(bool v) { stream_body_ = v; }
         protected:
             /// 名称
             std::string name_;
+            /// 是否自己读取请求消息体
+            bool stream_body_ = false;
         }; // class Servlet
 
 
@@ -154,14 +170,17 @@ namespace ygw {
         //-------------------------------------------------------------------------
         /**
          * @brief Servlet分发器
+         * @details 路由表只在启动或热更新时修改, 每个请求都要查.
+         *          查找在RCU读临界区内读当前的只读路由表, 不加锁;
+         *          修改时拷贝一份新表改好后原子替换, 等读端都离开旧表后释放旧表
          */
         class ServletDispatch : public Servlet 
         {
         public:
             /// 智能指针类型定义
             using ptr = std::shared_ptr<ServletDispatch>;
-            /// 读写锁类型定义
-            using RWMutexType = thread::RWMutex;
+            /// 写锁类型定义
+            using MutexType = thread::Mutex;
 
             /**
              * @brief 构造函数
@@ -215,12 +234,50 @@ namespace ygw {
                 AddGlobServletCreator(uri, std::make_shared<ServletCreator<T> >());
             }
 
+            /**
+             * @brief 添加路由servlet
+             * @param[in] pattern 路由, 如/user/:id, 写法见Router
+             * @param[in] slt servlet
+             * @param[in] method HTTP方法, INVALID_METHOD表示任意方法
+             * @return 路由格式错误或参数名冲突时返回false
+             */
+            bool AddRoute(const std::string& pattern, Servlet::ptr slt
+                    ,HttpMethod method = HttpMethod::INVALID_METHOD);
+
+            /**
+             * @brief 添加路由servlet
+             * @param[in] pattern 路由, 如/user/:id, 写法见Router
+             * @param[in] cb FunctionServlet回调函数
+             * @param[in] method HTTP方法, INVALID_METHOD表示任意方法
+             * @return 路由格式错误或参数名冲突时返回false
+             */
+            bool AddRoute(const std::string& pattern, FunctionServlet::callback cb
+                    ,HttpMethod method = HttpMethod::INVALID_METHOD);
+
+            bool AddRouteCreator(const std::string& pattern, IServletCreator::ptr creator
+                    ,HttpMethod method = HttpMethod::INVALID_METHOD);
+
+            template<class T>
+            bool AddRouteCreator(const std::string& pattern
+                    ,HttpMethod method = HttpMethod::INVALID_METHOD) 
+            {
+                return AddRouteCreator(pattern, std::make_shared<ServletCreator<T> >(), method);
+            }
+
             /**
              * @brief 删除servlet
              * @param[in] uri uri
              */
             void DelServlet(const std::string& uri);
 
+            /**
+             * @brief 删除路由servlet
+             * @param[in] pattern 路由
+             * @param[in] method HTTP方法, 和添加时一致
+             */
+            void DelRoute(const std::string& pattern
+                    ,HttpMethod method = HttpMethod::INVALID_METHOD);
+
             /**
              * @brief 删除模糊匹配servlet
              * @param[in] uri uri
@@ -230,13 +287,13 @@ namespace ygw {
             /**
              * @brief 返回默认servlet
              */
-            Servlet::ptr GetDefault() const { return default_; }
+            Servlet::ptr GetDefault();
 
             /**
              * @brief 设置默认servlet
              * @param[in] v servlet
              */
-            void SetDefault(Servlet::ptr v) { default_ = v;}
+            void SetDefault(Servlet::ptr v);
 
 
             /**
@@ -260,20 +317,47 @@ namespace ygw {
              */
             Servlet::ptr GetMatchedServlet(const std::string& uri);
 
+            /**
+             * @brief 为请求查找servlet, 匹配路由时把路径参数设置到请求上
+             * @param[in] request HTTP请求
+             * @return 依次精准匹配,路由匹配,模糊匹配,最后返回默认.
+             *         路径匹配路由但方法不匹配时返回405 servlet
+             */
+            Servlet::ptr Route(HttpRequest::ptr request);
+
             void ListAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
 
             void ListAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
+
+            void ListAllRouteCreator(std::map<std::string, IServletCreator::ptr>& infos);
         private:
-            /// 读写互斥量
-            RWMutexType mutex_;
-            /// 精准匹配servlet MAP
-            /// uri(/ygw/xxx) -> servlet
-            std::unordered_map<std::string, IServletCreator::ptr> datas_;
-            /// 模糊匹配servlet 数组
-            /// uri(/ygw/*) -> servlet
-            std::vector<std::pair<std::string, IServletCreator::ptr> > globs_;
-            /// 默认servlet，所有路径都没匹配到时使用
-            Servlet::ptr default_;
+            /**
+             * @brief 路由表, 发布后只读
+             */
+            struct Table
+            {
+                /// 精准匹配servlet MAP
+                /// uri(/ygw/xxx) -> servlet
+                std::unordered_map<std::string, IServletCreator::ptr> datas;
+                /// 模糊匹配servlet 数组
+                /// uri(/ygw/*) -> servlet
+                std::vector<std::pair<std::string, IServletCreator::ptr> > globs;
+                /// 路由servlet
+                /// /user/:id -> servlet
+                Router routes;
+                /// 默认servlet，所有路径都没匹配到时使用
+                Servlet::ptr default_servlet;
+            };
+
+            /**
+             * @brief 拷贝当前路由表, 用cb修改后发布
+             */
+            void Update(std::function<void(Table& table)> cb);
+        private:
+            /// 写锁, 串行化修改
+            MutexType mutex_;
+            /// 当前路由表
+            thread::RcuPtr<Table> table_;
         };
 
         //-------------------------------------------------------------------------
@@ -299,6 +383,28 @@ namespace ygw {
         };
 
         //-------------------------------------------------------------------------
+        /**
+         * @brief MethodNotAllowedServlet(路径匹配但方法不匹配, 返回405)
+         */
+        class MethodNotAllowedServlet : public Servlet {
+        public:
+            /// 智能指针类型定义
+            typedef std::shared_ptr<MethodNotAllowedServlet> ptr;
+            /**
+             * @brief 构造函数
+             * @param[in] allow 允许的方法, 用作Allow头部
+             */
+            MethodNotAllowedServlet(const std::string& allow);
+            virtual int32_t Handle(
+                             ygw::http::HttpRequest::ptr request
+                           , ygw::http::HttpResponse::ptr response
+                           , ygw::http::HttpSession::ptr session) override;
+
+        private:
+            std::string allow_;
+        };
+
+        //-------------------------------------------------------------------------
 
     } // namespace http
 
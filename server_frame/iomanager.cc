@@ -11,6 +11,7 @@
 #ifdef __GNUC__
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
 #endif // __GNUC__
 #include <cerrno>
@@ -107,6 +108,24 @@ namespace ygw {
             ctx.scheduler = nullptr;
             ctx.fiber.reset();
             ctx.cb = nullptr;
+            ctx.result = nullptr;
+            ctx.thread = -1;
+        }
+
+        //就绪一方与超时竞争
+        bool IOManager::FdContext::ResolveReady(EventContext& ctx) 
+        {
+            uint64_t state = ctx.wait_state.load();
+            while ((state & 3) == kWaitPending) 
+            {
+                if (ctx.wait_state.compare_exchange_weak(state, (state & ~3ull) | kWaitReady)) 
+                {
+                    //O(1)摘除内嵌的超时节点
+                    timer::TimerManager::CancelTimeout(&ctx.timeout);
+                    return true;
+                }
+            }
+            return (state & 3) != kWaitTimeout;
         }
 
         //触发事件
@@ -123,13 +142,19 @@ namespace ygw {
             //}
             events_ = (Event)(events_ & ~event);
             EventContext& ctx = GetContext(event);
+            if (!ResolveReady(ctx)) 
+            {
+                //超时回调会唤醒等待方
+                return;
+            }
+            ctx.result = nullptr;
             if (ctx.cb) 
             {
-                ctx.scheduler->Schedule(&ctx.cb);
+                ctx.scheduler->Schedule(&ctx.cb, ctx.thread);
             } 
             else 
             {
-                ctx.scheduler->Schedule(&ctx.fiber);
+                ctx.scheduler->Schedule(&ctx.fiber, ctx.thread);
             }
             ctx.scheduler = nullptr;
             return;
@@ -161,6 +186,13 @@ namespace ygw {
             rt = epoll_ctl(epfd_, EPOLL_CTL_ADD, tickle_fds_[0], &event);
             YGW_ASSERT(!rt);
 
+            timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            YGW_ASSERT(timerfd_ >= 0);
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = timerfd_;
+            rt = epoll_ctl(epfd_, EPOLL_CTL_ADD, timerfd_, &event);
+            YGW_ASSERT(!rt);
+
             ContextResize(32);
 
             Start();
@@ -173,6 +205,7 @@ namespace ygw {
             close(epfd_);
             close(tickle_fds_[0]);
             close(tickle_fds_[1]);
+            close(timerfd_);
 
             for (size_t i = 0; i < fd_contexts_.size(); ++i) 
             {
@@ -199,7 +232,8 @@ namespace ygw {
         }
 
         //添加事件
-        int IOManager::AddEvent(int fd, Event event, std::function<void()> cb) 
+        int IOManager::AddEvent(int fd, Event event, std::function<void()> cb
+                ,uint64_t timeout_ms, int* result, uint64_t slack_ms) 
         {
             FdContext* fd_ctx = nullptr;
             {//取出fd上下文
@@ -231,6 +265,10 @@ namespace ygw {
             epoll_event epevent;
             epevent.events = EPOLLET | fd_ctx->events_ | event;
             epevent.data.ptr = fd_ctx;
+            if (fd_ctx->exclusive_ && op == EPOLL_CTL_ADD) 
+            {
+                epevent.events |= EPOLLEXCLUSIVE;
+            }
 
             int rt = epoll_ctl(epfd_, op, fd, &epevent);
             if (rt) 
@@ -253,13 +291,29 @@ namespace ygw {
             if (cb) 
             {
                 event_ctx.cb.swap(cb);
+                event_ctx.thread = -1;
             } 
             else 
             {
+                //被指定线程的协程在原线程上唤醒, 连接不在线程间迁移
+                event_ctx.thread = Scheduler::GetTaskThread();
                 event_ctx.fiber = Fiber::GetThis();
                 YGW_MSG_ASSERT(event_ctx.fiber->GetState() == Fiber::State::kExec
                         ,"state = " << event_ctx.fiber->GetState());
             }
+            event_ctx.result = result;
+            timer::TimeoutNode& node = event_ctx.timeout;
+            if (timeout_ms == ~0ull) 
+            {
+                event_ctx.wait_state = (node.seq << 2) | kWaitNone;
+                return 0;
+            }
+            //先发布等待状态再挂入节点, 节点一挂入就可能到期
+            node.cb = &IOManager::OnEventTimeout;
+            node.owner = this;
+            node.data = fd_ctx;
+            event_ctx.wait_state = ((node.seq + 1) << 2) | kWaitPending;
+            ArmTimeout(&node, timeout_ms, slack_ms);
             return 0;
         }
 
@@ -298,6 +352,8 @@ namespace ygw {
             --pending_event_count_;
             fd_ctx->events_ = new_events;
             FdContext::EventContext& event_ctx = fd_ctx->GetContext(event);
+            //超时若已胜出, 回调看到上下文已重置就不会再唤醒
+            fd_ctx->ResolveReady(event_ctx);
             fd_ctx->ResetContext(event_ctx);
             return true;
         }
@@ -341,6 +397,29 @@ namespace ygw {
         }
 
 
+        bool IOManager::SetEventExclusive(int fd, bool v) 
+        {
+            FdContext* fd_ctx = nullptr;
+            {
+                RWMutexType::ReadLock lock(mutex_);
+                if (static_cast<int>(fd_contexts_.size()) > fd) 
+                {
+                    fd_ctx = fd_contexts_[fd];
+                    lock.unlock();
+                } 
+                else 
+                {
+                    lock.unlock();
+                    RWMutexType::WriteLock lock2(mutex_);
+                    ContextResize(fd * 1.5);
+                    fd_ctx = fd_contexts_[fd];
+                }
+            }
+            FdContext::MutexType::Lock lock(fd_ctx->mutex_);
+            fd_ctx->exclusive_ = v;
+            return true;
+        }
+
         //cancel all
         bool IOManager::CancelAll(int fd) 
         {
@@ -353,6 +432,8 @@ namespace ygw {
             lock.unlock();
 
             FdContext::MutexType::Lock fd_lock(fd_ctx->mutex_);
+            //句柄关闭后号码会被复用, 不能带着EPOLLEXCLUSIVE
+            fd_ctx->exclusive_ = false;
             //没有事件就不需要操作
             if (!fd_ctx->events_) 
             {
@@ -389,6 +470,59 @@ namespace ygw {
         }
 
         
+        void IOManager::OnEventTimeout(timer::TimeoutNode* node, uint64_t seq) 
+        {
+            IOManager* iom = static_cast<IOManager*>(node->owner);
+            FdContext* fd_ctx = static_cast<FdContext*>(node->data);
+            Event event = (node == &fd_ctx->read_.timeout) ? Event::kRead : Event::kWrite;
+            FdContext::EventContext& event_ctx = fd_ctx->GetContext(event);
+            uint64_t expected = (seq << 2) | kWaitPending;
+            //就绪一方已经胜出, 或节点已被下一次等待复用
+            if (!event_ctx.wait_state.compare_exchange_strong(expected, (seq << 2) | kWaitTimeout)) 
+            {
+                return;
+            }
+
+            FdContext::MutexType::Lock lock(fd_ctx->mutex_);
+            if (fd_ctx->events_ & event) 
+            {
+                Event new_events = (Event)(fd_ctx->events_ & ~event);
+                int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                epoll_event epevent;
+                epevent.events = EPOLLET | new_events;
+                epevent.data.ptr = fd_ctx;
+
+                int rt = epoll_ctl(iom->epfd_, op, fd_ctx->fd, &epevent);
+                if (rt) 
+                {
+                    YGW_LOG_ERROR(g_logger) << "epoll_ctl(" << iom->epfd_ << ", "
+                        << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                        << rt << " (" << errno << ") (" << strerror(errno) << ")";
+                }
+                --iom->pending_event_count_;
+                fd_ctx->events_ = new_events;
+            }
+            if (!event_ctx.scheduler) 
+            {
+                //事件已被DelEvent删除
+                return;
+            }
+            if (event_ctx.result) 
+            {
+                *event_ctx.result = ETIMEDOUT;
+            }
+            event_ctx.result = nullptr;
+            if (event_ctx.cb) 
+            {
+                event_ctx.scheduler->Schedule(&event_ctx.cb, event_ctx.thread);
+            } 
+            else 
+            {
+                event_ctx.scheduler->Schedule(&event_ctx.fiber, event_ctx.thread);
+            }
+            event_ctx.scheduler = nullptr;
+        }
+
         IOManager* IOManager::GetThis() 
         {
             return dynamic_cast<IOManager*>(Scheduler::GetThis());
@@ -415,7 +549,8 @@ namespace ygw {
         {
             YGW_MSG_ASSERT(timeout, "Stopping get a nullptr");   
             *timeout = GetNextTimer();
-            return *timeout == ~0ull
+            // 定时器分布在各线程分片中, 需要所有分片都为空
+            return !HasTimer()
                 && pending_event_count_ == 0
                 && Scheduler::Stopping();
         }
@@ -438,6 +573,8 @@ namespace ygw {
                     delete[] ptr;
             });
 
+            // 本线程添加的定时器由本线程管理
+            AttachTimerShard();
             while (true) 
             {
                 uint64_t next_timeout = 0;
@@ -446,6 +583,7 @@ namespace ygw {
                 {
                     YGW_LOG_INFO(g_logger) << "name=" << GetName()
                         << " idle stopping exit";
+                    DetachTimerShard();
                     break;
                 }
 
@@ -473,6 +611,8 @@ namespace ygw {
                     }
                 } while (true);
 
+                // 本轮的到期扫描共用这一次取到的时间
+                util::TimeUtil::UpdateCachedMS();
                 std::vector<std::function<void()> > cbs;
                 ListExpiredCb(cbs);
                 if (!cbs.empty()) 
@@ -481,6 +621,13 @@ namespace ygw {
                     Schedule(cbs.begin(), cbs.end());
                     cbs.clear();
                 }
+                ProcessExpiredTimeouts();
+                ListExpiredPreciseCb(cbs);
+                if (!cbs.empty()) 
+                {
+                    Schedule(cbs.begin(), cbs.end());
+                    cbs.clear();
+                }
 
                 //if (YGW_UNLIKELY(rt == MAX_EVNETS)) {
                 //    YGW_LOG_INFO(g_logger) << "epoll wait events=" << rt;
@@ -497,6 +644,14 @@ namespace ygw {
                             ;//do noting 
                         continue;
                     }
+                    if (event.data.fd == timerfd_) 
+                    {
+                        //到期的微秒定时器已在上面处理, 这里只清空计数
+                        uint64_t expirations = 0;
+                        while (read(timerfd_, &expirations, sizeof(expirations)) > 0)
+                            ;
+                        continue;
+                    }
 
                     FdContext* fd_ctx = (FdContext*)event.data.ptr;
                     FdContext::MutexType::Lock lock(fd_ctx->mutex_);
@@ -562,6 +717,21 @@ namespace ygw {
        {
            Tickle();
        }
+
+       void IOManager::OnPreciseTimerChanged(uint64_t next_us) 
+       {
+           //next_us为0时it_value全0, 即停止timerfd
+           struct itimerspec spec;
+           memset(&spec, 0, sizeof(spec));
+           spec.it_value.tv_sec = next_us / 1000000;
+           spec.it_value.tv_nsec = (next_us % 1000000) * 1000;
+           int rt = timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+           if (rt) 
+           {
+               YGW_LOG_ERROR(g_logger) << "timerfd_settime(" << timerfd_ << ", " << next_us
+                   << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+           }
+       }
                 
 
     } // namespace scheduler
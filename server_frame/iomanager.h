@@ -43,6 +43,20 @@ namespace ygw {
                 kWrite = 0x4,
             };
         private:
+            /**
+             * @brief 带超时的等待状态, 与等待序号一起存放在EventContext::wait_state中
+             */
+            enum WaitState {
+                /// 没有超时的等待
+                kWaitNone    = 0,
+                /// 等待中, 就绪与超时尚未决出
+                kWaitPending = 1,
+                /// 就绪一方胜出
+                kWaitReady   = 2,
+                /// 超时一方胜出
+                kWaitTimeout = 3,
+            };
+
             /**
              * @brief Socket事件上下文类
              */
@@ -61,6 +75,14 @@ namespace ygw {
                     Fiber::ptr fiber;
                     /// 事件的回调函数
                     std::function<void()> cb;
+                    /// 内嵌的超时节点, 等待超时不需要分配定时器
+                    timer::TimeoutNode timeout;
+                    /// (等待序号 << 2) | WaitState, 就绪与超时通过CAS决出唯一的唤醒方
+                    std::atomic<uint64_t> wait_state = {0};
+                    /// 等待结果(在等待协程的栈上), 0为就绪, ETIMEDOUT为超时
+                    int* result = nullptr;
+                    /// 唤醒时指定的线程, -1不指定(等待协程被指定线程时沿用)
+                    int thread = -1;
                 };
 
                 /**
@@ -76,6 +98,13 @@ namespace ygw {
                  */
                 void ResetContext(EventContext& ctx);
 
+                /**
+                 * @brief 就绪一方与超时竞争唤醒权, 胜出时摘除超时节点
+                 * @param[in, out] ctx 事件上下文
+                 * @return false表示超时已经胜出, 由超时回调唤醒等待方
+                 */
+                bool ResolveReady(EventContext& ctx);
+
                 /**
                  * @brief 触发事件
                  * @param[in] event 事件类型
@@ -92,6 +121,8 @@ namespace ygw {
                 int fd = 0;
                 /// 当前的事件
                 Event events_ = Event::kNone;
+                /// 读事件以EPOLLEXCLUSIVE加入epoll, 多个dup出来的监听句柄只唤醒一个
+                bool exclusive_ = false;
                 /// 事件的Mutex
                 MutexType mutex_;
             };
@@ -115,8 +146,15 @@ namespace ygw {
              * @param[in] fd socket句柄
              * @param[in] event 事件类型
              * @param[in] cb 事件回调函数
+             * @param[in] timeout_ms 等待超时(毫秒), ~0ull表示不超时
+             * @param[out] result 唤醒时写入等待结果, 0为就绪, ETIMEDOUT为超时
+             * @param[in] slack_ms 超时允许推迟的时间(毫秒)
+             * @details 超时节点内嵌在事件上下文中, 不分配内存;
+             *          超时后事件从epoll中移除并唤醒等待方, 不需要再调用CancelEvent
              */
-            int AddEvent(int fd, Event event, std::function<void()> cb = nullptr);
+            int AddEvent(int fd, Event event, std::function<void()> cb = nullptr
+                    ,uint64_t timeout_ms = ~0ull, int* result = nullptr
+                    ,uint64_t slack_ms = 0);
 
             /**
              * @brief 删除事件
@@ -140,6 +178,15 @@ namespace ygw {
              */
             bool CancelAll(int fd);
 
+            /**
+             * @brief 设置读事件以EPOLLEXCLUSIVE方式注册
+             * @details 用于同一监听socket dup出的多个句柄, 新连接只唤醒其中一个等待者.
+             *          EPOLLEXCLUSIVE不能MOD, 设置后只应等待读事件, 关闭句柄(CancelAll)时清除
+             * @param[in] fd socket句柄
+             * @param[in] v 是否开启
+             */
+            bool SetEventExclusive(int fd, bool v);
+
             /**
              * @brief 返回当前的IOManager
              */
@@ -153,6 +200,11 @@ namespace ygw {
 
             void OnTimerInsertedAtFront() override;
 
+            /**
+             * @brief 按最早的微秒定时器重设timerfd
+             */
+            void OnPreciseTimerChanged(uint64_t next_us) override;
+
             /**
              * @brief 重置socket句柄上下文的容器大小
              * @param[in] size 容量大小
@@ -165,11 +217,20 @@ namespace ygw {
              * @return 返回是否可以停止
              */
             bool Stopping(uint64_t* timeout);
+        private:
+            /**
+             * @brief 事件等待超时的回调
+             * @param[in] node 事件上下文中的超时节点
+             * @param[in] seq 到期的等待序号
+             */
+            static void OnEventTimeout(timer::TimeoutNode* node, uint64_t seq);
         private:
             /// epoll 文件句柄
             int epfd_ = 0;
             /// pipe 文件句柄
             int tickle_fds_[2];
+            /// 微秒定时器使用的timerfd(CLOCK_MONOTONIC, 绝对时间)
+            int timerfd_ = -1;
             /// 当前等待执行的事件数量
             std::atomic<size_t> pending_event_count_ = {0};
             /// IOManager的Mutex
@@ -0,0 +1,137 @@
+/**
+ * @file server_frame/iomanager_group.cc
+ * @brief
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-09-27
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "iomanager_group.h"
+#include "log.h"
+#include "macro.h"
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+namespace ygw {
+
+    //-------------------------------------------------------------------
+
+    namespace scheduler {
+
+        static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
+
+        IOManagerGroup::IOManagerGroup(size_t size, const std::string& name, bool pin_cpu)
+            : name_(name)
+        {
+            long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+            if (ncpu <= 0)
+            {
+                ncpu = 1;
+            }
+            if (size == 0)
+            {
+                size = ncpu;
+            }
+            for (size_t i = 0; i < size; ++i)
+            {
+                members_.push_back(std::make_shared<IOManager>(1, false
+                            ,name_ + "_" + std::to_string(i)));
+                cpus_.push_back(-1);
+            }
+            if (pin_cpu)
+            {
+                for (size_t i = 0; i < size; ++i)
+                {
+                    PinCpu(i, i % ncpu);
+                }
+            }
+        }
+
+        IOManagerGroup::~IOManagerGroup()
+        {
+            Stop();
+        }
+
+        void IOManagerGroup::Stop()
+        {
+            for (auto& i : members_)
+            {
+                i->Stop();
+            }
+        }
+
+        int IOManagerGroup::IndexOf(const Scheduler* v) const
+        {
+            for (size_t i = 0; i < members_.size(); ++i)
+            {
+                if (members_[i].get() == v)
+                {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        int IOManagerGroup::SelectByIncomingCpu(int fd)
+        {
+            int cpu = -1;
+            socklen_t len = sizeof(cpu);
+            if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) || cpu < 0)
+            {
+                return -1;
+            }
+            //成员比CPU多时同一个CPU上绑了多个成员, 在它们之间轮流
+            std::vector<int> matched;
+            for (size_t i = 0; i < cpus_.size(); ++i)
+            {
+                if (cpus_[i] == cpu)
+                {
+                    matched.push_back(i);
+                }
+            }
+            if (matched.size() == 1)
+            {
+                return matched[0];
+            }
+            if (matched.size() > 1)
+            {
+                return matched[next_++ % matched.size()];
+            }
+            return cpu % members_.size();
+        }
+
+        void IOManagerGroup::PinCpu(size_t idx, int cpu)
+        {
+            cpus_[idx] = cpu;
+            //成员只有一个线程, 任务一定在要绑定的线程上执行
+            std::string name = members_[idx]->GetName();
+            members_[idx]->Schedule([name, cpu]() {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if (rt)
+                {
+                    YGW_LOG_ERROR(g_logger) << "pthread_setaffinity_np name=" << name
+                        << " cpu=" << cpu << " rt=" << rt << " errstr=" << strerror(rt);
+                }
+            });
+        }
+
+        //-------------------------------------------------------------------
+
+    } // namespace scheduler
+
+    //-------------------------------------------------------------------
+
+} // namespace ygw
@@ -0,0 +1,135 @@
+/**
+ * @file iomanager_group.h
+ * @brief 单线程IO协程调度器组
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-09-27
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+
+#ifndef __YGW_IOMANAGER_GROUP_H__
+#define __YGW_IOMANAGER_GROUP_H__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iomanager.h"
+
+namespace ygw {
+
+    //--------------------------------------------------------------------
+
+    namespace scheduler {
+
+        //--------------------------------------------------------------------
+        /**
+         * @brief 一组单线程的IOManager
+         * @details 每个成员只有一个线程和自己的epoll, 连接放到某个成员上之后,
+         *          它的协程在整个生命周期里都在这个线程上运行, 不会跨线程迁移.
+         *          成员线程可以绑定到CPU, 新连接可以按SO_INCOMING_CPU放到
+         *          处理它软中断的那个CPU对应的成员上
+         */
+        class IOManagerGroup
+        {
+        public:
+            using ptr = std::shared_ptr<IOManagerGroup>;
+
+            /**
+             * @brief 构造函数, 创建并启动全部成员
+             * @param[in] size 成员数量, 为0时使用CPU核数
+             * @param[in] name 名称, 成员命名为name_下标
+             * @param[in] pin_cpu 成员线程是否依次绑定到CPU
+             */
+            IOManagerGroup(size_t size = 0, const std::string& name = "iom_group"
+                    ,bool pin_cpu = false);
+
+            /**
+             * @brief 析构函数, 停止全部成员
+             * @pre 不能在成员线程里析构
+             */
+            ~IOManagerGroup();
+
+            /**
+             * @brief 停止全部成员, 等待任务执行完成
+             */
+            void Stop();
+
+            /**
+             * @brief 返回成员数量
+             */
+            size_t GetSize() const { return members_.size(); }
+
+            /**
+             * @brief 返回第idx个成员
+             */
+            IOManager* Get(size_t idx) const { return members_[idx].get(); }
+
+            /**
+             * @brief 返回名称
+             */
+            const std::string& GetName() const { return name_; }
+
+            /**
+             * @brief 返回成员的下标
+             * @return 不是本组成员返回-1
+             */
+            int IndexOf(const Scheduler* v) const;
+
+            /**
+             * @brief 依次轮流选一个成员
+             * @return 成员下标
+             */
+            size_t Next() { return next_++ % members_.size(); }
+
+            /**
+             * @brief 按连接的SO_INCOMING_CPU选成员
+             * @details 成员绑了CPU时选绑在该CPU上的成员(有多个时轮流选), 否则按CPU编号取模
+             * @param[in] fd 连接句柄
+             * @return 成员下标, 取不到CPU返回-1
+             */
+            int SelectByIncomingCpu(int fd);
+
+            /**
+             * @brief 是否按SO_INCOMING_CPU放置连接
+             */
+            bool IsIncomingCpu() const { return incoming_cpu_; }
+
+            /**
+             * @brief 设置是否按SO_INCOMING_CPU放置连接
+             */
+            void SetIncomingCpu(bool v) { incoming_cpu_ = v; }
+
+            /**
+             * @brief 返回第idx个成员绑定的CPU, 没有绑定返回-1
+             */
+            int GetCpu(size_t idx) const { return cpus_[idx]; }
+        private:
+            /**
+             * @brief 把成员线程绑定到CPU
+             */
+            void PinCpu(size_t idx, int cpu);
+        private:
+            /// 名称
+            std::string name_;
+            /// 成员
+            std::vector<IOManager::ptr> members_;
+            /// 成员绑定的CPU, -1表示没有绑定
+            std::vector<int> cpus_;
+            /// 轮流选择的计数
+            std::atomic<uint64_t> next_ {0};
+            /// 是否按SO_INCOMING_CPU放置连接
+            bool incoming_cpu_ = false;
+        }; // class IOManagerGroup
+
+        //--------------------------------------------------------------------
+
+    } // namespace scheduler
+
+    //--------------------------------------------------------------------
+
+} // namespace ygw
+
+#endif // __YGW_IOMANAGER_GROUP_H__
@@ -12,6 +12,7 @@
  */
 
 #include <limits.h>
+#include <sys/sendfile.h>
 
 #include "base/fd_manager.h"
 #include "iomanager.h"
@@ -167,31 +168,129 @@ namespace ygw {
             {
                 sockfd_ = sockfd;
                 is_connected_ = true;
-                InitSock();
-                GetLocalAddress();
-                GetRemoteAddress();
+                //TCP_NODELAY/SO_SNDBUF等选项从监听socket继承, 不再逐个设置
+                //本地/远端地址在GetLocalAddress/GetRemoteAddress时才获取
                 return true;
             }
             return false;
         }
 
 
+        // AcceptFd
+        int Socket::AcceptFd(bool wait)
+        {
+            int newsockfd = -1;
+            if (wait)
+            {
+                newsockfd = ::accept4(sockfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            }
+            else
+            {
+                //不挂起协程, 直接调用原始的accept4, 监听句柄由hook设成了非阻塞
+                handle::FdContext::ptr ctx = handle::FdManager::GetInstance()->Get(sockfd_);
+                if (!ctx || ctx->IsClose())
+                {
+                    errno = EAGAIN;
+                    return -1;
+                }
+                newsockfd = accept4_f(sockfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            }
+            if (newsockfd == -1)
+            {
+                return -1;
+            }
+            //hook的accept4看到SOCK_NONBLOCK会当成用户要求非阻塞, 这里交还给hook挂起协程
+            handle::FdContext::ptr ctx = handle::FdManager::GetInstance()->Get(newsockfd, true);
+            if (ctx)
+            {
+                ctx->SetUserNonblock(false);
+            }
+            return newsockfd;
+        }
+
+        // CreateAccepted
+        Socket::ptr Socket::CreateAccepted(int sockfd)
+        {
+            Socket::ptr sock(new Socket(family_, type_, protocol_));
+            if (sock->Init(sockfd))
+            {
+                return sock;
+            }
+            return nullptr;
+        }
+
+        // IsListenClosed
+        bool Socket::IsListenClosed() const
+        {
+            //Close先标记句柄关闭再唤醒等待的协程, 最后把sockfd_置为-1
+            if (sockfd_ == -1)
+            {
+                return true;
+            }
+            handle::FdContext::ptr ctx = handle::FdManager::GetInstance()->Get(sockfd_);
+            return !ctx || ctx->IsClose();
+        }
+
         // Accept
         Socket::ptr Socket::Accept()
         {
-            Socket::ptr sock(new Socket(family_, type_, protocol_));
-            int newsockfd = ::accept(sockfd_, nullptr, nullptr);
+            int newsockfd = AcceptFd(true);
             if (newsockfd == -1)
             {
-                YGW_LOG_ERROR(g_logger) << "Accpet(" << sockfd_ << ") errno="
-                    << errno << " errstr=" << strerror(errno);
+                if (!IsListenClosed())
+                {
+                    YGW_LOG_ERROR(g_logger) << "Accpet(" << sockfd_ << ") errno="
+                        << errno << " errstr=" << strerror(errno);
+                }
                 return nullptr;
             }
-            if (sock->Init(newsockfd))
+            return CreateAccepted(newsockfd);
+        }
+
+        // AcceptMany
+        size_t Socket::AcceptMany(std::vector<Socket::ptr>& socks, size_t max_count)
+        {
+            size_t count = 0;
+            bool wait = true;
+            while (count < max_count)
             {
-                return sock;
+                int newsockfd = AcceptFd(wait);
+                if (newsockfd == -1)
+                {
+                    //监听socket被关闭(服务器停止)时安静地返回
+                    if ((wait || (errno != EAGAIN && errno != EWOULDBLOCK)) && !IsListenClosed())
+                    {
+                        YGW_LOG_ERROR(g_logger) << "Accpet(" << sockfd_ << ") errno="
+                            << errno << " errstr=" << strerror(errno);
+                    }
+                    break;
+                }
+                wait = false;
+                Socket::ptr sock = CreateAccepted(newsockfd);
+                if (sock)
+                {
+                    socks.push_back(sock);
+                    ++count;
+                }
             }
-            return nullptr;
+            return count;
+        }
+
+        // Dup
+        Socket::ptr Socket::Dup()
+        {
+            int fd = ::dup(sockfd_);
+            if (fd == -1)
+            {
+                YGW_LOG_ERROR(g_logger) << "Dup(" << sockfd_ << ") errno="
+                    << errno << " errstr=" << strerror(errno);
+                return nullptr;
+            }
+            handle::FdManager::GetInstance()->Get(fd, true);
+            Socket::ptr sock(new Socket(family_, type_, protocol_));
+            sock->sockfd_ = fd;
+            sock->local_address_ = local_address_;
+            return sock;
         }
 
         // Bind
@@ -433,6 +532,56 @@ namespace ygw {
             return -1;
         }
 
+        // SendFile
+        ssize_t Socket::SendFile(int in_fd, off_t* offset, size_t count)
+        {
+            if (IsConnected())
+            {
+                return ::sendfile(sockfd_, in_fd, offset, count);
+            }
+            return -1;
+        }
+
+        // SpliceFrom
+        ssize_t Socket::SpliceFrom(int fd_in, size_t length, unsigned int flags)
+        {
+            if (IsConnected())
+            {
+                return ::splice(fd_in, nullptr, sockfd_, nullptr, length, flags);
+            }
+            return -1;
+        }
+
+        // SpliceTo
+        ssize_t Socket::SpliceTo(int fd_out, size_t length, unsigned int flags)
+        {
+            if (IsConnected())
+            {
+                return ::splice(sockfd_, nullptr, fd_out, nullptr, length, flags);
+            }
+            return -1;
+        }
+
+        // SendMMsg
+        int Socket::SendMMsg(mmsghdr* msgs, unsigned int vlen, int flags)
+        {
+            if (IsConnected())
+            {
+                return ::sendmmsg(sockfd_, msgs, vlen, flags);
+            }
+            return -1;
+        }
+
+        // RecvMMsg
+        int Socket::RecvMMsg(mmsghdr* msgs, unsigned int vlen, int flags)
+        {
+            if (IsConnected())
+            {
+                return ::recvmmsg(sockfd_, msgs, vlen, flags, nullptr);
+            }
+            return -1;
+        }
+
         // GetRemoteAddress
         Address::ptr Socket::GetRemoteAddress()
         {
@@ -580,6 +729,10 @@ namespace ygw {
         {
             int val = 1;
             SetOption(SOL_SOCKET, SO_REUSEADDR, val);
+            if (is_reuse_port_)
+            {
+                SetOption(SOL_SOCKET, SO_REUSEPORT, val);
+            }
             if (type_ == SOCK_STREAM)
             {
                 SetOption(IPPROTO_TCP, TCP_NODELAY, val);
@@ -620,20 +773,13 @@ namespace ygw {
         {
         }
 
-        Socket::ptr SSLSocket::Accept() 
+        Socket::ptr SSLSocket::CreateAccepted(int sock) 
         {
-            SSLSocket::ptr sock(new SSLSocket(family_, type_, protocol_));
-            int newsock = ::accept(sockfd_, nullptr, nullptr);
-            if (newsock == -1)
+            SSLSocket::ptr ssl_sock(new SSLSocket(family_, type_, protocol_));
+            ssl_sock->ctx_ = ctx_;
+            if (ssl_sock->Init(sock)) 
             {
-                YGW_LOG_ERROR(g_logger) << "accept(" << sockfd_ << ") errno="
-                    << errno << " errstr=" << strerror(errno);
-                return nullptr;
-            }
-            sock->ctx_ = ctx_;
-            if (sock->Init(newsock)) 
-            {
-                return sock;
+                return ssl_sock;
             }
             return nullptr;
         }
@@ -751,6 +897,54 @@ namespace ygw {
             return -1;
         }
 
+        ssize_t SSLSocket::SendFile(int in_fd, off_t* offset, size_t count)
+        {
+            if (!ssl_)
+            {
+                return -1;
+            }
+            //一次最多一个TLS记录大小, 与sendfile一样允许部分发送
+            char buffer[16 * 1024];
+            size_t length = std::min(count, sizeof(buffer));
+            ssize_t n = offset ? ::pread(in_fd, buffer, length, *offset)
+                : ::read(in_fd, buffer, length);
+            if (n <= 0)
+            {
+                return n;
+            }
+            int rt = SSL_write(ssl_.get(), buffer, n);
+            if (rt > 0 && offset)
+            {
+                *offset += rt;
+            }
+            return rt;
+        }
+
+        ssize_t SSLSocket::SpliceFrom(int fd_in, size_t length, unsigned int flags)
+        {
+            //splice绕过SSL会发出明文
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+        ssize_t SSLSocket::SpliceTo(int fd_out, size_t length, unsigned int flags)
+        {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+        int SSLSocket::SendMMsg(mmsghdr* msgs, unsigned int vlen, int flags)
+        {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+        int SSLSocket::RecvMMsg(mmsghdr* msgs, unsigned int vlen, int flags)
+        {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
         bool SSLSocket::Init(int sock) 
         {
             bool v = Socket::Init(sock);
@@ -168,6 +168,30 @@ namespace ygw {
 			 */
 			virtual Socket::ptr Accept();
 
+			/**
+			 * @brief 批量接收连接
+			 * @details 没有连接时挂起当前协程, 有连接后不再挂起, 一直accept到队列为空(EAGAIN)
+			 *          或者达到max_count个, 新连接用accept4直接设成非阻塞, 地址在用到时才获取
+			 * @param[out] socks 新连接追加在末尾
+			 * @param[in] max_count 本次最多接收的连接数
+			 * @return 本次接收的连接数, 0表示出错(errno)
+			 * @pre Socket必须 bind , listen  成功
+			 */
+			size_t AcceptMany(std::vector<Socket::ptr>& socks, size_t max_count);
+
+			/**
+			 * @brief 复制监听句柄(dup), 两个Socket共享同一个连接队列
+			 * @return 成功返回新的Socket, 失败返回nullptr
+			 * @pre Socket必须 bind , listen  成功
+			 */
+			Socket::ptr Dup();
+
+			/**
+			 * @brief 设置SO_REUSEPORT, 多个socket监听同一地址, 内核把新连接分散到各个socket
+			 * @pre 在Bind之前设置
+			 */
+			void SetReusePort(bool v) { is_reuse_port_ = v;}
+
 			/**
 			 * @brief 绑定地址
 			 * @param[in] addr 地址
@@ -297,6 +321,64 @@ namespace ygw {
 			 */
 			virtual int RecvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0);
 
+			/**
+			 * @brief 零拷贝发送文件内容(sendfile)
+			 * @param[in] in_fd 文件句柄
+			 * @param[in, out] offset 文件偏移, 发送后更新; nullptr时使用并更新文件当前偏移
+			 * @param[in] count 最多发送的字节数
+			 * @return
+			 *      @retval >0 发送成功对应大小的数据
+			 *      @retval =0 文件已结束
+			 *      @retval <0 socket出错
+			 */
+			virtual ssize_t SendFile(int in_fd, off_t* offset, size_t count);
+
+			/**
+			 * @brief 从管道搬运数据到socket(splice)
+			 * @param[in] fd_in 管道读端
+			 * @param[in] length 最多搬运的字节数
+			 * @param[in] flags splice标志字(SPLICE_F_*)
+			 * @return
+			 *      @retval >0 搬运成功对应大小的数据
+			 *      @retval =0 管道写端已关闭
+			 *      @retval <0 socket出错
+			 */
+			virtual ssize_t SpliceFrom(int fd_in, size_t length, unsigned int flags = 0);
+
+			/**
+			 * @brief 从socket搬运数据到管道(splice)
+			 * @param[in] fd_out 管道写端
+			 * @param[in] length 最多搬运的字节数
+			 * @param[in] flags splice标志字(SPLICE_F_*)
+			 * @return
+			 *      @retval >0 搬运成功对应大小的数据
+			 *      @retval =0 socket被关闭
+			 *      @retval <0 socket出错
+			 */
+			virtual ssize_t SpliceTo(int fd_out, size_t length, unsigned int flags = 0);
+
+			/**
+			 * @brief 一次系统调用发送多个消息(sendmmsg)
+			 * @param[in, out] msgs 消息数组, msg_len返回每个消息发送的字节数
+			 * @param[in] vlen 消息数量
+			 * @param[in] flags 标志字
+			 * @return
+			 *      @retval >=0 发送成功的消息数量
+			 *      @retval <0 socket出错
+			 */
+			virtual int SendMMsg(mmsghdr* msgs, unsigned int vlen, int flags = 0);
+
+			/**
+			 * @brief 一次系统调用接收多个消息(recvmmsg)
+			 * @param[in, out] msgs 消息数组, msg_len返回每个消息接收的字节数
+			 * @param[in] vlen 消息数量
+			 * @param[in] flags 标志字
+			 * @return
+			 *      @retval >=0 接收到的消息数量
+			 *      @retval <0 socket出错
+			 */
+			virtual int RecvMMsg(mmsghdr* msgs, unsigned int vlen, int flags = 0);
+
 			/**
 			 * @brief 获取远端地址
 			 */
@@ -380,9 +462,28 @@ namespace ygw {
 			void NewSock();
 
 			/**
-			 * @brief 初始化sock
+			 * @brief 用accept得到的句柄初始化sock
+			 * @details 选项从监听socket继承, 不调用InitSock
 			 */
 			virtual bool Init(int sockfd);
+
+			/**
+			 * @brief 用accept得到的句柄创建同类型的Socket
+			 * @return 失败返回nullptr
+			 */
+			virtual Socket::ptr CreateAccepted(int sockfd);
+
+			/**
+			 * @brief accept一个连接
+			 * @param[in] wait 没有连接时是否挂起协程
+			 * @return 新的句柄, 失败返回-1
+			 */
+			int AcceptFd(bool wait);
+
+			/**
+			 * @brief 监听socket是否已经关闭或正在关闭, 此时accept失败是正常的
+			 */
+			bool IsListenClosed() const;
 		protected:
 			/// socket句柄
 			int sockfd_;
@@ -394,6 +495,8 @@ namespace ygw {
 			int protocol_;
 			/// 是否连接
 			bool is_connected_;
+			/// 是否SO_REUSEPORT
+			bool is_reuse_port_ = false;
 			/// 本地地址
 			Address::ptr local_address_;
 			/// 远端地址
@@ -411,7 +514,6 @@ namespace ygw {
 			static SSLSocket::ptr CreateTCPSocket6();
 
 			SSLSocket(int family, int type, int protocol = 0);
-			virtual Socket::ptr Accept() override;
 			virtual bool Bind(const Address::ptr addr) override;
 			virtual bool Connect(const Address::ptr addr, uint64_t timeout_ms = -1) override;
 			virtual bool Listen(int backlog = SOMAXCONN) override;
@@ -424,11 +526,18 @@ namespace ygw {
 			virtual int Recv(iovec* buffers, size_t length, int flags = 0) override;
 			virtual int RecvFrom(void* buffer, size_t length, Address::ptr from, int flags = 0) override;
 			virtual int RecvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0) override;
+			/// 内核不能加密, 读出文件后经SSL_write发送
+			virtual ssize_t SendFile(int in_fd, off_t* offset, size_t count) override;
+			virtual ssize_t SpliceFrom(int fd_in, size_t length, unsigned int flags = 0) override;
+			virtual ssize_t SpliceTo(int fd_out, size_t length, unsigned int flags = 0) override;
+			virtual int SendMMsg(mmsghdr* msgs, unsigned int vlen, int flags = 0) override;
+			virtual int RecvMMsg(mmsghdr* msgs, unsigned int vlen, int flags = 0) override;
 
 			bool LoadCertificates(const std::string& cert_file, const std::string& key_file);
 			virtual std::ostream& Dump(std::ostream& os) const override;
 		protected:
 			virtual bool Init(int sock) override;
+			virtual Socket::ptr CreateAccepted(int sock) override;
 		private:
 			std::shared_ptr<SSL_CTX> ctx_;
 			std::shared_ptr<SSL> ssl_;
@@ -10,6 +10,10 @@
  *  Description: 
  * ====================================================
  */
+#include <limits.h>
+
+#include <algorithm>
+
 #include "server_frame/util.h"
 #include "socket_stream.h"
 
@@ -73,6 +77,59 @@ namespace ygw {
             return socket_->Send(buffer, length);
         }
 
+        int SocketStream::WriteFixSizeV(iovec* iovs, size_t count, int flags) 
+        {
+            if (!IsConnected()) 
+            {
+                return -1;
+            }
+            int64_t total = 0;
+            while (count > 0) 
+            {
+                int n = socket_->Send(iovs, std::min<size_t>(count, IOV_MAX), flags);
+                if (n <= 0) 
+                {
+                    return n;
+                }
+                total += n;
+                //跳过已经写完的iovec, 调整写了一部分的那个
+                size_t left = n;
+                while (count > 0 && left >= iovs->iov_len) 
+                {
+                    left -= iovs->iov_len;
+                    ++iovs;
+                    --count;
+                }
+                if (left > 0) 
+                {
+                    iovs->iov_base = (char*)iovs->iov_base + left;
+                    iovs->iov_len -= left;
+                }
+            }
+            return total;
+        }
+
+        int64_t SocketStream::SendFile(int fd, uint64_t offset, uint64_t length) 
+        {
+            if (!IsConnected()) 
+            {
+                return -1;
+            }
+            //普通socket走sendfile零拷贝, SSLSocket读出文件后加密发送
+            int64_t total = 0;
+            off_t off = offset;
+            while ((uint64_t)total < length) 
+            {
+                ssize_t n = socket_->SendFile(fd, &off, std::min<uint64_t>(length - total, 0x7ffff000));
+                if (n <= 0) 
+                {
+                    return n;
+                }
+                total += n;
+            }
+            return total;
+        }
+
         int SocketStream::Write(container::ByteArray::ptr ba, size_t length) 
         {
             if (!IsConnected()) 
@@ -84,6 +84,33 @@ namespace ygw {
              */
             virtual int Write(container::ByteArray::ptr ba, size_t length) override;
 
+            /**
+             * @brief 用writev写完iovec数组中的全部数据, 不拷贝数据
+             * @param[in, out] iovs iovec数组, 部分写出时会修改其中的iov_base/iov_len
+             * @param[in] count iovec数组长度
+             * @param[in] flags 传给sendmsg的标志, 后面紧跟着发文件时可以用MSG_MORE
+             * @return
+             *      @retval >0 全部写完, 返回写出的总长度
+             *      @retval =0 socket被远端关闭
+             *      @retval <0 socket错误
+             */
+            int WriteFixSizeV(iovec* iovs, size_t count, int flags = 0);
+
+            /**
+             * @brief 把文件的一段写到socket
+             * @details 普通socket用sendfile在内核中拷贝, 不经过用户态;
+             *          SSLSocket需要加密, 退化为pread到固定大小的缓冲区再写出.
+             *          两种方式占用的内存都与文件大小无关
+             * @param[in] fd 文件句柄
+             * @param[in] offset 文件偏移
+             * @param[in] length 长度
+             * @return
+             *      @retval >0 全部写完, 返回写出的总长度
+             *      @retval =0 socket被远端关闭或者文件提前结束
+             *      @retval <0 socket错误
+             */
+            int64_t SendFile(int fd, uint64_t offset, uint64_t length);
+
             /**
              * @brief 关闭socket
              */
@@ -12,6 +12,11 @@
  */
 #include "tcp_server.h"
 
+#include <algorithm>
+#include <fstream>
+
+#include "util.h"
+
 namespace ygw {
 
     namespace tcp {
@@ -20,8 +25,30 @@ namespace ygw {
             ygw::config::Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
                                     "tcp server read timeout");
 
+        static ygw::config::ConfigVar<uint32_t>::ptr g_tcp_server_accept_batch =
+            ygw::config::Config::Lookup("tcp_server.accept_batch", (uint32_t)64,
+                                    "tcp server max accept per wakeup");
+
         static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
 
+        /**
+         * @brief 内核截断后的listen队列长度
+         */
+        static int EffectiveBacklog(int backlog)
+        {
+            if (backlog <= 0)
+            {
+                backlog = SOMAXCONN;
+            }
+            int somaxconn = 0;
+            std::ifstream ifs("/proc/sys/net/core/somaxconn");
+            if (ifs >> somaxconn && somaxconn > 0 && somaxconn < backlog)
+            {
+                return somaxconn;
+            }
+            return backlog;
+        }
+
         TcpServer::TcpServer(ygw::scheduler::IOManager* io_worker,
                 ygw::scheduler::IOManager* accept_worker)
             : io_worker_(io_worker)
@@ -30,6 +57,18 @@ namespace ygw {
             ,name_("ygw/1.0.0")
             ,is_stop_(true) 
         {
+            AddIOWorker(io_worker);
+        }
+
+        TcpServer::TcpServer(ygw::scheduler::IOManagerGroup::ptr io_group,
+                ygw::scheduler::IOManager* accept_worker)
+            : TcpServer(io_group->Get(0), accept_worker ? accept_worker : io_group->Get(0))
+        {
+            io_group_ = io_group;
+            for (size_t i = 1; i < io_group_->GetSize(); ++i) 
+            {
+                AddIOWorker(io_group_->Get(i));
+            }
         }
 
         TcpServer::~TcpServer() // 关闭全部socket
@@ -41,9 +80,126 @@ namespace ygw {
             socks_.clear();
         }
 
+        TcpServer::AcceptMode TcpServer::AcceptModeFromString(const std::string& v) 
+        {
+            if (v == "reuseport") 
+            {
+                return kAcceptReusePort;
+            }
+            if (v == "exclusive") 
+            {
+                return kAcceptExclusive;
+            }
+            return kAcceptSingle;
+        }
+
+        const char* TcpServer::AcceptModeToString(AcceptMode v) 
+        {
+            switch (v) 
+            {
+            case kAcceptReusePort:
+                return "reuseport";
+            case kAcceptExclusive:
+                return "exclusive";
+            default:
+                return "single";
+            }
+        }
+
+        TcpServer::DispatchMode TcpServer::DispatchModeFromString(const std::string& v) 
+        {
+            if (v == "least_conn") 
+            {
+                return kDispatchLeastConn;
+            }
+            return kDispatchRoundRobin;
+        }
+
+        const char* TcpServer::DispatchModeToString(DispatchMode v) 
+        {
+            switch (v) 
+            {
+            case kDispatchLeastConn:
+                return "least_conn";
+            default:
+                return "round_robin";
+            }
+        }
+
+        void TcpServer::SetConf(TcpServerConf::ptr v) 
+        {
+            conf_ = v;
+            if (conf_) 
+            {
+                accept_mode_ = AcceptModeFromString(conf_->accept_mode);
+                dispatch_mode_ = DispatchModeFromString(conf_->dispatch);
+                max_conns_ = std::max(conf_->max_connections, 0);
+                max_inflight_ = std::max(conf_->max_inflight, 0);
+                low_watermark_ = std::min(std::max(conf_->low_watermark, 0), 100);
+                reject_excess_ = conf_->reject_excess;
+            }
+        }
+
+        void TcpServer::AddIOWorker(ygw::scheduler::IOManager* v) 
+        {
+            if (!v) 
+            {
+                return;
+            }
+            for (auto& i : io_workers_) 
+            {
+                if (i->worker == v) 
+                {
+                    return;
+                }
+            }
+            IOWorkerSlot::ptr slot = std::make_shared<IOWorkerSlot>();
+            slot->worker = v;
+            io_workers_.push_back(slot);
+        }
+
         void TcpServer::SetConf(const TcpServerConf& v) 
         {
-            conf_.reset(new TcpServerConf(v));
+            SetConf(std::make_shared<TcpServerConf>(v));
+        }
+
+        const TcpServerConf& TcpServer::GetTuning() const 
+        {
+            static const TcpServerConf s_default;
+            return conf_ ? *conf_ : s_default;
+        }
+
+        bool TcpServer::ApplyListenOptions(ygw::socket::Socket::ptr sock) 
+        {
+            const TcpServerConf& conf = GetTuning();
+            bool rt = sock->SetOption(IPPROTO_TCP, TCP_NODELAY, conf.nodelay ? 1 : 0);
+            //缓冲区要在listen之前设置, 窗口扩大因子在握手时就确定了
+            if (conf.sndbuf > 0) 
+            {
+                rt = sock->SetOption(SOL_SOCKET, SO_SNDBUF, conf.sndbuf) && rt;
+            }
+            if (conf.rcvbuf > 0) 
+            {
+                rt = sock->SetOption(SOL_SOCKET, SO_RCVBUF, conf.rcvbuf) && rt;
+            }
+            if (conf.notsent_lowat > 0) 
+            {
+                rt = sock->SetOption(IPPROTO_TCP, TCP_NOTSENT_LOWAT, conf.notsent_lowat) && rt;
+            }
+            if (conf.defer_accept > 0) 
+            {
+                rt = sock->SetOption(IPPROTO_TCP, TCP_DEFER_ACCEPT, conf.defer_accept) && rt;
+            }
+            if (conf.fastopen > 0) 
+            {
+                rt = sock->SetOption(IPPROTO_TCP, TCP_FASTOPEN, conf.fastopen) && rt;
+            }
+            if (!rt) 
+            {
+                YGW_LOG_WARN(g_logger) << "set listen socket option fail errno="
+                    << errno << " errstr=" << strerror(errno) << " sock=" << *sock;
+            }
+            return rt;
         }
 
         bool TcpServer::Bind(ygw::socket::Address::ptr addr, bool ssl) 
@@ -59,26 +215,73 @@ namespace ygw {
                 ,bool ssl) 
         {
             ssl_ = ssl;
+            if (accept_mode_ == kAcceptExclusive && ssl) 
+            {
+                //SSLSocket的dup无法共享SSL_CTX, 退回SO_REUSEPORT
+                YGW_LOG_WARN(g_logger) << "accept_mode=exclusive not support ssl, use reuseport";
+                accept_mode_ = kAcceptReusePort;
+            }
+
+            //多监听模式下io_worker的每个工作线程对应一个accept协程
+            size_t acceptors = 1;
+            if (accept_mode_ != kAcceptSingle) 
+            {
+                acceptors = io_group_ ? io_group_->GetSize()
+                    : std::max<size_t>(io_worker_->GetWorkerThreadIds().size(), 1);
+            }
+            size_t listeners = accept_mode_ == kAcceptReusePort ? acceptors : 1;
+
             for (auto& addr : addrs) 
             {
-                ygw::socket::Socket::ptr sock = ssl ? ygw::socket::SSLSocket::CreateTCP(addr) : ygw::socket::Socket::CreateTCP(addr);
-                if (!sock->Bind(addr)) 
+                std::vector<ygw::socket::Socket::ptr> socks;
+                for (size_t i = 0; i < listeners; ++i) 
                 {
-                    YGW_LOG_ERROR(g_logger) << "bind fail errno="
-                        << errno << " errstr=" << strerror(errno)
-                        << " addr=[" << addr->ToString() << "]";
-                    fails.push_back(addr);
-                    continue;
+                    ygw::socket::Socket::ptr sock = ssl ? ygw::socket::SSLSocket::CreateTCP(addr) : ygw::socket::Socket::CreateTCP(addr);
+                    sock->SetReusePort(accept_mode_ == kAcceptReusePort);
+                    if (!sock->Bind(addr)) 
+                    {
+                        YGW_LOG_ERROR(g_logger) << "bind fail errno="
+                            << errno << " errstr=" << strerror(errno)
+                            << " addr=[" << addr->ToString() << "]";
+                        break;
+                    }
+                    ApplyListenOptions(sock);
+                    if (!sock->Listen(GetTuning().backlog > 0 ? GetTuning().backlog : SOMAXCONN)) 
+                    {
+                        YGW_LOG_ERROR(g_logger) << "listen fail errno="
+                            << errno << " errstr=" << strerror(errno)
+                            << " addr=[" << addr->ToString() << "]";
+                        break;
+                    }
+                    socks.push_back(sock);
                 }
-                if (!sock->Listen()) 
+                if (socks.size() != listeners) 
                 {
-                    YGW_LOG_ERROR(g_logger) << "listen fail errno="
-                        << errno << " errstr=" << strerror(errno)
-                        << " addr=[" << addr->ToString() << "]";
                     fails.push_back(addr);
                     continue;
                 }
-                socks_.push_back(sock);
+
+                if (accept_mode_ == kAcceptExclusive) 
+                {
+                    //同一个监听socket dup到每个线程, 以EPOLLEXCLUSIVE注册避免惊群
+                    for (size_t i = 1; i < acceptors; ++i) 
+                    {
+                        ygw::socket::Socket::ptr sock = socks[0]->Dup();
+                        if (!sock) 
+                        {
+                            YGW_LOG_ERROR(g_logger) << "dup listen socket fail errno="
+                                << errno << " errstr=" << strerror(errno);
+                            break;
+                        }
+                        socks.push_back(sock);
+                    }
+                    for (size_t i = 0; i < socks.size(); ++i) 
+                    {
+                        GetAcceptWorker(socks_.size() + i)->SetEventExclusive(socks[i]->GetSocket(), true);
+                    }
+                }
+
+                socks_.insert(socks_.end(), socks.begin(), socks.end());
             }
 
             if (!fails.empty()) 
@@ -91,6 +294,7 @@ namespace ygw {
                 YGW_LOG_INFO(g_logger) << "type=" << type_
                     << " name=" << name_
                     << " ssl=" << ssl_
+                    << " accept_mode=" << AcceptModeToString(accept_mode_)
                     << " server bind success: " << *i;
             }
             return true;
@@ -99,23 +303,219 @@ namespace ygw {
         void TcpServer::StartAccept(ygw::socket::Socket::ptr sock) 
         {
             //std::cout << "accept" << std::endl;
+            //一次唤醒把积压的连接都取出来, 再成批分配
+            size_t batch = std::max<size_t>(g_tcp_server_accept_batch->GetValue(), 1);
+            std::vector<ygw::socket::Socket::ptr> clients;
+            clients.reserve(batch);
             while (!is_stop_) 
             {
-                ygw::socket::Socket::ptr client = sock->Accept();
-                if (client)
+                size_t n = batch;
+                if (!reject_excess_) 
                 {
-                    client->SetRecvTimeout(recv_timeout_);
-                    io_worker_->Schedule(std::bind(&TcpServer::HandleClient,
-                                shared_from_this(), client));
-                } 
-                else 
+                    if (IsOverloaded()) 
+                    {
+                        PauseAccept();
+                        continue;
+                    }
+                    //一批不超过剩余的连接名额
+                    if (max_conns_ > 0) 
+                    {
+                        n = std::min<size_t>(n, std::max<int64_t>(max_conns_ - conns_, 1));
+                    }
+                }
+                clients.clear();
+                if (sock->AcceptMany(clients, n) == 0) 
                 {
-                    YGW_LOG_ERROR(g_logger) << "accept errno=" << errno
-                        << " errstr=" << strerror(errno);
+                    continue;
                 }
+                Dispatch(clients);
             }
         }
 
+        void TcpServer::RejectClient(ygw::socket::Socket::ptr client) 
+        {
+            client->Close();
+        }
+
+        void TcpServer::EndRequest() 
+        {
+            --inflight_;
+            if (has_paused_ && IsBelowLowWatermark()) 
+            {
+                ResumeAccept();
+            }
+        }
+
+        bool TcpServer::IsOverloaded() const 
+        {
+            return (max_conns_ > 0 && conns_ >= max_conns_)
+                || (max_inflight_ > 0 && inflight_ >= max_inflight_);
+        }
+
+        bool TcpServer::IsBelowLowWatermark() const 
+        {
+            return (max_conns_ <= 0 || conns_ <= max_conns_ * low_watermark_ / 100)
+                && (max_inflight_ <= 0 || inflight_ <= max_inflight_ * low_watermark_ / 100);
+        }
+
+        void TcpServer::PauseAccept() 
+        {
+            ygw::scheduler::Scheduler* sched = ygw::scheduler::Scheduler::GetThis();
+            ygw::scheduler::Fiber::ptr self = ygw::scheduler::Fiber::GetThis();
+            //切出后再登记, 连接在别的线程关闭时不会调度到还没切出的协程
+            ygw::scheduler::Scheduler::YieldToHoldThen([this, sched, self]() {
+                ygw::thread::Mutex::Lock lock(pause_mutex_);
+                //先置标记再检查, 和RunClient/EndRequest里先减计数再看标记配对, 不会漏掉唤醒
+                has_paused_ = true;
+                if (is_stop_ || IsBelowLowWatermark()) 
+                {
+                    if (paused_.empty()) 
+                    {
+                        has_paused_ = false;
+                    }
+                    lock.unlock();
+                    sched->Schedule(self);
+                    return;
+                }
+                if (paused_.empty()) 
+                {
+                    pause_start_us_ = ygw::util::TimeUtil::GetCurrentUS();
+                    ++pause_count_;
+                    YGW_LOG_WARN(g_logger) << "name=" << name_ << " pause accept conns="
+                        << conns_ << " inflight=" << inflight_;
+                }
+                paused_.push_back(std::make_pair(sched, self));
+            });
+        }
+
+        void TcpServer::ResumeAccept() 
+        {
+            std::vector<std::pair<ygw::scheduler::Scheduler*, ygw::scheduler::Fiber::ptr> > paused;
+            {
+                ygw::thread::Mutex::Lock lock(pause_mutex_);
+                if (paused_.empty()) 
+                {
+                    return;
+                }
+                paused.swap(paused_);
+                has_paused_ = false;
+                paused_us_ += ygw::util::TimeUtil::GetCurrentUS() - pause_start_us_;
+            }
+            YGW_LOG_INFO(g_logger) << "name=" << name_ << " resume accept conns="
+                << conns_ << " inflight=" << inflight_;
+            for (auto& i : paused) 
+            {
+                i.first->Schedule(i.second);
+            }
+        }
+
+        uint64_t TcpServer::GetPausedUS() 
+        {
+            ygw::thread::Mutex::Lock lock(pause_mutex_);
+            uint64_t v = paused_us_;
+            if (!paused_.empty()) 
+            {
+                v += ygw::util::TimeUtil::GetCurrentUS() - pause_start_us_;
+            }
+            return v;
+        }
+
+        void TcpServer::Dispatch(std::vector<ygw::socket::Socket::ptr>& clients) 
+        {
+            auto self = shared_from_this();
+            //TCP_QUICKACK不会从监听socket继承, 要在每个新连接上设置
+            bool quickack = GetTuning().quickack;
+            std::vector<std::vector<std::function<void()> > > cbs(io_workers_.size());
+            for (auto& client : clients) 
+            {
+                if (reject_excess_ && IsOverloaded()) 
+                {
+                    ++rejected_;
+                    RejectClient(client);
+                    continue;
+                }
+                ++conns_;
+                client->SetRecvTimeout(recv_timeout_);
+                if (quickack) 
+                {
+                    client->SetOption(IPPROTO_TCP, TCP_QUICKACK, 1);
+                }
+                size_t idx = PickIOWorker(client);
+                IOWorkerSlot::ptr& slot = io_workers_[idx];
+                ++slot->conns;
+                cbs[idx].push_back(std::bind(&TcpServer::RunClient, self, client, slot));
+            }
+            for (size_t i = 0; i < cbs.size(); ++i) 
+            {
+                if (!cbs[i].empty()) 
+                {
+                    io_workers_[i]->worker->Schedule(cbs[i].begin(), cbs[i].end());
+                }
+            }
+        }
+
+        size_t TcpServer::PickIOWorker(const ygw::socket::Socket::ptr& client) 
+        {
+            if (io_workers_.size() == 1) 
+            {
+                return 0;
+            }
+            if (io_group_) 
+            {
+                int idx = -1;
+                if (io_group_->IsIncomingCpu()) 
+                {
+                    idx = io_group_->SelectByIncomingCpu(client->GetSocket());
+                }
+                if (idx < 0 && accept_mode_ != kAcceptSingle) 
+                {
+                    //多监听模式下留在接收它的成员上
+                    idx = io_group_->IndexOf(ygw::scheduler::Scheduler::GetThis());
+                }
+                if (idx >= 0) 
+                {
+                    return idx;
+                }
+            }
+            if (dispatch_mode_ == kDispatchLeastConn) 
+            {
+                size_t idx = 0;
+                int64_t min_conns = io_workers_[0]->conns;
+                for (size_t i = 1; i < io_workers_.size(); ++i) 
+                {
+                    int64_t conns = io_workers_[i]->conns;
+                    if (conns < min_conns) 
+                    {
+                        min_conns = conns;
+                        idx = i;
+                    }
+                }
+                return idx;
+            }
+            return next_worker_++ % io_workers_.size();
+        }
+
+        void TcpServer::RunClient(ygw::socket::Socket::ptr client, IOWorkerSlot::ptr slot) 
+        {
+            //HandleClient抛出异常时也要减掉Dispatch里加的连接数
+            struct ConnectionGuard
+            {
+                TcpServer* server;
+                IOWorkerSlot* slot;
+
+                ~ConnectionGuard()
+                {
+                    --slot->conns;
+                    --server->conns_;
+                    if (server->has_paused_ && server->IsBelowLowWatermark())
+                    {
+                        server->ResumeAccept();
+                    }
+                }
+            } guard = {this, slot.get()};
+            HandleClient(client);
+        }
+
         bool TcpServer::Start() 
         {
             if (!is_stop_) 
@@ -123,26 +523,44 @@ namespace ygw {
                 return true;
             }
             is_stop_ = false;
-            for (auto& sock : socks_) 
+            for (size_t i = 0; i < socks_.size(); ++i) 
             {
-                accept_worker_->Schedule(std::bind(&TcpServer::StartAccept,
-                            shared_from_this(), sock));
+                GetAcceptWorker(i)->Schedule(std::bind(&TcpServer::StartAccept,
+                            shared_from_this(), socks_[i]));
             }
             return true;
         }
 
+        ygw::scheduler::IOManager* TcpServer::GetAcceptWorker(size_t idx) const 
+        {
+            if (accept_mode_ == kAcceptSingle) 
+            {
+                return accept_worker_;
+            }
+            if (io_group_) 
+            {
+                return io_group_->Get(idx % io_group_->GetSize());
+            }
+            return io_worker_;
+        }
+
         void TcpServer::Stop() 
         {
             is_stop_ = true;
+            //暂停的accept协程醒来后看到is_stop_退出
+            ResumeAccept();
             auto self = shared_from_this();
-            accept_worker_->Schedule([this, self]() {
-                for (auto& sock : socks_) 
-                {
-                    sock->CancelAll();
+            //监听socket的事件注册在它所在调度器的epoll上, 要在那里关闭.
+            //hook的close先标记关闭再取消事件, 醒来的accept协程看到关闭直接返回,
+            //不会在正在关闭的句柄上重新注册事件
+            for (size_t i = 0; i < socks_.size(); ++i) 
+            {
+                ygw::socket::Socket::ptr sock = socks_[i];
+                GetAcceptWorker(i)->Schedule([self, sock]() {
                     sock->Close();
-                }
-                socks_.clear();
-            });
+                });
+            }
+            socks_.clear();
         }
 
         void TcpServer::HandleClient(ygw::socket::Socket::ptr client) 
@@ -171,10 +589,48 @@ namespace ygw {
             std::stringstream ss;
             ss << prefix << "[type=" << type_
                 << " name=" << name_ << " ssl=" << ssl_
+                << " accept_mode=" << AcceptModeToString(accept_mode_)
+                << " dispatch=" << DispatchModeToString(dispatch_mode_)
+                << " io_workers=" << io_workers_.size()
+                << " io_group=" << (io_group_ ? io_group_->GetName() : "")
                 //<< " worker=" << (worker_ ? worker_->GetName() : "")
                 << " accept=" << (accept_worker_ ? accept_worker_->GetName() : "")
                 << " recv_timeout=" << recv_timeout_ << "]" << std::endl;
+            //监听socket上实际生效的选项, SO_SNDBUF/SO_RCVBUF是内核翻倍后的值
+            const TcpServerConf& conf = GetTuning();
+            int nodelay = conf.nodelay ? 1 : 0;
+            int defer_accept = conf.defer_accept;
+            int fastopen = conf.fastopen;
+            int sndbuf = conf.sndbuf;
+            int rcvbuf = conf.rcvbuf;
+            int notsent_lowat = conf.notsent_lowat;
+            if (!socks_.empty() && socks_[0]->IsValid()) 
+            {
+                socks_[0]->GetOption(IPPROTO_TCP, TCP_NODELAY, nodelay);
+                socks_[0]->GetOption(IPPROTO_TCP, TCP_DEFER_ACCEPT, defer_accept);
+                socks_[0]->GetOption(IPPROTO_TCP, TCP_FASTOPEN, fastopen);
+                socks_[0]->GetOption(SOL_SOCKET, SO_SNDBUF, sndbuf);
+                socks_[0]->GetOption(SOL_SOCKET, SO_RCVBUF, rcvbuf);
+                socks_[0]->GetOption(IPPROTO_TCP, TCP_NOTSENT_LOWAT, notsent_lowat);
+            }
             std::string pfx = prefix.empty() ? "    " : prefix;
+            ss << pfx << "[backlog=" << EffectiveBacklog(conf.backlog)
+                << " nodelay=" << nodelay
+                << " defer_accept=" << defer_accept
+                << " fastopen=" << fastopen
+                << " quickack=" << conf.quickack
+                << " sndbuf=" << sndbuf
+                << " rcvbuf=" << rcvbuf
+                << " notsent_lowat=" << notsent_lowat << "]" << std::endl;
+            ss << pfx << "[max_connections=" << max_conns_
+                << " max_inflight=" << max_inflight_
+                << " low_watermark=" << low_watermark_
+                << " reject_excess=" << reject_excess_
+                << " connections=" << conns_
+                << " inflight=" << inflight_
+                << " rejected=" << rejected_
+                << " pause_count=" << pause_count_
+                << " paused_us=" << GetPausedUS() << "]" << std::endl;
             for (auto& i : socks_) 
             {
                 ss << pfx << pfx << *i << std::endl;
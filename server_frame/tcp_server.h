@@ -11,12 +11,14 @@
 #ifndef __YGW_TCP_SERVER_H__
 #define __YGW_TCP_SERVER_H__
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
 #include "address.h"
 #include "config.h"
 #include "iomanager.h"
+#include "iomanager_group.h"
 #include "noncopyable.h"
 #include "socket.h"
 
@@ -44,6 +46,34 @@ namespace ygw {
             std::string accept_worker;
             std::string io_worker;
             std::string process_worker;
+            /// 接收连接方式: single, reuseport, exclusive @see TcpServer::AcceptMode
+            std::string accept_mode = "single";
+            /// 新连接分配到io_worker的方式: round_robin, least_conn @see TcpServer::DispatchMode
+            std::string dispatch = "round_robin";
+            /// listen队列长度, <=0使用SOMAXCONN, 内核会截断到net.core.somaxconn
+            int backlog = SOMAXCONN;
+            /// 是否开启TCP_NODELAY
+            int nodelay = 1;
+            /// TCP_DEFER_ACCEPT秒数, 连接收到数据后才交给accept, 0不开启
+            int defer_accept = 0;
+            /// TCP_FASTOPEN队列长度, 0不开启
+            int fastopen = 0;
+            /// 新连接是否开启TCP_QUICKACK
+            int quickack = 0;
+            /// SO_SNDBUF字节数, 0使用内核默认
+            int sndbuf = 0;
+            /// SO_RCVBUF字节数, 0使用内核默认
+            int rcvbuf = 0;
+            /// TCP_NOTSENT_LOWAT字节数, 0使用内核默认
+            int notsent_lowat = 0;
+            /// 最大并发连接数, 0不限制
+            int max_connections = 0;
+            /// 最大在途请求数, 0不限制
+            int max_inflight = 0;
+            /// 达到上限暂停接收后, 降到上限的百分之多少以下才恢复
+            int low_watermark = 80;
+            /// 达到上限时是否继续接收并立即拒绝多出的连接, 0暂停接收
+            int reject_excess = 0;
             std::map<std::string, std::string> args;
 
             bool IsValid() const 
@@ -63,6 +93,20 @@ namespace ygw {
                     && accept_worker == oth.accept_worker
                     && io_worker == oth.io_worker
                     && process_worker == oth.process_worker
+                    && accept_mode == oth.accept_mode
+                    && dispatch == oth.dispatch
+                    && backlog == oth.backlog
+                    && nodelay == oth.nodelay
+                    && defer_accept == oth.defer_accept
+                    && fastopen == oth.fastopen
+                    && quickack == oth.quickack
+                    && sndbuf == oth.sndbuf
+                    && rcvbuf == oth.rcvbuf
+                    && notsent_lowat == oth.notsent_lowat
+                    && max_connections == oth.max_connections
+                    && max_inflight == oth.max_inflight
+                    && low_watermark == oth.low_watermark
+                    && reject_excess == oth.reject_excess
                     && args == oth.args
                     && id == oth.id
                     && type == oth.type;
@@ -78,6 +122,50 @@ namespace ygw {
         {
         public:
             using ptr = std::shared_ptr<TcpServer>;
+
+            /**
+             * @brief 接收连接的方式
+             */
+            enum AcceptMode {
+                /// 每个地址一个监听socket, 在accept_worker上单个协程accept
+                kAcceptSingle = 0,
+                /// 每个地址按io_worker的线程数开多个SO_REUSEPORT监听socket,
+                /// 内核把连接分散到各监听队列, 多个accept协程在io_worker上并行接收
+                kAcceptReusePort = 1,
+                /// 每个地址一个监听socket, io_worker的每个线程dup一个句柄以EPOLLEXCLUSIVE等待,
+                /// 用于不支持SO_REUSEPORT负载均衡的内核
+                kAcceptExclusive = 2,
+            };
+
+            /**
+             * @brief 字符串转接收方式, 不认识的按kAcceptSingle
+             */
+            static AcceptMode AcceptModeFromString(const std::string& v);
+
+            /**
+             * @brief 接收方式转字符串
+             */
+            static const char* AcceptModeToString(AcceptMode v);
+
+            /**
+             * @brief 新连接分配到io_worker的方式
+             */
+            enum DispatchMode {
+                /// 依次轮流分配
+                kDispatchRoundRobin = 0,
+                /// 分配给当前连接数最少的io_worker
+                kDispatchLeastConn = 1,
+            };
+
+            /**
+             * @brief 字符串转分配方式, 不认识的按kDispatchRoundRobin
+             */
+            static DispatchMode DispatchModeFromString(const std::string& v);
+
+            /**
+             * @brief 分配方式转字符串
+             */
+            static const char* DispatchModeToString(DispatchMode v);
             /**
              * @brief 构造函数
              * @param[in] worker socket客户端工作的协程调度器
@@ -89,6 +177,16 @@ namespace ygw {
             TcpServer(ygw::scheduler::IOManager* io_woker = ygw::scheduler::IOManager::GetThis()
                     ,ygw::scheduler::IOManager* accept_worker = ygw::scheduler::IOManager::GetThis());
 
+            /**
+             * @brief 构造函数, 连接放在调度器组的成员上
+             * @param[in] io_group 处理连接的调度器组, 连接放到某个成员上后不再迁移
+             * @param[in] accept_worker 单监听模式下接收连接的调度器, 为空使用组的第一个成员
+             * @details 多监听模式下每个成员各跑一个accept协程, 连接留在接收它的成员上;
+             *          组开启SO_INCOMING_CPU时优先放到处理该连接软中断的CPU对应的成员上
+             */
+            TcpServer(ygw::scheduler::IOManagerGroup::ptr io_group
+                    ,ygw::scheduler::IOManager* accept_worker = ygw::scheduler::IOManager::GetThis());
+
             /**
              * @brief 析构函数
              */
@@ -158,9 +256,61 @@ namespace ygw {
             /**
              * @brief 设置配置
              */
-            void SetConf(TcpServerConf::ptr v) { conf_ = v;}
+            void SetConf(TcpServerConf::ptr v);
             void SetConf(const TcpServerConf& v);
 
+            /**
+             * @brief 设置接收连接的方式
+             * @pre 在Bind之前设置
+             */
+            void SetAcceptMode(AcceptMode v) { accept_mode_ = v;}
+
+            /**
+             * @brief 返回接收连接的方式
+             */
+            AcceptMode GetAcceptMode() const { return accept_mode_;}
+
+            /**
+             * @brief 增加一个处理连接的调度器, 新连接按分配方式分散到io_worker和这些调度器上
+             * @pre 在Start之前调用
+             */
+            void AddIOWorker(ygw::scheduler::IOManager* v);
+
+            /**
+             * @brief 设置新连接的分配方式
+             */
+            void SetDispatchMode(DispatchMode v) { dispatch_mode_ = v;}
+
+            /**
+             * @brief 返回新连接的分配方式
+             */
+            DispatchMode GetDispatchMode() const { return dispatch_mode_;}
+
+            /**
+             * @brief 返回当前连接数
+             */
+            int64_t GetConnections() const { return conns_;}
+
+            /**
+             * @brief 返回在途请求数
+             */
+            int64_t GetInflight() const { return inflight_;}
+
+            /**
+             * @brief 返回达到上限被拒绝的连接数
+             */
+            uint64_t GetRejected() const { return rejected_;}
+
+            /**
+             * @brief 返回暂停接收的次数
+             */
+            uint64_t GetPauseCount() const { return pause_count_;}
+
+            /**
+             * @brief 返回暂停接收的累计时长(微秒), 包括正在进行的暂停
+             */
+            uint64_t GetPausedUS();
+
             /**
              * @brief 转字符串
              */
@@ -180,6 +330,106 @@ namespace ygw {
              * @brief 开始接受连接
              */
             virtual void StartAccept(ygw::socket::Socket::ptr sock);
+
+            /**
+             * @brief 拒绝达到上限后多出的连接, 默认直接关闭
+             * @details 在accept协程中执行, 不能阻塞
+             */
+            virtual void RejectClient(ygw::socket::Socket::ptr client);
+
+            /**
+             * @brief 开始处理一个请求, 计入在途请求数
+             */
+            void BeginRequest() { ++inflight_;}
+
+            /**
+             * @brief 一个请求处理完成, 降到低水位时恢复接收
+             */
+            void EndRequest();
+
+            /**
+             * @brief 在途请求的作用域守卫, 构造时BeginRequest, 析构时EndRequest
+             * @details 协程入口会吞掉servlet抛出的异常, 计数靠析构保证减回去
+             */
+            class RequestGuard : able::Noncopyable
+            {
+            public:
+                explicit RequestGuard(TcpServer* server)
+                    :server_(server)
+                {
+                    server_->BeginRequest();
+                }
+
+                ~RequestGuard()
+                {
+                    server_->EndRequest();
+                }
+            private:
+                TcpServer* server_;
+            };
+
+            /**
+             * @brief 连接数或者在途请求数是否达到上限
+             */
+            bool IsOverloaded() const;
+
+            /**
+             * @brief 连接数和在途请求数是否都降到了低水位以下
+             */
+            bool IsBelowLowWatermark() const;
+
+            /**
+             * @brief 暂停接收, 挂起当前accept协程, 监听socket上不再注册读事件
+             */
+            void PauseAccept();
+
+            /**
+             * @brief 恢复所有暂停的accept协程
+             */
+            void ResumeAccept();
+
+            /**
+             * @brief 处理连接的调度器, 记录上面的连接数
+             */
+            struct IOWorkerSlot
+            {
+                using ptr = std::shared_ptr<IOWorkerSlot>;
+                scheduler::IOManager* worker = nullptr;
+                /// 正在处理的连接数
+                std::atomic<int64_t> conns {0};
+            };
+
+            /**
+             * @brief 把一批新连接分配到各个io_worker, 每个io_worker只调度一次
+             */
+            void Dispatch(std::vector<ygw::socket::Socket::ptr>& clients);
+
+            /**
+             * @brief 按分配方式选一个io_worker
+             * @return io_workers_的下标
+             */
+            size_t PickIOWorker(const ygw::socket::Socket::ptr& client);
+
+            /**
+             * @brief 返回第idx个监听socket所在的调度器
+             */
+            scheduler::IOManager* GetAcceptWorker(size_t idx) const;
+
+            /**
+             * @brief 返回生效的配置, 没有设置配置时返回默认值
+             */
+            const TcpServerConf& GetTuning() const;
+
+            /**
+             * @brief 在监听socket上设置TcpServerConf中的TCP选项, 新连接会继承这些选项
+             * @pre 已经bind, 还没有listen
+             */
+            bool ApplyListenOptions(ygw::socket::Socket::ptr sock);
+
+            /**
+             * @brief 在io_worker上处理连接, 结束后减少连接数
+             */
+            void RunClient(ygw::socket::Socket::ptr client, IOWorkerSlot::ptr slot);
         protected:
             /// 监听Socket数组
             std::vector<ygw::socket::Socket::ptr> socks_;
@@ -200,6 +450,42 @@ namespace ygw {
             bool ssl_ = false;
 
             TcpServerConf::ptr conf_;
+            /// 接收连接的方式
+            AcceptMode accept_mode_ = kAcceptSingle;
+            /// 处理连接的调度器, 第一个是io_worker_, 有调度器组时前面依次是组的成员
+            std::vector<IOWorkerSlot::ptr> io_workers_;
+            /// 处理连接的调度器组
+            scheduler::IOManagerGroup::ptr io_group_;
+            /// 新连接的分配方式
+            DispatchMode dispatch_mode_ = kDispatchRoundRobin;
+            /// 轮流分配的计数
+            std::atomic<uint64_t> next_worker_ {0};
+            /// 最大并发连接数, 0不限制
+            int64_t max_conns_ = 0;
+            /// 最大在途请求数, 0不限制
+            int64_t max_inflight_ = 0;
+            /// 恢复接收的水位百分比
+            int64_t low_watermark_ = 80;
+            /// 达到上限时是否拒绝多出的连接
+            bool reject_excess_ = false;
+            /// 当前连接数
+            std::atomic<int64_t> conns_ {0};
+            /// 在途请求数
+            std::atomic<int64_t> inflight_ {0};
+            /// 被拒绝的连接数
+            std::atomic<uint64_t> rejected_ {0};
+            /// 暂停接收的次数
+            std::atomic<uint64_t> pause_count_ {0};
+            /// 已结束的暂停累计时长(微秒)
+            std::atomic<uint64_t> paused_us_ {0};
+            /// 是否有暂停的accept协程, 连接关闭时不用加锁就能判断
+            std::atomic<bool> has_paused_ {false};
+            /// 保护paused_和pause_start_us_
+            ygw::thread::Mutex pause_mutex_;
+            /// 暂停的accept协程
+            std::vector<std::pair<ygw::scheduler::Scheduler*, ygw::scheduler::Fiber::ptr> > paused_;
+            /// 本次暂停开始的时间(微秒)
+            uint64_t pause_start_us_ = 0;
 
         }; // class TcpServer
 
@@ -227,9 +513,23 @@ namespace ygw {
                 conf.ssl = node["ssl"].as<int>(conf.ssl);
                 conf.cert_file = node["cert_file"].as<std::string>(conf.cert_file);
                 conf.key_file = node["key_file"].as<std::string>(conf.key_file);
-                conf.accept_worker = node["accept_worker"].as<std::string>();
-                conf.io_worker = node["io_worker"].as<std::string>();
-                conf.process_worker = node["process_worker"].as<std::string>();
+                conf.accept_worker = node["accept_worker"].as<std::string>(conf.accept_worker);
+                conf.io_worker = node["io_worker"].as<std::string>(conf.io_worker);
+                conf.process_worker = node["process_worker"].as<std::string>(conf.process_worker);
+                conf.accept_mode = node["accept_mode"].as<std::string>(conf.accept_mode);
+                conf.dispatch = node["dispatch"].as<std::string>(conf.dispatch);
+                conf.backlog = node["backlog"].as<int>(conf.backlog);
+                conf.nodelay = node["nodelay"].as<int>(conf.nodelay);
+                conf.defer_accept = node["defer_accept"].as<int>(conf.defer_accept);
+                conf.fastopen = node["fastopen"].as<int>(conf.fastopen);
+                conf.quickack = node["quickack"].as<int>(conf.quickack);
+                conf.sndbuf = node["sndbuf"].as<int>(conf.sndbuf);
+                conf.rcvbuf = node["rcvbuf"].as<int>(conf.rcvbuf);
+                conf.notsent_lowat = node["notsent_lowat"].as<int>(conf.notsent_lowat);
+                conf.max_connections = node["max_connections"].as<int>(conf.max_connections);
+                conf.max_inflight = node["max_inflight"].as<int>(conf.max_inflight);
+                conf.low_watermark = node["low_watermark"].as<int>(conf.low_watermark);
+                conf.reject_excess = node["reject_excess"].as<int>(conf.reject_excess);
                 conf.args = LexicalCast<std::string
                     ,std::map<std::string, std::string> >()(node["args"].as<std::string>(""));
                 if (node["address"].IsDefined()) 
@@ -261,6 +561,20 @@ namespace ygw {
                 node["accept_worker"] = conf.accept_worker;
                 node["io_worker"] = conf.io_worker;
                 node["process_worker"] = conf.process_worker;
+                node["accept_mode"] = conf.accept_mode;
+                node["dispatch"] = conf.dispatch;
+                node["backlog"] = conf.backlog;
+                node["nodelay"] = conf.nodelay;
+                node["defer_accept"] = conf.defer_accept;
+                node["fastopen"] = conf.fastopen;
+                node["quickack"] = conf.quickack;
+                node["sndbuf"] = conf.sndbuf;
+                node["rcvbuf"] = conf.rcvbuf;
+                node["notsent_lowat"] = conf.notsent_lowat;
+                node["max_connections"] = conf.max_connections;
+                node["max_inflight"] = conf.max_inflight;
+                node["low_watermark"] = conf.low_watermark;
+                node["reject_excess"] = conf.reject_excess;
                 node["args"] = YAML::Load(LexicalCast<std::map<std::string, std::string>
                         , std::string>()(conf.args));
                 for (auto& i : conf.address) 
@@ -18,16 +18,25 @@
 #include <dirent.h>
 #include <execinfo.h>
 #include <ifaddrs.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>   /* For SYS_xxx definitions */
 #include <sys/time.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif // __x86_64__
 #endif //_MSC_VER
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <mutex>
 #include <google/protobuf/unknown_field_set.h>
 
 #include "log.h"
 #include "base/fiber.h"
+#include "macro.h"
 #include "util.h"
 
 #ifdef _MSC_VER
@@ -199,6 +208,139 @@ namespace ygw {
             return tv.tv_sec * 1000 * 1000ul  + tv.tv_usec;
         }
 
+        uint64_t TimeUtil::GetMonotonicMS() 
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+        }
+
+        uint64_t TimeUtil::GetMonotonicUS() 
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+        }
+
+        uint64_t TimeUtil::GetCoarseMS() 
+        {
+            struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif // CLOCK_MONOTONIC_COARSE
+            return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+        }
+
+        // 每个线程缓存的单调时钟, 0表示未刷新过
+        static thread_local uint64_t t_cached_ms = 0;
+
+        uint64_t TimeUtil::UpdateCachedMS() 
+        {
+            t_cached_ms = GetMonotonicMS();
+            return t_cached_ms;
+        }
+
+        uint64_t TimeUtil::GetCachedMS() 
+        {
+            return YGW_LIKELY(t_cached_ms) ? t_cached_ms : GetCoarseMS();
+        }
+
+        //-------------------------------------------------------------------------------------
+        //                         TscClock
+        //-------------------------------------------------------------------------------------
+        static bool DetectInvariantTsc()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+            {
+                return false;
+            }
+            __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+            return edx & (1u << 8);
+#else
+            return false;
+#endif // __x86_64__
+        }
+
+        static uint64_t MonotonicNS()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+        }
+
+        // 启动时确定计数的来源, 之后不再改变, 前后两次Ticks总是同一种单位
+        static const bool s_tsc_invariant = DetectInvariantTsc();
+        // 每个计数的纳秒数(定点数, 左移32位), 0表示未校准
+        static std::atomic<uint64_t> s_tsc_ns_per_tick_q32 = {0};
+        static std::once_flag s_tsc_calibrate_once;
+
+        bool TscClock::IsInvariant()
+        {
+            return s_tsc_invariant;
+        }
+
+        uint64_t TscClock::Ticks() 
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            if (YGW_LIKELY(s_tsc_invariant))
+            {
+                return __rdtsc();
+            }
+#endif // __x86_64__
+            return MonotonicNS();
+        }
+
+        bool TscClock::Calibrate(uint64_t sample_ms) 
+        {
+            std::call_once(s_tsc_calibrate_once, [sample_ms]() {
+                if (!s_tsc_invariant)
+                {
+                    //计数本身就是纳秒
+                    s_tsc_ns_per_tick_q32 = 1ull << 32;
+                    return;
+                }
+                uint64_t sample_ns = std::max<uint64_t>(sample_ms, 1) * 1000000;
+                uint64_t begin_ns = MonotonicNS();
+                uint64_t begin_ticks = Ticks();
+                uint64_t end_ns = begin_ns;
+                //忙等而不是sleep, 不经过hook, 在协程里调用也不会切走
+                while (end_ns - begin_ns < sample_ns)
+                {
+                    end_ns = MonotonicNS();
+                }
+                uint64_t end_ticks = Ticks();
+                uint64_t ticks = std::max<uint64_t>(end_ticks - begin_ticks, 1);
+                s_tsc_ns_per_tick_q32 = (uint64_t)(((__uint128_t)(end_ns - begin_ns) << 32) / ticks);
+            });
+            return s_tsc_invariant;
+        }
+
+        bool TscClock::IsCalibrated() 
+        {
+            return s_tsc_ns_per_tick_q32 != 0;
+        }
+
+        uint64_t TscClock::TicksToNS(uint64_t ticks) 
+        {
+            uint64_t q32 = s_tsc_ns_per_tick_q32;
+            if (YGW_UNLIKELY(!q32)) 
+            {
+                Calibrate();
+                q32 = s_tsc_ns_per_tick_q32;
+            }
+            return (uint64_t)(((__uint128_t)ticks * q32) >> 32);
+        }
+
+        uint64_t TscClock::NowNS() 
+        {
+            //起点和CLOCK_MONOTONIC不同, 只用于求差
+            return TicksToNS(Ticks());
+        }
+
         // 时间 字符串 互转
         std::string TimeUtil::Time2Str(time_t ts, const std::string& format) 
         {
@@ -797,6 +939,9 @@ namespace ygw {
             { "html", "text/html" },
             { "htm", "text/htm" },
             { "css", "text/css" },
+            { "js", "application/javascript" },
+            { "json", "application/json" },
+            { "svg", "image/svg+xml" },
             { "gif", "image/gif" },
             { "jpg", "image/jpeg" },
             { "jpeg", "image/jpeg" },
@@ -85,6 +85,35 @@ namespace ygw {
              */
             static uint64_t GetCurrentUS();
 
+            /**
+             * @brief 获取单调时钟的毫秒(不受系统时间调整影响)
+             */
+            static uint64_t GetMonotonicMS();
+
+            /**
+             * @brief 获取单调时钟的微秒
+             */
+            static uint64_t GetMonotonicUS();
+
+            /**
+             * @brief 获取粗粒度单调时钟的毫秒(CLOCK_MONOTONIC_COARSE, 精度为一个jiffy)
+             */
+            static uint64_t GetCoarseMS();
+
+            /**
+             * @brief 刷新当前线程缓存的单调时钟
+             * @details IOManager每轮循环调用一次, 只用于到期扫描.
+             *          计算截止时间要用GetMonotonicMS, 否则前面的任务跑得久时会提前超时
+             * @return 刷新后的毫秒
+             */
+            static uint64_t UpdateCachedMS();
+
+            /**
+             * @brief 获取当前线程缓存的单调时钟毫秒
+             * @details 线程没有刷新过缓存时退化为GetCoarseMS
+             */
+            static uint64_t GetCachedMS();
+
 
             /**
              * @brief 时间转字符串
@@ -103,6 +132,49 @@ namespace ygw {
         };
         
 
+        /**
+         * @brief 基于TSC的纳秒时钟, 用于统计耗时
+         * @details 只有CPU声明TSC不变(invariant, 不随变频和休眠变化)时才读TSC,
+         *          每纳秒的计数用CLOCK_MONOTONIC校准一次; 否则计数本身就是
+         *          CLOCK_MONOTONIC的纳秒. 两种情况下计数差都用TicksToNS换算
+         */
+        class TscClock {
+        public:
+            /**
+             * @brief 用CLOCK_MONOTONIC校准TSC频率, 只在第一次调用时执行
+             * @details 采样期间忙等, 不会让出协程, 应在启动或开启统计时调用.
+             *          没有调用过时由第一次TicksToNS触发
+             * @param[in] sample_ms 校准采样时长(毫秒)
+             * @return 是否在使用TSC
+             */
+            static bool Calibrate(uint64_t sample_ms = 10);
+
+            /**
+             * @brief 是否已校准
+             */
+            static bool IsCalibrated();
+
+            /**
+             * @brief CPU是否支持不变TSC
+             */
+            static bool IsInvariant();
+
+            /**
+             * @brief 读取计数, 不变TSC时为TSC, 否则为CLOCK_MONOTONIC纳秒
+             */
+            static uint64_t Ticks();
+
+            /**
+             * @brief 计数差转换为纳秒
+             */
+            static uint64_t TicksToNS(uint64_t ticks);
+
+            /**
+             * @brief 获取当前纳秒时间戳, 起点不固定, 只用于求差
+             */
+            static uint64_t NowNS();
+        };
+
         /**
          * @brief 获取类型名
          */
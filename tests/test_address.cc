@@ -12,7 +12,11 @@
  */
 
 #include <server_frame/address.h>
+#include <server_frame/dns.h>
+#include <server_frame/iomanager.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/socket.h>
 
 ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
@@ -62,9 +66,150 @@ void test_ipv4()
     }
 }
 
+// 本地DNS桩服务器: stub.test的A记录返回10.0.0.1(TTL 1秒), 其他查询返回NXDOMAIN.
+// spoof.test先发出id相同但问题部分不一致的伪造应答(6.6.6.6), 再返回10.0.0.2
+static std::atomic<int> s_stub_queries {0};
+void run_stub_dns(ygw::socket::Socket::ptr sock)
+{
+    uint8_t buf[512];
+    while (true)
+    {
+        ygw::socket::Address::ptr from(new ygw::socket::IPv4Address);
+        int n = sock->RecvFrom(buf, sizeof(buf), from);
+        if (n <= 12)
+        {
+            break;
+        }
+        ++s_stub_queries;
+        usleep(50 * 1000); //拖慢应答, 让并发查询合并
+
+        std::string qname;
+        int pos = 12;
+        while (pos < n && buf[pos])
+        {
+            if (!qname.empty())
+            {
+                qname += ".";
+            }
+            qname.append((const char*)buf + pos + 1, buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        uint16_t qtype = (buf[pos + 1] << 8) | buf[pos + 2];
+        std::string rsp((const char*)buf, pos + 5);
+        rsp[2] = (char)0x81; //QR RD
+        rsp[3] = (char)0x80; //RA
+        if (qname == "stub.test" && qtype == 1)
+        {
+            rsp[7] = 1; //ANCOUNT
+            const uint8_t answer[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 1, 0, 4, 10, 0, 0, 1};
+            rsp.append((const char*)answer, sizeof(answer));
+        }
+        else if (qname == "spoof.test" && qtype == 1)
+        {
+            rsp[7] = 1;
+            const uint8_t forged[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 60, 0, 4, 6, 6, 6, 6};
+            std::string other_name = rsp + std::string((const char*)forged, sizeof(forged));
+            other_name[pos - 1] = 'x'; //spoof.tesx
+            sock->SendTo(other_name.data(), other_name.size(), from);
+            std::string other_type = rsp + std::string((const char*)forged, sizeof(forged));
+            other_type[pos + 2] = 28; //QTYPE AAAA
+            sock->SendTo(other_type.data(), other_type.size(), from);
+
+            const uint8_t answer[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 60, 0, 4, 10, 0, 0, 2};
+            rsp.append((const char*)answer, sizeof(answer));
+        }
+        else
+        {
+            rsp[3] |= 3; //NXDOMAIN
+        }
+        sock->SendTo(rsp.data(), rsp.size(), from);
+    }
+}
+
+void test_dns_resolver()
+{
+    auto server_addr = ygw::socket::IPv4Address::Create("127.0.0.1", 0);
+    auto server = ygw::socket::Socket::CreateUDP(server_addr);
+    server->Bind(server_addr);
+    server->SetRecvTimeout(3000);
+    auto local = std::dynamic_pointer_cast<ygw::socket::IPAddress>(server->GetLocalAddress());
+    ygw::scheduler::IOManager::GetThis()->Schedule(std::bind(run_stub_dns, server));
+
+    auto resolver = std::make_shared<ygw::socket::DnsResolver>(
+            std::vector<ygw::socket::IPAddress::ptr>{local});
+    resolver->SetTimeout(1000);
+
+    using ygw::socket::DnsResolver;
+    std::vector<ygw::socket::IPAddress::ptr> addrs;
+    bool v = resolver->Resolve(addrs, "stub.test") == DnsResolver::kAnswer;
+    v = resolver->Resolve(addrs, "STUB.test.") == DnsResolver::kAnswer && v;
+    YGW_LOG_INFO(g_logger) << "stub.test ok=" << v << " addr=" << (addrs.empty() ? "" : addrs[0]->ToString())
+        << " queries=" << s_stub_queries << " (expect 1)";
+    YGW_ASSERT(v && s_stub_queries == 1);
+
+    //否定应答和负缓存都是kNegative, 调用方不再回退到getaddrinfo
+    addrs.clear();
+    v = resolver->Resolve(addrs, "missing.test") == DnsResolver::kNegative;
+    v = resolver->Resolve(addrs, "missing.test") == DnsResolver::kNegative && v;
+    YGW_LOG_INFO(g_logger) << "missing.test negative=" << v << " queries=" << s_stub_queries << " (expect 2)";
+    YGW_ASSERT(v && addrs.empty() && s_stub_queries == 2);
+
+    //id相同但问题部分不一致的应答被忽略
+    addrs.clear();
+    v = resolver->Resolve(addrs, "spoof.test") == DnsResolver::kAnswer;
+    YGW_LOG_INFO(g_logger) << "spoof.test ok=" << v << " addr=" << (addrs.empty() ? "" : addrs[0]->ToString());
+    YGW_ASSERT(v && addrs.size() == 1 && addrs[0]->ToString() == "10.0.0.2:0");
+
+    //没有服务器应答时结果未知, 也不缓存
+    auto closed = ygw::socket::Socket::CreateUDP(server_addr);
+    closed->Bind(server_addr);
+    auto closed_addr = std::dynamic_pointer_cast<ygw::socket::IPAddress>(closed->GetLocalAddress());
+    closed->Close();
+    auto silent = std::make_shared<DnsResolver>(std::vector<ygw::socket::IPAddress::ptr>{closed_addr});
+    silent->SetTimeout(200);
+    silent->SetAttempts(1);
+    addrs.clear();
+    v = silent->Resolve(addrs, "stub.test") == DnsResolver::kNoAnswer;
+    v = silent->Resolve(addrs, "stub.test", AF_UNSPEC) == DnsResolver::kNoAnswer && v;
+    YGW_LOG_INFO(g_logger) << "no answer=" << v << " queries=" << silent->GetQueryCount() << " (expect 3)";
+    YGW_ASSERT(v && addrs.empty() && silent->GetQueryCount() == 3);
+
+    //TTL过期后并发查询只发出一次
+    sleep(2);
+    static std::atomic<int> done {0};
+    for (int i = 0; i < 10; ++i)
+    {
+        ygw::scheduler::IOManager::GetThis()->Schedule([resolver](){
+            std::vector<ygw::socket::IPAddress::ptr> addrs;
+            if (resolver->Resolve(addrs, "stub.test") != ygw::socket::DnsResolver::kAnswer
+                    || addrs[0]->ToString() != "10.0.0.1:0")
+            {
+                YGW_LOG_ERROR(g_logger) << "coalesced resolve fail";
+            }
+            ++done;
+        });
+    }
+    while (done < 10)
+    {
+        usleep(10 * 1000);
+    }
+    YGW_LOG_INFO(g_logger) << "coalesced queries=" << s_stub_queries << " (expect 4)";
+    YGW_ASSERT(s_stub_queries == 4);
+
+    //不带'.'的名字在hook线程里也交给getaddrinfo(阻塞任务线程池执行)
+    ygw::socket::Address::ptr addr = ygw::socket::Address::LookupAny("localhost:8080");
+    if (!addr)
+    {
+        YGW_LOG_ERROR(g_logger) << "Address::LookupAny(localhost:8080) fail";
+    }
+    YGW_LOG_INFO(g_logger) << "Address::LookupAny(localhost:8080)=" << (addr ? addr->ToString() : "null");
+}
+
 int main(int argc, char** argv)
 {
     test_address();
+    ygw::scheduler::IOManager iom(2);
+    iom.Schedule(test_dns_resolver);
     //test_iface();
     //test_ipv4();
     return 0;
@@ -0,0 +1,206 @@
+/**
+ * @file tests/test_concurrency_limiter.cc
+ * @brief 并发限制器的模拟压测
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-08
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#include <server_frame/concurrency_limiter.h>
+#include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
+
+/**
+ * @brief 模拟的事件
+ */
+struct Event
+{
+    /// 发生时间(微秒)
+    uint64_t time;
+    /// true到达, false完成
+    bool arrive;
+    /// 请求到达的时间
+    uint64_t start;
+    bool operator>(const Event& oth) const { return time > oth.time; }
+};
+
+/**
+ * @brief 每个阶段的统计
+ */
+struct PhaseStat
+{
+    uint64_t offered = 0;
+    uint64_t rejected = 0;
+    std::vector<uint64_t> latency;
+};
+
+/**
+ * @brief 离散事件模拟: kWorkers个工作线程, 每个请求平均kServiceUs, 超出的在队列里排队.
+ *        三个阶段的到达速率分别是处理能力的0.8倍, 2倍, 0.5倍, 统计每个阶段的延迟和拒绝数
+ * @param[in] limiter 为空表示不限制
+ */
+void simulate(const std::string& name, ygw::limiter::ConcurrencyLimiter::ptr limiter)
+{
+    const int kWorkers = 16;
+    const uint64_t kServiceUs = 10 * 1000;
+    const uint64_t kPhaseUs = 10 * 1000 * 1000;
+    const double kCapacity = kWorkers * 1000000.0 / kServiceUs;
+    const double kLoad[] = {0.8, 2.0, 0.5};
+
+    std::mt19937_64 rng(42);
+    std::exponential_distribution<double> service(1.0 / kServiceUs);
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+    std::deque<uint64_t> waiting;
+    int busy = 0;
+    PhaseStat stats[3];
+
+    auto start_service = [&](uint64_t now, uint64_t start) {
+        ++busy;
+        events.push(Event{now + (uint64_t)service(rng), false, start});
+    };
+
+    std::exponential_distribution<double> first(kCapacity * kLoad[0] / 1000000.0);
+    events.push(Event{(uint64_t)first(rng), true, 0});
+    while (!events.empty())
+    {
+        Event ev = events.top();
+        events.pop();
+        size_t phase = std::min<size_t>(ev.time / kPhaseUs, 2);
+        if (ev.arrive)
+        {
+            if (ev.time >= kPhaseUs * 3)
+            {
+                continue;
+            }
+            std::exponential_distribution<double> next(kCapacity * kLoad[phase] / 1000000.0);
+            events.push(Event{ev.time + (uint64_t)next(rng), true, 0});
+            ++stats[phase].offered;
+            if (limiter && !limiter->TryAcquire())
+            {
+                ++stats[phase].rejected;
+                continue;
+            }
+            if (busy < kWorkers)
+            {
+                start_service(ev.time, ev.time);
+            }
+            else
+            {
+                waiting.push_back(ev.time);
+            }
+        }
+        else
+        {
+            --busy;
+            uint64_t rtt = ev.time - ev.start;
+            stats[std::min<size_t>(ev.start / kPhaseUs, 2)].latency.push_back(rtt);
+            if (limiter)
+            {
+                limiter->Release(rtt);
+            }
+            if (!waiting.empty())
+            {
+                start_service(ev.time, waiting.front());
+                waiting.pop_front();
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        auto& lat = stats[i].latency;
+        std::sort(lat.begin(), lat.end());
+        uint64_t sum = 0;
+        for (auto v : lat)
+        {
+            sum += v;
+        }
+        YGW_LOG_INFO(g_logger) << name << " load=" << kLoad[i]
+            << " offered=" << stats[i].offered
+            << " served=" << lat.size()
+            << " rejected=" << stats[i].rejected
+            << " avg_ms=" << (lat.empty() ? 0 : sum / lat.size() / 1000.0)
+            << " p99_ms=" << (lat.empty() ? 0 : lat[lat.size() * 99 / 100] / 1000.0);
+    }
+    if (limiter)
+    {
+        YGW_LOG_INFO(g_logger) << name << " " << limiter->ToString();
+        YGW_ASSERT(limiter->GetInflight() == 0);
+    }
+}
+
+/**
+ * @brief 基本语义: 达到上限拒绝, 归还后可以再申请
+ */
+void test_acquire()
+{
+    ygw::limiter::ConcurrencyLimiter::Options opts;
+    opts.initial_limit = 2;
+    ygw::limiter::ConcurrencyLimiter limiter(opts);
+    YGW_ASSERT(limiter.TryAcquire());
+    YGW_ASSERT(limiter.TryAcquire());
+    YGW_ASSERT(!limiter.TryAcquire());
+    YGW_ASSERT(limiter.GetRejected() == 1);
+    limiter.Release(1000, ygw::limiter::ConcurrencyLimiter::kIgnore);
+    YGW_ASSERT(limiter.TryAcquire());
+    limiter.Release(1000);
+    limiter.Release(1000);
+    YGW_ASSERT(limiter.GetInflight() == 0);
+    YGW_LOG_INFO(g_logger) << limiter.ToString();
+}
+
+/**
+ * @brief LimiterGuard: 显式归还只归还一次, 抛出异常时析构归还
+ */
+void test_guard()
+{
+    ygw::limiter::ConcurrencyLimiter::Options opts;
+    opts.initial_limit = 1;
+    auto limiter = std::make_shared<ygw::limiter::ConcurrencyLimiter>(opts);
+    {
+        ygw::limiter::LimiterGuard admit(limiter);
+        YGW_ASSERT(admit.IsAcquired());
+        ygw::limiter::LimiterGuard rejected(limiter);
+        YGW_ASSERT(!rejected.IsAcquired());
+        admit.Release();
+        YGW_ASSERT(limiter->GetInflight() == 0);
+    }
+    YGW_ASSERT(limiter->GetInflight() == 0);
+    try
+    {
+        ygw::limiter::LimiterGuard admit(limiter);
+        YGW_ASSERT(limiter->GetInflight() == 1);
+        throw std::runtime_error("handler error");
+    }
+    catch (std::exception& e)
+    {
+    }
+    YGW_ASSERT(limiter->GetInflight() == 0);
+    ygw::limiter::LimiterGuard none(nullptr);
+    YGW_ASSERT(none.IsAcquired());
+}
+
+int main(int argc, char** argv)
+{
+    test_acquire();
+    test_guard();
+
+    simulate("none", nullptr);
+
+    ygw::limiter::ConcurrencyLimiter::Options opts;
+    simulate("gradient", std::make_shared<ygw::limiter::ConcurrencyLimiter>(opts));
+
+    opts.algorithm = ygw::limiter::ConcurrencyLimiter::kAimd;
+    opts.timeout_us = 50 * 1000;
+    simulate("aimd", std::make_shared<ygw::limiter::ConcurrencyLimiter>(opts));
+    return 0;
+}
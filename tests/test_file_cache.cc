@@ -0,0 +1,118 @@
+/**
+ * @file tests/test_file_cache.cc
+ * @brief 静态文件打开文件缓存的测试和压测
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-12
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#include <server_frame/http/file_cache.h>
+#include <server_frame/iomanager.h>
+#include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <functional>
+#include <vector>
+
+ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
+
+static const std::string g_root = "/tmp/ygw_file_cache";
+
+/**
+ * @brief 写一个小文件
+ */
+static void write_file(const std::string& path, const std::string& content)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    YGW_ASSERT(fp && fwrite(content.data(), 1, content.size(), fp) == content.size());
+    fclose(fp);
+}
+
+/**
+ * @brief 命中, 过期后文件没变续用fd, 文件变了重新打开, 删除后返回ENOENT, LRU淘汰
+ */
+void test_cache()
+{
+    std::string path = g_root + "/a.css";
+    write_file(path, "a{color:0}");
+    ygw::http::FileCache cache(2, 100);
+
+    auto f1 = cache.Get(path);
+    YGW_ASSERT(f1->IsFile() && f1->fd >= 0 && f1->st.st_size == 10);
+    YGW_ASSERT(std::string(f1->content_type) == "text/css");
+    YGW_ASSERT(cache.Get(path) == f1);
+    YGW_ASSERT(cache.GetHits() == 1);
+
+    usleep(150 * 1000);
+    YGW_ASSERT(cache.Get(path) == f1);
+
+    //mtime是秒级, 换一个大小保证能看出变化
+    write_file(path, "a{color:00}");
+    usleep(150 * 1000);
+    auto f2 = cache.Get(path);
+    YGW_ASSERT(f2 != f1 && f2->st.st_size == 11 && f2->etag != f1->etag);
+    //旧条目还被f1持有, fd仍然有效
+    YGW_ASSERT(fcntl(f1->fd, F_GETFD) != -1);
+
+    unlink(path.c_str());
+    usleep(150 * 1000);
+    YGW_ASSERT(cache.Get(path)->err == ENOENT);
+
+    cache.Get(g_root + "/x");
+    cache.Get(g_root + "/y");
+    YGW_ASSERT(cache.GetSize() == 2);
+    YGW_LOG_INFO(g_logger) << cache.ToString();
+}
+
+/**
+ * @brief 在IO协程里反复查找一组热点小文件, 对比每次stat/open和经过缓存的耗时
+ */
+void bench()
+{
+    const int kFiles = 64;
+    const int kLoops = 200;
+    std::vector<std::string> paths;
+    for (int i = 0; i < kFiles; ++i)
+    {
+        paths.push_back(g_root + "/hot_" + std::to_string(i) + ".css");
+        write_file(paths.back(), std::string(512, 'a' + i % 26));
+    }
+
+    ygw::scheduler::IOManager iom(1, false, "bench");
+    iom.Schedule([&paths]() {
+        //每个请求都要查一次不存在的servlet路径和一次文件
+        auto run = [&paths](const std::string& name
+                ,std::function<ygw::http::CachedFile::ptr(const std::string&)> open) {
+            uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+            for (int i = 0; i < kLoops; ++i)
+            {
+                for (auto& p : paths)
+                {
+                    YGW_ASSERT(open(g_root + "/servlet")->err == ENOENT);
+                    YGW_ASSERT(open(p)->IsFile());
+                }
+            }
+            uint64_t used = ygw::util::TimeUtil::GetCurrentUS() - start;
+            YGW_LOG_INFO(g_logger) << name << " requests=" << kLoops * paths.size()
+                << " used_us=" << used
+                << " ns/request=" << used * 1000 / (kLoops * paths.size());
+        };
+        run("uncached", &ygw::http::FileCache::Load);
+        ygw::http::FileCache::ptr cache = std::make_shared<ygw::http::FileCache>();
+        run("cached", [cache](const std::string& p) { return cache->Get(p); });
+        YGW_LOG_INFO(g_logger) << cache->ToString();
+    });
+}
+
+int main(int argc, char** argv)
+{
+    mkdir(g_root.c_str(), 0755);
+    test_cache();
+    bench();
+    return 0;
+}
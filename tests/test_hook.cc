@@ -1,6 +1,11 @@
+#include <server_frame/base/block_detector.h>
+#include <server_frame/base/blocking_executor.h>
+#include <server_frame/config.h>
 #include <server_frame/hook.h>
 #include <server_frame/iomanager.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <string.h>
@@ -66,11 +71,259 @@ void test_sockcet()
     YGW_LOG_INFO(g_logger) << buff;
 }
 
+//recv超时与数据到达竞争: 每次等待只能被就绪或超时之一唤醒
+void test_recv_timeout()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (const sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+    listen(listen_fd, 1);
+
+    int cli = socket(AF_INET, SOCK_STREAM, 0);
+    connect(cli, (const sockaddr*)&addr, sizeof(addr));
+    int srv = accept(listen_fd, nullptr, nullptr);
+
+    timeval tv = {0, 2000};
+    setsockopt(cli, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    int reads = 0;
+    int timeouts = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        ygw::scheduler::IOManager::GetThis()->AddTimer(1 + i % 3, [srv](){
+            send(srv, "x", 1, 0);
+        });
+        char c;
+        int rt = recv(cli, &c, 1, 0);
+        if (rt == 1)
+        {
+            ++reads;
+        }
+        else if (errno == ETIMEDOUT)
+        {
+            ++timeouts;
+        }
+        else
+        {
+            YGW_LOG_ERROR(g_logger) << "recv rt=" << rt << " errno=" << errno;
+        }
+    }
+    YGW_LOG_INFO(g_logger) << "reads=" << reads << " timeouts=" << timeouts;
+    close(cli);
+    close(srv);
+    close(listen_fd);
+}
+
+//亚毫秒睡眠精度: usleep/nanosleep走timerfd驱动的微秒定时器
+void test_usleep_accuracy()
+{
+    const uint64_t sleeps[] = {100, 500, 1500};
+    for (uint64_t us : sleeps)
+    {
+        const int count = 200;
+        uint64_t total = 0;
+        uint64_t max_err = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            uint64_t start = ygw::util::TimeUtil::GetMonotonicUS();
+            usleep(us);
+            uint64_t elapsed = ygw::util::TimeUtil::GetMonotonicUS() - start;
+            if (elapsed < us)
+            {
+                YGW_LOG_ERROR(g_logger) << "usleep(" << us << ") woke early after " << elapsed << "us";
+            }
+            total += elapsed;
+            max_err = std::max(max_err, elapsed - us);
+        }
+        YGW_LOG_INFO(g_logger) << "usleep(" << us << ") avg=" << total / count
+            << "us max_err=" << max_err << "us";
+    }
+}
+
+//取消和推后首部微秒定时器后, 后面的定时器仍按时触发
+void test_precise_head_change()
+{
+    auto iom = ygw::scheduler::IOManager::GetThis();
+    auto fired = std::make_shared<std::vector<int> >();
+    auto first = iom->AddTimerUs(2000, [fired](){ fired->push_back(1); });
+    auto second = iom->AddTimerUs(5000, [fired](){ fired->push_back(2); });
+    auto third = iom->AddTimerUs(8000, [fired](){ fired->push_back(3); });
+    YGW_ASSERT(first->Cancel());
+    YGW_ASSERT(second->Reset(20000, true));
+    usleep(12 * 1000);
+    YGW_ASSERT(fired->size() == 1 && (*fired)[0] == 3);
+    usleep(20 * 1000);
+    YGW_LOG_INFO(g_logger) << "precise head change: fired=" << fired->size();
+    YGW_ASSERT(fired->size() == 2 && (*fired)[1] == 2);
+    YGW_ASSERT(!third->Cancel());
+}
+
+//前一个协程长时间占用线程后, 后面协程的定时器不能按过期的缓存时钟提前触发
+void test_stale_clock()
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (const sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+    listen(listen_fd, 1);
+    int cli = socket(AF_INET, SOCK_STREAM, 0);
+    connect(cli, (const sockaddr*)&addr, sizeof(addr));
+    int srv = accept(listen_fd, nullptr, nullptr);
+    timeval tv = {0, 100 * 1000};
+    setsockopt(cli, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    //三个协程连续排队, 中间不经过epoll_wait
+    ygw::scheduler::IOManager::GetThis()->Schedule([](){
+        uint64_t start = ygw::util::TimeUtil::GetMonotonicMS();
+        while (ygw::util::TimeUtil::GetMonotonicMS() - start < 300);
+    });
+    ygw::scheduler::IOManager::GetThis()->Schedule([](){
+        uint64_t start = ygw::util::TimeUtil::GetMonotonicMS();
+        usleep(100 * 1000);
+        uint64_t elapsed = ygw::util::TimeUtil::GetMonotonicMS() - start;
+        if (elapsed < 100)
+        {
+            YGW_LOG_ERROR(g_logger) << "usleep(100ms) after busy fiber woke early after " << elapsed << "ms";
+        }
+        else
+        {
+            YGW_LOG_INFO(g_logger) << "usleep(100ms) after busy fiber cost=" << elapsed << "ms";
+        }
+    });
+    ygw::scheduler::IOManager::GetThis()->Schedule([cli, srv, listen_fd](){
+        uint64_t start = ygw::util::TimeUtil::GetMonotonicMS();
+        char c;
+        int rt = recv(cli, &c, 1, 0);
+        uint64_t elapsed = ygw::util::TimeUtil::GetMonotonicMS() - start;
+        if (rt != -1 || errno != ETIMEDOUT || elapsed < 100)
+        {
+            YGW_LOG_ERROR(g_logger) << "recv timeout(100ms) after busy fiber rt=" << rt
+                << " errno=" << errno << " after " << elapsed << "ms";
+        }
+        else
+        {
+            YGW_LOG_INFO(g_logger) << "recv timeout(100ms) after busy fiber cost=" << elapsed << "ms";
+        }
+        close(cli);
+        close(srv);
+        close(listen_fd);
+    });
+}
+
+//阻塞任务在线程池执行期间, 同一IO线程上的其他协程照常运行
+void test_run_blocking()
+{
+    static std::atomic<int> ticks {0};
+    ygw::scheduler::IOManager::GetThis()->Schedule([](){
+        for (int i = 0; i < 10; ++i)
+        {
+            usleep(10 * 1000);
+            ++ticks;
+        }
+    });
+
+    int before = ticks;
+    uint64_t start = ygw::util::TimeUtil::GetMonotonicUS();
+    ygw::scheduler::RunBlocking([](){
+        usleep(100 * 1000); //执行器线程没有开启hook, 真正阻塞
+    });
+    YGW_LOG_INFO(g_logger) << "RunBlocking cost=" << ygw::util::TimeUtil::GetMonotonicUS() - start
+        << "us ticks while blocked=" << ticks - before;
+
+    try
+    {
+        ygw::scheduler::RunBlocking([](){
+            throw std::runtime_error("blocking error");
+        });
+    }
+    catch (std::exception& e)
+    {
+        YGW_LOG_INFO(g_logger) << "RunBlocking rethrow: " << e.what();
+    }
+}
+
+//指定线程的协程从线程池回来后仍在原线程; 协程挂起期间调度器等待唤醒, 不会提前停止
+void test_run_blocking_affinity(ygw::scheduler::IOManager& iom, std::atomic<int>& resumed)
+{
+    for (int tid : iom.GetWorkerThreadIds())
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            iom.Schedule([tid, &resumed](){
+                YGW_ASSERT(ygw::util::GetThreadId() == tid);
+                ygw::scheduler::RunBlocking([](){
+                    usleep(50 * 1000);
+                });
+                YGW_ASSERT(ygw::util::GetThreadId() == tid);
+                ++resumed;
+            }, tid);
+        }
+    }
+}
+
+//IO线程上的锁等待和未hook的阻塞调用都会被记录
+void test_block_detector()
+{
+    auto enable = ygw::config::Config::Lookup<bool>("block_detector.enable", false);
+    enable->SetValue(true);
+    usleep(1000); //让出一次, 之后的运行时长开始统计
+
+    static ygw::thread::Mutex mutex;
+    static ygw::thread::Semaphore locked;
+    ygw::thread::Thread holder([](){
+        ygw::thread::Mutex::Lock lock(mutex);
+        locked.Notify();
+        usleep(30 * 1000);
+    }, "holder");
+    locked.Wait();
+    {
+        ygw::thread::Mutex::Lock lock(mutex); //等待holder释放, 带调用栈告警
+    }
+    usleep_f(20 * 1000); //绕过hook的阻塞, 由协程运行时长发现
+    holder.Join();
+    usleep(1000);
+    enable->SetValue(false);
+
+    std::stringstream ss;
+    ygw::scheduler::BlockDetector::Dump(ss);
+    YGW_LOG_INFO(g_logger) << ss.str();
+}
+
 int main()
 {
     //test_sleep();
+    {
+        ygw::scheduler::IOManager detector_iom(1, false, "detector");
+        detector_iom.Schedule(test_block_detector);
+    }
+    {
+        ygw::scheduler::IOManager clock_iom(1, false, "clock");
+        clock_iom.Schedule(test_stale_clock);
+    }
+    {
+        std::atomic<int> resumed {0};
+        {
+            ygw::scheduler::IOManager affinity_iom(3, false, "affinity");
+            test_run_blocking_affinity(affinity_iom, resumed);
+        }
+        YGW_LOG_INFO(g_logger) << "RunBlocking resumed on pinned thread: " << resumed;
+        YGW_ASSERT(resumed == 12);
+    }
     ygw::scheduler::IOManager iom;
     iom.Schedule(test_sockcet);
+    iom.Schedule(test_recv_timeout);
+    iom.Schedule(test_usleep_accuracy);
+    iom.Schedule(test_precise_head_change);
+    iom.Schedule(test_run_blocking);
     //test_sockcet();
     return 0;
 }
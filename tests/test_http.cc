@@ -13,6 +13,11 @@
 
 #include <server_frame/http/http.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
+#include <sstream>
+
+static ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
 
 void test_request()
@@ -35,10 +40,95 @@ void test_response()
     rsp->Dump(std::cout) << std::endl;
 }
 
+/**
+ * @brief 对比响应序列化: stringstream整体输出(含消息体拷贝) 和 DumpHeader只序列化响应头到复用缓冲区
+ */
+void bench_serialize()
+{
+    using namespace ygw::http;
+    const size_t kSizes[] = {0, 1024, 1024 * 1024};
+    for (auto size : kSizes)
+    {
+        HttpResponse::ptr rsp(new HttpResponse);
+        rsp->SetHeader("Server", "ygw/1.0.0");
+        rsp->SetHeader("Content-Type", "text/html");
+        rsp->SetHeader("X-Request-Id", "0123456789abcdef");
+        rsp->SetBody(std::string(size, 'x'));
+        rsp->SetClose(false);
+        int n = size >= 1024 * 1024 ? 200 : 200000;
+
+        std::string header;
+        rsp->DumpHeader(header);
+        YGW_ASSERT(header.size() >= 4 && header.compare(header.size() - 4, 4, "\r\n\r\n") == 0);
+        YGW_ASSERT(rsp->ToString() == header + rsp->GetBody());
+
+        uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+        size_t bytes = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            std::stringstream ss;
+            ss << *rsp;
+            std::string data = ss.str();
+            bytes += data.size();
+        }
+        uint64_t stream_us = ygw::util::TimeUtil::GetCurrentUS() - start;
+
+        start = ygw::util::TimeUtil::GetCurrentUS();
+        for (int i = 0; i < n; ++i)
+        {
+            header.clear();
+            rsp->DumpHeader(header);
+            bytes += header.size() + rsp->GetBody().size();
+        }
+        uint64_t header_us = ygw::util::TimeUtil::GetCurrentUS() - start;
+
+        YGW_LOG_INFO(g_logger) << "body=" << size << " n=" << n
+            << " stringstream ns/op=" << stream_us * 1000 / n
+            << " DumpHeader ns/op=" << header_us * 1000 / n
+            << " bytes=" << bytes;
+    }
+}
+
+/**
+ * @brief 头部忽略大小写查找, 覆盖, 删除, 拷贝, 类型转换和转回map
+ */
+void test_headers()
+{
+    ygw::http::HttpRequest req;
+    const char raw[] = "content-TYPE: text/plainX-Trace-Id: abc";
+    req.SetHeader(raw, 12, raw + 14, 10);
+    req.SetHeader(raw + 24, 10, raw + 36, 3);
+    req.SetHeader("Content-Length", "42");
+    req.SetHeader("x-trace-id", "def");
+    YGW_ASSERT(req.GetHeaders().size() == 3);
+    YGW_ASSERT(req.GetHeader("Content-Type") == "text/plain");
+    YGW_ASSERT(req.GetHeader(ygw::http::HttpHeader::CONTENT_TYPE) == "text/plain");
+    YGW_ASSERT(req.GetHeader("X-TRACE-ID") == "def");
+    YGW_ASSERT(req.GetHeaderAs<int>("content-length") == 42);
+    YGW_ASSERT(*req.FindHeader(ygw::http::HttpHeader::CONTENT_LENGTH) == "42");
+    YGW_ASSERT(!req.FindHeader(ygw::http::HttpHeader::HOST));
+    YGW_ASSERT(req.GetHeader("missing", "def") == "def");
+
+    auto it = req.GetHeaders().find("x-trace-id");
+    YGW_ASSERT(it != req.GetHeaders().end() && it->first == "X-Trace-Id");
+
+    ygw::http::HttpRequest copy;
+    copy.SetHeaders(req.GetHeaders());
+    req.DelHeader("content-type");
+    YGW_ASSERT(!req.HasHeader("Content-Type") && req.GetHeaderAs<int>("Content-Length") == 42);
+    YGW_ASSERT(copy.GetHeader("content-type") == "text/plain");
+
+    ygw::http::HttpRequest::MapType m = copy.GetHeaders();
+    YGW_ASSERT(m.size() == 3 && m["X-TRACE-ID"] == "def");
+    YGW_LOG_INFO(g_logger) << "test_headers ok";
+}
+
 int main(int argc, char** argv)
 {
     test_request();
     test_response();
+    test_headers();
+    bench_serialize();
 
 
     return 0;
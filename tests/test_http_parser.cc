@@ -12,6 +12,8 @@
  */
 #include <server_frame/http/http_parser.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
 
 static ygw::log::Logger::ptr g_logger = YGW_LOG_NAME("system");
 
@@ -60,9 +62,54 @@ void test_response()
         << " tmp[s]=" << tmp[s];
     YGW_LOG_INFO(g_logger) << parser.GetData()->ToString();
 }
+static char bench_request_data[] = 
+    "GET /api/v1/user/42?fields=name,email&page=2 HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 Chrome/86.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Referer: https://www.example.com/user/42\r\n"
+    "Origin: https://www.example.com\r\n"
+    "X-Request-Id: 6f1c2b9e-8a1d-4c5e-9b7a-3f2d1e0c9b8a\r\n"
+    "If-None-Match: \"5f85a1c2-1a2b\"\r\n"
+    "Cookie: sid=8d7f6e5d4c3b2a19; lang=zh; theme=dark\r\n\r\n";
+
+/**
+ * @brief 解析一个带十几个头部的请求并读取几个常用头部, 统计每个请求的耗时
+ */
+void bench_request()
+{
+    const int kLoops = 200000;
+    std::string data = bench_request_data;
+    std::string tmp;
+    uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+    for (int i = 0; i < kLoops; ++i)
+    {
+        ygw::http::HttpRequestParser parser;
+        tmp = data;
+        parser.Execute(&tmp[0], tmp.size());
+        YGW_ASSERT(parser.IsFinished() && !parser.HasError());
+        auto req = parser.GetData();
+        YGW_ASSERT(req->GetHeader("host") == "api.example.com");
+        YGW_ASSERT(!req->GetHeader("Connection").empty());
+        YGW_ASSERT(req->GetHeader("content-type").empty());
+        YGW_ASSERT(req->GetHeaderAs<int>("content-length", -1) == -1);
+        YGW_ASSERT(req->HasHeader("if-none-match"));
+        YGW_ASSERT(req->GetHeader("X-Request-Id").size() == 36);
+    }
+    uint64_t used = ygw::util::TimeUtil::GetCurrentUS() - start;
+    YGW_LOG_INFO(g_logger) << "bench_request requests=" << kLoops
+        << " used_us=" << used
+        << " ns/request=" << used * 1000 / kLoops;
+}
+
 int main(int argc, char** argv)
 {
     test_request();
     test_response();
+    bench_request();
     return 0;
 }
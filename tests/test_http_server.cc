@@ -14,7 +14,15 @@
 #include <server_frame/http/http_server.h>
 #include <server_frame/log.h>
 #include <server_frame/config.h>
+#include <server_frame/macro.h>
+#include <server_frame/stream/zlib_stream.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <iostream>
+#include <thread>
 static ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
 void run()
@@ -43,8 +51,634 @@ void run()
     });
     server->Start();
 }
+/**
+ * @brief 当前进程打开的fd数量
+ */
+static int count_fds()
+{
+    int count = 0;
+    DIR* dir = opendir("/proc/self/fd");
+    YGW_ASSERT(dir);
+    while (readdir(dir))
+    {
+        ++count;
+    }
+    closedir(dir);
+    return count;
+}
+
+/**
+ * @brief 用阻塞socket把reqs原样发给本机port, 读到对方关闭为止
+ * @param[in] more 不为空时等100ms, 前面的响应写出后再发送
+ */
+std::string raw_request(uint16_t port, const std::string& reqs, const std::string& more = "")
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    YGW_ASSERT(::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    YGW_ASSERT(::write(fd, reqs.c_str(), reqs.size()) == (ssize_t)reqs.size());
+    if (!more.empty())
+    {
+        usleep(100 * 1000);
+        ::send(fd, more.c_str(), more.size(), MSG_NOSIGNAL);
+    }
+    std::string rsps;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+        rsps.append(buf, n);
+    }
+    ::close(fd);
+    return rsps;
+}
+
+/**
+ * @brief 测试管线化: 一次写入三个请求(中间一个带消息体), 响应按顺序返回
+ */
+void test_pipeline()
+{
+    ygw::scheduler::IOManager iom(1, false, "pipeline");
+    ygw::http::HttpServer::ptr server;
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        server.reset(new ygw::http::HttpServer(true));
+        server->GetServletDispatch()->AddServlet("/echo", [](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                rsp->SetBody("[" + req->GetQuery() + req->GetBody() + "]");
+                return 0;
+        });
+        server->GetServletDispatch()->AddServlet("/throw", [](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session) -> int32_t {
+                throw std::runtime_error("servlet error");
+        });
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8021")) && server->Start() ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(bound == 1);
+
+    std::string rsps = raw_request(8021, "GET /echo?a=1 HTTP/1.1\r\nHost: t\r\n\r\n"
+        "POST /echo HTTP/1.1\r\nHost: t\r\nContent-Length: 5\r\n\r\nhello"
+        "GET /echo?c=3 HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    YGW_LOG_INFO(g_logger) << rsps;
+    size_t a = rsps.find("[a=1]");
+    size_t b = rsps.find("[hello]");
+    size_t c = rsps.find("[c=3]");
+    YGW_ASSERT(a != std::string::npos && b != std::string::npos && c != std::string::npos);
+    YGW_ASSERT(a < b && b < c);
+
+    //消息体边界有歧义的请求回复400并关闭连接, 后面夹带的请求不会被执行
+    const char* bad_bodies[] = {
+        "Content-Length: abc\r\n",
+        "Content-Length: 5\r\nContent-Length: 6\r\n",
+        "Content-Length: 5\r\nTransfer-Encoding: chunked\r\n",
+        "Transfer-Encoding: chunked\r\nContent-Length: 5\r\n",
+    };
+    for (auto bad : bad_bodies)
+    {
+        rsps = raw_request(8021, "GET /echo?a=1 HTTP/1.1\r\nHost: t\r\n\r\n"
+            "POST /echo HTTP/1.1\r\nHost: t\r\n" + std::string(bad) + "\r\n"
+            "GET /echo?x=smuggled HTTP/1.1\r\nHost: t\r\n\r\n");
+        YGW_LOG_INFO(g_logger) << rsps;
+        a = rsps.find("[a=1]");
+        b = rsps.find("HTTP/1.1 400 Bad Request");
+        YGW_ASSERT(a != std::string::npos && b != std::string::npos && a < b);
+        YGW_ASSERT(rsps.find("smuggled") == std::string::npos);
+    }
+    //重复但相同的Content-Length可以接受
+    rsps = raw_request(8021, "POST /echo HTTP/1.1\r\nHost: t\r\nContent-Length: 5\r\n"
+        "Content-Length: 5\r\nConnection: close\r\n\r\nhello");
+    YGW_ASSERT(rsps.find("[hello]") != std::string::npos);
+
+    //servlet抛出异常时连接被关闭, 连接数和在途请求数都要减回去
+    raw_request(8021, "GET /throw HTTP/1.1\r\nHost: t\r\n\r\n");
+    for (int i = 0; i < 100 && server->GetConnections() > 0; ++i)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(server->GetConnections() == 0 && server->GetInflight() == 0);
+    iom.Schedule([&]() {
+        server->Stop();
+        server.reset();
+    });
+}
+
+/**
+ * @brief 测试静态文件: 200/HEAD/206/416/304, 文件由sendfile发送
+ */
+void test_static()
+{
+    const std::string root = "/tmp/ygw_static";
+    const size_t kSize = 4 * 1024 * 1024;
+    mkdir(root.c_str(), 0755);
+    std::string content(kSize, 0);
+    for (size_t i = 0; i < kSize; ++i)
+    {
+        content[i] = 'a' + i % 26;
+    }
+    FILE* fp = fopen((root + "/big.txt").c_str(), "wb");
+    YGW_ASSERT(fp && fwrite(content.data(), 1, kSize, fp) == kSize);
+    fclose(fp);
+
+    ygw::scheduler::IOManager iom(1, false, "static");
+    ygw::http::HttpServer::ptr server;
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        server.reset(new ygw::http::HttpServer(true));
+        server->SetRoot(root);
+        //声明的长度比文件长, 模拟发送期间文件被截短
+        server->GetServletDispatch()->AddServlet("/shrunk", [root](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                int fd = open((root + "/big.txt").c_str(), O_RDONLY);
+                rsp->SetFileBody(std::make_shared<ygw::http::HttpFileBody>(fd, 4 * 1024 * 1024 - 10, 100));
+                return 0;
+        });
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8022")) && server->Start() ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(bound == 1);
+
+    auto header = [](const std::string& rsp, const std::string& key) {
+        size_t pos = rsp.find("\r\n" + key + ": ");
+        YGW_ASSERT(pos != std::string::npos);
+        pos += key.size() + 4;
+        return rsp.substr(pos, rsp.find("\r\n", pos) - pos);
+    };
+    auto body = [](const std::string& rsp) {
+        return rsp.substr(rsp.find("\r\n\r\n") + 4);
+    };
+
+    std::string rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    YGW_ASSERT(body(rsp) == content);
+    std::string etag = header(rsp, "ETag");
+    std::string last_modified = header(rsp, "Last-Modified");
+    YGW_LOG_INFO(g_logger) << "etag=" << etag << " last_modified=" << last_modified;
+
+    rsp = raw_request(8022, "HEAD /big.txt HTTP/1.1\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(header(rsp, "content-length") == std::to_string(kSize));
+    YGW_ASSERT(body(rsp).empty());
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nRange: bytes=10-19\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 206") == 0);
+    YGW_ASSERT(header(rsp, "Content-Range") == "bytes 10-19/" + std::to_string(kSize));
+    YGW_ASSERT(body(rsp) == content.substr(10, 10));
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nRange: bytes=-5\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(body(rsp) == content.substr(kSize - 5));
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nRange: bytes=" + std::to_string(kSize)
+            + "-\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 416") == 0);
+    YGW_ASSERT(header(rsp, "Content-Range") == "bytes */" + std::to_string(kSize));
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nRange: bytes=0-0\r\nIf-Range: \"old\"\r\n"
+            "Connection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 200") == 0);
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nIf-None-Match: " + etag
+            + "\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 304") == 0);
+    YGW_ASSERT(body(rsp).empty());
+
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nIf-Modified-Since: " + last_modified
+            + "\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 304") == 0);
+
+    //长连接上连续两个区间请求, 文件消息体和后面的响应不能错位
+    rsp = raw_request(8022, "GET /big.txt HTTP/1.1\r\nRange: bytes=0-2\r\n\r\n"
+            "GET /big.txt HTTP/1.1\r\nRange: bytes=3-5\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.find("\r\n\r\nabcHTTP/1.1 206") != std::string::npos);
+    YGW_ASSERT(rsp.compare(rsp.size() - 7, 7, "\r\n\r\ndef") == 0);
+
+    //文件没发完就结束, 连接被关闭, 后面管线化的请求不再处理.
+    //没有所有者的HttpFileBody析构时关闭fd, 请求结束后fd数量回到原值
+    usleep(100 * 1000);
+    int fds = count_fds();
+    for (int i = 0; i < 3; ++i)
+    {
+        rsp = raw_request(8022, "GET /shrunk HTTP/1.1\r\n\r\n"
+                ,"GET /big.txt HTTP/1.1\r\nRange: bytes=0-2\r\nConnection: close\r\n\r\n");
+        YGW_ASSERT(rsp.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+        YGW_ASSERT(rsp.find("HTTP/1.1 206") == std::string::npos);
+    }
+    for (int i = 0; i < 100 && count_fds() != fds; ++i)
+    {
+        usleep(10 * 1000);
+    }
+    YGW_ASSERT(count_fds() == fds);
+
+    YGW_LOG_INFO(g_logger) << "test_static ok";
+    iom.Schedule([&]() {
+        server->Stop();
+        server.reset();
+    });
+}
+
+/**
+ * @brief 测试静态小文件的内存缓存: 接受gzip时发预先压缩的副本, 否则发原始内容
+ */
+void test_asset()
+{
+    const std::string root = "/tmp/ygw_static";
+    mkdir(root.c_str(), 0755);
+    std::string content;
+    for (int i = 0; i < 1000; ++i)
+    {
+        content += "function f" + std::to_string(i) + "() { return " + std::to_string(i) + "; }\n";
+    }
+    FILE* fp = fopen((root + "/app.js").c_str(), "wb");
+    YGW_ASSERT(fp && fwrite(content.data(), 1, content.size(), fp) == content.size());
+    fclose(fp);
+
+    ygw::scheduler::IOManager iom(1, false, "asset");
+    ygw::http::HttpServer::ptr server;
+    auto asset_cache = std::make_shared<ygw::http::AssetCache>();
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        server.reset(new ygw::http::HttpServer(true));
+        server->SetRoot(root);
+        server->SetFileCache(std::make_shared<ygw::http::FileCache>());
+        server->SetAssetCache(asset_cache);
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8023")) && server->Start() ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(bound == 1);
+
+    auto body = [](const std::string& rsp) {
+        return rsp.substr(rsp.find("\r\n\r\n") + 4);
+    };
+    for (int i = 0; i < 3; ++i)
+    {
+        std::string rsp = raw_request(8023, "GET /app.js HTTP/1.1\r\nAccept-Encoding: deflate, gzip\r\n"
+                "Connection: close\r\n\r\n");
+        YGW_ASSERT(rsp.find("\r\nContent-Encoding: gzip\r\n") != std::string::npos);
+        YGW_ASSERT(rsp.find("\r\nVary: Accept-Encoding\r\n") != std::string::npos);
+        std::string gz = body(rsp);
+        YGW_ASSERT(gz.size() < content.size() / 4);
+        auto zs = ygw::stream::ZlibStream::CreateGzip(false);
+        zs->Write(gz.c_str(), gz.size());
+        zs->Flush();
+        YGW_ASSERT(zs->GetResult() == content);
+    }
+
+    std::string rsp = raw_request(8023, "GET /app.js HTTP/1.1\r\nAccept-Encoding: gzip;q=0\r\n"
+            "Connection: close\r\n\r\n");
+    YGW_ASSERT(rsp.find("Content-Encoding") == std::string::npos);
+    YGW_ASSERT(body(rsp) == content);
+
+    //区间请求不走内存副本
+    rsp = raw_request(8023, "GET /app.js HTTP/1.1\r\nAccept-Encoding: gzip\r\nRange: bytes=0-7\r\n"
+            "Connection: close\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 206") == 0 && body(rsp) == content.substr(0, 8));
+
+    YGW_LOG_INFO(g_logger) << asset_cache->ToString();
+    YGW_ASSERT(asset_cache->GetMisses() == 1 && asset_cache->GetHits() == 4);
+    YGW_LOG_INFO(g_logger) << "test_asset ok";
+    iom.Schedule([&]() {
+        server->Stop();
+        server.reset();
+    });
+}
+
+/**
+ * @brief 从chunked编码的消息体中取出数据
+ */
+static std::string dechunk(const std::string& v)
+{
+    std::string out;
+    size_t pos = 0;
+    while (true)
+    {
+        size_t eol = v.find("\r\n", pos);
+        YGW_ASSERT(eol != std::string::npos);
+        size_t len = strtoul(v.c_str() + pos, nullptr, 16);
+        if (len == 0)
+        {
+            YGW_ASSERT(v.compare(eol, 4, "\r\n\r\n") == 0 && eol + 4 == v.size());
+            return out;
+        }
+        out.append(v, eol + 2, len);
+        YGW_ASSERT(v.compare(eol + 2 + len, 2, "\r\n") == 0);
+        pos = eol + 4 + len;
+    }
+}
+
+/**
+ * @brief 测试流式响应: chunked大响应在客户端不读时挂起servlet, Content-Length模式, HTTP/1.0和HEAD
+ */
+void test_stream()
+{
+    const size_t kChunk = 64 * 1024;
+    const size_t kChunks = 512;
+    std::atomic<size_t> written {0};
+    ygw::scheduler::IOManager iom(1, false, "stream");
+    ygw::http::HttpServer::ptr server;
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        server.reset(new ygw::http::HttpServer(true));
+        server->GetServletDispatch()->AddServlet("/chunked", [&](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                YGW_ASSERT(session->SendResponseHeader(rsp) > 0);
+                std::string chunk(kChunk, 0);
+                for (size_t i = 0; i < kChunks; ++i)
+                {
+                    memset(&chunk[0], 'a' + i % 26, kChunk);
+                    if (session->SendBodyChunk(chunk) <= 0)
+                    {
+                        return -1;
+                    }
+                    ++written;
+                }
+                return 0;
+        });
+        server->GetServletDispatch()->AddServlet("/fixed", [](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                rsp->SetHeader("Content-Length", "11");
+                session->SendResponseHeader(rsp);
+                session->SendBodyChunk("hello");
+                session->SendBodyChunk(" world");
+                return session->FinishResponse() > 0 ? 0 : -1;
+        });
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8024")) && server->Start() ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(bound == 1);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8024);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    YGW_ASSERT(::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    std::string req = "GET /chunked HTTP/1.1\r\nConnection: close\r\n\r\n";
+    YGW_ASSERT(::write(fd, req.c_str(), req.size()) == (ssize_t)req.size());
+    //客户端不读, servlet写满socket缓冲区后应该停下
+    usleep(300 * 1000);
+    size_t stalled = written;
+    YGW_LOG_INFO(g_logger) << "chunks written while client stalled: " << stalled << "/" << kChunks;
+    YGW_ASSERT(stalled < kChunks);
+    std::string rsp;
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+        rsp.append(buf, n);
+    }
+    ::close(fd);
+    YGW_ASSERT(written == kChunks);
+    size_t header_end = rsp.find("\r\n\r\n") + 4;
+    YGW_ASSERT(rsp.find("\r\nTransfer-Encoding: chunked\r\n") < header_end);
+    YGW_ASSERT(rsp.find("content-length") > header_end);
+    std::string body = dechunk(rsp.substr(header_end));
+    YGW_ASSERT(body.size() == kChunk * kChunks);
+    for (size_t i = 0; i < kChunks; ++i)
+    {
+        YGW_ASSERT(body[i * kChunk] == (char)('a' + i % 26) && body[i * kChunk + kChunk - 1] == body[i * kChunk]);
+    }
+
+    //长连接上Content-Length模式之后还能继续处理请求
+    rsp = raw_request(8024, "GET /fixed HTTP/1.1\r\n\r\nHEAD /fixed HTTP/1.1\r\n\r\n"
+            "GET /fixed HTTP/1.1\r\nConnection: close\r\n\r\n");
+    YGW_LOG_INFO(g_logger) << rsp;
+    size_t first = rsp.find("\r\n\r\nhello worldHTTP/1.1 200");
+    YGW_ASSERT(first != std::string::npos);
+    YGW_ASSERT(rsp.find("\r\n\r\nHTTP/1.1 200", first + 4) != std::string::npos);
+    YGW_ASSERT(rsp.compare(rsp.size() - 15, 15, "\r\n\r\nhello world") == 0);
+
+    //HTTP/1.0不支持chunked, 消息体写完后关闭连接
+    rsp = raw_request(8024, "GET /chunked HTTP/1.0\r\n\r\n");
+    header_end = rsp.find("\r\n\r\n") + 4;
+    YGW_ASSERT(rsp.find("Transfer-Encoding") > header_end);
+    YGW_ASSERT(rsp.find("connection: close") < header_end);
+    YGW_ASSERT(rsp.size() - header_end == kChunk * kChunks);
+
+    YGW_LOG_INFO(g_logger) << "test_stream ok";
+    iom.Schedule([&]() {
+        server->Stop();
+        server.reset();
+    });
+}
+
+/**
+ * @brief 测试请求消息体: chunked解码, 流式读取, 大消息体落盘, 100-continue, 没读完的消息体
+ */
+void test_upload()
+{
+    ygw::scheduler::IOManager iom(1, false, "upload");
+    ygw::http::HttpServer::ptr server;
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        server.reset(new ygw::http::HttpServer(true));
+        auto dispatch = server->GetServletDispatch();
+        dispatch->AddServlet("/echo", [](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                rsp->SetBody("[" + req->GetBody() + "]");
+                return 0;
+        });
+        //消息体超过64KB写到临时文件, 回复长度/是否落盘/字节和
+        auto upload = std::make_shared<ygw::http::FunctionServlet>([](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                auto ba = std::make_shared<ygw::container::ByteArray>();
+                std::string path;
+                int64_t size = session->SpoolBody(ba, 64 * 1024, "/tmp", path);
+                uint64_t sum = 0;
+                std::string data = ba->ToString();
+                if (!path.empty())
+                {
+                    YGW_ASSERT(ba->GetSize() == 0);
+                    FILE* fp = fopen(path.c_str(), "rb");
+                    YGW_ASSERT(fp);
+                    data.resize(size);
+                    YGW_ASSERT(fread(&data[0], 1, size, fp) == (size_t)size);
+                    fclose(fp);
+                    unlink(path.c_str());
+                }
+                for (auto c : data)
+                {
+                    sum += (unsigned char)c;
+                }
+                rsp->SetBody("size=" + std::to_string(size) + " file=" + std::to_string(!path.empty())
+                        + " sum=" + std::to_string(sum));
+                return 0;
+        });
+        upload->SetStreamBody(true);
+        dispatch->AddServlet("/upload", upload);
+        //用小节点的ByteArray通过Stream读消息体, 每次读取跨多个iovec
+        auto stream = std::make_shared<ygw::http::FunctionServlet>([](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                auto body = session->GetBodyStream();
+                auto ba = std::make_shared<ygw::container::ByteArray>(16);
+                YGW_ASSERT(body->Read(ba, 0) == 0);
+                int n = 0;
+                while ((n = body->Read(ba, 100)) > 0)
+                {
+                }
+                YGW_ASSERT(n == 0);
+                ba->SetPosition(0);
+                rsp->SetBody("<" + ba->ToString() + ">");
+                return 0;
+        });
+        stream->SetStreamBody(true);
+        dispatch->AddServlet("/stream", stream);
+        //不读消息体就回复
+        auto ignore = std::make_shared<ygw::http::FunctionServlet>([](ygw::http::HttpRequest::ptr req,
+                    ygw::http::HttpResponse::ptr rsp,
+                    ygw::http::HttpSession::ptr session){
+                rsp->SetStatus(ygw::http::HttpStatus::PAYLOAD_TOO_LARGE);
+                return 0;
+        });
+        ignore->SetStreamBody(true);
+        dispatch->AddServlet("/ignore", ignore);
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8025")) && server->Start() ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    YGW_ASSERT(bound == 1);
+
+    //chunked请求(带扩展和trailer)后面紧跟着管线化的请求
+    std::string rsp = raw_request(8025, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5;ext=1\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n"
+            "GET /echo?x HTTP/1.1\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.find("[hello world]") != std::string::npos);
+    YGW_ASSERT(rsp.find("[]") != std::string::npos);
+
+    //10MB的Content-Length消息体落盘, 后面的请求还能正常处理
+    const size_t kSize = 10 * 1024 * 1024;
+    std::string big(kSize, 0);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kSize; ++i)
+    {
+        big[i] = i * 7;
+        sum += (unsigned char)big[i];
+    }
+    std::string expect = "size=" + std::to_string(kSize) + " file=1 sum=" + std::to_string(sum);
+    rsp = raw_request(8025, "POST /upload HTTP/1.1\r\nContent-Length: " + std::to_string(kSize)
+            + "\r\n\r\n" + big + "GET /echo HTTP/1.1\r\nConnection: close\r\n\r\n");
+    YGW_ASSERT(rsp.find(expect) != std::string::npos);
+    YGW_ASSERT(rsp.find("[]") != std::string::npos);
+
+    //同样的数据用chunked分成不规则的块
+    std::string chunked;
+    for (size_t pos = 0, n = 1; pos < kSize; pos += n, n = n * 3 % 70001 + 1)
+    {
+        n = std::min(n, kSize - pos);
+        char line[32];
+        snprintf(line, sizeof(line), "%zx\r\n", n);
+        chunked.append(line).append(big, pos, n).append("\r\n");
+    }
+    rsp = raw_request(8025, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+            + chunked + "0\r\n\r\n");
+    YGW_ASSERT(rsp.find(expect) != std::string::npos);
+
+    //Stream读ByteArray: 跨节点的读取不丢数据
+    std::string text;
+    for (int i = 0; i < 100; ++i)
+    {
+        text += "line-" + std::to_string(i) + ";";
+    }
+    rsp = raw_request(8025, "POST /stream HTTP/1.1\r\nContent-Length: " + std::to_string(text.size())
+            + "\r\nConnection: close\r\n\r\n" + text);
+    YGW_ASSERT(rsp.find("<" + text + ">") != std::string::npos);
+    rsp = raw_request(8025, "POST /stream HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+            "5\r\nhello\r\n1d\r\n, this chunk spans two nodes.\r\n0\r\n\r\n");
+    YGW_ASSERT(rsp.find("<hello, this chunk spans two nodes.>") != std::string::npos);
+
+    //小消息体留在内存里
+    rsp = raw_request(8025, "POST /upload HTTP/1.1\r\nContent-Length: 3\r\nConnection: close\r\n\r\nabc");
+    YGW_ASSERT(rsp.find("size=3 file=0 sum=294") != std::string::npos);
+
+    //Expect: 100-continue, 收到100之后才发消息体
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8025);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    YGW_ASSERT(::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+    std::string req = "POST /upload HTTP/1.1\r\nContent-Length: 3\r\nExpect: 100-continue\r\n"
+        "Connection: close\r\n\r\n";
+    YGW_ASSERT(::write(fd, req.c_str(), req.size()) == (ssize_t)req.size());
+    char buf[256];
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    YGW_ASSERT(n > 0 && std::string(buf, n) == "HTTP/1.1 100 Continue\r\n\r\n");
+    YGW_ASSERT(::write(fd, "abc", 3) == 3);
+    rsp.clear();
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    {
+        rsp.append(buf, n);
+    }
+    ::close(fd);
+    YGW_ASSERT(rsp.find("size=3 file=0") != std::string::npos);
+
+    //servlet没读消息体, 回复后关闭连接, 不把消息体当成下一个请求
+    rsp = raw_request(8025, "POST /ignore HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+            "GET /echo HTTP/1.1\r\n\r\n");
+    YGW_ASSERT(rsp.compare(0, 12, "HTTP/1.1 413") == 0);
+    YGW_ASSERT(rsp.find("connection: close") != std::string::npos);
+    YGW_ASSERT(rsp.find("[]") == std::string::npos);
+
+    YGW_LOG_INFO(g_logger) << "test_upload ok";
+    iom.Schedule([&]() {
+        server->Stop();
+        server.reset();
+    });
+}
+
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "pipeline")
+    {
+        test_pipeline();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "static")
+    {
+        test_static();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "asset")
+    {
+        test_asset();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "stream")
+    {
+        test_stream();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "upload")
+    {
+        test_upload();
+        return 0;
+    }
     ygw::scheduler::IOManager iom(2);
     iom.Schedule(run);
     return 0;
@@ -1,5 +1,8 @@
 #include <server_frame/iomanager.h>
+#include <server_frame/iomanager_group.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -9,6 +12,7 @@
 #include <cerrno>
 #include <iostream>
 #include <memory>
+#include <set>
 
 ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
@@ -68,6 +72,128 @@ void test_timer()
     }, true);
 }
 
+//带slack的定时器对齐到同一时间点, 只需要少量唤醒
+void test_timer_slack()
+{
+    ygw::scheduler::IOManager iom(1);
+    static std::set<uint64_t> s_fire_times;
+    for (int i = 0; i < 100; ++i)
+    {
+        iom.AddTimer(1000 + i * 3, [](){
+            s_fire_times.insert(ygw::util::TimeUtil::GetCachedMS());
+        }, false, 200);
+    }
+
+    //Refresh只推后期限, 原执行时间到达时才重新插入
+    static uint64_t s_start = ygw::util::TimeUtil::GetMonotonicMS();
+    static ygw::timer::Timer::ptr s_idle = iom.AddTimer(500, [](){
+        YGW_LOG_INFO(g_logger) << "idle timer fired after "
+            << ygw::util::TimeUtil::GetMonotonicMS() - s_start << "ms (expect ~900)";
+    });
+    iom.AddTimer(400, [](){
+        s_idle->Refresh();
+    });
+    iom.AddTimer(2000, [](){
+        YGW_LOG_INFO(g_logger) << "100 slack timers fired at "
+            << s_fire_times.size() << " distinct times";
+    });
+}
+
+//其他线程的Cancel和归属线程的到期执行只有一方成功;
+//其他线程的Reset成功后定时器按新时间执行, 不会再按旧时间执行
+void test_timer_race()
+{
+    struct Round
+    {
+        std::atomic<int> fired {0};
+        std::atomic<uint64_t> fired_us {0};
+        bool op_ok = false;
+        uint64_t op_us = 0;
+    };
+    const int rounds = 300;
+    std::vector<std::shared_ptr<Round> > cancels;
+    std::vector<std::shared_ptr<Round> > resets;
+    std::atomic<int> done {0};
+    {
+        ygw::scheduler::IOManager iom(2, false, "race");
+        std::vector<int> tids = iom.GetWorkerThreadIds();
+        iom.Schedule([&iom, tids, &cancels, &resets, &done, rounds](){
+            for (int i = 0; i < rounds; ++i)
+            {
+                //定时器属于tids[0], 在tids[1]上于到期前后操作
+                auto round = std::make_shared<Round>();
+                auto timer = iom.AddTimer(1, [round](){
+                    round->fired_us = ygw::util::TimeUtil::GetMonotonicUS();
+                    ++round->fired;
+                });
+                bool reset = i % 2;
+                (reset ? resets : cancels).push_back(round);
+                uint64_t start = ygw::util::TimeUtil::GetMonotonicUS();
+                uint64_t delay = rand() % 2000;
+                iom.Schedule([timer, round, reset, start, delay, &done](){
+                    while (ygw::util::TimeUtil::GetMonotonicUS() < start + delay);
+                    round->op_us = ygw::util::TimeUtil::GetMonotonicUS();
+                    round->op_ok = reset ? timer->Reset(20, true) : timer->Cancel();
+                    ++done;
+                }, tids[1]);
+                usleep(2500);
+            }
+            while (done < rounds)
+            {
+                usleep(1000);
+            }
+            usleep(50 * 1000);
+        }, tids[0]);
+    }
+
+    int cancelled = 0;
+    for (auto& i : cancels)
+    {
+        YGW_ASSERT(i->fired + i->op_ok == 1);
+        cancelled += i->op_ok;
+    }
+    int reset = 0;
+    for (auto& i : resets)
+    {
+        YGW_ASSERT(i->fired == 1);
+        if (i->op_ok)
+        {
+            //缓存时钟精度1ms
+            YGW_ASSERT(i->fired_us + 1000 >= i->op_us + 20 * 1000);
+            ++reset;
+        }
+        else
+        {
+            //归属线程先取出了回调, 回调在Reset之后才执行也是按旧时间触发
+            YGW_ASSERT(i->fired_us < i->op_us + 20 * 1000);
+        }
+    }
+    YGW_LOG_INFO(g_logger) << "timer race: cancel won " << cancelled << "/" << cancels.size()
+        << " reset won " << reset << "/" << resets.size();
+}
+
+void test_group()
+{
+    //每个成员的任务都在同一个线程上执行
+    ygw::scheduler::IOManagerGroup group(4, "group", true);
+    std::vector<std::set<int> > threads(group.GetSize());
+    ygw::thread::Mutex mutex;
+    for (int i = 0; i < 100; ++i)
+    {
+        size_t idx = group.Next();
+        group.Get(idx)->Schedule([idx, &threads, &mutex]() {
+            ygw::thread::Mutex::Lock lock(mutex);
+            threads[idx].insert(ygw::util::GetThreadId());
+        });
+    }
+    group.Stop();
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        YGW_LOG_INFO(g_logger) << "member=" << group.Get(i)->GetName()
+            << " cpu=" << group.GetCpu(i) << " threads=" << threads[i].size();
+    }
+}
+
 void test1()
 {
     ygw::scheduler::IOManager iom;
@@ -78,6 +204,9 @@ int main()
 {
     test1();
     //test_timer();
+    test_timer_slack();
+    test_timer_race();
+    test_group();
 
     return 0;
 }
@@ -0,0 +1,290 @@
+/**
+ * @file tests/test_router.cc
+ * @brief 路由匹配的测试和压测
+ * @author YeGuiWu
+ * @email yeguiwu@qq.com
+ * @version 1.0
+ * @date 2020-10-16
+ * @copyright Copyright (c) 2020年 guiwu.ye All rights reserved www.yeguiwu.top
+ */
+#include <server_frame/base/rcu.h>
+#include <server_frame/base/thread.h>
+#include <server_frame/http/servlet.h>
+#include <server_frame/log.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
+
+using ygw::http::HttpMethod;
+using ygw::http::HttpRequest;
+using ygw::http::ServletDispatch;
+
+/**
+ * @brief 只用名字区分的servlet
+ */
+class NamedServlet : public ygw::http::Servlet
+{
+public:
+    NamedServlet(const std::string& name)
+        : Servlet(name)
+    {
+    }
+
+    int32_t Handle(ygw::http::HttpRequest::ptr request
+            , ygw::http::HttpResponse::ptr response
+            , ygw::http::HttpSession::ptr session) override
+    {
+        return 0;
+    }
+};
+
+static ygw::http::Servlet::ptr named(const std::string& name)
+{
+    return std::make_shared<NamedServlet>(name);
+}
+
+static HttpRequest::ptr make_request(HttpMethod method, const std::string& path)
+{
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    req->SetMethod(method);
+    req->SetPath(path);
+    return req;
+}
+
+/**
+ * @brief 返回匹配的servlet名字
+ */
+static std::string route(ServletDispatch& d, HttpMethod method, const std::string& path
+        ,HttpRequest::ptr* out = nullptr)
+{
+    HttpRequest::ptr req = make_request(method, path);
+    if (out)
+    {
+        *out = req;
+    }
+    return d.Route(req)->GetName();
+}
+
+/**
+ * @brief 静态/参数/通配优先级, 回退, 按方法分发, 405, 和精准匹配/模糊匹配的顺序
+ */
+void test_route()
+{
+    ServletDispatch d;
+    YGW_ASSERT(d.AddRoute("/user/:id", named("user_get"), HttpMethod::GET));
+    YGW_ASSERT(d.AddRoute("/user/:id", named("user_put"), HttpMethod::PUT));
+    YGW_ASSERT(d.AddRoute("/user/new", named("user_new"), HttpMethod::POST));
+    YGW_ASSERT(d.AddRoute("/user/:id/files/*path", named("user_files")));
+    YGW_ASSERT(d.AddRoute("/users", named("users")));
+    YGW_ASSERT(d.AddRoute("/static/*path", named("static")));
+    YGW_ASSERT(d.AddRoute("/a/:x/c", named("axc")));
+    YGW_ASSERT(d.AddRoute("/a/b/d", named("abd")));
+    YGW_ASSERT(d.AddRoute("/time:now", named("literal")));
+    YGW_ASSERT(!d.AddRoute("/user/:name", named("conflict")));
+    YGW_ASSERT(!d.AddRoute("/x/*rest/y", named("bad")));
+    YGW_ASSERT(!d.AddRoute("x", named("bad")));
+    d.AddServlet("/user/me", named("exact"));
+    d.AddGlobServlet("/user/*", named("glob"));
+
+    HttpRequest::ptr req;
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/42", &req) == "user_get");
+    YGW_ASSERT(req->GetPathParam("id") == "42");
+    YGW_ASSERT(route(d, HttpMethod::HEAD, "/user/42") == "user_get");
+    YGW_ASSERT(route(d, HttpMethod::PUT, "/user/42") == "user_put");
+    YGW_ASSERT(route(d, HttpMethod::POST, "/user/new") == "user_new");
+    //静态/user/new只有POST, GET回退到/user/:id
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/new", &req) == "user_get");
+    YGW_ASSERT(req->GetPathParam("id") == "new");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/me") == "exact");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/42/files/a/b.txt", &req) == "user_files");
+    YGW_ASSERT(req->GetPathParam("id") == "42" && req->GetPathParam("path") == "a/b.txt");
+    YGW_ASSERT(req->GetPathParams().size() == 2);
+    YGW_ASSERT(route(d, HttpMethod::GET, "/users") == "users");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/static/", &req) == "static");
+    YGW_ASSERT(req->HasPathParam("path") && req->GetPathParam("path", "x") == "");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/a/b/c", &req) == "axc");
+    YGW_ASSERT(req->GetPathParam("x") == "b");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/a/b/d") == "abd");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/time:now") == "literal");
+    //路由没有匹配时仍然走模糊匹配
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/42/other") == "glob");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/nothing") == "NotFoundServlet");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/") == "glob");
+
+    //路径匹配但方法不匹配
+    d.DelGlobServlet("/user/*");
+    YGW_ASSERT(route(d, HttpMethod::DELETE, "/user/42") == "MethodNotAllowedServlet");
+    HttpRequest::ptr r = make_request(HttpMethod::DELETE, "/user/42");
+    ygw::http::HttpResponse::ptr rsp = std::make_shared<ygw::http::HttpResponse>(0x11);
+    d.Route(r)->Handle(r, rsp, nullptr);
+    YGW_ASSERT(rsp->GetStatus() == ygw::http::HttpStatus::METHOD_NOT_ALLOWED);
+    YGW_ASSERT(rsp->GetHeader("Allow") == "GET, PUT, HEAD");
+
+    d.DelRoute("/user/:id", HttpMethod::PUT);
+    YGW_ASSERT(route(d, HttpMethod::PUT, "/user/42") == "MethodNotAllowedServlet");
+    YGW_ASSERT(route(d, HttpMethod::GET, "/user/42/files/x") == "user_files");
+
+    std::map<std::string, ygw::http::IServletCreator::ptr> infos;
+    d.ListAllRouteCreator(infos);
+    YGW_ASSERT(infos.count("GET /user/:id") && infos.count("* /static/*path"));
+    YGW_LOG_INFO(g_logger) << "test_route ok, routes=" << infos.size();
+}
+
+/**
+ * @brief 400个路由, 对比逐个fnmatch的模糊匹配和前缀树路由, 分别测命中和未命中
+ */
+void bench()
+{
+    const int kResources = 20;
+    const int kActions = 20;
+    const int kLoops = 200;
+
+    ServletDispatch globs;
+    ServletDispatch routes;
+    std::vector<std::string> hits;
+    for (int r = 0; r < kResources; ++r)
+    {
+        for (int a = 0; a < kActions; ++a)
+        {
+            std::string base = "/api/v1/res" + std::to_string(r);
+            std::string action = "/act" + std::to_string(a);
+            globs.AddGlobServlet(base + "/*" + action, named("x"));
+            routes.AddRoute(base + "/:id" + action, named("x"), HttpMethod::GET);
+            hits.push_back(base + "/" + std::to_string(r * a) + action);
+        }
+    }
+    std::vector<std::string> misses;
+    for (auto& i : hits)
+    {
+        misses.push_back(i + "/none");
+    }
+
+    auto run = [kLoops](const std::string& name, const std::vector<std::string>& paths
+            ,std::function<ygw::http::Servlet::ptr(HttpRequest::ptr)> match, bool hit) {
+        std::vector<HttpRequest::ptr> reqs;
+        for (auto& p : paths)
+        {
+            reqs.push_back(make_request(HttpMethod::GET, p));
+        }
+        uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+        for (int i = 0; i < kLoops; ++i)
+        {
+            for (auto& r : reqs)
+            {
+                YGW_ASSERT((match(r)->GetName() == "x") == hit);
+            }
+        }
+        uint64_t used = ygw::util::TimeUtil::GetCurrentUS() - start;
+        YGW_LOG_INFO(g_logger) << name << " lookups=" << kLoops * reqs.size()
+            << " used_us=" << used
+            << " ns/lookup=" << used * 1000 / (kLoops * reqs.size());
+    };
+    auto glob_match = [&globs](HttpRequest::ptr r) { return globs.GetMatchedServlet(r->GetPath()); };
+    auto route_match = [&routes](HttpRequest::ptr r) { return routes.Route(r); };
+    run("glob hit", hits, glob_match, true);
+    run("glob miss", misses, glob_match, false);
+    run("route hit", hits, route_match, true);
+    run("route miss", misses, route_match, false);
+}
+
+/**
+ * @brief 多个线程不停查找的同时反复增删路由, 读端总能查到固定的路由,
+ *        看不到半改好的表
+ */
+void test_update()
+{
+    const int kThreads = 4;
+    ServletDispatch d;
+    d.AddRoute("/fixed/:id", named("fixed"), HttpMethod::GET);
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> lookups(0);
+    std::vector<ygw::thread::Thread::ptr> thrs;
+    for (int i = 0; i < kThreads; ++i)
+    {
+        thrs.push_back(std::make_shared<ygw::thread::Thread>([&d, &stop, &lookups]() {
+            HttpRequest::ptr req;
+            uint64_t n = 0;
+            while (!stop)
+            {
+                YGW_ASSERT(route(d, HttpMethod::GET, "/fixed/1", &req) == "fixed");
+                YGW_ASSERT(req->GetPathParam("id") == "1");
+                std::string name = route(d, HttpMethod::GET, "/tmp/1");
+                YGW_ASSERT(name == "tmp" || name == "NotFoundServlet");
+                ++n;
+            }
+            lookups += n;
+        }, "reader_" + std::to_string(i)));
+    }
+    int updates = 0;
+    uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+    while (ygw::util::TimeUtil::GetCurrentUS() - start < 500 * 1000)
+    {
+        d.AddRoute("/tmp/:id", named("tmp"), HttpMethod::GET);
+        d.DelRoute("/tmp/:id", HttpMethod::GET);
+        updates += 2;
+    }
+    stop = true;
+    for (auto& i : thrs)
+    {
+        i->Join();
+    }
+    YGW_LOG_INFO(g_logger) << "test_update ok, updates=" << updates << " lookups=" << lookups;
+}
+
+/**
+ * @brief 多线程查找, 对比每次加pthread读写锁和RCU读临界区
+ */
+void bench_threads()
+{
+    const int kThreads = 4;
+    const int kLoops = 1000000;
+    ygw::http::Router router;
+    router.Add(HttpMethod::GET, "/api/v1/user/:id", nullptr);
+    router.Add(HttpMethod::GET, "/api/v1/user/:id/files/*path", nullptr);
+
+    auto run = [&router, kThreads, kLoops](const std::string& name, std::function<void()> lock
+            ,std::function<void()> unlock) {
+        std::vector<ygw::thread::Thread::ptr> thrs;
+        uint64_t start = ygw::util::TimeUtil::GetCurrentUS();
+        for (int i = 0; i < kThreads; ++i)
+        {
+            thrs.push_back(std::make_shared<ygw::thread::Thread>([&]() {
+                std::string path = "/api/v1/user/42";
+                HttpRequest::PathParams params;
+                for (int j = 0; j < kLoops; ++j)
+                {
+                    params.clear();
+                    lock();
+                    router.Match(HttpMethod::GET, path, &params);
+                    unlock();
+                }
+            }, name + "_" + std::to_string(i)));
+        }
+        for (auto& i : thrs)
+        {
+            i->Join();
+        }
+        uint64_t used = ygw::util::TimeUtil::GetCurrentUS() - start;
+        YGW_LOG_INFO(g_logger) << name << " threads=" << kThreads
+            << " lookups=" << (uint64_t)kThreads * kLoops
+            << " used_us=" << used
+            << " ns/lookup(per thread)=" << used * 1000 / kLoops;
+    };
+    ygw::thread::RWMutex mutex;
+    run("rwlock", [&mutex]() { mutex.rdlock(); }, [&mutex]() { mutex.unlock(); });
+    run("rcu", &ygw::thread::Rcu::ReadLock, &ygw::thread::Rcu::ReadUnlock);
+}
+
+int main(int argc, char** argv)
+{
+    test_route();
+    test_update();
+    bench();
+    bench_threads();
+    return 0;
+}
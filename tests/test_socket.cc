@@ -13,7 +13,12 @@
 
 #include <server_frame/iomanager.h>
 #include <server_frame/log.h>
+#include <server_frame/macro.h>
 #include <server_frame/socket.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 static ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
@@ -27,6 +32,7 @@ void test_sock()
     else
     {
         YGW_LOG_ERROR(g_logger) << "get address fail";
+        return;
     }
 
     ygw::socket::Socket::ptr sock = ygw::socket::Socket::CreateTCP(addr);
@@ -63,9 +69,141 @@ void test_sock()
     YGW_LOG_INFO(g_logger) << buffer;
 }
 
+//sendfile大文件, 接收方慢于发送方时发送协程在EAGAIN上让出
+void test_sendfile()
+{
+    char path[] = "/tmp/test_sendfile_XXXXXX";
+    int file_fd = mkstemp(path);
+    YGW_ASSERT(file_fd >= 0);
+    unlink(path);
+    std::string block(1024 * 1024, '\0');
+    const size_t total = 4 * block.size();
+    for (int i = 0; i < 4; ++i)
+    {
+        for (size_t j = 0; j < block.size(); ++j)
+        {
+            block[j] = 'a' + (i * block.size() + j) % 26;
+        }
+        YGW_ASSERT(write(file_fd, block.data(), block.size()) == (ssize_t)block.size());
+    }
+
+    auto addr = ygw::socket::IPv4Address::Create("127.0.0.1", 0);
+    auto listener = ygw::socket::Socket::CreateTCP(addr);
+    YGW_ASSERT(listener->Bind(addr));
+    YGW_ASSERT(listener->Listen());
+    auto client = ygw::socket::Socket::CreateTCP(addr);
+    int bufsize = 64 * 1024;
+    client->SetOption(SOL_SOCKET, SO_RCVBUF, bufsize);
+    YGW_ASSERT(client->Connect(listener->GetLocalAddress()));
+    auto server = listener->Accept();
+    YGW_ASSERT(server);
+    server->SetOption(SOL_SOCKET, SO_SNDBUF, bufsize);
+
+    //单线程调度: 接收协程只有在发送协程EAGAIN让出后才能运行
+    auto done = std::make_shared<bool>(false);
+    auto received_while_sending = std::make_shared<size_t>(0);
+    ygw::scheduler::IOManager::GetThis()->Schedule([client, total, done, received_while_sending](){
+        std::string buffer(64 * 1024, '\0');
+        size_t received = 0;
+        while (received < total)
+        {
+            int rt = client->Recv(&buffer[0], buffer.size());
+            if (rt <= 0)
+            {
+                break;
+            }
+            for (int i = 0; i < rt; ++i)
+            {
+                YGW_ASSERT(buffer[i] == (char)('a' + (received + i) % 26));
+            }
+            received += rt;
+            if (!*done)
+            {
+                *received_while_sending = received;
+            }
+        }
+        YGW_LOG_INFO(g_logger) << "sendfile received " << received << "/" << total
+            << " while_sending=" << *received_while_sending;
+        YGW_ASSERT(received == total);
+        YGW_ASSERT(*received_while_sending > 0);
+    });
+
+    off_t offset = 0;
+    size_t calls = 0;
+    while ((size_t)offset < total)
+    {
+        ssize_t rt = server->SendFile(file_fd, &offset, total - offset);
+        YGW_ASSERT(rt > 0);
+        ++calls;
+    }
+    *done = true;
+    YGW_ASSERT((size_t)offset == total);
+    YGW_LOG_INFO(g_logger) << "sendfile sent " << offset << " in " << calls << " calls";
+    close(file_fd);
+}
+
+//sendmmsg/recvmmsg一次系统调用收发多个数据报
+void test_mmsg()
+{
+    auto addr = ygw::socket::IPv4Address::Create("127.0.0.1", 0);
+    auto receiver = ygw::socket::Socket::CreateUDP(addr);
+    YGW_ASSERT(receiver->Bind(addr));
+    auto sender = ygw::socket::Socket::CreateUDP(addr);
+    YGW_ASSERT(sender->Connect(receiver->GetLocalAddress()));
+
+    const unsigned int count = 8;
+    char data[count][16];
+    iovec iovs[count];
+    mmsghdr msgs[count];
+    memset(msgs, 0, sizeof(msgs));
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        snprintf(data[i], sizeof(data[i]), "msg-%u", i);
+        iovs[i].iov_base = data[i];
+        iovs[i].iov_len = strlen(data[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = sender->SendMMsg(msgs, count);
+    YGW_ASSERT(sent == (int)count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        YGW_ASSERT(msgs[i].msg_len == strlen(data[i]));
+    }
+
+    char buffer[count][16];
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        iovs[i].iov_base = buffer[i];
+        iovs[i].iov_len = sizeof(buffer[i]);
+        msgs[i].msg_len = 0;
+    }
+    //回环UDP在sendmmsg返回时已全部入队
+    int received = receiver->RecvMMsg(msgs, count, MSG_WAITFORONE);
+    YGW_LOG_INFO(g_logger) << "sendmmsg=" << sent << " recvmmsg=" << received;
+    YGW_ASSERT(received == (int)count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        YGW_ASSERT(std::string(buffer[i], msgs[i].msg_len) == data[i]);
+    }
+}
+
 int main(int argc, char** argv)
 {
+    std::string mode = argc > 1 ? argv[1] : "";
     ygw::scheduler::IOManager iom;
-    iom.Schedule(test_sock);
+    //sock依赖外网, 仅显式指定时运行
+    if (mode == "sock")
+    {
+        iom.Schedule(test_sock);
+    }
+    if (mode.empty() || mode == "sendfile")
+    {
+        iom.Schedule(test_sendfile);
+    }
+    if (mode.empty() || mode == "mmsg")
+    {
+        iom.Schedule(test_mmsg);
+    }
     return 0;
 }
@@ -12,6 +12,13 @@
  */
 #include <server_frame/tcp_server.h>
 #include <server_frame/iomanager.h>
+#include <server_frame/macro.h>
+#include <server_frame/util.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 ygw::log::Logger::ptr g_logger = YGW_LOG_ROOT();
 
@@ -34,8 +41,301 @@ void run()
     tcp_server->Start();
 }
 
+/**
+ * @brief 压测用的服务器, 只统计连接数以及处理连接的线程
+ */
+class BenchServer : public ygw::tcp::TcpServer
+{
+public:
+    using ptr = std::shared_ptr<BenchServer>;
+    BenchServer(ygw::scheduler::IOManager* worker)
+        : TcpServer(worker, worker)
+    {
+    }
+    BenchServer(ygw::scheduler::IOManagerGroup::ptr group)
+        : TcpServer(group)
+    {
+    }
+    std::atomic<uint64_t> count {0};
+    ygw::thread::Mutex mutex;
+    std::map<int, uint64_t> threads;
+protected:
+    void HandleClient(ygw::socket::Socket::ptr client) override
+    {
+        ++count;
+        {
+            ygw::thread::Mutex::Lock lock(mutex);
+            ++threads[ygw::util::GetThreadId()];
+        }
+        client->Close();
+    }
+};
+
+/**
+ * @brief 对比三种accept模式的建连速度
+ * @param[in] mode single/reuseport/exclusive
+ * @param[in] dispatch 为空只用一个io_worker, round_robin/least_conn再加一个io_worker,
+ *            group使用4个绑核的单线程调度器组
+ */
+void bench_accept(const std::string& mode, const std::string& dispatch)
+{
+    ygw::scheduler::IOManager iom(4, false, "bench");
+    ygw::scheduler::IOManager iom2(2, false, "bench2");
+    ygw::scheduler::IOManagerGroup::ptr group;
+    BenchServer::ptr server;
+    ygw::tcp::TcpServerConf conf;
+    conf.accept_mode = mode;
+    if (dispatch == "group")
+    {
+        group = std::make_shared<ygw::scheduler::IOManagerGroup>(4, "bench_group", true);
+        group->SetIncomingCpu(true);
+        server.reset(new BenchServer(group));
+    }
+    else
+    {
+        server.reset(new BenchServer(&iom));
+    }
+    if (!dispatch.empty() && dispatch != "group")
+    {
+        conf.dispatch = dispatch;
+        server->AddIOWorker(&iom2);
+    }
+    server->SetConf(conf);
+    //监听socket要在hook线程里创建, 才会被设置成非阻塞
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        if (!server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8034")))
+        {
+            YGW_LOG_ERROR(g_logger) << "bind 127.0.0.1:8034 fail";
+            bound = -1;
+            return;
+        }
+        bound = 1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    if (bound < 0)
+    {
+        return;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8034);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    //先把连接堆在监听队列里, 再启动服务, 测清空积压连接的速度
+    const uint64_t kBacklog = 3000;
+    std::vector<int> fds;
+    for (uint64_t i = 0; i < kBacklog; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+        {
+            fds.push_back(fd);
+        }
+        else
+        {
+            ::close(fd);
+        }
+    }
+    uint64_t start_us = ygw::util::TimeUtil::GetCurrentUS();
+    server->Start();
+    while (server->count < fds.size()
+            && ygw::util::TimeUtil::GetCurrentUS() - start_us < 10 * 1000 * 1000)
+    {
+        usleep(100);
+    }
+    uint64_t drain_us = ygw::util::TimeUtil::GetCurrentUS() - start_us;
+    YGW_LOG_INFO(g_logger) << "accept_mode=" << mode << " dispatch=" << dispatch
+        << " backlog=" << fds.size() << " accepted=" << server->count
+        << " drain_us=" << drain_us
+        << " drain conn/s=" << (server->count * 1000000 / (drain_us ? drain_us : 1));
+    for (auto fd : fds)
+    {
+        ::close(fd);
+    }
+    server->count = 0;
+
+    const int kClients = 4;
+    const uint64_t kDurationMs = 2000;
+    std::atomic<uint64_t> connected {0};
+    std::vector<std::thread> clients;
+    uint64_t begin = ygw::util::TimeUtil::GetCurrentMS();
+    for (int i = 0; i < kClients; ++i)
+    {
+        clients.emplace_back([&]() {
+            char buf[1];
+            while (ygw::util::TimeUtil::GetCurrentMS() - begin < kDurationMs)
+            {
+                int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+                {
+                    ++connected;
+                    //等服务端先关闭, TIME_WAIT留在服务端, 客户端端口不会被占满
+                    ::read(fd, buf, sizeof(buf));
+                }
+                ::close(fd);
+            }
+        });
+    }
+    for (auto& i : clients)
+    {
+        i.join();
+    }
+    uint64_t used = ygw::util::TimeUtil::GetCurrentMS() - begin;
+    usleep(100 * 1000);
+
+    YGW_LOG_INFO(g_logger) << "accept_mode=" << mode << " dispatch=" << dispatch
+        << " connected=" << connected << " accepted=" << server->count
+        << " conn/s=" << (connected * 1000 / (used ? used : 1));
+    for (auto& i : server->threads)
+    {
+        YGW_LOG_INFO(g_logger) << "    thread=" << i.first << " accepted=" << i.second;
+    }
+    server->Stop();
+    //在主线程里停掉组, 免得最后一个引用在成员线程里释放
+    if (group)
+    {
+        group->Stop();
+    }
+}
+
+/**
+ * @brief 测试TcpServerConf中的TCP选项, 打印监听socket上生效的值
+ */
+void test_tuning()
+{
+    ygw::tcp::TcpServerConf conf;
+    conf = ygw::config::LexicalCast<std::string, ygw::tcp::TcpServerConf>()(
+            "{address: [127.0.0.1:8035], backlog: 1024, nodelay: 0, defer_accept: 5"
+            ", fastopen: 16, quickack: 1, sndbuf: 65536, rcvbuf: 131072, notsent_lowat: 16384}");
+    YGW_LOG_INFO(g_logger) << ygw::config::LexicalCast<ygw::tcp::TcpServerConf, std::string>()(conf);
+
+    ygw::tcp::TcpServer::ptr server(new ygw::tcp::TcpServer);
+    server->SetConf(conf);
+    if (!server->Bind(ygw::socket::Address::LookupAny(conf.address[0])))
+    {
+        YGW_LOG_ERROR(g_logger) << "bind " << conf.address[0] << " fail";
+        return;
+    }
+    YGW_LOG_INFO(g_logger) << server->ToString();
+    server->Start();
+    server->Stop();
+}
+
+/**
+ * @brief 一直持有连接直到对端关闭的服务器
+ */
+class HoldServer : public ygw::tcp::TcpServer
+{
+public:
+    HoldServer(ygw::scheduler::IOManager* worker)
+        : TcpServer(worker, worker)
+    {
+    }
+protected:
+    void HandleClient(ygw::socket::Socket::ptr client) override
+    {
+        char buf[64];
+        while (client->Recv(buf, sizeof(buf)) > 0);
+        client->Close();
+    }
+};
+
+/**
+ * @brief 测试连接数上限: 暂停接收, 降到低水位恢复, 以及直接拒绝
+ */
+void test_admission(bool reject)
+{
+    ygw::scheduler::IOManager iom(2, false, "admission");
+    std::shared_ptr<HoldServer> server(new HoldServer(&iom));
+    ygw::tcp::TcpServerConf conf;
+    conf.max_connections = 10;
+    conf.low_watermark = 50;
+    conf.reject_excess = reject;
+    server->SetConf(conf);
+    std::atomic<int> bound {0};
+    iom.Schedule([&]() {
+        bound = server->Bind(ygw::socket::Address::LookupAny("127.0.0.1:8036")) ? 1 : -1;
+    });
+    while (bound == 0)
+    {
+        usleep(1000);
+    }
+    if (bound < 0)
+    {
+        YGW_LOG_ERROR(g_logger) << "bind 127.0.0.1:8036 fail";
+        return;
+    }
+    server->Start();
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8036);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    std::vector<int> fds;
+    for (int i = 0; i < 30; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0)
+        {
+            fds.push_back(fd);
+        }
+        else
+        {
+            ::close(fd);
+        }
+    }
+    usleep(200 * 1000);
+    YGW_LOG_INFO(g_logger) << "reject=" << reject << " connected=" << fds.size()
+        << " connections=" << server->GetConnections()
+        << " rejected=" << server->GetRejected()
+        << " pause_count=" << server->GetPauseCount();
+    YGW_ASSERT(server->GetConnections() == 10);
+    YGW_ASSERT(reject ? server->GetRejected() == 20 : server->GetPauseCount() == 1);
+
+    //关掉一半降到低水位, 暂停的accept恢复, 接收积压的连接
+    for (int i = 0; i < 5; ++i)
+    {
+        ::close(fds[i]);
+    }
+    usleep(200 * 1000);
+    YGW_LOG_INFO(g_logger) << "reject=" << reject << " after close connections="
+        << server->GetConnections() << " paused_us=" << server->GetPausedUS()
+        << std::endl << server->ToString();
+    YGW_ASSERT(server->GetConnections() == (reject ? 5 : 10));
+
+    for (size_t i = 5; i < fds.size(); ++i)
+    {
+        ::close(fds[i]);
+    }
+    server->Stop();
+}
+
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "admission")
+    {
+        test_admission(false);
+        test_admission(true);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "tuning")
+    {
+        ygw::scheduler::IOManager iom(1);
+        iom.Schedule(test_tuning);
+        return 0;
+    }
+    if (argc > 1)
+    {
+        bench_accept(argv[1], argc > 2 ? argv[2] : "");
+        return 0;
+    }
     ygw::scheduler::IOManager iom(2);
     iom.Schedule(run);
      
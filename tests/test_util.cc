@@ -1,4 +1,7 @@
 #include <cassert>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
 
 #include <server_frame/log.h>
 #include <server_frame/util.h>
@@ -12,8 +15,39 @@ void test_assert()
     YGW_ASSERT(false);
 }
 
-int main()
+//TicksToNS换算出的间隔和CLOCK_MONOTONIC测得的一致
+void test_tsc_clock()
 {
+    ygw::util::TscClock::Calibrate();
+    YGW_ASSERT(ygw::util::TscClock::IsCalibrated());
+    const uint64_t sleeps_us[] = {1000, 20000, 100000};
+    for (uint64_t us : sleeps_us)
+    {
+        uint64_t m0 = ygw::util::TimeUtil::GetMonotonicUS();
+        uint64_t t0 = ygw::util::TscClock::Ticks();
+        usleep(us);
+        uint64_t t1 = ygw::util::TscClock::Ticks();
+        uint64_t m1 = ygw::util::TimeUtil::GetMonotonicUS();
+        int64_t tsc_us = ygw::util::TscClock::TicksToNS(t1 - t0) / 1000;
+        int64_t mono_us = m1 - m0;
+        YGW_LOG_INFO(g_logger) << "invariant=" << ygw::util::TscClock::IsInvariant()
+            << " sleep=" << us << "us tsc=" << tsc_us << "us monotonic=" << mono_us << "us";
+        //允许2%的校准误差, 再加上两次读时钟之间的50us
+        YGW_ASSERT(std::abs(tsc_us - mono_us) <= mono_us / 50 + 50);
+    }
+    uint64_t n0 = ygw::util::TscClock::NowNS();
+    usleep(10000);
+    uint64_t n1 = ygw::util::TscClock::NowNS();
+    YGW_ASSERT(n1 - n0 >= 9800000 && n1 - n0 < 50000000);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "tsc")
+    {
+        test_tsc_clock();
+        return 0;
+    }
     test_assert();
 
     return 0;